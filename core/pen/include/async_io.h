@@ -0,0 +1,114 @@
+// async_io.h
+// Copyright 2014 - 2019 Alex Dixon.
+// License: https://github.com/polymonster/pmtech/blob/master/license.md
+
+// Asynchronous file reads serviced by background io threads.
+// Requests are queued by priority and read in chunks so in flight requests can be cancelled between chunks.
+// Completions are delivered either on the io thread, or queued and delivered on whichever thread calls
+// io_dispatch_completions (usually the user thread once per frame).
+// Requests without a callback stay alive after completion until they are collected with io_get_result.
+
+// Data is read into the dst buffer if one is supplied, otherwise it is allocated with alloc_func or memory_alloc,
+// allocated data is owned by the receiver of the completion and is null terminated for convenience.
+// alloc_func must be paired with free_func, which is used for data that is never delivered (failed or cancelled
+// reads and results dropped by io_shutdown).
+
+#pragma once
+
+#include "pen.h"
+
+namespace pen
+{
+    typedef u32 io_handle; // generation counted slot handle, 0 is null
+
+    namespace e_io_priority
+    {
+        enum io_priority_t
+        {
+            low,
+            normal,
+            high,
+            COUNT
+        };
+    }
+    typedef e_io_priority::io_priority_t io_priority;
+
+    namespace e_io_status
+    {
+        enum io_status_t
+        {
+            invalid,
+            pending,
+            in_flight,
+            complete,
+            failed,
+            cancelled
+        };
+    }
+    typedef e_io_status::io_status_t io_status;
+
+    namespace e_io_completion
+    {
+        enum io_completion_t
+        {
+            io_thread, // callback is called on the io thread as soon as the read finishes
+            dispatch   // callback is called from io_dispatch_completions
+        };
+    }
+    typedef e_io_completion::io_completion_t io_completion;
+
+    struct io_result
+    {
+        io_handle handle;
+        io_status status;
+        void*     data;
+        u32       size;
+        void*     user_data;
+    };
+
+    typedef void (*io_callback)(const io_result& result);
+    typedef void* (*io_alloc_func)(u32 size, void* alloc_user_data);
+    typedef void (*io_free_func)(void* data, void* alloc_user_data);
+
+    struct io_request
+    {
+        const c8*     filename = nullptr;
+        u32           offset = 0;
+        u32           size = 0; // 0 reads from offset to the end of the file
+        io_priority   priority = e_io_priority::normal;
+        void*         dst = nullptr; // optional destination, must have space for size bytes
+        io_alloc_func alloc_func = nullptr;
+        io_free_func  free_func = nullptr;
+        void*         alloc_user_data = nullptr;
+        io_callback   callback = nullptr;
+        void*         user_data = nullptr;
+        io_completion completion = e_io_completion::dispatch;
+    };
+
+    struct io_stats
+    {
+        u64 requests;
+        u64 completed;
+        u64 failed;
+        u64 cancelled;
+        u64 bytes_read;
+        f32 read_ms;         // time spent inside reads across all io threads
+        f32 bandwidth_mbps;  // bytes_read / read_ms
+        f32 avg_latency_ms;  // submit to completion
+        f32 max_latency_ms;
+        u32 queued;
+        u32 in_flight;
+    };
+
+    // Service, started with the default jobs
+    void io_init(u32 num_threads = 1);
+    void io_shutdown();
+
+    // Requests
+    io_handle io_read(const io_request& request);
+    bool      io_cancel(io_handle handle); // true if the request was cancelled before it completed
+    io_status io_get_status(io_handle handle);
+    bool      io_get_result(io_handle handle, io_result& result); // collect a finished request without a callback
+    u32       io_dispatch_completions(); // returns the number of completions delivered
+    void      io_get_stats(io_stats& stats);
+} // namespace pen
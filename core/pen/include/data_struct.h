@@ -10,6 +10,10 @@
 #include "memory.h"
 #include "threads.h"
 
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
 #ifndef NO_STRETCHY_BUFFER_SHORT_NAMES
 #define sb_free stb_sb_free
 #define sb_push stb_sb_push
@@ -73,6 +77,73 @@ static void* stb__sbgrowf(void* arr, int increment, int itemsize)
 
 namespace pen
 {
+    // index of the most significant set bit, v must be non zero
+    pen_inline u32 msb_index(u32 v)
+    {
+#ifdef _MSC_VER
+        unsigned long i;
+        _BitScanReverse(&i, v);
+        return (u32)i;
+#else
+        return 31 - __builtin_clz(v);
+#endif
+    }
+
+    // 64 bit sort key with a 32 bit payload, typically an index into the data being sorted
+    struct sort_item
+    {
+        u64 key;
+        u32 value;
+    };
+
+    // stable lsd radix sort, 8 bits per pass. passes where all keys share the same byte are skipped
+    // tmp must have space for count items, the sorted result is always written back to items.
+    pen_inline void radix_sort(sort_item* items, sort_item* tmp, u32 count)
+    {
+        if (count < 2)
+            return;
+
+        u32 histogram[8][256];
+        memset(histogram, 0x0, sizeof(histogram));
+
+        for (u32 i = 0; i < count; ++i)
+        {
+            u64 k = items[i].key;
+            for (u32 p = 0; p < 8; ++p)
+                histogram[p][(k >> (p * 8)) & 0xff]++;
+        }
+
+        sort_item* src = items;
+        sort_item* dst = tmp;
+        for (u32 p = 0; p < 8; ++p)
+        {
+            u32  shift = p * 8;
+            u32* h = histogram[p];
+
+            if (h[(src[0].key >> shift) & 0xff] == count)
+                continue;
+
+            // prefix sum into offsets
+            u32 offset = 0;
+            for (u32 b = 0; b < 256; ++b)
+            {
+                u32 c = h[b];
+                h[b] = offset;
+                offset += c;
+            }
+
+            for (u32 i = 0; i < count; ++i)
+                dst[h[(src[i].key >> shift) & 0xff]++] = src[i];
+
+            sort_item* t = src;
+            src = dst;
+            dst = t;
+        }
+
+        if (src != items)
+            memcpy(items, src, sizeof(sort_item) * count);
+    }
+
     // lightweight stack - single threaded
     template <typename T>
     struct stack
@@ -86,7 +157,51 @@ namespace pen
         int  size();
     };
 
+    // open addressing hash table with linear probing for hash_id or u32 keys - single threaded
+    // key 0 is reserved for empty slots, capacity is a power of 2 and grows to keep the load under 3/4.
+    // removal shifts following entries back so there are no tombstones. values are moved with memcpy when the
+    // table grows so they must be trivially copyable, pointers and indices into other containers are ideal.
+    template <typename V>
+    struct hash_map
+    {
+        u32* _keys = nullptr;
+        V*   _values = nullptr;
+        u32  _capacity = 0;
+        u32  _size = 0;
+
+        hash_map() = default;
+        ~hash_map();
+        hash_map(const hash_map&) = delete;
+        hash_map& operator=(const hash_map&) = delete;
+
+        void insert(u32 key, const V& value); // replaces the value if the key exists
+        bool try_insert(u32 key, const V& value); // keeps the existing value and returns false if the key exists
+        V*   find(u32 key);
+        bool erase(u32 key);
+        void reserve(u32 count);
+        void clear();
+        u32  size();
+
+        u32  _find_slot(u32 key);
+        void _remove_slot(u32 slot);
+    };
+
+    // keys only version of hash_map
+    struct hash_set
+    {
+        hash_map<u8> _map;
+
+        bool insert(u32 key); // returns false if the key was already present
+        bool contains(u32 key);
+        bool erase(u32 key);
+        void clear();
+        u32  size();
+    };
+
     // lockless single producer single consumer - thread safe ring buffer
+    // holds capacity - 1 items, put will wait for the consumer when full and try_put will fail.
+    // put is only safe when the consumer drains without waiting on the producer, otherwise use spsc_queue.
+    // the item returned by get stays valid until the next call to get.
     template <typename T>
     struct ring_buffer
     {
@@ -101,16 +216,103 @@ namespace pen
 
         void create(u32 capacity);
         void put(const T& item);
+        bool try_put(const T& item);
         T*   get();
         T*   check();
     };
 
+    // lockless multiple producer multiple consumer - bounded queue, capacity is rounded up to a power of 2
+    // try_push / try_pop fail when full / empty, push / pop yield until they succeed.
+    template <typename T>
+    struct mpmc_queue
+    {
+        struct cell
+        {
+            a_u32 sequence;
+            T     data;
+        };
+
+        cell* _cells = nullptr;
+        u32   _mask = 0;
+
+        alignas(64) a_u32 _enqueue_pos;
+        alignas(64) a_u32 _dequeue_pos;
+
+        mpmc_queue();
+        ~mpmc_queue();
+
+        void create(u32 capacity);
+        bool try_push(const T& item);
+        bool try_pop(T& item);
+        void push(const T& item);
+        void pop(T& item);
+        u32  capacity();
+    };
+
+    // lockless single producer single consumer - unbounded queue made of linked blocks
+    // push never fails, when the current block is full a new one is linked in and the consumer frees blocks it has drained.
+    template <typename T>
+    struct spsc_queue
+    {
+        struct block
+        {
+            T*                  data;
+            u32                 capacity;
+            a_u32               put_pos;
+            u32                 get_pos;
+            std::atomic<block*> next;
+        };
+
+        block* _head = nullptr; // consumer
+        block* _tail = nullptr; // producer
+        u32    _block_size = 0;
+        u32    _max_block_size = 0;
+
+        spsc_queue();
+        ~spsc_queue();
+
+        void create(u32 block_size, u32 max_block_size = 64 * 1024);
+        void push(const T& item);
+        bool try_pop(T& item);
+        T*   peek();
+        void pop();
+
+        block* _new_block(u32 capacity);
+    };
+
+    // multiple producer multiple consumer - vector with segmented storage, elements are never relocated.
+    // segments double in size, B is the size of the first. push_back is lock-free, elements < size() are visible to all
+    // threads. reserve allocates storage for random access by index without changing the size.
+    template <typename T, u32 B = 64>
+    struct concurrent_vector
+    {
+        static const u32 k_num_segments = 32;
+
+        std::atomic<T*> _segments[k_num_segments];
+        a_u32           _reserved;
+        a_u32           _size;
+
+        concurrent_vector();
+        ~concurrent_vector();
+        concurrent_vector(const concurrent_vector&) = delete;
+        concurrent_vector& operator=(const concurrent_vector&) = delete;
+
+        u32  push_back(const T& item);
+        void reserve(u32 capacity);
+        u32  size();
+        void clear();
+        T&   operator[](u32 index);
+
+        T* _segment(u32 seg);
+    };
+
     // lockless single producer multiple consumer - thread safe resource pool which will grow to accomodate contents
+    // storage is segmented, so resources never move when the pool grows.
     template <typename T>
     struct res_pool
     {
-        T*    _resources = nullptr;
-        a_u32 _capacity;
+        concurrent_vector<T> _resources;
+        a_u32                _capacity;
 
         res_pool();
         ~res_pool();
@@ -162,19 +364,11 @@ namespace pen
         void grow(size_t size);
     };
 
-    // multiple producer, multiple consumer buffer - partially lock-free but will lock when re-sizing.
+    // multiple producer, multiple consumer buffer - lock-free, backed by a concurrent_vector so growth never relocates.
     template <typename T>
     struct mpmc_stretchy_buffer
     {
-        T*          _data[2] = {nullptr, nullptr};
-        a_size_t    _fb = {0};
-        pen::mutex* _mut = nullptr;
-
-        mpmc_stretchy_buffer()
-        {
-            _mut = pen::mutex_create();
-            _fb = 0;
-        }
+        concurrent_vector<T> _data;
 
         size_t size();
         void   push_back(T item);
@@ -219,6 +413,180 @@ namespace pen
         return pos;
     }
 
+    pen_inline u32 hash_table_index(u32 key, u32 capacity)
+    {
+        // fibonacci hashing, spreads sequential handles and weak hashes over the table
+        return (key * 2654435769u) >> (32 - msb_index(capacity));
+    }
+
+    template <typename V>
+    pen_inline hash_map<V>::~hash_map()
+    {
+        memory_free(_keys);
+        memory_free(_values);
+    }
+
+    template <typename V>
+    pen_inline u32 hash_map<V>::_find_slot(u32 key)
+    {
+        PEN_ASSERT(key != 0);
+
+        u32 mask = _capacity - 1;
+        u32 i = hash_table_index(key, _capacity);
+        while (_keys[i] != 0 && _keys[i] != key)
+            i = (i + 1) & mask;
+
+        return i;
+    }
+
+    template <typename V>
+    pen_inline void hash_map<V>::reserve(u32 count)
+    {
+        u32 new_cap = _capacity ? _capacity : 16;
+        while (count > new_cap - new_cap / 4)
+            new_cap *= 2;
+
+        if (new_cap == _capacity)
+            return;
+
+        u32* old_keys = _keys;
+        V*   old_values = _values;
+        u32  old_cap = _capacity;
+
+        _keys = (u32*)memory_alloc(sizeof(u32) * new_cap);
+        _values = (V*)memory_alloc(sizeof(V) * new_cap);
+        _capacity = new_cap;
+        memset(_keys, 0x0, sizeof(u32) * new_cap);
+
+        for (u32 i = 0; i < old_cap; ++i)
+        {
+            if (!old_keys[i])
+                continue;
+
+            u32 slot = _find_slot(old_keys[i]);
+            _keys[slot] = old_keys[i];
+            memcpy(&_values[slot], &old_values[i], sizeof(V));
+        }
+
+        memory_free(old_keys);
+        memory_free(old_values);
+    }
+
+    template <typename V>
+    pen_inline void hash_map<V>::insert(u32 key, const V& value)
+    {
+        reserve(_size + 1);
+
+        u32 slot = _find_slot(key);
+        if (!_keys[slot])
+        {
+            _keys[slot] = key;
+            ++_size;
+        }
+
+        _values[slot] = value;
+    }
+
+    template <typename V>
+    pen_inline bool hash_map<V>::try_insert(u32 key, const V& value)
+    {
+        reserve(_size + 1);
+
+        u32 slot = _find_slot(key);
+        if (_keys[slot])
+            return false;
+
+        _keys[slot] = key;
+        _values[slot] = value;
+        ++_size;
+        return true;
+    }
+
+    template <typename V>
+    pen_inline V* hash_map<V>::find(u32 key)
+    {
+        if (_size == 0)
+            return nullptr;
+
+        u32 slot = _find_slot(key);
+        return _keys[slot] ? &_values[slot] : nullptr;
+    }
+
+    template <typename V>
+    pen_inline void hash_map<V>::_remove_slot(u32 slot)
+    {
+        // shift back any following entries which probed past the slot
+        u32 mask = _capacity - 1;
+        u32 hole = slot;
+        for (u32 i = (slot + 1) & mask; _keys[i]; i = (i + 1) & mask)
+        {
+            u32 home = hash_table_index(_keys[i], _capacity);
+            if (((i - home) & mask) >= ((i - hole) & mask))
+            {
+                _keys[hole] = _keys[i];
+                memcpy(&_values[hole], &_values[i], sizeof(V));
+                hole = i;
+            }
+        }
+
+        _keys[hole] = 0;
+        --_size;
+    }
+
+    template <typename V>
+    pen_inline bool hash_map<V>::erase(u32 key)
+    {
+        if (_size == 0)
+            return false;
+
+        u32 slot = _find_slot(key);
+        if (!_keys[slot])
+            return false;
+
+        _remove_slot(slot);
+        return true;
+    }
+
+    template <typename V>
+    pen_inline void hash_map<V>::clear()
+    {
+        if (_keys)
+            memset(_keys, 0x0, sizeof(u32) * _capacity);
+
+        _size = 0;
+    }
+
+    template <typename V>
+    pen_inline u32 hash_map<V>::size()
+    {
+        return _size;
+    }
+
+    pen_inline bool hash_set::insert(u32 key)
+    {
+        return _map.try_insert(key, 0);
+    }
+
+    pen_inline bool hash_set::contains(u32 key)
+    {
+        return _map.find(key) != nullptr;
+    }
+
+    pen_inline bool hash_set::erase(u32 key)
+    {
+        return _map.erase(key);
+    }
+
+    pen_inline void hash_set::clear()
+    {
+        _map.clear();
+    }
+
+    pen_inline u32 hash_set::size()
+    {
+        return _map.size();
+    }
+
     template <typename T>
     pen_inline ring_buffer<T>::ring_buffer()
     {
@@ -244,11 +612,26 @@ namespace pen
         memset(data, 0x0, sizeof(T) * _capacity.load());
     }
 
+    template <typename T>
+    pen_inline bool ring_buffer<T>::try_put(const T& item)
+    {
+        u32 pp = put_pos;
+        u32 np = (pp + 1) % _capacity;
+
+        // full, the slot before get_pos may still be in use by the consumer
+        if (np == get_pos)
+            return false;
+
+        data[pp] = item;
+        put_pos = np;
+        return true;
+    }
+
     template <typename T>
     pen_inline void ring_buffer<T>::put(const T& item)
     {
-        data[put_pos] = item;
-        put_pos = (put_pos + 1) % _capacity;
+        while (!try_put(item))
+            pen::thread_yield();
     }
 
     template <typename T>
@@ -272,6 +655,315 @@ namespace pen
         return &data[gp];
     }
 
+    template <typename T>
+    pen_inline mpmc_queue<T>::mpmc_queue()
+    {
+        _enqueue_pos = 0;
+        _dequeue_pos = 0;
+    }
+
+    template <typename T>
+    pen_inline mpmc_queue<T>::~mpmc_queue()
+    {
+        pen::memory_free(_cells);
+    }
+
+    template <typename T>
+    inline void mpmc_queue<T>::create(u32 capacity)
+    {
+        u32 size = 2;
+        while (size < capacity)
+            size <<= 1;
+
+        _cells = (cell*)pen::memory_alloc(sizeof(cell) * size);
+        memset((void*)_cells, 0x0, sizeof(cell) * size);
+        _mask = size - 1;
+
+        // each cell sequence starts as its index, a cell is writable when sequence == pos and readable at pos + 1
+        for (u32 i = 0; i < size; ++i)
+            _cells[i].sequence.store(i, std::memory_order_relaxed);
+
+        _enqueue_pos = 0;
+        _dequeue_pos = 0;
+    }
+
+    template <typename T>
+    pen_inline bool mpmc_queue<T>::try_push(const T& item)
+    {
+        u32   pos = _enqueue_pos.load(std::memory_order_relaxed);
+        cell* c;
+        for (;;)
+        {
+            c = &_cells[pos & _mask];
+            u32 seq = c->sequence.load(std::memory_order_acquire);
+            s32 diff = (s32)(seq - pos);
+            if (diff == 0)
+            {
+                if (_enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if (diff < 0)
+            {
+                return false; // full
+            }
+            else
+            {
+                pos = _enqueue_pos.load(std::memory_order_relaxed);
+            }
+        }
+
+        c->data = item;
+        c->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    template <typename T>
+    pen_inline bool mpmc_queue<T>::try_pop(T& item)
+    {
+        u32   pos = _dequeue_pos.load(std::memory_order_relaxed);
+        cell* c;
+        for (;;)
+        {
+            c = &_cells[pos & _mask];
+            u32 seq = c->sequence.load(std::memory_order_acquire);
+            s32 diff = (s32)(seq - (pos + 1));
+            if (diff == 0)
+            {
+                if (_dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if (diff < 0)
+            {
+                return false; // empty
+            }
+            else
+            {
+                pos = _dequeue_pos.load(std::memory_order_relaxed);
+            }
+        }
+
+        item = c->data;
+        c->sequence.store(pos + _mask + 1, std::memory_order_release);
+        return true;
+    }
+
+    template <typename T>
+    pen_inline void mpmc_queue<T>::push(const T& item)
+    {
+        while (!try_push(item))
+            pen::thread_yield();
+    }
+
+    template <typename T>
+    pen_inline void mpmc_queue<T>::pop(T& item)
+    {
+        while (!try_pop(item))
+            pen::thread_yield();
+    }
+
+    template <typename T>
+    pen_inline u32 mpmc_queue<T>::capacity()
+    {
+        return _mask + 1;
+    }
+
+    template <typename T>
+    pen_inline spsc_queue<T>::spsc_queue()
+    {
+    }
+
+    template <typename T>
+    pen_inline spsc_queue<T>::~spsc_queue()
+    {
+        block* b = _head;
+        while (b)
+        {
+            block* next = b->next;
+            pen::memory_free(b);
+            b = next;
+        }
+    }
+
+    template <typename T>
+    inline typename spsc_queue<T>::block* spsc_queue<T>::_new_block(u32 capacity)
+    {
+        // block header and items in a single allocation
+        size_t header = (sizeof(block) + alignof(T) - 1) & ~(alignof(T) - 1);
+        u8*    mem = (u8*)pen::memory_alloc(header + sizeof(T) * capacity);
+        memset(mem, 0x0, header + sizeof(T) * capacity);
+
+        block* b = (block*)mem;
+        b->data = (T*)(mem + header);
+        b->capacity = capacity;
+        b->put_pos = 0;
+        b->get_pos = 0;
+        b->next = nullptr;
+        return b;
+    }
+
+    template <typename T>
+    inline void spsc_queue<T>::create(u32 block_size, u32 max_block_size)
+    {
+        _block_size = block_size;
+        _max_block_size = max_block_size;
+        _head = _tail = _new_block(block_size);
+    }
+
+    template <typename T>
+    pen_inline void spsc_queue<T>::push(const T& item)
+    {
+        block* b = _tail;
+        u32    pp = b->put_pos.load(std::memory_order_relaxed);
+        if (pp == b->capacity)
+        {
+            // blocks are filled once, a full block is handed to the consumer and a larger one is linked in
+            _block_size = min<u32>(_block_size * 2, _max_block_size);
+            block* nb = _new_block(_block_size);
+            nb->data[0] = item;
+            nb->put_pos.store(1, std::memory_order_relaxed);
+            b->next.store(nb, std::memory_order_release);
+            _tail = nb;
+            return;
+        }
+
+        b->data[pp] = item;
+        b->put_pos.store(pp + 1, std::memory_order_release);
+    }
+
+    template <typename T>
+    pen_inline T* spsc_queue<T>::peek()
+    {
+        block* b = _head;
+        if (b->get_pos == b->put_pos.load(std::memory_order_acquire))
+        {
+            if (b->get_pos < b->capacity)
+                return nullptr;
+
+            // drained a full block, move to the next once the producer has linked it
+            block* next = b->next.load(std::memory_order_acquire);
+            if (!next)
+                return nullptr;
+
+            pen::memory_free(b);
+            _head = b = next;
+
+            if (b->get_pos == b->put_pos.load(std::memory_order_acquire))
+                return nullptr;
+        }
+
+        return &b->data[b->get_pos];
+    }
+
+    template <typename T>
+    pen_inline void spsc_queue<T>::pop()
+    {
+        _head->get_pos++;
+    }
+
+    template <typename T>
+    pen_inline bool spsc_queue<T>::try_pop(T& item)
+    {
+        T* p = peek();
+        if (!p)
+            return false;
+
+        item = *p;
+        pop();
+        return true;
+    }
+
+    template <typename T, u32 B>
+    pen_inline concurrent_vector<T, B>::concurrent_vector()
+    {
+        for (u32 i = 0; i < k_num_segments; ++i)
+            _segments[i] = nullptr;
+
+        _reserved = 0;
+        _size = 0;
+    }
+
+    template <typename T, u32 B>
+    pen_inline concurrent_vector<T, B>::~concurrent_vector()
+    {
+        for (u32 i = 0; i < k_num_segments; ++i)
+            pen::memory_free(_segments[i].load());
+    }
+
+    template <typename T, u32 B>
+    inline T* concurrent_vector<T, B>::_segment(u32 seg)
+    {
+        T* s = _segments[seg].load(std::memory_order_acquire);
+        if (s)
+            return s;
+
+        // allocate, if another thread beat us to it use theirs
+        size_t bytes = sizeof(T) * (B << seg);
+        T*     ns = (T*)pen::memory_alloc(bytes);
+        memset(ns, 0x0, bytes);
+
+        if (_segments[seg].compare_exchange_strong(s, ns, std::memory_order_acq_rel))
+            return ns;
+
+        pen::memory_free(ns);
+        return s;
+    }
+
+    template <typename T, u32 B>
+    pen_inline T& concurrent_vector<T, B>::operator[](u32 index)
+    {
+        // segment n holds [B * (2^n - 1), B * (2^(n+1) - 1))
+        u32 v = index + B;
+        u32 hb = msb_index(v);
+        u32 seg = hb - msb_index(B);
+        return _segments[seg].load(std::memory_order_acquire)[v - (1 << hb)];
+    }
+
+    template <typename T, u32 B>
+    inline void concurrent_vector<T, B>::reserve(u32 capacity)
+    {
+        if (capacity == 0)
+            return;
+
+        u32 last = msb_index(capacity - 1 + B) - msb_index(B);
+        for (u32 i = 0; i <= last; ++i)
+            _segment(i);
+    }
+
+    template <typename T, u32 B>
+    pen_inline u32 concurrent_vector<T, B>::push_back(const T& item)
+    {
+        u32 index = _reserved.fetch_add(1);
+
+        u32 v = index + B;
+        u32 hb = msb_index(v);
+        T*  s = _segment(hb - msb_index(B));
+        s[v - (1 << hb)] = item;
+
+        // publish in order so every index below size() has been written
+        u32 expected = index;
+        while (!_size.compare_exchange_weak(expected, index + 1))
+        {
+            expected = index;
+            pen::thread_yield();
+        }
+
+        return index;
+    }
+
+    template <typename T, u32 B>
+    pen_inline u32 concurrent_vector<T, B>::size()
+    {
+        return _size.load(std::memory_order_acquire);
+    }
+
+    template <typename T, u32 B>
+    pen_inline void concurrent_vector<T, B>::clear()
+    {
+        // not thread safe, storage is kept for reuse
+        _reserved = 0;
+        _size = 0;
+    }
+
     template <typename T>
     pen_inline res_pool<T>::res_pool()
     {
@@ -281,16 +973,13 @@ namespace pen
     template <typename T>
     pen_inline res_pool<T>::~res_pool()
     {
-        pen::memory_free(_resources);
     }
 
     template <typename T>
     pen_inline void res_pool<T>::init(u32 reserved_capacity)
     {
         _capacity = reserved_capacity;
-        _resources = (T*)pen::memory_alloc(sizeof(T) * reserved_capacity);
-
-        memset(_resources, 0x0, sizeof(T) * _capacity);
+        _resources.reserve(reserved_capacity);
     }
 
     template <typename T>
@@ -298,13 +987,8 @@ namespace pen
     {
         if (_capacity <= min_capacity)
         {
-            size_t new_cap = (min_capacity * 2);
-
-            _resources = (T*)pen::memory_realloc(_resources, new_cap * sizeof(T));
-
-            size_t existing_offset = _capacity * sizeof(T);
-            memset(((u8*)_resources) + existing_offset, 0x0, sizeof(T) * _capacity);
-
+            u32 new_cap = (min_capacity * 2);
+            _resources.reserve(new_cap);
             _capacity = new_cap;
         }
     }
@@ -419,47 +1103,19 @@ namespace pen
     template <typename T>
     pen_inline void mpmc_stretchy_buffer<T>::push_back(T item)
     {
-        u32 cc = sb_count(_data[_fb]);
-        if (cc > 0 && cc < stb__sbm(_data[_fb]))
-        {
-            sb_push(_data[_fb], item);
-        }
-        else
-        {
-            // lock and resize
-            pen::mutex_lock(_mut);
-
-            if (cc == 0 || cc >= stb__sbm(_data[_fb]))
-            {
-                u32 bb = _fb ^ 1;
-                sb_free(_data[bb]);
-                _data[bb] = nullptr;
-
-                // todo: this could be improved with memcpy
-                for (u32 i = 0; i < cc; ++i)
-                    sb_push(_data[bb], _data[_fb][i]);
-
-                // swap buffers
-                _fb ^= 1;
-            }
-
-            pen::mutex_unlock(_mut);
-
-            // push new entry
-            sb_push(_data[_fb], item);
-        }
+        _data.push_back(item);
     }
 
     template <typename T>
     pen_inline size_t mpmc_stretchy_buffer<T>::size()
     {
-        return sb_count(_data[_fb]);
+        return _data.size();
     }
 
     template <typename T>
     pen_inline T& mpmc_stretchy_buffer<T>::operator[](size_t slot)
     {
-        return _data[_fb][slot];
+        return _data[(u32)slot];
     }
 
 } // namespace pen
@@ -6,6 +6,8 @@
 
 // Can read files and also enumerate file system and volumes as an fs_tree_node.
 // Make sure to free p_buffer yourself allocated from filesystem_read_file_to_buffer.
+// filesystem_map_file gives a read only view of a whole file without copying it, release with filesystem_unmap_file.
+// mapped views are not null terminated, use filesystem_read_file_to_buffer for text.
 // Make sure to call filesystem_enum_free_mem with your fs_tree_node once finished with it.
 
 // Implemented with:
@@ -26,7 +28,27 @@ namespace pen
         u32           num_children = 0;
     };
 
+    namespace e_file_access
+    {
+        enum file_access_t
+        {
+            normal,
+            sequential, // read once front to back, read ahead aggressively
+            random
+        };
+    }
+    typedef e_file_access::file_access_t file_access;
+
+    struct mapped_file
+    {
+        const void* data = nullptr;
+        u32         size = 0;
+        bool        _mapped = false; // false when the platform could not map and the file was read into memory
+    };
+
     pen_error  filesystem_read_file_to_buffer(const c8* filename, void** p_buffer, u32& buffer_size);
+    pen_error  filesystem_map_file(const c8* filename, mapped_file& file, file_access access = e_file_access::normal);
+    void       filesystem_unmap_file(mapped_file& file);
     pen_error  filesystem_getmtime(const c8* filename, u32& mtime_out);
     void       filesystem_toggle_hidden_files();
     pen_error  filesystem_enum_volumes(fs_tree_node& results);
@@ -0,0 +1,27 @@
+// file_watcher.h
+// Copyright 2014 - 2019 Alex Dixon.
+// License: https://github.com/polymonster/pmtech/blob/master/license.md
+
+// Event driven file watching, used by the hot loaders so nothing is polled when no files change.
+// Watches are placed on the directory containing each file, changes are coalesced until no more have arrived for
+// a short time so a burst of writes from a build or an editor save is delivered once.
+
+// Implemented with:
+//      inotify (linux, android)
+//      mtime polling of a few files per update on other platforms, or if a directory cannot be watched.
+
+// Not thread safe, add files and update from the same thread, callbacks are called from file_watcher_update.
+
+#pragma once
+
+#include "pen.h"
+
+namespace pen
+{
+    typedef void (*file_watch_callback)(const c8* filename, void* user_data);
+
+    // adding the same filename, callback and user_data more than once is ignored.
+    void file_watcher_add(const c8* filename, file_watch_callback callback, void* user_data);
+    void file_watcher_update();
+    void file_watcher_shutdown();
+} // namespace pen
@@ -48,8 +48,23 @@ namespace pen
     uint32_t hashMurmur2A(char* _data);
 
     typedef HashMurmur2A hash_murmur;
+
+    // compile time murmur2a, produces the same ids as hashMurmur2A for the same bytes
+    constexpr uint32_t const_hash_murmur2a(const char* _data, uint32_t _size);
+
+    template <uint32_t N>
+    constexpr uint32_t const_hash_murmur2a(const char (&_literal)[N]);
+
+    template <uint32_t H>
+    struct const_hash
+    {
+        static constexpr uint32_t value = H;
+    };
 } // namespace pen
 
 #define _hash_h
 #define PEN_HASH(V) pen::hashMurmur2A(V)
+
+// for string literals only, the hash is folded into a constant so no static is needed to cache it
+#define PEN_CONST_HASH(V) pen::const_hash<pen::const_hash_murmur2a(V)>::value
 #include "hash.inl"
@@ -128,6 +128,58 @@ namespace pen
         }
     }
 
+    // c++11 constexpr functions are single expressions, so the loops in HashMurmur2A are unrolled into recursion
+    namespace const_murmur
+    {
+        constexpr uint32_t mix_k(uint32_t _k)
+        {
+            return ((_k * MURMUR_M) ^ ((_k * MURMUR_M) >> MURMUR_R)) * MURMUR_M;
+        }
+
+        constexpr uint32_t mix(uint32_t _h, uint32_t _k)
+        {
+            return (_h * MURMUR_M) ^ mix_k(_k);
+        }
+
+        constexpr uint32_t read(const char* _data, uint32_t _i)
+        {
+            return (uint32_t)(uint8_t)_data[_i] | (uint32_t)(uint8_t)_data[_i + 1] << 8 |
+                   (uint32_t)(uint8_t)_data[_i + 2] << 16 | (uint32_t)(uint8_t)_data[_i + 3] << 24;
+        }
+
+        constexpr uint32_t body(const char* _data, uint32_t _size, uint32_t _i, uint32_t _h)
+        {
+            return _i + 4 <= _size ? body(_data, _size, _i + 4, mix(_h, read(_data, _i))) : _h;
+        }
+
+        constexpr uint32_t tail(const char* _data, uint32_t _i, uint32_t _count)
+        {
+            return _count == 0 ? 0 : (uint32_t)(uint8_t)_data[_i] | tail(_data, _i + 1, _count - 1) << 8;
+        }
+
+        constexpr uint32_t fmix(uint32_t _h)
+        {
+            return ((_h ^ (_h >> 13)) * MURMUR_M) ^ (((_h ^ (_h >> 13)) * MURMUR_M) >> 15);
+        }
+    } // namespace const_murmur
+
+    constexpr uint32_t const_hash_murmur2a(const char* _data, uint32_t _size)
+    {
+        return const_murmur::fmix(const_murmur::mix(
+            const_murmur::mix(const_murmur::body(_data, _size, 0, 0), const_murmur::tail(_data, _size & ~3u, _size & 3u)),
+            _size));
+    }
+
+    template <uint32_t N>
+    constexpr uint32_t const_hash_murmur2a(const char (&_literal)[N])
+    {
+        // exclude the null terminator
+        return const_hash_murmur2a(&_literal[0], N - 1);
+    }
+
+    template <uint32_t H>
+    constexpr uint32_t const_hash<H>::value;
+
 #undef MURMUR_M
 #undef MURMUR_R
 #undef mmix
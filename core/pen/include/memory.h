@@ -32,6 +32,34 @@
 
 namespace pen
 {
+    // Allocation tags, allocations are attributed to the tag active on the calling thread.
+    namespace e_mem_tag
+    {
+        enum mem_tag_t
+        {
+            general,
+            renderer,
+            ecs,
+            physics,
+            audio,
+            loader,
+            json,
+            ui,
+            COUNT
+        };
+    }
+    typedef e_mem_tag::mem_tag_t mem_tag;
+
+    struct memory_tag_stats
+    {
+        const c8* name;
+        size_t    live_bytes;
+        size_t    high_water_bytes;
+        u32       live_allocs;
+        u32       frame_allocs; // allocations made during the last completed frame
+        u64       total_allocs;
+    };
+
     // Functions
 
     void* memory_alloc(size_t size_bytes);
@@ -41,8 +69,43 @@ namespace pen
     void  memory_free_align(void* mem);
     void  memory_zero(void* dest, size_t size_bytes);
 
+    // Tracking is compiled in with PEN_MEMORY_TRACKING (premake --memory_tracking), otherwise these are no-ops.
+    // When tracking, memory from memory_alloc must be released with memory_free and never with free.
+    mem_tag memory_push_tag(mem_tag tag);
+    void    memory_pop_tag(mem_tag prev);
+    bool    memory_get_tag_stats(memory_tag_stats* stats); // stats must have space for e_mem_tag::COUNT
+    void    memory_tracking_new_frame();
+    void    memory_tracking_report(); // logs anything still live, call at shutdown to find leaks
+
+    struct memory_tag_scope
+    {
+        mem_tag prev;
+
+        memory_tag_scope(mem_tag tag)
+        {
+            prev = memory_push_tag(tag);
+        }
+
+        ~memory_tag_scope()
+        {
+            memory_pop_tag(prev);
+        }
+    };
+
+#ifdef PEN_MEMORY_TRACKING
+#define PEN_MEMORY_TAG(tag) pen::memory_tag_scope _pen_memory_tag_scope(tag)
+#else
+#define PEN_MEMORY_TAG(tag)
+#endif
+
     // Implementation
 
+    inline void memory_zero(void* dest, size_t size_bytes)
+    {
+        memset(dest, 0x00, size_bytes);
+    }
+
+#ifndef PEN_MEMORY_TRACKING
     inline void* memory_alloc(size_t size_bytes)
     {
         return malloc(size_bytes);
@@ -63,11 +126,6 @@ namespace pen
         free(mem);
     }
 
-    inline void memory_zero(void* dest, size_t size_bytes)
-    {
-        memset(dest, 0x00, size_bytes);
-    }
-
     inline void* memory_alloc_align(size_t size_bytes, size_t alignment)
     {
         void* mem;
@@ -80,6 +138,31 @@ namespace pen
     {
         PEN_MEM_ALIGN_FREE(mem);
     }
+
+    inline mem_tag memory_push_tag(mem_tag tag)
+    {
+        return e_mem_tag::general;
+    }
+
+    inline void memory_pop_tag(mem_tag prev)
+    {
+    }
+
+    inline bool memory_get_tag_stats(memory_tag_stats* stats)
+    {
+        return false;
+    }
+
+    inline void memory_tracking_new_frame()
+    {
+    }
+
+    inline void memory_tracking_report()
+    {
+    }
+#else
+    void* memory_calloc(size_t count, size_t size_bytes);
+#endif
 } // namespace pen
 
 // And override global new and delete
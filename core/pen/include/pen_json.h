@@ -4,8 +4,9 @@
 
 // C++ wrapper api for JSMN.
 // Provides operators to access JSON objects and arrays and get retreive typed values.
-// json file is kept in a char buffer and jsmn tokens are used to iterate.
-// this api does not use any vectors or maps to store the json data.
+// json text is tokenised once by jsmn into a single block of nodes, child indices, a hashed key table and
+// null terminated strings, which is shared and ref counted by every json value taken from it.
+// member lookup by name and element lookup by index are o(1) and copying a json is o(1).
 
 // Examples:
 // Load:
@@ -41,6 +42,10 @@
 // Combine will combine members of j1 and j2 on an object by object, member by members basis
 // if duplicate members exist j2.member will replace j1.member
 
+// Binary:
+// j.save_binary("filename") writes the parsed block as is, load_from_file detects it by header
+// so a binary file is loaded with a single read and no parsing.
+
 // API for writing json is limited, if you want to write to nested members or arrays
 // you will need to create copies of the objects and then manually recursively write the objects
 // back upwards once you have written to a value (leaf).
@@ -54,7 +59,7 @@
 
 namespace pen
 {
-    struct json_object;
+    struct json_doc;
     class json;
 
     // functions
@@ -76,6 +81,8 @@ namespace pen
         static json load(const c8* json_str);
         static json combine(const json& j1, const json& j2, s32 indent = 0);
 
+        bool save_binary(const c8* filename) const;
+
         Str        dumps() const;
         Str        key() const;
         Str        name() const; // same as key
@@ -126,8 +133,12 @@ namespace pen
         }
 
       private:
-        json_object* m_internal_object;
-        void         copy(json* dst, const json& other);
+        json_doc*   m_doc;
+        u32         m_node; // index of the value node in m_doc
+        u32         m_key;  // index of the key node, 0 for array elements and roots
+        mutable c8* m_text; // lazily created copy of an object or array's source text
+        void        copy(json* dst, const json& other);
+        void        release();
     };
 
     // inline functions
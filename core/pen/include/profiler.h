@@ -0,0 +1,108 @@
+// profiler.h
+// Copyright 2014 - 2019 Alex Dixon.
+// License: https://github.com/polymonster/pmtech/blob/master/license.md
+
+// Hierarchical cpu profiler, scoped markers can be used from any thread.
+// Each thread records completed markers into its own ring of events, the owning thread is the only writer and
+// publishes events with an atomic index so recording never takes a lock.
+// profiler_new_frame (called by the user thread when it submits a frame to the renderer) collects events from all
+// threads into an aggregate tree for the last frame, and keeps a history which can be exported in the chrome trace
+// json format (open with chrome://tracing or perfetto).
+
+// Compiled in with PEN_PROFILER (premake --profiler), otherwise markers are no-ops and there is nothing to view.
+
+#pragma once
+
+#include "pen.h"
+
+namespace pen
+{
+    struct profile_node
+    {
+        const c8* name;
+        const c8* thread_name;
+        u32       depth; // 0 is a root marker for the thread
+        u32       calls;
+        f32       total_ms;
+        f32       self_ms; // total_ms minus the time in child markers
+    };
+
+    // names passed to profiler_begin must stay alive for the duration of the program (string literals, __FUNCTION__)
+    // use profiler_begin_dynamic for temporaries, names are copied once per thread and kept.
+    void profiler_begin(const c8* name);
+    void profiler_begin_dynamic(const c8* name);
+    void profiler_end();
+    void profiler_set_thread_name(const c8* name);
+
+    // Collection and views
+    bool profiler_enabled();
+    void profiler_new_frame();
+    u32  profiler_get_frame(profile_node* nodes, u32 max_nodes); // depth first per thread, returns the node count
+    bool profiler_export_chrome_trace(const c8* filename);       // writes the history of the last few frames
+    void profiler_shutdown();
+
+    struct profile_scope
+    {
+        profile_scope(const c8* name)
+        {
+            profiler_begin(name);
+        }
+
+        ~profile_scope()
+        {
+            profiler_end();
+        }
+    };
+
+#ifdef PEN_PROFILER
+#define PEN_PROFILE_CONCAT_(A, B) A##B
+#define PEN_PROFILE_CONCAT(A, B) PEN_PROFILE_CONCAT_(A, B)
+#define PEN_PROFILE_SCOPE(name) pen::profile_scope PEN_PROFILE_CONCAT(_pen_profile_scope, __LINE__)(name)
+#define PEN_PROFILE_FUNCTION PEN_PROFILE_SCOPE(__FUNCTION__)
+#define PEN_PROFILE_THREAD(name) pen::profiler_set_thread_name(name)
+#else
+#define PEN_PROFILE_SCOPE(name)
+#define PEN_PROFILE_FUNCTION
+#define PEN_PROFILE_THREAD(name)
+
+    // Stubs
+    inline void profiler_begin(const c8* name)
+    {
+    }
+
+    inline void profiler_begin_dynamic(const c8* name)
+    {
+    }
+
+    inline void profiler_end()
+    {
+    }
+
+    inline void profiler_set_thread_name(const c8* name)
+    {
+    }
+
+    inline bool profiler_enabled()
+    {
+        return false;
+    }
+
+    inline void profiler_new_frame()
+    {
+    }
+
+    inline u32 profiler_get_frame(profile_node* nodes, u32 max_nodes)
+    {
+        return 0;
+    }
+
+    inline bool profiler_export_chrome_trace(const c8* filename)
+    {
+        return false;
+    }
+
+    inline void profiler_shutdown()
+    {
+    }
+#endif
+} // namespace pen
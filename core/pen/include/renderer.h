@@ -13,6 +13,8 @@
 // Public api used by the user thread will store function call arguments in a command buffer
 // Dedicated thread will wait on a semaphore until renderer_consume_command_buffer is called
 // command buffer will be consumed passing arguments to the direct:: functions.
+// Each consume ends a frame in the command buffer, the user thread can have up to renderer_set_frames_in_flight frames
+// submitted before it blocks until the render thread completes one.
 
 #pragma once
 
@@ -361,7 +363,61 @@ namespace pen
         float dimension_x, dimension_y;
         float padding_0, padding_1;
     };
-    
+
+    struct renderer_arena_stats
+    {
+        size_t arena_size;       // current size of each per frame command payload arena
+        size_t high_water_bytes; // largest amount of payload data requested by a single frame
+        size_t frame_bytes;      // arena bytes used by the last completed frame
+        size_t heap_bytes;       // bytes which fell back to the heap last frame
+        u32    frame_allocs;
+        u32    heap_allocs;    // oversize payloads or allocations after the arena filled
+        u32    stalled_frames; // frames where no arena had been released by the render thread in time
+    };
+
+    struct renderer_cmd_stats
+    {
+        u32 stream_size; // capacity of the packed command stream in bytes
+        u32 frame_bytes; // bytes written to the command stream by the last frame
+        u32 frame_cmds;
+        u32 stalls;      // times the user thread waited for the render thread to free space
+        f32 dispatch_ms; // render thread time spent executing commands last frame
+        u32 state_cmds;     // set state commands issued last frame
+        u32 state_filtered; // redundant set state commands dropped before they were queued last frame
+        u32 frames_in_flight; // frames submitted by the user thread which the render thread had not completed
+        f32 user_wait_ms;     // user thread time blocked waiting for the render thread to complete a frame
+        f32 render_idle_ms;   // render thread time blocked waiting for the user thread to submit a frame
+    };
+
+    // accumulated time spent executing each type of command
+    struct renderer_cmd_timing
+    {
+        const c8* name;
+        u32       count;
+        f64       total_us;
+    };
+
+#ifdef PEN_RENDERER_NULL
+    // headless backend counts calls instead of submitting them to a gpu
+    struct renderer_null_stats
+    {
+        u64 frames;
+        u64 draws;
+        u64 indexed_draws;
+        u64 instanced_draws;
+        u64 dispatches;
+        u64 clears;
+        u64 state_changes;
+        u64 buffer_updates;
+        u64 buffer_update_bytes;
+        u64 read_backs;
+        u64 creates;
+        u64 releases;
+        u64 live_resources;
+    };
+    void renderer_null_get_stats(renderer_null_stats& stats);
+#endif
+
     // general accessors
     const c8*            renderer_get_shader_platform();
     bool                 renderer_viewport_vup();
@@ -436,8 +492,35 @@ namespace pen
     void        renderer_release_depth_stencil_state(u32 depth_stencil_state);
     void        renderer_window_resize(s32 width, s32 height);
     void        renderer_consume_cmd_buffer();
+    void        renderer_set_frames_in_flight(u32 num_frames); // 1 - 3, frames the user thread can submit ahead
+    u32         renderer_get_frames_in_flight();
     void        renderer_update_queries();
     void        renderer_get_present_time(f32& cpu_ms, f32& gpu_ms);
+    void        renderer_get_arena_stats(renderer_arena_stats& stats);
+    void        renderer_get_cmd_stats(renderer_cmd_stats& stats);
+
+    // deferred command lists, any thread can record into a list using the public-api while the list is bound to it.
+    // lists are submitted to the render thread in the order submit is called from the user thread.
+    // resource creation and release is not thread safe and must happen on the user thread.
+    u32         renderer_create_cmd_list();
+    void        renderer_release_cmd_list(u32 list);
+    void        renderer_begin_cmd_list(u32 list); // binds list to the calling thread
+    void        renderer_end_cmd_list();
+    bool        renderer_recording_cmd_list(); // true if the calling thread has a list bound
+    void        renderer_submit_cmd_list(u32 list); // copies recorded commands into the queue and resets the list
+
+    // capture the commands consumed by the render thread to a binary trace, including resource data,
+    // and replay it through the same dispatch on any backend. capture from startup so the trace creates everything it uses.
+    // replay from the user thread with a bare renderer context, each frame is followed by renderer_consume_cmd_buffer.
+    void        renderer_capture_enable(const c8* filename, u32 num_frames); // starts on the next frame
+    bool        renderer_capture_active();
+    bool        renderer_replay_load(const c8* filename);
+    u32         renderer_replay_num_frames();
+    void        renderer_replay_frame(u32 frame);
+    void        renderer_replay_reset(); // releases resources still alive at the end of the trace, to loop it
+    void        renderer_replay_release();
+    void        renderer_cmd_timings_enable(bool enable); // times every command executed on the render thread
+    u32         renderer_get_cmd_timings(renderer_cmd_timing* timings, u32 max_timings);
     
     // virtual interface for render backends
     class render_backend
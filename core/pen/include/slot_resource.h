@@ -3,33 +3,31 @@
 // License: https://github.com/polymonster/pmtech/blob/master/license.md
 
 // Simple slot resource api can be used to allocate an array slot to a generic opaque resource via a handle.
-// Implements a free list so getting a new resource slot is an o(1) operation.
+// Free slots are kept on a dense stack of indices so getting a new resource slot is an o(1) operation.
+// Each slot has a generation which changes when the slot is used and freed, slot_handle packs it with the index
+// so a stale handle to a recycled slot can be detected in o(1).
 // will grow to accomodate more items
 
 #pragma once
 
+#include "console.h"
+#include "memory.h"
 #include "pen.h"
 
 namespace pen
 {
-    enum e_resource_flags
-    {
-        RESOURCE_FREE = 1,
-        RESOURCE_USED = 1 << 1
-    };
+    // index in the low 24 bits, generation in the top 8
+    typedef u32 slot_handle;
 
-    struct free_slot_list
-    {
-        u32             index;
-        free_slot_list* next;
-        u32             flags;
-    };
+    static const u32 k_slot_index_bits = 24;
+    static const u32 k_slot_index_mask = (1 << k_slot_index_bits) - 1;
 
     struct slot_resources
     {
-        free_slot_list* slots;
-        free_slot_list* head;
-        u32             _capacity;
+        u32* free_indices = nullptr; // stack of free slots, the top is used next
+        u8*  generations = nullptr;  // per slot, odd while the slot is in use
+        u32  num_free = 0;
+        u32  _capacity = 0;
     };
 
     // Function decl
@@ -37,83 +35,104 @@ namespace pen
     void slot_resources_init(slot_resources* resources, u32 num);
     u32  slot_resources_get_next(slot_resources* resources);
     bool slot_resources_free(slot_resources* resources, const u32 slot);
+    bool slot_resources_is_used(const slot_resources* resources, const u32 slot);
+
+    // generation counted handles, for apis which do not need to pass bare indices to other systems
+    slot_handle slot_resources_get_next_handle(slot_resources* resources);
+    bool        slot_resources_free_handle(slot_resources* resources, slot_handle handle);
+    bool        slot_resources_valid(const slot_resources* resources, slot_handle handle);
+    u32         slot_handle_index(slot_handle handle);
 
     // Implementation
+    inline void slot_resources_push_free(slot_resources* resources, u32 begin, u32 end)
+    {
+        // push in reverse so the lowest index is on top
+        for (u32 i = end; i > begin; --i)
+            resources->free_indices[resources->num_free++] = i - 1;
+    }
+
     inline void slot_resources_grow(slot_resources* resources)
     {
         u32 cur_cap = resources->_capacity;
         u32 new_cap = resources->_capacity * 2;
+        PEN_ASSERT(new_cap - 1 <= k_slot_index_mask);
 
-        resources->slots = (free_slot_list*)pen::memory_realloc(resources->slots, sizeof(free_slot_list) * new_cap);
-
-        // init free list
-        for (s32 i = new_cap - 1; i > cur_cap; --i)
-        {
-            resources->slots[i].index = i;
-
-            if (i >= new_cap - 1)
-                resources->slots[i].next = nullptr;
-            else
-                resources->slots[i].next = resources->head;
-
-            resources->head = &resources->slots[i];
-
-            resources->slots[i].flags |= RESOURCE_FREE;
-        }
+        resources->free_indices = (u32*)pen::memory_realloc(resources->free_indices, sizeof(u32) * new_cap);
+        resources->generations = (u8*)pen::memory_realloc(resources->generations, new_cap);
+        memset(resources->generations + cur_cap, 0x0, new_cap - cur_cap);
 
+        slot_resources_push_free(resources, cur_cap, new_cap);
         resources->_capacity = new_cap;
     }
 
     inline void slot_resources_init(slot_resources* resources, u32 num)
     {
-        //resources->slots = new free_slot_list[num];
-        resources->_capacity = num;
-        resources->slots = (free_slot_list*)pen::memory_alloc(sizeof(slot_resources) * num);
-
         // 0 is reserved as null slot
-        for (s32 i = num - 1; i > 0; --i)
-        {
-            resources->slots[i].index = i;
-
-            if (i >= num - 1)
-                resources->slots[i].next = nullptr;
-            else
-                resources->slots[i].next = resources->head;
+        num = std::max<u32>(num, 2);
 
-            resources->head = &resources->slots[i];
+        resources->_capacity = num;
+        resources->num_free = 0;
+        resources->free_indices = (u32*)pen::memory_alloc(sizeof(u32) * num);
+        resources->generations = (u8*)pen::memory_alloc(num);
+        memset(resources->generations, 0x0, num);
 
-            resources->slots[i].flags |= RESOURCE_FREE;
-        }
+        slot_resources_push_free(resources, 1, num);
     }
 
     inline u32 slot_resources_get_next(slot_resources* resources)
     {
-        if (!resources->head)
+        if (resources->num_free == 0)
             slot_resources_grow(resources);
 
-        u32 r = resources->head->index;
-        resources->head->flags &= ~RESOURCE_FREE;
-        resources->head->flags |= RESOURCE_USED;
-
-        resources->head = resources->head->next;
+        u32 r = resources->free_indices[--resources->num_free];
+        resources->generations[r]++;
 
         return r;
     }
 
+    inline bool slot_resources_is_used(const slot_resources* resources, const u32 slot)
+    {
+        return slot < resources->_capacity && (resources->generations[slot] & 1);
+    }
+
     inline bool slot_resources_free(slot_resources* resources, const u32 slot)
     {
         if (slot == 0)
             return false;
 
         // avoid double free
-        if (resources->slots[slot].flags & RESOURCE_FREE)
+        if (!slot_resources_is_used(resources, slot))
             return false;
 
-        // mark free and add to free list
-        resources->slots[slot].flags |= RESOURCE_FREE;
-        resources->slots[slot].next = resources->head;
-        resources->head = &resources->slots[slot];
+        // bump generation to mark free and add to free list
+        resources->generations[slot]++;
+        resources->free_indices[resources->num_free++] = slot;
 
         return true;
     }
+
+    inline u32 slot_handle_index(slot_handle handle)
+    {
+        return handle & k_slot_index_mask;
+    }
+
+    inline slot_handle slot_resources_get_next_handle(slot_resources* resources)
+    {
+        u32 r = slot_resources_get_next(resources);
+        return ((u32)resources->generations[r] << k_slot_index_bits) | r;
+    }
+
+    inline bool slot_resources_valid(const slot_resources* resources, slot_handle handle)
+    {
+        u32 slot = slot_handle_index(handle);
+        return slot_resources_is_used(resources, slot) && resources->generations[slot] == (handle >> k_slot_index_bits);
+    }
+
+    inline bool slot_resources_free_handle(slot_resources* resources, slot_handle handle)
+    {
+        if (!slot_resources_valid(resources, handle))
+            return false;
+
+        return slot_resources_free(resources, slot_handle_index(handle));
+    }
 } // namespace pen
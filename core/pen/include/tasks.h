@@ -0,0 +1,69 @@
+// tasks.h
+// Copyright 2014 - 2019 Alex Dixon.
+// License: https://github.com/polymonster/pmtech/blob/master/license.md
+
+// Work stealing task scheduler with one worker thread per core.
+// Lives alongside the long lived jobs in threads.h, jobs are for dedicated system threads (render, physics, audio)
+// tasks are for splitting short pieces of work across all cores within a frame.
+
+// Each worker owns a lockless deque (owner push / pop at the bottom, thieves steal from the top)
+// threads which are not workers submit into a shared queue.
+// Tasks signal a task_counter on completion, any thread can wait on a counter and will help execute work while waiting.
+// Continuations are tasks which are kicked when a counter reaches zero.
+
+// Task data is allocated from per-thread free lists which grow in blocks of k_task_block_size, finished tasks are returned
+// to the list of the thread which submitted them. Without a scheduler tasks run in place.
+
+#pragma once
+
+#include "pen.h"
+
+namespace pen
+{
+    typedef void (*task_function)(void* user_data);
+    typedef void (*task_range_function)(void* user_data, u32 start, u32 end);
+
+    struct task;
+
+    struct task_counter
+    {
+        a_u32              value = {0};
+        a_u32              finishing = {0};
+        std::atomic<task*> continuations = {nullptr};
+    };
+
+    enum task_limits
+    {
+        k_max_task_workers = 64,
+        k_task_block_size = 4096,
+    };
+
+    struct task_scheduler_stats
+    {
+        u32 num_workers;
+        u64 tasks_executed;
+        u64 tasks_stolen;
+    };
+
+    // Scheduler, num_workers == 0 will use num cores - 1 to leave room for the thread calling init
+    void task_scheduler_init(u32 num_workers = 0);
+    void task_scheduler_shutdown();
+    u32  task_scheduler_num_workers();
+    s32  task_scheduler_worker_index(); // -1 for threads which are not task workers
+    void task_scheduler_get_stats(task_scheduler_stats& stats);
+
+    // Submission, the counter (optional) is incremented for each task and decremented on completion
+    void task_run(task_function func, void* user_data, task_counter* counter = nullptr);
+    void task_parallel_for(u32 start, u32 end, u32 grain_size, task_range_function func, void* user_data,
+                           task_counter* counter);
+
+    // Continuation, func will be kicked when dependency reaches zero, it signals counter (optional) on completion
+    void task_run_after(task_counter* dependency, task_function func, void* user_data, task_counter* counter = nullptr);
+
+    // Sync, waiting threads execute other pending tasks until the counter reaches zero
+    void task_wait(task_counter* counter);
+    bool task_complete(const task_counter* counter);
+
+    // Helper to run a parallel_for and wait for it to finish
+    void task_parallel_for_wait(u32 start, u32 end, u32 grain_size, task_range_function func, void* user_data);
+} // namespace pen
@@ -62,6 +62,8 @@ namespace pen
     thread* thread_create(dispatch_thread thread_func, u32 stack_size, void* thread_params, thread_start_flags flags);
     void    thread_sleep_ms(u32 milliseconds);
     void    thread_sleep_us(u32 microseconds);
+    void    thread_yield();
+    u32     thread_get_num_cores(); // num logical cores available to the process
 
     // Jobs
     void jobs_create_default(const default_thread_info& info);
@@ -81,6 +83,7 @@ namespace pen
     void       semaphore_destroy(semaphore* p_semaphore);
     bool       semaphore_try_wait(semaphore* p_semaphore);
     bool       semaphore_wait(semaphore* p_semaphore);
+    bool       semaphore_wait_ms(semaphore* p_semaphore, u32 timeout_ms); // returns false if the timeout expired
     void       semaphore_post(semaphore* p_semaphore, u32 count);
 
 } // namespace pen
@@ -27,4 +27,9 @@ namespace pen
     {
         return true;
     }
+
+    bool semaphore_wait_ms(pen::semaphore*, unsigned int)
+    {
+        return true;
+    }
 } // namespace pen
@@ -0,0 +1,508 @@
+// async_io.cpp
+// Copyright 2014 - 2019 Alex Dixon.
+// License: https://github.com/polymonster/pmtech/blob/master/license.md
+
+#include <stdio.h>
+#include <string.h>
+
+#include "async_io.h"
+#include "console.h"
+#include "memory.h"
+#include "os.h"
+#include "profiler.h"
+#include "slot_resource.h"
+#include "threads.h"
+#include "timer.h"
+
+using namespace pen;
+
+namespace
+{
+    enum io_limits
+    {
+        k_max_io_threads = 8,
+        k_io_chunk_size = 256 * 1024, // cancellation is checked between chunks
+        k_io_initial_requests = 64
+    };
+
+    struct io_slot
+    {
+        io_request req;
+        io_handle  handle;
+        io_status  status;
+        c8*        filename;
+        void*      data;
+        u32        size;
+        f32        submit_ms;
+        u32        next; // intrusive queue link, 0 is end
+        bool       owns_data;
+        bool       cancel;
+    };
+
+    struct io_queue
+    {
+        u32 head = 0;
+        u32 tail = 0;
+    };
+
+    struct io_service
+    {
+        mutex*         lock = nullptr;
+        semaphore*     wake_semaphore = nullptr;
+        semaphore*     exit_semaphore = nullptr;
+        thread*        threads[k_max_io_threads] = {};
+        u32            num_threads = 0;
+        a_u32          exit = {0};
+        slot_resources resources;
+        io_slot*       slots = nullptr;
+        u32            capacity = 0;
+        io_queue       pending[e_io_priority::COUNT];
+        io_queue       completions;
+        timer*         clock = nullptr; // latency is measured from init to keep precision in f32
+        io_stats       stats = {};
+        f64            total_latency_ms = 0.0;
+    };
+    io_service* s_io = nullptr;
+
+    void queue_push(io_queue& q, u32 index)
+    {
+        s_io->slots[index].next = 0;
+
+        if (q.tail)
+            s_io->slots[q.tail].next = index;
+        else
+            q.head = index;
+
+        q.tail = index;
+    }
+
+    u32 queue_pop(io_queue& q)
+    {
+        u32 index = q.head;
+        if (!index)
+            return 0;
+
+        q.head = s_io->slots[index].next;
+        if (!q.head)
+            q.tail = 0;
+
+        return index;
+    }
+
+    u32 pop_pending()
+    {
+        for (s32 p = e_io_priority::COUNT - 1; p >= 0; --p)
+        {
+            u32 index = queue_pop(s_io->pending[p]);
+            if (index)
+                return index;
+        }
+
+        return 0;
+    }
+
+    io_slot* get_slot(io_handle handle)
+    {
+        if (!s_io || !slot_resources_valid(&s_io->resources, handle))
+            return nullptr;
+
+        return &s_io->slots[slot_handle_index(handle)];
+    }
+
+    io_result make_result(const io_slot& slot)
+    {
+        io_result result;
+        result.handle = slot.handle;
+        result.status = slot.status;
+        result.data = slot.data;
+        result.size = slot.size;
+        result.user_data = slot.req.user_data;
+        return result;
+    }
+
+    void release_slot(io_slot& slot)
+    {
+        memory_free(slot.filename);
+        slot_resources_free_handle(&s_io->resources, slot.handle);
+    }
+
+    void free_data(const io_request& req, void* data)
+    {
+        if (req.alloc_func)
+            req.free_func(data, req.alloc_user_data);
+        else
+            memory_free(data);
+    }
+
+    void read_request(u32 index)
+    {
+        PEN_PROFILE_SCOPE("io_read");
+
+        // copy what we need while locked, slots can be reallocated by io_read
+        mutex_lock(s_io->lock);
+        io_slot&   slot = s_io->slots[index];
+        io_request req = slot.req;
+        c8*        filename = slot.filename;
+        bool       cancel = slot.cancel;
+        f32        submit_ms = slot.submit_ms;
+        slot.status = e_io_status::in_flight;
+        s_io->stats.queued--;
+        s_io->stats.in_flight++;
+        mutex_unlock(s_io->lock);
+
+        io_status status = cancel ? e_io_status::cancelled : e_io_status::failed;
+        void*     data = nullptr;
+        u32       size = 0;
+        u32       bytes_read = 0;
+        bool      owns_data = false;
+
+        f32   start_ms = timer_elapsed_ms(s_io->clock);
+        FILE* fp = cancel ? nullptr : fopen(filename, "rb");
+        if (fp)
+        {
+            fseek(fp, 0L, SEEK_END);
+            long file_size = ftell(fp);
+
+            size = req.size ? req.size : (u32)(file_size - req.offset);
+            if ((long)req.offset + (long)size <= file_size && fseek(fp, (long)req.offset, SEEK_SET) == 0)
+            {
+                data = req.dst;
+                if (!data)
+                {
+                    PEN_MEMORY_TAG(e_mem_tag::loader);
+                    data = req.alloc_func ? req.alloc_func(size + 1, req.alloc_user_data) : memory_alloc(size + 1);
+                    ((u8*)data)[size] = '\0';
+                    owns_data = true;
+                }
+
+                status = e_io_status::complete;
+                while (bytes_read < size)
+                {
+                    mutex_lock(s_io->lock);
+                    cancel = s_io->slots[index].cancel;
+                    mutex_unlock(s_io->lock);
+
+                    if (cancel)
+                    {
+                        status = e_io_status::cancelled;
+                        break;
+                    }
+
+                    u32 chunk = min<u32>(size - bytes_read, k_io_chunk_size);
+                    u32 r = (u32)fread((u8*)data + bytes_read, 1, chunk, fp);
+                    bytes_read += r;
+
+                    if (r != chunk)
+                    {
+                        status = e_io_status::failed;
+                        break;
+                    }
+                }
+            }
+
+            fclose(fp);
+        }
+        f32 end_ms = timer_elapsed_ms(s_io->clock);
+
+        mutex_lock(s_io->lock);
+        io_slot& done = s_io->slots[index];
+
+        // a cancel which arrives after the last chunk still wins, io_cancel has already returned true
+        if (done.cancel)
+            status = e_io_status::cancelled;
+
+        if (status != e_io_status::complete)
+        {
+            if (owns_data)
+                free_data(req, data);
+
+            data = nullptr;
+            size = 0;
+        }
+
+        done.status = status;
+        done.data = data;
+        done.size = size;
+        done.owns_data = owns_data && data;
+
+        io_stats& stats = s_io->stats;
+        stats.in_flight--;
+        stats.bytes_read += bytes_read;
+        stats.read_ms += end_ms - start_ms;
+
+        f32 latency = end_ms - submit_ms;
+        stats.max_latency_ms = max<f32>(stats.max_latency_ms, latency);
+        s_io->total_latency_ms += latency;
+
+        if (status == e_io_status::complete)
+            stats.completed++;
+        else if (status == e_io_status::cancelled)
+            stats.cancelled++;
+        else
+            stats.failed++;
+
+        if (!req.callback)
+        {
+            // kept until io_get_result
+            mutex_unlock(s_io->lock);
+            return;
+        }
+
+        if (req.completion == e_io_completion::dispatch)
+        {
+            queue_push(s_io->completions, index);
+            mutex_unlock(s_io->lock);
+            return;
+        }
+
+        io_result result = make_result(done);
+        release_slot(done);
+        mutex_unlock(s_io->lock);
+
+        req.callback(result);
+    }
+
+    void* io_thread_func(void* params)
+    {
+        PEN_PROFILE_THREAD("io");
+
+        for (;;)
+        {
+            semaphore_wait(s_io->wake_semaphore);
+
+            if (s_io->exit.load())
+                break;
+
+            mutex_lock(s_io->lock);
+            u32 index = pop_pending();
+            mutex_unlock(s_io->lock);
+
+            if (index)
+                read_request(index);
+        }
+
+        semaphore_post(s_io->exit_semaphore, 1);
+        return PEN_THREAD_OK;
+    }
+} // namespace
+
+namespace pen
+{
+    void io_init(u32 num_threads)
+    {
+        if (s_io)
+            return;
+
+        num_threads = min<u32>(max<u32>(num_threads, 1), k_max_io_threads);
+
+        s_io = new io_service();
+        s_io->lock = mutex_create();
+        s_io->wake_semaphore = semaphore_create(0, 0x7fffffff);
+        s_io->exit_semaphore = semaphore_create(0, k_max_io_threads);
+        s_io->clock = timer_create();
+        timer_start(s_io->clock);
+
+        slot_resources_init(&s_io->resources, k_io_initial_requests);
+        s_io->capacity = s_io->resources._capacity;
+        s_io->slots = (io_slot*)memory_alloc(sizeof(io_slot) * s_io->capacity);
+
+        s_io->num_threads = num_threads;
+        for (u32 i = 0; i < num_threads; ++i)
+            s_io->threads[i] = thread_create(io_thread_func, 1024 * 1024, nullptr, e_thread_start_flags::detached);
+    }
+
+    void io_shutdown()
+    {
+        if (!s_io)
+            return;
+
+        s_io->exit = 1;
+
+        u32 nt = s_io->num_threads;
+        semaphore_post(s_io->wake_semaphore, nt);
+
+        for (u32 i = 0; i < nt; ++i)
+            semaphore_wait(s_io->exit_semaphore);
+
+        for (u32 i = 0; i < nt; ++i)
+            memory_free(s_io->threads[i]);
+
+        // anything not delivered is dropped, free the data we allocated on the receivers behalf
+        for (u32 i = 1; i < s_io->capacity; ++i)
+        {
+            if (!slot_resources_is_used(&s_io->resources, i))
+                continue;
+
+            io_slot& slot = s_io->slots[i];
+            if (slot.owns_data)
+                free_data(slot.req, slot.data);
+
+            memory_free(slot.filename);
+        }
+
+        memory_free(s_io->slots);
+        memory_free(s_io->resources.free_indices);
+        memory_free(s_io->resources.generations);
+
+        mutex_destroy(s_io->lock);
+        semaphore_destroy(s_io->wake_semaphore);
+        semaphore_destroy(s_io->exit_semaphore);
+        timer_destroy(s_io->clock);
+
+        delete s_io;
+        s_io = nullptr;
+    }
+
+    io_handle io_read(const io_request& request)
+    {
+        if (!s_io || !request.filename)
+            return 0;
+
+        PEN_ASSERT(!request.alloc_func || request.free_func);
+
+        // resolve the resource path on the calling thread, on some platforms it is not thread safe
+        const c8* path = os_path_for_resource(request.filename);
+        u32       len = (u32)strlen(path);
+        c8*       filename = (c8*)memory_alloc(len + 1);
+        memcpy(filename, path, len + 1);
+
+        mutex_lock(s_io->lock);
+
+        io_handle handle = slot_resources_get_next_handle(&s_io->resources);
+        if (s_io->resources._capacity > s_io->capacity)
+        {
+            s_io->capacity = s_io->resources._capacity;
+            s_io->slots = (io_slot*)memory_realloc(s_io->slots, sizeof(io_slot) * s_io->capacity);
+        }
+
+        u32      index = slot_handle_index(handle);
+        io_slot& slot = s_io->slots[index];
+        slot.req = request;
+        slot.req.filename = filename;
+        slot.handle = handle;
+        slot.status = e_io_status::pending;
+        slot.filename = filename;
+        slot.data = nullptr;
+        slot.size = 0;
+        slot.submit_ms = timer_elapsed_ms(s_io->clock);
+        slot.owns_data = false;
+        slot.cancel = false;
+
+        queue_push(s_io->pending[request.priority], index);
+
+        s_io->stats.requests++;
+        s_io->stats.queued++;
+
+        mutex_unlock(s_io->lock);
+
+        semaphore_post(s_io->wake_semaphore, 1);
+        return handle;
+    }
+
+    bool io_cancel(io_handle handle)
+    {
+        if (!s_io)
+            return false;
+
+        // pending requests are skipped when they are popped, in flight reads stop at the next chunk
+        // either way the request completes with e_io_status::cancelled
+        bool cancelled = false;
+
+        mutex_lock(s_io->lock);
+        io_slot* slot = get_slot(handle);
+        if (slot && !slot->cancel &&
+            (slot->status == e_io_status::pending || slot->status == e_io_status::in_flight))
+        {
+            slot->cancel = true;
+            cancelled = true;
+        }
+        mutex_unlock(s_io->lock);
+
+        return cancelled;
+    }
+
+    io_status io_get_status(io_handle handle)
+    {
+        if (!s_io)
+            return e_io_status::invalid;
+
+        mutex_lock(s_io->lock);
+        io_slot*  slot = get_slot(handle);
+        io_status status = slot ? slot->status : e_io_status::invalid;
+        mutex_unlock(s_io->lock);
+
+        return status;
+    }
+
+    bool io_get_result(io_handle handle, io_result& result)
+    {
+        if (!s_io)
+            return false;
+
+        mutex_lock(s_io->lock);
+
+        io_slot* slot = get_slot(handle);
+        if (!slot || slot->req.callback || slot->status == e_io_status::pending ||
+            slot->status == e_io_status::in_flight)
+        {
+            mutex_unlock(s_io->lock);
+            return false;
+        }
+
+        result = make_result(*slot);
+        release_slot(*slot);
+
+        mutex_unlock(s_io->lock);
+        return true;
+    }
+
+    u32 io_dispatch_completions()
+    {
+        if (!s_io)
+            return 0;
+
+        u32 count = 0;
+        for (;;)
+        {
+            mutex_lock(s_io->lock);
+
+            u32 index = queue_pop(s_io->completions);
+            if (!index)
+            {
+                mutex_unlock(s_io->lock);
+                break;
+            }
+
+            io_slot&    slot = s_io->slots[index];
+            io_callback cb = slot.req.callback;
+            io_result   result = make_result(slot);
+            release_slot(slot);
+
+            mutex_unlock(s_io->lock);
+
+            cb(result);
+            ++count;
+        }
+
+        return count;
+    }
+
+    void io_get_stats(io_stats& stats)
+    {
+        stats = {};
+        if (!s_io)
+            return;
+
+        mutex_lock(s_io->lock);
+        stats = s_io->stats;
+
+        u64 finished = stats.completed + stats.failed + stats.cancelled;
+        if (finished)
+            stats.avg_latency_ms = (f32)(s_io->total_latency_ms / (f64)finished);
+
+        if (stats.read_ms > 0.0f)
+            stats.bandwidth_mbps = ((f32)stats.bytes_read / (1024.0f * 1024.0f)) / (stats.read_ms / 1000.0f);
+
+        mutex_unlock(s_io->lock);
+    }
+} // namespace pen
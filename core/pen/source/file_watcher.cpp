@@ -0,0 +1,374 @@
+// file_watcher.cpp
+// Copyright 2014 - 2019 Alex Dixon.
+// License: https://github.com/polymonster/pmtech/blob/master/license.md
+
+#include "file_watcher.h"
+#include "console.h"
+#include "data_struct.h"
+#include "file_system.h"
+#include "hash.h"
+#include "str_utilities.h"
+#include "timer.h"
+
+#include <vector>
+
+#ifdef __linux__
+#include <errno.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#define PEN_INOTIFY 1
+#endif
+
+using namespace pen;
+
+namespace
+{
+    enum file_watcher_limits
+    {
+        k_coalesce_ms = 100, // changes are delivered once there have been no events for this long
+        k_poll_budget = 64   // files checked per update when polling
+    };
+
+    struct watched_file
+    {
+        hash_id             id;
+        Str                 filename;
+        u32                 mtime;
+        file_watch_callback callback;
+        void*               user_data;
+        s32                 next; // next watch on the same file
+        bool                changed;
+    };
+
+    struct watched_dir
+    {
+        Str prefix; // the directory including the trailing slash, empty for the working directory
+        s32 wd;
+        s32 next; // next prefix which resolved to the same inotify watch
+    };
+
+    struct file_watcher
+    {
+        std::vector<watched_file> files;
+        std::vector<watched_dir>  dirs;
+        hash_map<u32>             file_lookup; // file id to the first watch in files
+        hash_map<u32>             dir_lookup;  // prefix id to index in dirs
+        hash_map<u32>             wd_lookup;   // inotify watch descriptor to the first prefix in dirs
+        u32*                      pending = nullptr;
+        u32*                      polled = nullptr; // watches which have no directory watch
+        u32                       poll_cursor = 0;
+        timer*                    clock = nullptr;
+        f32                       last_event_ms = 0.0f;
+        s32                       fd = -1;
+    };
+    file_watcher* s_fw = nullptr;
+
+    Str file_prefix(const Str& filename)
+    {
+        s32 slash = str_find_reverse(filename, "/");
+        if (slash == -1)
+            return "";
+
+        return str_substr(filename, 0, slash + 1);
+    }
+
+    void init()
+    {
+        s_fw = new file_watcher();
+        s_fw->clock = timer_create();
+        timer_start(s_fw->clock);
+
+#if PEN_INOTIFY
+        s_fw->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (s_fw->fd < 0)
+            PEN_LOG("[file watcher] inotify unavailable (%i), falling back to polling", errno);
+#endif
+    }
+
+    s32 add_watch(const Str& prefix)
+    {
+#if PEN_INOTIFY
+        if (s_fw->fd >= 0)
+        {
+            const c8* path = prefix.length() ? prefix.c_str() : ".";
+            return inotify_add_watch(s_fw->fd, path, IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_ATTRIB);
+        }
+#endif
+        return -1;
+    }
+
+    void link_dir(u32 index, s32 wd)
+    {
+        // different prefixes can name the same directory, inotify gives them the same descriptor
+        s32  next = -1;
+        u32* same = s_fw->wd_lookup.find((u32)wd);
+        if (same)
+            next = (s32)*same;
+
+        s_fw->dirs[index].wd = wd;
+        s_fw->dirs[index].next = next;
+        s_fw->wd_lookup.insert((u32)wd, index);
+    }
+
+    bool watch_dir(const Str& prefix)
+    {
+        // prefixes whose watch was lost stay in the lookup with no descriptor, their files are polled
+        hash_id id = PEN_HASH(prefix.c_str());
+        u32*    existing = s_fw->dir_lookup.find(id);
+        if (existing)
+            return s_fw->dirs[*existing].wd >= 0;
+
+        s32 wd = add_watch(prefix);
+        if (wd < 0)
+            return false;
+
+        u32 index = (u32)s_fw->dirs.size();
+        s_fw->dirs.push_back({prefix, -1, -1});
+        s_fw->dir_lookup.insert(id, index);
+        link_dir(index, wd);
+        return true;
+    }
+
+    void file_changed(hash_id id)
+    {
+        u32* first = s_fw->file_lookup.find(id);
+        if (!first)
+            return;
+
+        for (s32 i = (s32)*first; i != -1; i = s_fw->files[i].next)
+        {
+            watched_file& wf = s_fw->files[i];
+            if (wf.changed)
+                continue;
+
+            wf.changed = true;
+            sb_push(s_fw->pending, (u32)i);
+        }
+
+        s_fw->last_event_ms = timer_elapsed_ms(s_fw->clock);
+    }
+
+    void all_changed()
+    {
+        u32 num_files = (u32)s_fw->files.size();
+        for (u32 i = 0; i < num_files; ++i)
+        {
+            watched_file& wf = s_fw->files[i];
+            if (wf.changed)
+                continue;
+
+            wf.changed = true;
+            sb_push(s_fw->pending, i);
+        }
+
+        s_fw->last_event_ms = timer_elapsed_ms(s_fw->clock);
+    }
+
+    void dir_lost(s32 wd)
+    {
+        // the directory was deleted or unmounted, watch it again if it has been replaced, otherwise poll its files
+        u32* first = s_fw->wd_lookup.find((u32)wd);
+        if (!first)
+            return;
+
+        s32 d = (s32)*first;
+        s_fw->wd_lookup.erase((u32)wd);
+
+        while (d != -1)
+        {
+            watched_dir& dir = s_fw->dirs[d];
+            s32          next = dir.next;
+            Str          prefix = dir.prefix;
+
+            s32 new_wd = add_watch(prefix);
+            if (new_wd >= 0)
+                link_dir((u32)d, new_wd);
+            else
+                dir.wd = -1;
+
+            // events in between are missed, so files either change now or get the mtime to poll against
+            u32 num_files = (u32)s_fw->files.size();
+            for (u32 i = 0; i < num_files; ++i)
+            {
+                watched_file& wf = s_fw->files[i];
+                if (!(file_prefix(wf.filename) == prefix))
+                    continue;
+
+                if (new_wd >= 0)
+                {
+                    file_changed(wf.id);
+                    continue;
+                }
+
+                wf.mtime = 0;
+                filesystem_getmtime(wf.filename.c_str(), wf.mtime);
+                sb_push(s_fw->polled, i);
+            }
+
+            d = next;
+        }
+    }
+
+    void read_events()
+    {
+#if PEN_INOTIFY
+        if (s_fw->fd < 0)
+            return;
+
+        alignas(inotify_event) c8 buf[4096];
+        for (;;)
+        {
+            ssize_t len = read(s_fw->fd, buf, sizeof(buf));
+            if (len <= 0)
+                break;
+
+            for (c8* p = buf; p < buf + len;)
+            {
+                inotify_event* ev = (inotify_event*)p;
+                p += sizeof(inotify_event) + ev->len;
+
+                // events were dropped, any file could have changed
+                if (ev->mask & IN_Q_OVERFLOW)
+                {
+                    all_changed();
+                    continue;
+                }
+
+                if (ev->mask & IN_IGNORED)
+                {
+                    dir_lost(ev->wd);
+                    continue;
+                }
+
+                if (ev->len == 0)
+                    continue;
+
+                u32* dir = s_fw->wd_lookup.find((u32)ev->wd);
+                if (!dir)
+                    continue;
+
+                for (s32 d = (s32)*dir; d != -1; d = s_fw->dirs[d].next)
+                {
+                    Str path = s_fw->dirs[d].prefix;
+                    path.append(ev->name);
+                    file_changed(PEN_HASH(path.c_str()));
+                }
+            }
+        }
+#endif
+    }
+
+    void poll_files()
+    {
+        u32 num_polled = sb_count(s_fw->polled);
+        if (num_polled == 0)
+            return;
+
+        u32 count = min<u32>(num_polled, k_poll_budget);
+        for (u32 i = 0; i < count; ++i)
+        {
+            s_fw->poll_cursor = (s_fw->poll_cursor + 1) % num_polled;
+            watched_file& wf = s_fw->files[s_fw->polled[s_fw->poll_cursor]];
+
+            u32 mtime = 0;
+            if (filesystem_getmtime(wf.filename.c_str(), mtime) != PEN_ERR_OK || mtime == wf.mtime)
+                continue;
+
+            wf.mtime = mtime;
+            file_changed(wf.id);
+        }
+    }
+} // namespace
+
+namespace pen
+{
+    void file_watcher_add(const c8* filename, file_watch_callback callback, void* user_data)
+    {
+        if (!s_fw)
+            init();
+
+        Str     fn = str_replace_chars(filename, '\\', '/');
+        hash_id id = PEN_HASH(fn.c_str());
+
+        s32  first = -1;
+        u32* existing = s_fw->file_lookup.find(id);
+        if (existing)
+        {
+            first = (s32)*existing;
+            for (s32 i = first; i != -1; i = s_fw->files[i].next)
+                if (s_fw->files[i].callback == callback && s_fw->files[i].user_data == user_data)
+                    return;
+        }
+
+        watched_file wf;
+        wf.id = id;
+        wf.filename = fn;
+        wf.mtime = 0;
+        wf.callback = callback;
+        wf.user_data = user_data;
+        wf.next = first;
+        wf.changed = false;
+
+        u32 index = (u32)s_fw->files.size();
+        s_fw->files.push_back(wf);
+        s_fw->file_lookup.insert(id, index);
+
+        if (!watch_dir(file_prefix(fn)))
+        {
+            filesystem_getmtime(fn.c_str(), s_fw->files[index].mtime);
+            sb_push(s_fw->polled, index);
+        }
+    }
+
+    void file_watcher_update()
+    {
+        if (!s_fw)
+            return;
+
+        read_events();
+        poll_files();
+
+        u32 num_pending = sb_count(s_fw->pending);
+        if (num_pending == 0)
+            return;
+
+        if (timer_elapsed_ms(s_fw->clock) - s_fw->last_event_ms < (f32)k_coalesce_ms)
+            return;
+
+        // callbacks can add more watches, so take the list and copy what we need before each call
+        u32* pending = s_fw->pending;
+        s_fw->pending = nullptr;
+
+        for (u32 i = 0; i < num_pending; ++i)
+        {
+            watched_file& wf = s_fw->files[pending[i]];
+            wf.changed = false;
+
+            Str                 fn = wf.filename;
+            file_watch_callback cb = wf.callback;
+            void*               user_data = wf.user_data;
+
+            cb(fn.c_str(), user_data);
+        }
+
+        sb_free(pending);
+    }
+
+    void file_watcher_shutdown()
+    {
+        if (!s_fw)
+            return;
+
+#if PEN_INOTIFY
+        if (s_fw->fd >= 0)
+            close(s_fw->fd);
+#endif
+
+        timer_destroy(s_fw->clock);
+        sb_free(s_fw->pending);
+        sb_free(s_fw->polled);
+
+        delete s_fw;
+        s_fw = nullptr;
+    }
+} // namespace pen
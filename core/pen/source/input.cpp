@@ -135,7 +135,8 @@ namespace pen
         if (s_unicode_ring.data == nullptr)
             s_unicode_ring.create(128);
 
-        s_unicode_ring.put(Str(utf8));
+        // drop input if the user thread is not consuming it, rather than stall the os thread
+        s_unicode_ring.try_put(Str(utf8));
     }
 
     Str input_get_unicode_input()
@@ -2,7 +2,12 @@
 // Copyright 2014 - 2019 Alex Dixon.
 // License: https://github.com/polymonster/pmtech/blob/master/license.md
 
+#include "async_io.h"
+#include "file_watcher.h"
+#include "memory.h"
+#include "profiler.h"
 #include "renderer.h"
+#include "tasks.h"
 #include "threads.h"
 
 namespace pen
@@ -43,6 +48,8 @@ namespace pen
 
     void jobs_create_default(const pen::default_thread_info& info)
     {
+        task_scheduler_init();
+        io_init();
         jobs_create_job(&pen::user_entry, 1024 * 1024, info.user_thread_params, pen::e_thread_start_flags::detached);
     }
 
@@ -62,6 +69,12 @@ namespace pen
             }
         }
 
+        // jobs may have tasks or reads in flight so workers go last
+        io_shutdown();
+        task_scheduler_shutdown();
+        file_watcher_shutdown();
+        profiler_shutdown();
+        memory_tracking_report();
         return true;
     }
 } // namespace pen
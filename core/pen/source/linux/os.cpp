@@ -1,7 +1,9 @@
 // os.cpp
 // Copyright 2014 - 2019 Alex Dixon.
 // License: https://github.com/polymonster/pmtech/blob/master/license.md
+#ifndef PEN_RENDERER_NULL
 #include "GL/glew.h"
+#endif
 
 #include "console.h"
 #include "hash.h"
@@ -21,9 +23,11 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#ifndef PEN_RENDERER_NULL
 #include <GL/glx.h>
 #include <GL/glxext.h>
 #include <X11/Xlib.h>
+#endif
 
 using namespace pen;
 
@@ -31,6 +35,7 @@ using namespace pen;
 window_creation_params pen_window;
 pen::user_info         pen_user_info;
 
+#ifndef PEN_RENDERER_NULL
 // glx / gl stuff
 #define GLX_CONTEXT_MAJOR_VERSION_ARB 0x2091
 #define GLX_CONTEXT_MINOR_VERSION_ARB 0x2092
@@ -62,11 +67,15 @@ void pen_gl_swap_buffers()
     glXSwapBuffers(_display, _window);
 }
 
+#endif
+
 namespace
 {
+#ifndef PEN_RENDERER_NULL
     XIM          _xim;
     XIC          _xic;
     bool         _ctx_error_occured = false;
+#endif
     window_frame _window_frame;
     bool         _invalidate_window_frame = false;
 
@@ -81,6 +90,7 @@ namespace
         pen_user_info.user_name = &homedir[6];
     }
 
+#ifndef PEN_RENDERER_NULL
     int ctx_error_handler(Display* dpy, XErrorEvent* ev)
     {
         PEN_LOG("CONTEXT ERROR %i", ev->error_code);
@@ -229,6 +239,18 @@ namespace
 
         return s_error_code;
     }
+#else
+    int pen_run_headless()
+    {
+        // no window or context, the null renderer runs the same render thread loop for profiling without a gpu
+        s_windowed = true;
+        renderer_init(nullptr, true);
+
+        pen::jobs_terminate_all();
+
+        return s_error_code;
+    }
+#endif
 
     int pen_run_console_app()
     {
@@ -244,6 +266,7 @@ namespace
         return s_error_code;
     }
 
+#ifndef PEN_RENDERER_NULL
     s32 translate_mouse_button(s32 b)
     {
         static f32 mw = 0.0f;
@@ -500,6 +523,20 @@ namespace
 
         pen::input_gamepad_update();
     }
+#else
+    void update_window()
+    {
+        // resize the virtual backbuffer
+        if (_invalidate_window_frame)
+        {
+            pen_window.width = _window_frame.width;
+            pen_window.height = _window_frame.height;
+            _invalidate_window_frame = false;
+        }
+
+        pen::input_gamepad_update();
+    }
+#endif
 } // namespace
 
 int main(int argc, char* argv[])
@@ -515,9 +552,18 @@ int main(int argc, char* argv[])
     pen_window.window_title = pc.window_title;
     pen_window.sample_count = pc.window_sample_count;
 
+    // -capture <file> <num_frames> writes a trace of the renderer commands for renderer_replay
+    for (s32 i = 1; i + 1 < argc; ++i)
+        if (strcmp(argv[i], "-capture") == 0)
+            renderer_capture_enable(argv[i + 1], i + 2 < argc ? atoi(argv[i + 2]) : 60);
+
     if (pc.flags & e_pen_create_flags::renderer)
     {
+#ifdef PEN_RENDERER_NULL
+        pen_run_headless();
+#else
         pen_run_windowed();
+#endif
     }
     else
     {
@@ -569,7 +615,11 @@ namespace pen
 
     void* window_get_primary_display_handle()
     {
+#ifdef PEN_RENDERER_NULL
+        return nullptr;
+#else
         return (void*)(intptr_t)_window;
+#endif
     }
 
     void window_get_size(s32& width, s32& height)
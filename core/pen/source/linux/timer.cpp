@@ -36,7 +36,7 @@ namespace pen
 
     u64 get_absolute_time()
     {
-        static struct timeval tv;
+        struct timeval tv;
         gettimeofday(&tv, nullptr);
         return (tv.tv_sec * 1000 * 1000) + (tv.tv_usec);
     }
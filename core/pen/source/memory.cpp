@@ -3,6 +3,221 @@
 // License: https://github.com/polymonster/pmtech/blob/master/license.md
 
 #include "memory.h"
+#include "console.h"
+
+#ifdef PEN_MEMORY_TRACKING
+namespace
+{
+    const u32 k_alloc_magic = 0x4d454d50; // PMEM
+
+    // sits directly before each tracked allocation, 16 bytes to keep malloc alignment
+    struct alloc_header
+    {
+        u64 size;
+        u32 magic;
+        u16 tag;
+        u16 offset; // from the start of the underlying allocation to the user pointer
+    };
+    static_assert(sizeof(alloc_header) == 16, "alloc_header must preserve 16 byte alignment");
+
+    // static storage is zero initialised, so this is valid for allocations made before main
+    struct tag_counters
+    {
+        a_u64 live_bytes;
+        a_u64 high_water_bytes;
+        a_u32 live_allocs;
+        a_u64 total_allocs;
+        a_u64 frame_start_allocs;
+        a_u32 frame_allocs;
+    };
+
+    const c8* k_tag_names[] = {"general", "renderer", "ecs", "physics", "audio", "loader", "json", "ui"};
+    static_assert(PEN_ARRAY_SIZE(k_tag_names) == pen::e_mem_tag::COUNT, "mismatched memory tag names");
+
+    tag_counters              s_tags[pen::e_mem_tag::COUNT];
+    thread_local pen::mem_tag t_tag = pen::e_mem_tag::general;
+
+    void track_alloc(u32 tag, u64 size)
+    {
+        tag_counters& tc = s_tags[tag];
+        u64           live = tc.live_bytes.fetch_add(size, std::memory_order_relaxed) + size;
+
+        u64 hw = tc.high_water_bytes.load(std::memory_order_relaxed);
+        while (live > hw && !tc.high_water_bytes.compare_exchange_weak(hw, live, std::memory_order_relaxed))
+            ;
+
+        tc.live_allocs.fetch_add(1, std::memory_order_relaxed);
+        tc.total_allocs.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void track_free(u32 tag, u64 size)
+    {
+        s_tags[tag].live_bytes.fetch_sub(size, std::memory_order_relaxed);
+        s_tags[tag].live_allocs.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    void* track(void* base, size_t offset, size_t size)
+    {
+        u8*           mem = (u8*)base + offset;
+        alloc_header* h = (alloc_header*)mem - 1;
+        h->size = size;
+        h->magic = k_alloc_magic;
+        h->tag = (u16)t_tag;
+        h->offset = (u16)offset;
+
+        track_alloc(h->tag, size);
+        return mem;
+    }
+
+    alloc_header* header(void* mem)
+    {
+        alloc_header* h = (alloc_header*)mem - 1;
+        // memory from malloc or a third party allocator passed to memory_free
+        PEN_ASSERT(h->magic == k_alloc_magic);
+        return h;
+    }
+} // namespace
+
+namespace pen
+{
+    void* memory_alloc(size_t size_bytes)
+    {
+        void* base = malloc(size_bytes + sizeof(alloc_header));
+        if (!base)
+            return nullptr;
+
+        return track(base, sizeof(alloc_header), size_bytes);
+    }
+
+    void* memory_calloc(size_t count, size_t size_bytes)
+    {
+        void* mem = memory_alloc(count * size_bytes);
+        if (mem)
+            memset(mem, 0x0, count * size_bytes);
+
+        return mem;
+    }
+
+    void* memory_realloc(void* mem, size_t size_bytes)
+    {
+        if (!mem)
+            return memory_alloc(size_bytes);
+
+        alloc_header* h = header(mem);
+        PEN_ASSERT(h->offset == sizeof(alloc_header));
+
+        u32 tag = h->tag;
+        u64 prev_size = h->size;
+
+        void* base = realloc(h, size_bytes + sizeof(alloc_header));
+        if (!base)
+            return nullptr;
+
+        track_free(tag, prev_size);
+
+        h = (alloc_header*)base;
+        h->size = size_bytes;
+        track_alloc(tag, size_bytes);
+
+        return h + 1;
+    }
+
+    void memory_free(void* mem)
+    {
+        if (!mem)
+            return;
+
+        alloc_header* h = header(mem);
+        track_free(h->tag, h->size);
+        h->magic = 0;
+
+        free((u8*)mem - h->offset);
+    }
+
+    void* memory_alloc_align(size_t size_bytes, size_t alignment)
+    {
+        // pad by a whole alignment so the user pointer stays aligned
+        size_t pad = std::max<size_t>(alignment, sizeof(alloc_header));
+
+        void* base;
+        PEN_MEM_ALIGN_ALLOC(base, alignment, size_bytes + pad);
+        if (!base)
+            return nullptr;
+
+        return track(base, pad, size_bytes);
+    }
+
+    void memory_free_align(void* mem)
+    {
+        if (!mem)
+            return;
+
+        alloc_header* h = header(mem);
+        track_free(h->tag, h->size);
+        h->magic = 0;
+
+        PEN_MEM_ALIGN_FREE((u8*)mem - h->offset);
+    }
+
+    mem_tag memory_push_tag(mem_tag tag)
+    {
+        mem_tag prev = t_tag;
+        t_tag = tag;
+        return prev;
+    }
+
+    void memory_pop_tag(mem_tag prev)
+    {
+        t_tag = prev;
+    }
+
+    bool memory_get_tag_stats(memory_tag_stats* stats)
+    {
+        for (u32 i = 0; i < e_mem_tag::COUNT; ++i)
+        {
+            tag_counters& tc = s_tags[i];
+
+            stats[i].name = k_tag_names[i];
+            stats[i].live_bytes = (size_t)tc.live_bytes.load(std::memory_order_relaxed);
+            stats[i].high_water_bytes = (size_t)tc.high_water_bytes.load(std::memory_order_relaxed);
+            stats[i].live_allocs = tc.live_allocs.load(std::memory_order_relaxed);
+            stats[i].frame_allocs = tc.frame_allocs.load(std::memory_order_relaxed);
+            stats[i].total_allocs = tc.total_allocs.load(std::memory_order_relaxed);
+        }
+
+        return true;
+    }
+
+    void memory_tracking_new_frame()
+    {
+        for (u32 i = 0; i < e_mem_tag::COUNT; ++i)
+        {
+            tag_counters& tc = s_tags[i];
+
+            u64 total = tc.total_allocs.load(std::memory_order_relaxed);
+            tc.frame_allocs = (u32)(total - tc.frame_start_allocs.load(std::memory_order_relaxed));
+            tc.frame_start_allocs = total;
+        }
+    }
+
+    void memory_tracking_report()
+    {
+        PEN_LOG("[memory] live allocations at shutdown:");
+
+        for (u32 i = 0; i < e_mem_tag::COUNT; ++i)
+        {
+            tag_counters& tc = s_tags[i];
+
+            u32 live = tc.live_allocs.load();
+            if (live == 0)
+                continue;
+
+            PEN_LOG("[memory] %-10s %8i allocs %12llu bytes (high water %llu bytes)", k_tag_names[i], live,
+                    (unsigned long long)tc.live_bytes.load(), (unsigned long long)tc.high_water_bytes.load());
+        }
+    }
+} // namespace pen
+#endif
 
 // C++ standard says these must be in cpp file and not inline in header ;_;
 
@@ -0,0 +1,478 @@
+// renderer_null.cpp
+// Copyright 2014 - 2019 Alex Dixon.
+// License: https://github.com/polymonster/pmtech/blob/master/license.md
+
+// Headless backend which implements the direct:: api without a gpu.
+// Resources are tracked so handles and read backs behave, calls are counted so cpu side frame cost can be measured.
+
+#include "console.h"
+#include "data_struct.h"
+#include "memory.h"
+#include "pen.h"
+#include "renderer.h"
+#include "renderer_shared.h"
+#include "threads.h"
+
+extern pen::window_creation_params pen_window;
+
+using namespace pen;
+
+namespace
+{
+    enum e_null_resource
+    {
+        RES_NONE = 0,
+        RES_CLEAR_STATE,
+        RES_SHADER,
+        RES_INPUT_LAYOUT,
+        RES_SHADER_PROGRAM,
+        RES_BUFFER,
+        RES_TEXTURE,
+        RES_SAMPLER,
+        RES_RASTER_STATE,
+        RES_BLEND_STATE,
+        RES_DEPTH_STENCIL_STATE,
+        RES_RENDER_TARGET
+    };
+
+    struct resource_allocation
+    {
+        u32                     type;
+        u32                     size;
+        u8*                     data; // shadow copy for cpu readable buffers
+        texture_creation_params tcp;
+    };
+
+    res_pool<resource_allocation> _res_pool;
+    renderer_null_stats           _stats;
+    renderer_info                 _info;
+
+    void create_resource(u32 slot, u32 type)
+    {
+        _res_pool.grow(slot);
+        resource_allocation& res = _res_pool[slot];
+        res.type = type;
+        res.size = 0;
+        res.data = nullptr;
+
+        _stats.creates++;
+        _stats.live_resources++;
+    }
+
+    void release_resource(u32 slot)
+    {
+        resource_allocation& res = _res_pool[slot];
+        if (res.type == RES_NONE)
+            return;
+
+        memory_free(res.data);
+        res.data = nullptr;
+        res.type = RES_NONE;
+
+        _stats.releases++;
+        _stats.live_resources--;
+    }
+
+    void create_texture_resource(const texture_creation_params& tcp, u32 slot, u32 type)
+    {
+        create_resource(slot, type);
+        resource_allocation& res = _res_pool[slot];
+        res.tcp = tcp;
+        res.tcp.data = nullptr;
+    }
+} // namespace
+
+namespace pen
+{
+    a_u64 g_gpu_total;
+
+    const renderer_info& renderer_get_info()
+    {
+        return _info;
+    }
+
+    const c8* renderer_get_shader_platform()
+    {
+        // shaders are never compiled, use the linux shader data so assets load as they would on gpu machines
+        return "glsl";
+    }
+
+    bool renderer_viewport_vup()
+    {
+        return true;
+    }
+
+    void renderer_null_get_stats(renderer_null_stats& stats)
+    {
+        stats = _stats;
+    }
+
+    namespace direct
+    {
+        u32 renderer_initialise(void*, u32 bb_res, u32 bb_depth_res)
+        {
+            _res_pool.init(2048);
+
+            _info.api_version = "null";
+            _info.shader_version = "none";
+            _info.renderer = "null";
+            _info.vendor = "pmtech";
+            _info.renderer_cmd = "-renderer null";
+
+            // report everything as supported so all code paths are exercised
+            _info.caps = PEN_CAPS_TEXTURE_MULTISAMPLE | PEN_CAPS_DEPTH_CLAMP | PEN_CAPS_COMPUTE |
+                         PEN_CAPS_TEXTURE_CUBE_ARRAY | PEN_CAPS_TEX_FORMAT_BC1 | PEN_CAPS_TEX_FORMAT_BC2 |
+                         PEN_CAPS_TEX_FORMAT_BC3 | PEN_CAPS_TEX_FORMAT_BC4 | PEN_CAPS_TEX_FORMAT_BC5 |
+                         PEN_CAPS_TEX_FORMAT_BC6 | PEN_CAPS_TEX_FORMAT_BC7;
+
+            // backbuffer
+            texture_creation_params tcp = {};
+            tcp.width = pen_window.width;
+            tcp.height = pen_window.height;
+            tcp.num_mips = 1;
+            tcp.num_arrays = 1;
+            tcp.sample_count = pen_window.sample_count;
+            tcp.format = PEN_TEX_FORMAT_RGBA8_UNORM;
+            tcp.block_size = 32;
+            tcp.pixels_per_block = 1;
+            create_texture_resource(tcp, bb_res, RES_RENDER_TARGET);
+
+            tcp.format = PEN_TEX_FORMAT_D24_UNORM_S8_UINT;
+            create_texture_resource(tcp, bb_depth_res, RES_RENDER_TARGET);
+
+            return PEN_ERR_OK;
+        }
+
+        void renderer_shutdown()
+        {
+            if (_stats.live_resources > 2)
+                PEN_LOG("[null renderer] %llu resources alive at shutdown", _stats.live_resources - 2);
+        }
+
+        void renderer_sync()
+        {
+            // unused on this platform
+        }
+
+        void renderer_new_frame()
+        {
+            _renderer_new_frame();
+        }
+
+        void renderer_end_frame()
+        {
+            // advance the frame index so deferred releases are processed
+            _renderer_end_frame();
+        }
+
+        bool renderer_frame_valid()
+        {
+            return true;
+        }
+
+        void renderer_create_clear_state(const clear_state& cs, u32 resource_slot)
+        {
+            create_resource(resource_slot, RES_CLEAR_STATE);
+        }
+
+        void renderer_clear(u32 clear_state_index, u32 colour_slice, u32 depth_slice)
+        {
+            _stats.clears++;
+        }
+
+        void renderer_load_shader(const pen::shader_load_params& params, u32 resource_slot)
+        {
+            create_resource(resource_slot, RES_SHADER);
+        }
+
+        void renderer_set_shader(u32 shader_index, u32 shader_type)
+        {
+            _stats.state_changes++;
+        }
+
+        void renderer_create_input_layout(const input_layout_creation_params& params, u32 resource_slot)
+        {
+            create_resource(resource_slot, RES_INPUT_LAYOUT);
+        }
+
+        void renderer_set_input_layout(u32 layout_index)
+        {
+            _stats.state_changes++;
+        }
+
+        void renderer_link_shader_program(const shader_link_params& params, u32 resource_slot)
+        {
+            create_resource(resource_slot, RES_SHADER_PROGRAM);
+        }
+
+        void renderer_create_buffer(const buffer_creation_params& params, u32 resource_slot)
+        {
+            create_resource(resource_slot, RES_BUFFER);
+
+            resource_allocation& res = _res_pool[resource_slot];
+            res.size = params.buffer_size;
+
+            // keep contents of buffers which can be read back
+            if (params.cpu_access_flags & PEN_CPU_ACCESS_READ)
+            {
+                res.data = (u8*)memory_alloc(params.buffer_size);
+                memset(res.data, 0x0, params.buffer_size);
+
+                if (params.data)
+                    memcpy(res.data, params.data, params.buffer_size);
+            }
+        }
+
+        void renderer_set_vertex_buffers(u32* buffer_indices, u32 num_buffers, u32 start_slot, const u32* strides,
+                                         const u32* offsets)
+        {
+            _stats.state_changes++;
+        }
+
+        void renderer_set_index_buffer(u32 buffer_index, u32 format, u32 offset)
+        {
+            _stats.state_changes++;
+        }
+
+        void renderer_set_constant_buffer(u32 buffer_index, u32 resource_slot, u32 flags)
+        {
+            _stats.state_changes++;
+        }
+
+        void renderer_set_structured_buffer(u32 buffer_index, u32 resource_slot, u32 flags)
+        {
+            _stats.state_changes++;
+        }
+
+        void renderer_update_buffer(u32 buffer_index, const void* data, u32 data_size, u32 offset)
+        {
+            _stats.buffer_updates++;
+            _stats.buffer_update_bytes += data_size;
+
+            resource_allocation& res = _res_pool[buffer_index];
+            if (res.data && offset + data_size <= res.size)
+                memcpy(res.data + offset, data, data_size);
+        }
+
+        void renderer_create_texture(const texture_creation_params& tcp, u32 resource_slot)
+        {
+            create_texture_resource(tcp, resource_slot, RES_TEXTURE);
+        }
+
+        void renderer_create_sampler(const sampler_creation_params& scp, u32 resource_slot)
+        {
+            create_resource(resource_slot, RES_SAMPLER);
+        }
+
+        void renderer_set_texture(u32 texture_index, u32 sampler_index, u32 resource_slot, u32 bind_flags)
+        {
+            _stats.state_changes++;
+        }
+
+        void renderer_create_rasterizer_state(const rasteriser_state_creation_params& rscp, u32 resource_slot)
+        {
+            create_resource(resource_slot, RES_RASTER_STATE);
+        }
+
+        void renderer_set_rasterizer_state(u32 rasterizer_state_index)
+        {
+            _stats.state_changes++;
+        }
+
+        void renderer_set_viewport(const viewport& vp)
+        {
+            _stats.state_changes++;
+        }
+
+        void renderer_set_scissor_rect(const rect& r)
+        {
+            _stats.state_changes++;
+        }
+
+        void renderer_create_blend_state(const blend_creation_params& bcp, u32 resource_slot)
+        {
+            create_resource(resource_slot, RES_BLEND_STATE);
+        }
+
+        void renderer_set_blend_state(u32 blend_state_index)
+        {
+            _stats.state_changes++;
+        }
+
+        void renderer_create_depth_stencil_state(const depth_stencil_creation_params& dscp, u32 resource_slot)
+        {
+            create_resource(resource_slot, RES_DEPTH_STENCIL_STATE);
+        }
+
+        void renderer_set_depth_stencil_state(u32 depth_stencil_state)
+        {
+            _stats.state_changes++;
+        }
+
+        void renderer_set_stencil_ref(u8 ref)
+        {
+            _stats.state_changes++;
+        }
+
+        void renderer_draw(u32 vertex_count, u32 start_vertex, u32 primitive_topology)
+        {
+            _stats.draws++;
+        }
+
+        void renderer_draw_indexed(u32 index_count, u32 start_index, u32 base_vertex, u32 primitive_topology)
+        {
+            _stats.indexed_draws++;
+        }
+
+        void renderer_draw_indexed_instanced(u32 instance_count, u32 start_instance, u32 index_count, u32 start_index,
+                                             u32 base_vertex, u32 primitive_topology)
+        {
+            _stats.instanced_draws++;
+        }
+
+        void renderer_draw_auto()
+        {
+            _stats.draws++;
+        }
+
+        void renderer_dispatch_compute(uint3 grid, uint3 num_threads)
+        {
+            _stats.dispatches++;
+        }
+
+        void renderer_create_render_target(const texture_creation_params& tcp, u32 resource_slot, bool track)
+        {
+            PEN_ASSERT(tcp.width != 0 && tcp.height != 0);
+
+            if (track)
+                _renderer_track_managed_render_target(tcp, resource_slot);
+
+            texture_creation_params _tcp = _renderer_tcp_resolve_ratio(tcp);
+            create_texture_resource(_tcp, resource_slot, RES_RENDER_TARGET);
+        }
+
+        void renderer_set_targets(const u32* const colour_targets, u32 num_colour_targets, u32 depth_target,
+                                  u32 colour_slice, u32 depth_slice)
+        {
+            _stats.state_changes++;
+        }
+
+        void renderer_set_resolve_targets(u32 colour_target, u32 depth_target)
+        {
+            _stats.state_changes++;
+        }
+
+        void renderer_set_stream_out_target(u32 buffer_index)
+        {
+            _stats.state_changes++;
+        }
+
+        void renderer_resolve_target(u32 target, e_msaa_resolve_type type, resolve_resources res)
+        {
+            _stats.draws++;
+        }
+
+        void renderer_read_back_resource(const resource_read_back_params& rrbp)
+        {
+            _stats.read_backs++;
+
+            resource_allocation& res = _res_pool[rrbp.resource_index];
+
+            // buffers return their contents, anything else a pattern derived from the handle so tests are repeatable
+            u8* data = (u8*)memory_alloc(rrbp.data_size);
+            if (res.data)
+            {
+                u32 size = min<u32>(rrbp.data_size, res.size);
+                memcpy(data, res.data, size);
+                memset(data + size, 0x0, rrbp.data_size - size);
+            }
+            else
+            {
+                for (u32 i = 0; i < rrbp.data_size; ++i)
+                    data[i] = (u8)((i * 31) ^ rrbp.resource_index);
+            }
+
+            rrbp.call_back_function(data, rrbp.row_pitch, rrbp.depth_pitch, rrbp.block_size);
+            memory_free(data);
+        }
+
+        void renderer_present()
+        {
+            _stats.frames++;
+        }
+
+        void renderer_push_perf_marker(const c8* name)
+        {
+            // unused on this platform
+        }
+
+        void renderer_pop_perf_marker()
+        {
+            // unused on this platform
+        }
+
+        void renderer_replace_resource(u32 dest, u32 src, e_renderer_resource type)
+        {
+            if (type == RESOURCE_RENDER_TARGET)
+                _renderer_untrack_managed_render_target(dest);
+
+            release_resource(dest);
+            _res_pool[dest] = _res_pool[src];
+
+            // src handle is now owned by dest
+            _res_pool[src].type = RES_NONE;
+            _res_pool[src].data = nullptr;
+        }
+
+        void renderer_release_shader(u32 shader_index, u32 shader_type)
+        {
+            release_resource(shader_index);
+        }
+
+        void renderer_release_clear_state(u32 clear_state)
+        {
+            release_resource(clear_state);
+        }
+
+        void renderer_release_buffer(u32 buffer_index)
+        {
+            release_resource(buffer_index);
+        }
+
+        void renderer_release_texture(u32 texture_index)
+        {
+            release_resource(texture_index);
+        }
+
+        void renderer_release_sampler(u32 sampler)
+        {
+            release_resource(sampler);
+        }
+
+        void renderer_release_raster_state(u32 raster_state_index)
+        {
+            release_resource(raster_state_index);
+        }
+
+        void renderer_release_blend_state(u32 blend_state)
+        {
+            release_resource(blend_state);
+        }
+
+        void renderer_release_render_target(u32 render_target)
+        {
+            _renderer_untrack_managed_render_target(render_target);
+            release_resource(render_target);
+        }
+
+        void renderer_release_input_layout(u32 input_layout)
+        {
+            release_resource(input_layout);
+        }
+
+        void renderer_release_depth_stencil_state(u32 depth_stencil_state)
+        {
+            release_resource(depth_stencil_state);
+        }
+    } // namespace direct
+} // namespace pen
@@ -5,27 +5,60 @@
 #include "pen_json.h"
 #include "../third_party/jsmn/jsmn.c"
 #include "console.h"
+#include "data_struct.h"
 #include "file_system.h"
 #include "memory.h"
 #include "pen_string.h"
 #include "str_utilities.h"
 
+#include <fstream>
+
 using namespace pen;
 
 namespace pen
 {
-    struct json_object
+    struct json_node
     {
-        jsmntok_t* tokens;
-        s32        num_tokens;
-        c8*        data;
-        u32        size;
-        c8*        name;
+        u32 type;   // jsmntype_t
+        u32 start;  // source range in text
+        u32 end;    //
+        u32 size;   // number of members or elements
+        u32 offset; // objects and arrays: first child in children, primitives and strings: null terminated in strings
+    };
 
-        json_object get_object_by_name(const c8* name);
-        json_object get_object_by_index(const u32 index);
+    struct json_key
+    {
+        u32 object;
+        u32 hash;
+        u32 node; // key node, the value is node + 1, 0 is empty
+    };
 
-        Str get_name() const;
+    // header of the single allocation which holds a parsed document, it is also the binary file format
+    struct json_block
+    {
+        u32 magic;
+        u32 version;
+        u32 block_size;
+        u32 num_nodes;
+        u32 table_capacity;
+
+        // offsets from the start of the block
+        u32 nodes;
+        u32 children;
+        u32 table;
+        u32 text;
+        u32 strings;
+    };
+
+    struct json_doc
+    {
+        a_u32       ref_count;
+        json_block* block;
+        json_node*  nodes;
+        u32*        children; // object children are the key nodes
+        json_key*   table;    // open addressed (object, key hash) lookup
+        c8*         text;
+        c8*         strings;
     };
 } // namespace pen
 
@@ -39,396 +72,367 @@ namespace
 #define NON_STRICT_NAME(V)
 #define JSON_NAME NON_STRICT_NAME
 
-    union json_value {
-        bool        b;
-        u32         u;
-        s32         s;
-        f32         f;
-        u64         ul;
-        s64         sl;
-        const c8*   str;
-        json_object object;
-    };
+    const u32 k_json_binary_magic = 0x42534a50; // PJSB
+    const u32 k_json_binary_version = 1;
 
-    enum PRIMITIVE_TYPE
+    u32 align_4(u32 v)
     {
-        JSON_STR = 0,
-        JSON_U32,
-        JSON_S32,
-        JSON_F32,
-        JSON_U32_HEX,
-        JSON_BOOL,
-        JSON_U64,
-        JSON_S64
-    };
+        return (v + 3) & ~3;
+    }
 
-    struct enumerate_params
+    bool is_container(const json_node& n)
     {
-        bool       get_next;
-        int        return_value;
-        jsmntok_t* name_token;
-    };
+        return n.type == JSMN_OBJECT || n.type == JSMN_ARRAY;
+    }
+
+    json_doc* create_doc(json_block* block)
+    {
+        u8* base = (u8*)block;
 
-    void create_json_object(json_object& jo);
+        json_doc* doc = new json_doc;
+        doc->ref_count = 1;
+        doc->block = block;
+        doc->nodes = (json_node*)(base + block->nodes);
+        doc->children = (u32*)(base + block->children);
+        doc->table = (json_key*)(base + block->table);
+        doc->text = (c8*)(base + block->text);
+        doc->strings = (c8*)(base + block->strings);
+        return doc;
+    }
 
-    int jsoneq(const char* json, jsmntok_t* tok, const char* s)
+    bool is_binary_block(const void* data, u32 size)
     {
-        if ((int)strlen(s) == tok->end - tok->start && strncmp(json + tok->start, s, tok->end - tok->start) == 0)
+        const json_block* block = (const json_block*)data;
+        if (size < sizeof(json_block) || block->magic != k_json_binary_magic)
+            return false;
+
+        if (block->version != k_json_binary_version || block->block_size != size || block->num_nodes == 0)
         {
-            return 0;
+            PEN_LOG("Failed to load binary JSON: version %i size %i\n", block->version, size);
+            return false;
         }
-        return -1;
+
+        return block->strings <= size && block->text <= block->strings && block->table <= block->text;
     }
 
-    int _dump(Str& output, const char* js, jsmntok_t* t, size_t count, int indent)
+    u32 key_slot(u32 object, u32 hash, u32 capacity)
     {
-        int i, j, k;
-        if (count == 0)
-        {
-            return 0;
-        }
-        if (t->type == JSMN_PRIMITIVE || t->type == JSMN_STRING)
-        {
-            if (t->type == JSMN_STRING)
-                output.append('\"');
+        return hash_table_index(hash ^ object, capacity);
+    }
 
-            for (s32 c = 0; c < t->end - t->start; ++c)
-                output.append(*(js + t->start + c));
+    void insert_key(json_doc* doc, u32 object, u32 key)
+    {
+        u32 mask = doc->block->table_capacity - 1;
+        u32 hash = PEN_HASH(doc->strings + doc->nodes[key].offset);
 
-            if (t->type == JSMN_STRING)
-                output.append('\"');
-            return 1;
-        }
-        else if (t->type == JSMN_OBJECT)
-        {
-            output.append("\n");
-            for (k = 0; k < indent; k++)
-                output.append("\t");
-            output.append("{\n");
-            j = 0;
-            for (i = 0; i < t->size; i++)
-            {
-                for (k = 0; k < indent + 1; k++)
-                    output.append("\t");
-                j += _dump(output, js, t + 1 + j, count - j, indent + 1);
-                output.append(": ");
-                j += _dump(output, js, t + 1 + j, count - j, indent + 1);
-                output.append(",\n");
-            }
-            for (k = 0; k < indent; k++)
-                output.append("\t");
-            output.append("}");
-            return j + 1;
-        }
-        else if (t->type == JSMN_ARRAY)
-        {
-            j = 0;
-            output.append("[");
-            for (i = 0; i < t->size; i++)
-            {
-                j += _dump(output, js, t + 1 + j, count - j, indent + 1);
-                if (i < t->size - 1)
-                    output.append(", ");
-            }
-            output.append("]");
-            return j + 1;
-        }
-        return 0;
+        // keys are inserted in document order, so the first of any duplicates is found first
+        u32 i = key_slot(object, hash, doc->block->table_capacity);
+        while (doc->table[i].node)
+            i = (i + 1) & mask;
+
+        doc->table[i] = {object, hash, key};
     }
 
-    bool enumerate_primitve(const char* js, jsmntok_t* t, json_value& result, PRIMITIVE_TYPE type)
+    u32 find_key(const json_doc* doc, u32 object, const c8* name)
     {
-        if (t->type == JSMN_PRIMITIVE)
-        {
-            switch (type)
-            {
-                case JSON_STR:
-                    result.str = js;
-                    break;
-
-                case JSON_U32:
-                case JSON_S32:
-                case JSON_U64:
-                case JSON_S64:
-                {
-                    c8* tok_str = pen::sub_string(js + t->start, t->end - t->start);
-                    result.ul = atoll(tok_str);
-                    pen::memory_free(tok_str);
-                }
-                break;
+        u32 capacity = doc->block->table_capacity;
+        if (capacity == 0)
+            return 0;
 
-                case JSON_U32_HEX:
-                {
-                    c8* tok_str = pen::sub_string(js + t->start, t->end - t->start);
-                    result.u = strtol(tok_str, NULL, 16);
-                    pen::memory_free(tok_str);
-                    break;
-                }
-                case JSON_F32:
-                {
-                    c8* tok_str = pen::sub_string(js + t->start, t->end - t->start);
-                    result.f = (f32)atof(tok_str);
-                    pen::memory_free(tok_str);
-                }
-                break;
-                case JSON_BOOL:
-                    if (*(js + t->start) == 't')
-                    {
-                        result.b = true;
-                        return true;
-                    }
-                    else if (*(js + t->start) == 'f')
-                    {
-                        result.b = false;
-                        return true;
-                    }
-                    return false;
-                    break;
-            }
+        u32 mask = capacity - 1;
+        u32 hash = PEN_HASH(name);
 
-            return true;
+        u32 i = key_slot(object, hash, capacity);
+        while (doc->table[i].node)
+        {
+            const json_key& k = doc->table[i];
+            if (k.object == object && k.hash == hash && strcmp(doc->strings + doc->nodes[k.node].offset, name) == 0)
+                return k.node;
+
+            i = (i + 1) & mask;
         }
 
-        return false;
+        return 0;
     }
 
-    bool is_key(const char* js, size_t jsize, jsmntok_t* t, size_t count)
+    u32 build_children(json_doc* doc, u32 t, u32& next_child)
     {
-        if (count < 1)
-            return false;
+        u32 num_nodes = doc->block->num_nodes;
+        if (t >= num_nodes)
+            return 0;
+
+        json_node& n = doc->nodes[t];
+        if (!is_container(n))
+            return 1;
 
-        jsmntok_t* next = t + 1;
+        n.offset = next_child;
+        next_child += n.size;
 
-        u32 num = next->start - t->end;
+        u32 j = 1;
+        for (u32 i = 0; i < n.size && t + j < num_nodes; ++i)
+        {
+            doc->children[n.offset + i] = t + j;
 
-        static c8 buf[64];
-        pen::sub_string(js + t->end, buf, std::min<u32>(num, 63));
+            if (n.type == JSMN_OBJECT)
+            {
+                insert_key(doc, t, t + j);
+                j += build_children(doc, t + j, next_child);
+            }
 
-        for (u32 i = 0; i <= num; ++i)
-            if (buf[i] == ':')
-                return true;
+            j += build_children(doc, t + j, next_child);
+        }
 
-        return false;
+        return j;
     }
 
-    int enumerate(const char* js, size_t jsize, jsmntok_t* t, size_t count, int indent, const c8* search_name,
-                  s32 search_index, json_value& result, enumerate_params& ep)
+    json_doc* parse_doc(const c8* data, u32 size)
     {
-        if (ep.return_value != 0)
-            return ep.return_value;
-
-        int i, j;
-        if (count == 0)
-            return 0;
-
-        if (t->type == JSMN_PRIMITIVE)
+        // count tokens first so they are allocated once
+        jsmn_parser p;
+        jsmn_init(&p);
+        s32 num_tokens = jsmn_parse(&p, data, size, nullptr, 0);
+        if (num_tokens <= 0)
         {
-            if (result.object.name)
-                pen::memory_free(result.object.name);
+            if (num_tokens < 0)
+                PEN_LOG("Failed to parse JSON: %d\n", num_tokens);
+
+            return nullptr;
+        }
 
-            result.object.name = pen::sub_string(js + t->start, t->end - t->start);
+        jsmntok_t* tokens = (jsmntok_t*)memory_alloc(sizeof(jsmntok_t) * num_tokens);
+        jsmn_init(&p);
+        jsmn_parse(&p, data, size, tokens, num_tokens);
 
-            if (indent == 1)
+        u32 num_children = 0;
+        u32 num_keys = 0;
+        u32 strings_size = 0;
+        for (s32 i = 0; i < num_tokens; ++i)
+        {
+            if (tokens[i].type == JSMN_OBJECT || tokens[i].type == JSMN_ARRAY)
             {
-                if (search_name == nullptr)
-                {
-                    ep.get_next = true;
-                }
-                else if (jsoneq(js, t, search_name) == 0)
-                {
-                    if (is_key(js, jsize, t, count))
-                        ep.get_next = true;
-                }
+                num_children += tokens[i].size;
+                if (tokens[i].type == JSMN_OBJECT)
+                    num_keys += tokens[i].size;
+            }
+            else
+            {
+                strings_size += tokens[i].end - tokens[i].start + 1;
             }
-            return 1;
         }
-        else if (t->type == JSMN_STRING)
+
+        // keep load at or below 1/2 so probes are short and always terminate
+        u32 table_capacity = 0;
+        if (num_keys)
         {
-            if (result.object.name)
-                pen::memory_free(result.object.name);
+            table_capacity = 2;
+            while (table_capacity < num_keys * 2)
+                table_capacity <<= 1;
+        }
 
-            result.object.name = pen::sub_string(js + t->start, t->end - t->start);
+        u32 offset = align_4(sizeof(json_block));
+        u32 nodes_offset = offset;
+        offset += sizeof(json_node) * num_tokens;
+        u32 children_offset = offset;
+        offset += sizeof(u32) * num_children;
+        u32 table_offset = offset;
+        offset += sizeof(json_key) * table_capacity;
+        u32 text_offset = offset;
+        offset += size + 1;
+        u32 strings_offset = offset;
+        offset = align_4(offset + strings_size);
+
+        json_block* block = (json_block*)memory_alloc(offset);
+        memset(block, 0x0, offset);
+
+        block->magic = k_json_binary_magic;
+        block->version = k_json_binary_version;
+        block->block_size = offset;
+        block->num_nodes = num_tokens;
+        block->table_capacity = table_capacity;
+        block->nodes = nodes_offset;
+        block->children = children_offset;
+        block->table = table_offset;
+        block->text = text_offset;
+        block->strings = strings_offset;
+
+        json_doc* doc = create_doc(block);
+        memcpy(doc->text, data, size);
+
+        u32 next_string = 0;
+        for (s32 i = 0; i < num_tokens; ++i)
+        {
+            json_node& n = doc->nodes[i];
+            n.type = tokens[i].type;
+            n.start = tokens[i].start;
+            n.end = tokens[i].end;
+            n.size = tokens[i].size;
 
-            if (indent == 1)
+            if (!is_container(n))
             {
-                if (search_name == nullptr)
-                {
-                    ep.get_next = true;
-                }
-                else if (jsoneq(js, t, search_name) == 0)
-                {
-                    if (is_key(js, jsize, t, count))
-                        ep.get_next = true;
-                }
+                u32 len = n.end - n.start;
+                n.offset = next_string;
+                memcpy(doc->strings + next_string, data + n.start, len);
+                next_string += len + 1;
             }
-            return 1;
         }
-        else if (t->type == JSMN_OBJECT)
-        {
-            j = 0;
-            for (i = 0; i < t->size; i++)
-            {
-                j += enumerate(js, jsize, t + 1 + j, count - j, indent + 1, search_name, search_index, result, ep);
 
-                if ((indent == 0 && search_index == i) || ep.get_next)
-                {
-                    jsmntok_t* at = t + 1 + j;
+        memory_free(tokens);
 
-                    result.object.data = pen::sub_string(js + at->start, at->end - at->start);
-                    result.object.size = at->end - at->start;
+        u32 next_child = 0;
+        build_children(doc, 0, next_child);
 
-                    create_json_object(result.object);
+        return doc;
+    }
 
-                    ep.return_value = 1;
-                    ep.get_next = false;
-                    return 1;
-                }
+    void _dump(Str& output, const json_doc* doc, u32 t, int indent)
+    {
+        const json_node& n = doc->nodes[t];
 
-                j += enumerate(js, jsize, t + 1 + j, count - j, indent + 1, search_name, search_index, result, ep);
-            }
-            return j + 1;
+        if (n.type == JSMN_PRIMITIVE || n.type == JSMN_STRING)
+        {
+            if (n.type == JSMN_STRING)
+                output.append('\"');
+
+            output.append(doc->text + n.start, doc->text + n.end);
+
+            if (n.type == JSMN_STRING)
+                output.append('\"');
         }
-        else if (t->type == JSMN_ARRAY)
+        else if (n.type == JSMN_OBJECT)
         {
-            if (ep.get_next)
+            output.append("\n");
+            for (s32 k = 0; k < indent; k++)
+                output.append("\t");
+            output.append("{\n");
+            for (u32 i = 0; i < n.size; i++)
             {
-                result.object.data = pen::sub_string(js + t->start, t->end - t->start);
-                result.object.size = t->end - t->start;
-
-                create_json_object(result.object);
+                u32 key = doc->children[n.offset + i];
 
-                ep.return_value = 1;
-                ep.get_next = false;
-                return 1;
+                for (s32 k = 0; k < indent + 1; k++)
+                    output.append("\t");
+                _dump(output, doc, key, indent + 1);
+                output.append(": ");
+                if (key + 1 < doc->block->num_nodes)
+                    _dump(output, doc, key + 1, indent + 1);
+                output.append(",\n");
             }
-
-            j = 0;
-            for (i = 0; i < t->size; i++)
+            for (s32 k = 0; k < indent; k++)
+                output.append("\t");
+            output.append("}");
+        }
+        else if (n.type == JSMN_ARRAY)
+        {
+            output.append("[");
+            for (u32 i = 0; i < n.size; i++)
             {
-                if (indent == 0 && search_index == i)
-                {
-                    jsmntok_t* at = t + 1 + j;
-
-                    result.object.data = pen::sub_string(js + at->start, at->end - at->start);
-                    result.object.size = at->end - at->start;
-
-                    create_json_object(result.object);
-
-                    ep.return_value = 1;
-                    ep.get_next = false;
-                    return 1;
-                }
-
-                j += enumerate(js, jsize, t + 1 + j, count - j, indent + 1, search_name, search_index, result, ep);
+                _dump(output, doc, doc->children[n.offset + i], indent + 1);
+                if (i < n.size - 1)
+                    output.append(", ");
             }
-            return j + 1;
+            output.append("]");
         }
-
-        return ep.return_value;
     }
 
-    bool as_value(json_value& jv, json_object* jo, PRIMITIVE_TYPE type)
+    // strings are re-tokenised values in the old api, so quoted numbers and bools convert the same as unquoted ones
+    const c8* primitive_str(const json_doc* doc, u32 t)
     {
-        if (jo->num_tokens <= 0 || jo->num_tokens > 1)
-        {
-            if (type == JSON_STR && jo->data)
-            {
-                jv.str = jo->data;
-                return true;
-            }
+        if (!doc)
+            return nullptr;
 
-            return false;
-        }
+        const json_node& n = doc->nodes[t];
+        if (is_container(n) || n.end == n.start)
+            return nullptr;
 
-        return enumerate_primitve(jo->data, jo->tokens, jv, type);
+        return doc->strings + n.offset;
     }
 
-    json_object get_object(json_object* jo, const c8* name, s32 index)
+    bool is_digit(c8 c)
     {
-        json_value jv;
-        jv.object.name = nullptr;
-        jv.object.tokens = nullptr;
-        jv.object.data = nullptr;
-        jv.object.num_tokens = 0;
+        return c >= '0' && c <= '9';
+    }
 
-        if (jo == NULL)
-            return jv.object;
+    // same results as atoll without the temp string
+    s64 parse_s64(const c8* s)
+    {
+        const c8* p = s;
 
-        enumerate_params ep = {false, 0, nullptr};
+        bool neg = false;
+        if (*p == '-' || *p == '+')
+            neg = *p++ == '-';
 
-        enumerate(jo->data, jo->size, jo->tokens, jo->num_tokens, 0, name, index, jv, ep);
+        u64 v = 0;
+        while (is_digit(*p))
+            v = v * 10 + (*p++ - '0');
 
-        return jv.object;
+        return neg ? -(s64)v : (s64)v;
     }
 
-    void create_json_object(json_object& jo)
+    // fast path for decimals which are exact in a double, anything else goes through strtod
+    f32 parse_f32(const c8* s)
     {
-        jsmn_parser p;
+        static const f64 k_pow10[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+                                      1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+        const c8* p = s;
 
-        // default try 64 tokens
-        u32 token_count = 64;
-        jo.tokens = new jsmntok_t[token_count];
+        bool neg = false;
+        if (*p == '-' || *p == '+')
+            neg = *p++ == '-';
+
+        u64 mantissa = 0;
+        s32 exponent = 0;
+        u32 digits = 0;
+        while (is_digit(*p))
+        {
+            mantissa = mantissa * 10 + (*p++ - '0');
+            ++digits;
+        }
 
-        bool loaded = false;
-        while (!loaded)
+        if (*p == '.')
         {
-            jsmn_init(&p);
-            jo.num_tokens = jsmn_parse(&p, jo.data, jo.size, jo.tokens, token_count);
-            if (jo.num_tokens < JSMN_ERROR_NOMEM)
+            ++p;
+            while (is_digit(*p))
             {
-                PEN_LOG("Failed to parse JSON: %d\n", jo.num_tokens);
-                break;
+                mantissa = mantissa * 10 + (*p++ - '0');
+                --exponent;
+                ++digits;
             }
-            else if (jo.num_tokens == JSMN_ERROR_NOMEM)
-            {
-                // allocate space for more tokens
-                delete jo.tokens;
+        }
+
+        if ((*p == 'e' || *p == 'E') && digits > 0)
+        {
+            ++p;
 
-                token_count <<= 1;
-                jo.tokens = new jsmntok_t[token_count];
+            bool exp_neg = false;
+            if (*p == '-' || *p == '+')
+                exp_neg = *p++ == '-';
 
-                continue;
-            }
+            s32 e = 0;
+            while (is_digit(*p) && e < 1000)
+                e = e * 10 + (*p++ - '0');
 
-            loaded = true;
-            break;
+            exponent += exp_neg ? -e : e;
         }
 
-        if (!loaded)
-        {
-            delete jo.tokens;
-            jo.tokens = nullptr;
+        if (*p != '\0' || digits == 0 || digits > 15 || exponent < -22 || exponent > 22)
+            return (f32)strtod(s, nullptr);
 
-            jo.num_tokens = 0;
+        f64 v = (f64)mantissa;
+        v = exponent < 0 ? v / k_pow10[-exponent] : v * k_pow10[exponent];
 
-            pen::memory_free(jo.data);
-            jo.data = nullptr;
-        }
+        return (f32)(neg ? -v : v);
     }
 } // namespace
 
 namespace pen
 {
-    Str json_object::get_name() const
-    {
-        return Str(this->name);
-    }
-
-    json_object json_object::get_object_by_name(const c8* name)
-    {
-        return get_object(this, name, -1);
-    }
-
-    json_object json_object::get_object_by_index(const u32 index)
-    {
-        return get_object(this, "__unused_ai__", index);
-    }
-
     //------------------------------------------------------------------------------
     // C++ Public API
     //------------------------------------------------------------------------------
     json json::load_from_file(const c8* filename)
     {
+        PEN_MEMORY_TAG(e_mem_tag::json);
+
         json new_json;
 
         void* data = nullptr;
@@ -438,12 +442,15 @@ namespace pen
 
         if (err == PEN_ERR_OK)
         {
-            new_json.m_internal_object = (json_object*)memory_alloc(sizeof(json_object));
-            new_json.m_internal_object->data = (c8*)data;
-            new_json.m_internal_object->size = size;
-            new_json.m_internal_object->name = nullptr;
+            if (is_binary_block(data, size))
+            {
+                // the file buffer is the block
+                new_json.m_doc = create_doc((json_block*)data);
+                return new_json;
+            }
 
-            create_json_object(*new_json.m_internal_object);
+            new_json.m_doc = parse_doc((const c8*)data, size);
+            pen::memory_free(data);
         }
 
         return new_json;
@@ -451,18 +458,32 @@ namespace pen
 
     json json::load(const c8* json_str)
     {
+        PEN_MEMORY_TAG(e_mem_tag::json);
+
         json new_json;
+        new_json.m_doc = parse_doc(json_str, pen::string_length(json_str));
 
-        new_json.m_internal_object = (json_object*)memory_alloc(sizeof(json_object));
+        return new_json;
+    }
 
-        new_json.m_internal_object->data = pen::sub_string(json_str, pen::string_length(json_str));
+    bool json::save_binary(const c8* filename) const
+    {
+        if (!m_doc)
+            return false;
 
-        new_json.m_internal_object->size = pen::string_length(json_str);
-        new_json.m_internal_object->name = nullptr;
+        // members are saved as a document of their own
+        if (m_node != 0)
+        {
+            json sub = load(as_cstr());
+            return sub.save_binary(filename);
+        }
 
-        create_json_object(*new_json.m_internal_object);
+        std::ofstream ofs(filename, std::ofstream::binary);
+        if (!ofs.is_open())
+            return false;
 
-        return new_json;
+        ofs.write((const c8*)m_doc->block, m_doc->block->block_size);
+        return true;
     }
 
     enum combine_action
@@ -474,6 +495,8 @@ namespace pen
 
     json json::combine(const json& j1, const json& j2, s32 indent)
     {
+        PEN_MEMORY_TAG(e_mem_tag::json);
+
         // iterate member wise
         s32 s1 = j1.size();
         s32 s2 = j2.size();
@@ -533,7 +556,7 @@ namespace pen
                 JSON_NAME(json_string);
 
                 json_string.append(": ");
-                json_string.append(j1[i].m_internal_object->data);
+                json_string.append(j1[i].as_cstr());
                 json_string.append(",\n");
             }
 
@@ -564,7 +587,7 @@ namespace pen
                 JSON_NAME(json_string);
 
                 json_string.append(": ");
-                json_string.append(j2[i].m_internal_object->data);
+                json_string.append(j2[i].as_cstr());
                 json_string.append(",\n");
             }
         }
@@ -583,9 +606,8 @@ namespace pen
 
     u32 json::size() const
     {
-        if (m_internal_object->num_tokens > 0)
-            if (m_internal_object->tokens[0].type == JSMN_ARRAY || m_internal_object->tokens[0].type == JSMN_OBJECT)
-                return m_internal_object->tokens[0].size;
+        if (m_doc && is_container(m_doc->nodes[m_node]))
+            return m_doc->nodes[m_node].size;
 
         return 0;
     }
@@ -593,20 +615,43 @@ namespace pen
     json json::operator[](const c8* name) const
     {
         json new_json;
+        if (!m_doc || m_doc->nodes[m_node].type != JSMN_OBJECT)
+            return new_json;
 
-        new_json.m_internal_object = (json_object*)memory_alloc(sizeof(json_object));
+        u32 key = find_key(m_doc, m_node, name);
+        if (key == 0 || key + 1 >= m_doc->block->num_nodes)
+            return new_json;
 
-        *new_json.m_internal_object = m_internal_object->get_object_by_name(name);
+        m_doc->ref_count++;
+        new_json.m_doc = m_doc;
+        new_json.m_key = key;
+        new_json.m_node = key + 1;
         return new_json;
     }
 
     json json::operator[](const u32 index) const
     {
         json new_json;
+        if (index >= size())
+            return new_json;
+
+        const json_node& n = m_doc->nodes[m_node];
+        u32              child = m_doc->children[n.offset + index];
+
+        u32 key = 0;
+        if (n.type == JSMN_OBJECT)
+        {
+            key = child;
+            child = key + 1;
+        }
 
-        new_json.m_internal_object = (json_object*)memory_alloc(sizeof(json_object));
+        if (child >= m_doc->block->num_nodes)
+            return new_json;
 
-        *new_json.m_internal_object = m_internal_object->get_object_by_index(index);
+        m_doc->ref_count++;
+        new_json.m_doc = m_doc;
+        new_json.m_key = key;
+        new_json.m_node = child;
         return new_json;
     }
 
@@ -617,44 +662,38 @@ namespace pen
 
     json::json()
     {
-        m_internal_object = nullptr;
+        m_doc = nullptr;
+        m_node = 0;
+        m_key = 0;
+        m_text = nullptr;
     }
 
     void json::copy(json* dst, const json& other)
     {
-        dst->m_internal_object = nullptr;
-
-        if (other.m_internal_object == nullptr)
-            return;
-
-        dst->m_internal_object = (json_object*)memory_alloc(sizeof(json_object));
+        // the parsed document is shared
+        dst->m_doc = other.m_doc;
+        dst->m_node = other.m_node;
+        dst->m_key = other.m_key;
+        dst->m_text = nullptr;
 
-        // shallow copy default copy ctor
-        *dst->m_internal_object = *other.m_internal_object;
+        if (dst->m_doc)
+            dst->m_doc->ref_count++;
+    }
 
-        u32 num_tokens = other.m_internal_object->num_tokens;
-        dst->m_internal_object->tokens = new jsmntok_t[num_tokens];
-        memcpy(dst->m_internal_object->tokens, other.m_internal_object->tokens, sizeof(jsmntok_t) * num_tokens);
+    void json::release()
+    {
+        pen::memory_free(m_text);
+        m_text = nullptr;
 
-        // deep copy take ownership of mem
-        if (other.m_internal_object->data)
+        if (m_doc && --m_doc->ref_count == 0)
         {
-            s32 data_size = string_length(other.m_internal_object->data);
-
-            dst->m_internal_object->data = (c8*)memory_alloc(data_size + 1);
-            memcpy(dst->m_internal_object->data, other.m_internal_object->data, data_size);
-            dst->m_internal_object->data[data_size] = '\0';
+            pen::memory_free(m_doc->block);
+            delete m_doc;
         }
 
-        // take ownership of name
-        if (other.m_internal_object->name)
-        {
-            s32 name_size = string_length(other.m_internal_object->name);
-            m_internal_object->name = (c8*)memory_alloc(name_size + 1);
-            m_internal_object->name[name_size] = '\0';
-
-            memcpy(m_internal_object->name, other.m_internal_object->name, name_size);
-        }
+        m_doc = nullptr;
+        m_node = 0;
+        m_key = 0;
     }
 
     json::json(const json& other)
@@ -664,6 +703,10 @@ namespace pen
 
     json& json::operator=(const json& other)
     {
+        if (this == &other)
+            return *this;
+
+        release();
         copy(this, other);
 
         return *this;
@@ -671,20 +714,24 @@ namespace pen
 
     Str json::as_str(const c8* default_value) const
     {
-        json_value jv;
-        if (as_value(jv, m_internal_object, JSON_STR))
-            return m_internal_object->data;
-
-        return default_value;
+        return as_cstr(default_value);
     }
 
     const c8* json::as_cstr(const c8* default_value) const
     {
-        json_value jv;
-        if (as_value(jv, m_internal_object, JSON_STR))
-            return m_internal_object->data;
+        if (!m_doc)
+            return default_value;
 
-        return default_value;
+        const json_node& n = m_doc->nodes[m_node];
+        if (!is_container(n))
+            return m_doc->strings + n.offset;
+
+        // objects and arrays return their source
+        PEN_MEMORY_TAG(e_mem_tag::json);
+        if (!m_text)
+            m_text = pen::sub_string((const c8*)m_doc->text + n.start, n.end - n.start);
+
+        return m_text;
     }
 
     hash_id json::as_hash_id(hash_id default_value) const
@@ -698,72 +745,75 @@ namespace pen
 
     u32 json::as_u32(u32 default_value) const
     {
-        json_value jv;
-        if (as_value(jv, m_internal_object, JSON_U32))
-            return jv.u;
+        const c8* s = primitive_str(m_doc, m_node);
+        if (s)
+            return (u32)parse_s64(s);
 
         return default_value;
     }
 
     s32 json::as_s32(s32 default_value) const
     {
-        json_value jv;
-        if (as_value(jv, m_internal_object, JSON_S32))
-            return jv.s;
+        const c8* s = primitive_str(m_doc, m_node);
+        if (s)
+            return (s32)parse_s64(s);
 
         return default_value;
     }
 
     u64 json::as_u64(u64 default_value) const
     {
-        json_value jv;
-        if (as_value(jv, m_internal_object, JSON_U64))
-            return jv.ul;
+        const c8* s = primitive_str(m_doc, m_node);
+        if (s)
+            return (u64)parse_s64(s);
 
         return default_value;
     }
 
     s64 json::as_s64(s64 default_value) const
     {
-        json_value jv;
-        if (as_value(jv, m_internal_object, JSON_S64))
-            return jv.sl;
+        const c8* s = primitive_str(m_doc, m_node);
+        if (s)
+            return parse_s64(s);
 
         return default_value;
     }
 
     bool json::as_bool(bool default_value) const
     {
-        json_value jv;
-        if (as_value(jv, m_internal_object, JSON_BOOL))
-            return jv.b;
+        const c8* s = primitive_str(m_doc, m_node);
+        if (s && s[0] == 't')
+            return true;
+
+        if (s && s[0] == 'f')
+            return false;
 
         return default_value;
     }
 
     f32 json::as_f32(f32 default_value) const
     {
-        json_value jv;
-        if (as_value(jv, m_internal_object, JSON_F32))
-            return jv.f;
+        const c8* s = primitive_str(m_doc, m_node);
+        if (s)
+            return parse_f32(s);
 
         return default_value;
     }
 
     u8 json::as_u8_hex(u8 default_value) const
     {
-        json_value jv;
-        if (as_value(jv, m_internal_object, JSON_U32_HEX))
-            return jv.u;
+        const c8* s = primitive_str(m_doc, m_node);
+        if (s)
+            return (u8)strtoul(s, nullptr, 16);
 
         return default_value;
     }
 
     u32 json::as_u32_hex(u32 default_value) const
     {
-        json_value jv;
-        if (as_value(jv, m_internal_object, JSON_U32_HEX))
-            return jv.u;
+        const c8* s = primitive_str(m_doc, m_node);
+        if (s)
+            return (u32)strtoul(s, nullptr, 16);
 
         return default_value;
     }
@@ -780,29 +830,36 @@ namespace pen
     Str json::dumps() const
     {
         Str t;
-        _dump(t, m_internal_object->data, m_internal_object->tokens, m_internal_object->num_tokens, 0);
+        if (m_doc)
+            _dump(t, m_doc, m_node, 0);
+
         return t;
     }
 
     Str json::name() const
     {
-        return m_internal_object->get_name();
+        if (!m_key)
+            return "";
+
+        return m_doc->strings + m_doc->nodes[m_key].offset;
     }
 
     Str json::key() const
     {
-        return m_internal_object->get_name();
+        return name();
     }
 
     jsmntype_t json::type() const
     {
-        if (!m_internal_object)
+        if (!m_doc)
             return JSMN_UNDEFINED;
 
-        if (m_internal_object->num_tokens <= 0)
+        // empty strings have always been treated as null
+        const json_node& n = m_doc->nodes[m_node];
+        if (n.type == JSMN_STRING && n.start == n.end)
             return JSMN_UNDEFINED;
 
-        return m_internal_object->tokens[0].type;
+        return (jsmntype_t)n.type;
     }
 
     bool json::is_null() const
@@ -812,16 +869,7 @@ namespace pen
 
     json::~json()
     {
-        if (m_internal_object)
-        {
-            delete[] m_internal_object->tokens;
-
-            pen::memory_free(m_internal_object->data);
-            pen::memory_free(m_internal_object->name);
-        }
-
-        pen::memory_free(m_internal_object);
-        m_internal_object = nullptr;
+        release();
     }
 
     void json::set(const c8* name, const Str val)
@@ -836,7 +884,7 @@ namespace pen
 
         pen::json json_set = pen::json::load(new_json_object.c_str());
 
-        if (m_internal_object)
+        if (m_doc)
         {
             pen::json combined = combine(*this, json_set);
 
@@ -871,7 +919,7 @@ namespace pen
 
         pen::json json_set = pen::json::load(new_json_object.c_str());
 
-        if (m_internal_object)
+        if (m_doc)
         {
             pen::json combined = combine(*this, json_set);
 
@@ -3,12 +3,15 @@
 // License: https://github.com/polymonster/pmtech/blob/master/license.md
 
 #include <dirent.h>
+#include <fcntl.h>
 #include <fnmatch.h>
 #include <stdarg.h>
 #include <stdio.h>
+#include <sys/mman.h>
 #include <sys/mount.h>
 #include <sys/param.h>
 #include <sys/stat.h>
+#include <unistd.h>
 
 #include "file_system.h"
 #include "memory.h"
@@ -57,6 +60,57 @@ namespace pen
         return PEN_ERR_FILE_NOT_FOUND;
     }
 
+    pen_error filesystem_map_file(const c8* filename, mapped_file& file, file_access access)
+    {
+        file = mapped_file();
+
+        const char* resource_name = os_path_for_resource(filename);
+
+        s32 fd = open(resource_name, O_RDONLY);
+        if (fd < 0)
+            return PEN_ERR_FILE_NOT_FOUND;
+
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size > 0)
+        {
+            void* view = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (view != MAP_FAILED)
+            {
+                static const s32 advice[] = {MADV_NORMAL, MADV_SEQUENTIAL, MADV_RANDOM};
+                madvise(view, (size_t)st.st_size, advice[access]);
+
+                file.data = view;
+                file.size = (u32)st.st_size;
+                file._mapped = true;
+            }
+        }
+
+        // the view keeps the file referenced
+        close(fd);
+
+        if (file._mapped)
+            return PEN_ERR_OK;
+
+        // empty files and file systems which do not support mmap
+        void*     buffer = nullptr;
+        u32       size = 0;
+        pen_error err = filesystem_read_file_to_buffer(filename, &buffer, size);
+
+        file.data = buffer;
+        file.size = size;
+        return err;
+    }
+
+    void filesystem_unmap_file(mapped_file& file)
+    {
+        if (file._mapped)
+            munmap((void*)file.data, file.size);
+        else
+            pen::memory_free((void*)file.data);
+
+        file = mapped_file();
+    }
+
     pen_error filesystem_enum_volumes(fs_tree_node& results)
     {
         static const c8* volumes_name = "Volumes";
@@ -245,7 +299,8 @@ namespace pen
     {
         struct stat stat_res;
 
-        stat(filename, &stat_res);
+        if (stat(filename, &stat_res) != 0)
+            return PEN_ERR_FILE_NOT_FOUND;
 
         mtime_out = get_mtime(stat_res);
 
@@ -9,9 +9,12 @@
 #include "os.h"
 #include "pen_string.h"
 
+#include <errno.h>
 #include <fcntl.h>
 #include <pthread.h>
+#include <sched.h>
 #include <semaphore.h>
+#include <time.h>
 #include <unistd.h>
 
 namespace pen
@@ -125,6 +128,40 @@ namespace pen
         return true;
     }
 
+    bool semaphore_wait_ms(semaphore* p_semaphore, u32 timeout_ms)
+    {
+#ifdef __APPLE__
+        // no sem_timedwait on darwin
+        for (u32 us = 0; us < timeout_ms * 1000; us += 100)
+        {
+            if (sem_trywait(p_semaphore->handle) == 0)
+                return true;
+
+            usleep(100);
+        }
+
+        return sem_trywait(p_semaphore->handle) == 0;
+#else
+        timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_sec += timeout_ms / 1000;
+        ts.tv_nsec += (long)(timeout_ms % 1000) * 1000000;
+        if (ts.tv_nsec >= 1000000000)
+        {
+            ts.tv_sec++;
+            ts.tv_nsec -= 1000000000;
+        }
+
+        while (sem_timedwait(p_semaphore->handle, &ts) != 0)
+        {
+            if (errno != EINTR)
+                return false;
+        }
+
+        return true;
+#endif
+    }
+
     bool semaphore_try_wait(pen::semaphore* p_semaphore)
     {
         if (sem_trywait(p_semaphore->handle) == 0)
@@ -135,7 +172,8 @@ namespace pen
 
     void semaphore_post(semaphore* p_semaphore, u32 count)
     {
-        sem_post(p_semaphore->handle);
+        for (u32 i = 0; i < count; ++i)
+            sem_post(p_semaphore->handle);
     }
 
     void thread_sleep_ms(u32 milliseconds)
@@ -147,4 +185,18 @@ namespace pen
     {
         usleep(microseconds);
     }
+
+    void thread_yield()
+    {
+        sched_yield();
+    }
+
+    u32 thread_get_num_cores()
+    {
+        long n = sysconf(_SC_NPROCESSORS_ONLN);
+        if (n < 1)
+            return 1;
+
+        return (u32)n;
+    }
 } // namespace pen
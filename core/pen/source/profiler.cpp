@@ -0,0 +1,477 @@
+// profiler.cpp
+// Copyright 2014 - 2019 Alex Dixon.
+// License: https://github.com/polymonster/pmtech/blob/master/license.md
+
+#include "profiler.h"
+
+#ifdef PEN_PROFILER
+#include "console.h"
+#include "data_struct.h"
+#include "hash.h"
+#include "memory.h"
+#include "pen_string.h"
+#include "threads.h"
+
+#include <algorithm>
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+
+using namespace pen;
+
+namespace
+{
+    enum profiler_limits
+    {
+        k_max_profile_threads = 32,
+        k_max_profile_depth = 64,
+        k_profile_ring_size = 16384, // events per thread, power of 2
+        k_profile_history_size = 1 << 18,
+        k_max_profile_nodes = 2048,
+        k_max_thread_name = 32
+    };
+
+    struct profile_event
+    {
+        const c8* name;
+        u64       start_ns;
+        u64       end_ns;
+        u32       depth;
+        u32       thread;
+    };
+
+    struct open_marker
+    {
+        const c8* name;
+        u64       start_ns;
+    };
+
+    struct profile_thread
+    {
+        // written by the owning thread only
+        profile_event       ring[k_profile_ring_size];
+        a_u64               write = {0};
+        open_marker         stack[k_max_profile_depth];
+        u32                 depth = 0;
+        hash_map<const c8*> names; // copies of dynamic names
+        c8                  name[k_max_thread_name];
+        bool                named = false;
+        u32                 index;
+
+        // consumer only
+        u64 read = 0;
+        u32 dropped = 0;
+    };
+
+    const u32 k_null_node = (u32)-1;
+
+    struct aggregate_node
+    {
+        const c8* name;
+        u32       first_child;
+        u32       next_sibling;
+        u32       calls;
+        u64       total_ns;
+        u64       child_ns;
+    };
+
+    struct profiler
+    {
+        profile_thread* threads[k_max_profile_threads] = {};
+        a_u32           num_threads = {0};
+        mutex*          register_mutex = nullptr;
+
+        // consumer side, profiler_new_frame, profiler_get_frame and export
+        mutex*         consume_mutex = nullptr;
+        profile_event* history = nullptr; // ring of collected events for export
+        u64            history_pos = 0;
+        profile_event* scratch = nullptr; // events collected from one thread, up to k_profile_ring_size
+        profile_node   frame[k_max_profile_nodes];
+        u32            frame_nodes = 0;
+        aggregate_node nodes[k_max_profile_nodes];
+    };
+
+    profiler*                    s_profiler = nullptr;
+    thread_local profile_thread* t_thread = nullptr;
+
+    // lazily created from the first marker, threads are created before the user thread calls new frame
+    profiler* get_profiler()
+    {
+        static profiler* p = []() {
+            profiler* np = new profiler();
+            np->register_mutex = mutex_create();
+            np->consume_mutex = mutex_create();
+            np->history = (profile_event*)memory_alloc(sizeof(profile_event) * k_profile_history_size);
+            np->scratch = (profile_event*)memory_alloc(sizeof(profile_event) * k_profile_ring_size);
+            s_profiler = np;
+            return np;
+        }();
+
+        return p;
+    }
+
+    u64 now_ns()
+    {
+        static const auto start = std::chrono::steady_clock::now();
+        auto              d = std::chrono::steady_clock::now() - start;
+        return (u64)std::chrono::duration_cast<std::chrono::nanoseconds>(d).count();
+    }
+
+    profile_thread* get_thread()
+    {
+        if (t_thread)
+            return t_thread;
+
+        profiler* p = get_profiler();
+
+        mutex_lock(p->register_mutex);
+
+        u32 index = p->num_threads.load();
+        if (index < k_max_profile_threads)
+        {
+            profile_thread* pt = new profile_thread();
+            pt->index = index;
+            string_format(pt->name, k_max_thread_name, "thread %i", index);
+
+            p->threads[index] = pt;
+            p->num_threads = index + 1;
+            t_thread = pt;
+        }
+        else
+        {
+            PEN_LOG("[profiler] more than %i threads, markers are ignored", (s32)k_max_profile_threads);
+        }
+
+        mutex_unlock(p->register_mutex);
+
+        return t_thread;
+    }
+
+    void begin(profile_thread* pt, const c8* name)
+    {
+        u32 d = pt->depth++;
+        if (d >= k_max_profile_depth)
+            return;
+
+        pt->stack[d].name = name;
+        pt->stack[d].start_ns = now_ns();
+    }
+
+    // copies the events the thread has published since the last collect into scratch, returns the count
+    u32 collect_thread(profiler* p, profile_thread* pt)
+    {
+        u64 w = pt->write.load(std::memory_order_acquire);
+
+        if (w - pt->read > k_profile_ring_size)
+        {
+            pt->dropped += (u32)(w - pt->read - k_profile_ring_size);
+            pt->read = w - k_profile_ring_size;
+        }
+
+        u32 count = (u32)(w - pt->read);
+        for (u32 i = 0; i < count; ++i)
+            p->scratch[i] = pt->ring[(pt->read + i) & (k_profile_ring_size - 1)];
+
+        // anything the owner has lapped while we copied is invalid
+        u64 w2 = pt->write.load(std::memory_order_acquire);
+        u32 lapped = 0;
+        if (w2 > pt->read + k_profile_ring_size)
+            lapped = (u32)min<u64>(w2 - k_profile_ring_size - pt->read, count);
+
+        if (lapped)
+        {
+            memmove(p->scratch, p->scratch + lapped, (count - lapped) * sizeof(profile_event));
+            count -= lapped;
+            pt->dropped += lapped;
+        }
+
+        pt->read = w;
+        return count;
+    }
+
+    u32 find_child(profiler* p, u32& num_nodes, u32 parent, const c8* name)
+    {
+        u32 prev = k_null_node;
+        for (u32 c = p->nodes[parent].first_child; c != k_null_node; c = p->nodes[c].next_sibling)
+        {
+            if (p->nodes[c].name == name || strcmp(p->nodes[c].name, name) == 0)
+                return c;
+
+            prev = c;
+        }
+
+        if (num_nodes >= k_max_profile_nodes)
+            return k_null_node;
+
+        u32             n = num_nodes++;
+        aggregate_node& an = p->nodes[n];
+        an.name = name;
+        an.first_child = k_null_node;
+        an.next_sibling = k_null_node;
+        an.calls = 0;
+        an.total_ns = 0;
+        an.child_ns = 0;
+
+        if (prev == k_null_node)
+            p->nodes[parent].first_child = n;
+        else
+            p->nodes[prev].next_sibling = n;
+
+        return n;
+    }
+
+    void flatten(profiler* p, u32 node, u32 depth, const c8* thread_name)
+    {
+        for (u32 c = node; c != k_null_node; c = p->nodes[c].next_sibling)
+        {
+            if (p->frame_nodes >= k_max_profile_nodes)
+                return;
+
+            aggregate_node& an = p->nodes[c];
+            profile_node&   pn = p->frame[p->frame_nodes++];
+            pn.name = an.name;
+            pn.thread_name = thread_name;
+            pn.depth = depth;
+            pn.calls = an.calls;
+            pn.total_ms = (f32)((f64)an.total_ns / 1000000.0);
+            pn.self_ms = (f32)((f64)(an.total_ns - min<u64>(an.child_ns, an.total_ns)) / 1000000.0);
+
+            flatten(p, an.first_child, depth + 1, thread_name);
+        }
+    }
+
+    bool event_order(const profile_event& a, const profile_event& b)
+    {
+        if (a.start_ns != b.start_ns)
+            return a.start_ns < b.start_ns;
+
+        return a.depth < b.depth;
+    }
+
+    // builds the call tree for one threads events, parents start before their children so once sorted by start time
+    // the last event seen at depth - 1 is the parent if it contains the event. children of markers which are still
+    // open at the end of the frame have no parent yet, so they are added as roots.
+    void aggregate_thread(profiler* p, profile_event* events, u32 count, const c8* thread_name)
+    {
+        if (count == 0)
+            return;
+
+        std::sort(events, events + count, event_order);
+
+        // node 0 is the root for the thread
+        u32 num_nodes = 1;
+        p->nodes[0].name = thread_name;
+        p->nodes[0].first_child = k_null_node;
+        p->nodes[0].next_sibling = k_null_node;
+
+        u32                  stack[k_max_profile_depth];
+        const profile_event* stack_events[k_max_profile_depth] = {};
+
+        for (u32 i = 0; i < count; ++i)
+        {
+            const profile_event& e = events[i];
+
+            u32 parent = 0;
+            if (e.depth > 0)
+            {
+                const profile_event* pe = stack_events[e.depth - 1];
+                if (pe && pe->start_ns <= e.start_ns && pe->end_ns >= e.end_ns)
+                    parent = stack[e.depth - 1];
+            }
+
+            u32 n = find_child(p, num_nodes, parent, e.name);
+            if (n == k_null_node)
+            {
+                stack_events[e.depth] = nullptr;
+                continue;
+            }
+
+            stack[e.depth] = n;
+            stack_events[e.depth] = &e;
+
+            u64 ns = e.end_ns - e.start_ns;
+            p->nodes[n].calls++;
+            p->nodes[n].total_ns += ns;
+
+            if (parent != 0)
+                p->nodes[parent].child_ns += ns;
+        }
+
+        flatten(p, p->nodes[0].first_child, 0, thread_name);
+    }
+
+    void write_json_string(FILE* fp, const c8* s)
+    {
+        fputc('"', fp);
+        for (; *s; ++s)
+        {
+            if (*s == '"' || *s == '\\')
+                fputc('\\', fp);
+
+            if ((u8)*s >= 0x20)
+                fputc(*s, fp);
+        }
+        fputc('"', fp);
+    }
+} // namespace
+
+namespace pen
+{
+    void profiler_begin(const c8* name)
+    {
+        profile_thread* pt = get_thread();
+        if (pt)
+            begin(pt, name);
+    }
+
+    void profiler_begin_dynamic(const c8* name)
+    {
+        profile_thread* pt = get_thread();
+        if (!pt)
+            return;
+
+        hash_id    id = PEN_HASH(name);
+        const c8** copy = pt->names.find(id);
+        if (!copy)
+        {
+            u32 len = string_length(name);
+            c8* buf = (c8*)memory_alloc(len + 1);
+            memcpy(buf, name, len + 1);
+            pt->names.insert(id, buf);
+            copy = pt->names.find(id);
+        }
+
+        begin(pt, *copy);
+    }
+
+    void profiler_end()
+    {
+        profile_thread* pt = t_thread;
+        if (!pt || pt->depth == 0)
+            return;
+
+        u32 d = --pt->depth;
+        if (d >= k_max_profile_depth)
+            return;
+
+        u64            w = pt->write.load(std::memory_order_relaxed);
+        profile_event& e = pt->ring[w & (k_profile_ring_size - 1)];
+        e.name = pt->stack[d].name;
+        e.start_ns = pt->stack[d].start_ns;
+        e.end_ns = now_ns();
+        e.depth = d;
+        e.thread = pt->index;
+
+        pt->write.store(w + 1, std::memory_order_release);
+    }
+
+    void profiler_set_thread_name(const c8* name)
+    {
+        profile_thread* pt = get_thread();
+        if (!pt)
+            return;
+
+        string_format(pt->name, k_max_thread_name, "%s", name);
+        pt->named = true;
+    }
+
+    bool profiler_enabled()
+    {
+        return true;
+    }
+
+    void profiler_new_frame()
+    {
+        // new frame is called from the user thread
+        profile_thread* self = get_thread();
+        if (self && !self->named)
+            profiler_set_thread_name("user");
+
+        profiler* p = get_profiler();
+
+        mutex_lock(p->consume_mutex);
+
+        p->frame_nodes = 0;
+
+        u32 nt = p->num_threads.load();
+        for (u32 t = 0; t < nt; ++t)
+        {
+            profile_thread* pt = p->threads[t];
+
+            u32 count = collect_thread(p, pt);
+            for (u32 i = 0; i < count; ++i)
+                p->history[(p->history_pos++) & (k_profile_history_size - 1)] = p->scratch[i];
+
+            aggregate_thread(p, p->scratch, count, pt->name);
+        }
+
+        mutex_unlock(p->consume_mutex);
+    }
+
+    u32 profiler_get_frame(profile_node* nodes, u32 max_nodes)
+    {
+        profiler* p = get_profiler();
+
+        mutex_lock(p->consume_mutex);
+
+        u32 count = min<u32>(max_nodes, p->frame_nodes);
+        memcpy(nodes, p->frame, count * sizeof(profile_node));
+
+        mutex_unlock(p->consume_mutex);
+
+        return count;
+    }
+
+    bool profiler_export_chrome_trace(const c8* filename)
+    {
+        FILE* fp = fopen(filename, "wb");
+        if (!fp)
+            return false;
+
+        profiler* p = get_profiler();
+
+        mutex_lock(p->consume_mutex);
+
+        fprintf(fp, "{\"traceEvents\":[\n");
+
+        u32 nt = p->num_threads.load();
+        for (u32 t = 0; t < nt; ++t)
+        {
+            fprintf(fp, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%u,\"args\":{\"name\":", t);
+            write_json_string(fp, p->threads[t]->name);
+            fprintf(fp, "}},\n");
+        }
+
+        u64 count = min<u64>(p->history_pos, k_profile_history_size);
+        for (u64 i = p->history_pos - count; i < p->history_pos; ++i)
+        {
+            const profile_event& e = p->history[i & (k_profile_history_size - 1)];
+
+            fprintf(fp, "{\"name\":");
+            write_json_string(fp, e.name);
+            fprintf(fp, ",\"ph\":\"X\",\"pid\":0,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}%s\n", e.thread,
+                    (f64)e.start_ns / 1000.0, (f64)(e.end_ns - e.start_ns) / 1000.0, i + 1 < p->history_pos ? "," : "");
+        }
+
+        fprintf(fp, "],\"displayTimeUnit\":\"ms\"}\n");
+
+        mutex_unlock(p->consume_mutex);
+
+        fclose(fp);
+        return true;
+    }
+
+    void profiler_shutdown()
+    {
+        // threads may still be running at shutdown, so only the consumer side is released
+        profiler* p = s_profiler;
+        if (!p)
+            return;
+
+        mutex_lock(p->consume_mutex);
+        p->frame_nodes = 0;
+        p->history_pos = 0;
+        mutex_unlock(p->consume_mutex);
+    }
+} // namespace pen
+#endif
@@ -11,6 +11,7 @@
 #include "os.h"
 #include "pen.h"
 #include "pen_string.h"
+#include "profiler.h"
 #include "renderer.h"
 #include "renderer_shared.h"
 #include "slot_resource.h"
@@ -21,8 +22,6 @@
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #include "stb/stb_image_write.h"
 
-#define MAX_COMMANDS (1 << 16)
-
 extern pen::window_creation_params pen_window;
 pen::resolve_resources             g_resolve_resources;
 
@@ -86,7 +85,267 @@ namespace
         CMD_PUSH_PERF_MARKER,
         CMD_POP_PERF_MARKER,
         CMD_DISPATCH_COMPUTE,
-        CMD_SET_STENCIL_REF
+        CMD_SET_STENCIL_REF,
+        CMD_RECYCLE_FRAME_ARENA,
+        CMD_EXEC_RELEASE,
+        CMD_END_FRAME,
+        CMD_WRAP
+    };
+
+    static const c8* k_cmd_names[] = {"none",
+                                      "clear",
+                                      "present",
+                                      "load_shader",
+                                      "set_shader",
+                                      "link_shader",
+                                      "create_input_layout",
+                                      "set_input_layout",
+                                      "create_buffer",
+                                      "set_vertex_buffer",
+                                      "set_index_buffer",
+                                      "draw",
+                                      "draw_indexed",
+                                      "draw_indexed_instanced",
+                                      "create_texture",
+                                      "release_shader",
+                                      "release_buffer",
+                                      "release_texture_2d",
+                                      "create_sampler",
+                                      "set_texture",
+                                      "create_raster_state",
+                                      "set_raster_state",
+                                      "set_viewport",
+                                      "set_scissor_rect",
+                                      "set_viewport_ratio",
+                                      "set_scissor_rect_ratio",
+                                      "release_raster_state",
+                                      "create_blend_state",
+                                      "set_blend_state",
+                                      "set_constant_buffer",
+                                      "set_structured_buffer",
+                                      "update_buffer",
+                                      "create_depth_stencil_state",
+                                      "set_depth_stencil_state",
+                                      "update_queries",
+                                      "create_render_target",
+                                      "set_targets",
+                                      "release_blend_state",
+                                      "release_render_target",
+                                      "release_input_layout",
+                                      "release_sampler",
+                                      "release_program",
+                                      "release_clear_state",
+                                      "release_depth_stencil_state",
+                                      "create_so_shader",
+                                      "set_so_target",
+                                      "resolve_target",
+                                      "draw_auto",
+                                      "map_resource",
+                                      "replace_resource",
+                                      "create_clear_state",
+                                      "push_perf_marker",
+                                      "pop_perf_marker",
+                                      "dispatch_compute",
+                                      "set_stencil_ref",
+                                      "recycle_frame_arena",
+                                      "exec_release",
+                                      "end_frame"};
+    static_assert(PEN_ARRAY_SIZE(k_cmd_names) == CMD_WRAP, "k_cmd_names must match commands");
+
+    // runs of commands in the same category are grouped into one profiler marker on the render thread
+    namespace e_cmd_category
+    {
+        enum cmd_category_t
+        {
+            none, // perf markers, which open and close their own profiler markers
+            create,
+            state,
+            draw,
+            update,
+            release,
+            present,
+            COUNT
+        };
+    }
+    typedef e_cmd_category::cmd_category_t cmd_category;
+
+    static const c8* k_cmd_category_names[] = {"", "cmd_create", "cmd_state", "cmd_draw", "cmd_update", "cmd_release",
+                                               "cmd_present"};
+    static_assert(PEN_ARRAY_SIZE(k_cmd_category_names) == e_cmd_category::COUNT, "mismatched category names");
+
+    cmd_category get_cmd_category(u32 command_index)
+    {
+        switch (command_index)
+        {
+            case CMD_LOAD_SHADER:
+            case CMD_LINK_SHADER:
+            case CMD_CREATE_INPUT_LAYOUT:
+            case CMD_CREATE_BUFFER:
+            case CMD_CREATE_TEXTURE:
+            case CMD_CREATE_SAMPLER:
+            case CMD_CREATE_RASTER_STATE:
+            case CMD_CREATE_BLEND_STATE:
+            case CMD_CREATE_DEPTH_STENCIL_STATE:
+            case CMD_CREATE_RENDER_TARGET:
+            case CMD_CREATE_SO_SHADER:
+            case CMD_CREATE_CLEAR_STATE:
+                return e_cmd_category::create;
+            case CMD_CLEAR:
+            case CMD_DRAW:
+            case CMD_DRAW_INDEXED:
+            case CMD_DRAW_INDEXED_INSTANCED:
+            case CMD_DRAW_AUTO:
+            case CMD_DISPATCH_COMPUTE:
+            case CMD_RESOLVE_TARGET:
+                return e_cmd_category::draw;
+            case CMD_UPDATE_BUFFER:
+            case CMD_UPDATE_QUERIES:
+            case CMD_MAP_RESOURCE:
+            case CMD_REPLACE_RESOURCE:
+                return e_cmd_category::update;
+            case CMD_RELEASE_SHADER:
+            case CMD_RELEASE_BUFFER:
+            case CMD_RELEASE_TEXTURE_2D:
+            case CMD_RELEASE_RASTER_STATE:
+            case CMD_RELEASE_BLEND_STATE:
+            case CMD_RELEASE_RENDER_TARGET:
+            case CMD_RELEASE_INPUT_LAYOUT:
+            case CMD_RELEASE_SAMPLER:
+            case CMD_RELEASE_PROGRAM:
+            case CMD_RELEASE_CLEAR_STATE:
+            case CMD_RELEASE_DEPTH_STENCIL_STATE:
+            case CMD_RECYCLE_FRAME_ARENA:
+            case CMD_EXEC_RELEASE:
+                return e_cmd_category::release;
+            case CMD_PRESENT:
+                return e_cmd_category::present;
+            case CMD_PUSH_PERF_MARKER:
+            case CMD_POP_PERF_MARKER:
+            case CMD_NONE:
+            case CMD_END_FRAME:
+            case CMD_WRAP:
+                return e_cmd_category::none;
+            default:
+                return e_cmd_category::state;
+        }
+    }
+
+    // commands are packed into a byte stream as a small header followed by the exact payload for that command,
+    // small variable length data (vertex buffer arrays, cbuffer updates, marker names) is stored inline after the payload.
+    static const u32 k_cmd_align = 8;
+    static const u32 k_cmd_stream_size = 8 * 1024 * 1024;
+    static const u32 k_max_inline_data = 1024;
+
+    struct cmd_header
+    {
+        u16 command_index;
+        u16 size; // header + payload + inline data, aligned to k_cmd_align
+        u32 resource_slot;
+    };
+
+    pen_inline u32 cmd_align(u32 size)
+    {
+        return (size + k_cmd_align - 1) & ~(k_cmd_align - 1);
+    }
+
+    template <typename T>
+    pen_inline const T& cmd_payload(const cmd_header* h)
+    {
+        return *(const T*)(h + 1);
+    }
+
+    template <typename T>
+    pen_inline void* cmd_inline_data(const cmd_header* h)
+    {
+        return (u8*)(h + 1) + cmd_align(sizeof(T));
+    }
+
+    // lockless single producer single consumer byte ring, commands are contiguous and never straddle the end.
+    // the consumer only advances once a command has executed so payloads can be used in place.
+    struct cmd_stream
+    {
+        u8*   data = nullptr;
+        u32   capacity = 0;
+        a_u32 get_pos = {0};
+        a_u32 put_pos = {0};
+
+        void create(u32 size)
+        {
+            capacity = cmd_align(size);
+            data = (u8*)memory_alloc(capacity);
+            get_pos = 0;
+            put_pos = 0;
+        }
+
+        // returns nullptr if there is not enough space until the consumer catches up
+        u8* reserve(u32 size)
+        {
+            for (;;)
+            {
+                u32 pp = put_pos.load(std::memory_order_relaxed);
+                u32 gp = get_pos.load(std::memory_order_acquire);
+
+                if (pp >= gp)
+                {
+                    // put may land at the end of the ring as long as wrapping doesnt make it equal to get
+                    if (pp + size < capacity || (pp + size == capacity && gp != 0))
+                        return data + pp;
+
+                    // wrap to the start once the command fits there without catching up to get
+                    if (size < gp)
+                    {
+                        cmd_header* wrap = (cmd_header*)(data + pp);
+                        wrap->command_index = CMD_WRAP;
+                        wrap->size = 0;
+                        put_pos.store(0, std::memory_order_release);
+                        continue;
+                    }
+                }
+                else if (pp + size < gp)
+                {
+                    return data + pp;
+                }
+
+                return nullptr;
+            }
+        }
+
+        void commit(u32 size)
+        {
+            u32 pp = put_pos.load(std::memory_order_relaxed) + size;
+            if (pp == capacity)
+                pp = 0;
+
+            put_pos.store(pp, std::memory_order_release);
+        }
+
+        cmd_header* get()
+        {
+            for (;;)
+            {
+                u32 gp = get_pos.load(std::memory_order_relaxed);
+                if (gp == put_pos.load(std::memory_order_acquire))
+                    return nullptr;
+
+                cmd_header* h = (cmd_header*)(data + gp);
+                if (h->command_index == CMD_WRAP)
+                {
+                    get_pos.store(0, std::memory_order_release);
+                    continue;
+                }
+
+                return h;
+            }
+        }
+
+        void pop(const cmd_header* h)
+        {
+            u32 gp = (u32)((const u8*)h - data) + h->size;
+            if (gp == capacity)
+                gp = 0;
+
+            get_pos.store(gp, std::memory_order_release);
+        }
     };
 
     struct set_shader_cmd
@@ -95,11 +354,10 @@ namespace
         u32 shader_type;
     };
 
-    static const u32 k_max_colour_targets = 8;
+    // colour target indices are stored inline
     struct set_target_cmd
     {
         u32 num_colour;
-        u32 colour[k_max_colour_targets];
         u32 depth;
         u32 array_index;
     };
@@ -110,14 +368,11 @@ namespace
         u32 array_index;
     };
 
+    // buffer indices, strides and offsets are stored inline
     struct set_vertex_buffer_cmd
     {
-        u32  buffer_index;
-        u32  start_slot;
-        u32* buffer_indices;
-        u32  num_buffers;
-        u32* strides;
-        u32* offsets;
+        u32 start_slot;
+        u32 num_buffers;
     };
 
     struct set_index_buffer_cmd
@@ -167,12 +422,20 @@ namespace
         u32 flags;
     };
 
+    // data is inline for small updates, otherwise allocated from the frame arena
     struct update_buffer_cmd
     {
         u32   buffer_index;
-        void* data;
         u32   data_size;
         u32   offset;
+        u32   inline_data;
+        void* data;
+    };
+
+    // single index for set state commands
+    struct index_cmd
+    {
+        u32 index;
     };
 
     struct msaa_resolve_params
@@ -194,65 +457,829 @@ namespace
         uint3 num_threads;
     };
 
-    struct renderer_cmd
+    struct recycle_arena_cmd
+    {
+        u32    arena_index;
+        size_t requested;
+    };
+
+    // releases are deferred a few frames so resources are no longer in use on the gpu
+    struct release_cmd
     {
         u32 command_index;
         u32 resource_slot;
+        u32 shader_type;
         u64 frame_index;
+    };
 
-        union {
-            u32                              command_data_index;
-            shader_load_params               shader_load;
-            set_shader_cmd                   set_shader;
-            input_layout_creation_params     create_input_layout;
-            buffer_creation_params           create_buffer;
-            set_vertex_buffer_cmd            set_vertex_buffer;
-            set_index_buffer_cmd             set_index_buffer;
-            draw_cmd                         draw;
-            draw_indexed_cmd                 draw_indexed;
-            draw_indexed_instanced_cmd       draw_indexed_instanced;
-            texture_creation_params          create_texture;
-            sampler_creation_params          create_sampler;
-            set_texture_cmd                  set_texture;
-            rasteriser_state_creation_params create_raster_state;
-            viewport                         set_viewport;
-            rect                             set_rect;
-            blend_creation_params            create_blend_state;
-            set_buffer_cmd                   set_buffer;
-            update_buffer_cmd                update_buffer;
-            depth_stencil_creation_params*   p_create_depth_stencil_state;
-            texture_creation_params          create_render_target;
-            set_target_cmd                   set_targets;
-            clear_cmd                        clear;
-            shader_link_params               link_params;
-            resource_read_back_params        rrb_params;
-            msaa_resolve_params              resolve_params;
-            replace_resource                 replace_resource_params;
-            clear_state                      clear_state_params;
-            c8*                              name;
-            compute_dispatch_params          cs_dispatch;
-            u8                               stencil_ref;
-        };
+    // the user thread can submit this many frames before waiting for the render thread to complete one
+    static const u32 k_max_frames_in_flight = 3;
+
+    // render thread wakes this often while no frames are submitted to keep the window responsive
+    static const u32 k_render_idle_wait_ms = 4;
+
+    // command payloads are bump allocated from a per frame linear arena on the user thread,
+    // arenas are handed back by the render thread once it has consumed the frame which used them.
+    // payloads which are too large, or frames which fill the arena, fall back to the heap.
+    static const u32    k_frame_arena_count = k_max_frames_in_flight + 1;
+    static const size_t k_frame_arena_initial_size = 1024 * 1024;
+    static const size_t k_frame_arena_max_size = 64 * 1024 * 1024;
+    static const size_t k_frame_arena_max_payload = 256 * 1024;
+    static const size_t k_frame_arena_align = 16;
 
-        renderer_cmd(){};
+    struct frame_arena
+    {
+        u8*    data = nullptr; // data and size are only written by the render thread while the arena is in flight
+        size_t size = 0;
+        size_t pos = 0;
+        size_t requested = 0;
+        a_u32  in_flight = {0};
     };
-        
+
+    // last state set through the public-api, set commands which would not change anything are dropped before they
+    // are queued. anything which may change backend state behind the cache's back invalidates all of it.
+    static const u32 k_state_cache_slots = 32; // higher texture and buffer slots are never filtered
+    static const u32 k_max_vertex_buffers = 16;
+
+    struct texture_state
+    {
+        u32 texture;
+        u32 sampler;
+        u32 bind_flags;
+    };
+
+    struct buffer_state
+    {
+        u32 buffer;
+        u32 flags;
+    };
+
+    struct state_cache
+    {
+        u32                  shader[PEN_SHADER_TYPE_CS + 1];
+        u32                  input_layout;
+        u32                  raster_state;
+        u32                  blend_state;
+        u32                  depth_stencil_state;
+        u32                  stencil_ref;
+        set_index_buffer_cmd index_buffer;
+        u32                  vertex_buffers[2 + k_max_vertex_buffers * 3]; // start slot, count, indices, strides, offsets
+        texture_state        textures[k_state_cache_slots];
+        buffer_state         cbuffers[k_state_cache_slots];
+        buffer_state         sbuffers[k_state_cache_slots];
+        u32                  issued;
+        u32                  filtered;
+    };
+
+    void state_cache_invalidate(state_cache& sc)
+    {
+        u32 issued = sc.issued;
+        u32 filtered = sc.filtered;
+
+        memset(&sc, 0xff, sizeof(state_cache));
+
+        sc.issued = issued;
+        sc.filtered = filtered;
+    }
+
+    template <typename T>
+    pen_inline bool state_redundant(state_cache& sc, T& cached, const T& value)
+    {
+        if (memcmp(&cached, &value, sizeof(T)) == 0)
+        {
+            sc.filtered++;
+            return true;
+        }
+
+        cached = value;
+        sc.issued++;
+        return false;
+    }
+
+    // deferred command list, recorded into by any thread and copied into the cmd_stream when submitted
+    struct cmd_list
+    {
+        u8*         data = nullptr;
+        u32         size = 0;
+        u32         capacity = 0;
+        u32         num_cmds = 0;
+        state_cache state;
+    };
+
     // front end render_ctx
     struct fe_render_ctx
     {
-        pen::timer*               present_timer = nullptr;
-        f32                       present_time = 0.0f;
-        pen::resolve_resources    resolve_resources;
-        pen::semaphore*           consume_semaphore = nullptr;
-        pen::semaphore*           continue_semaphore = nullptr;
-        pen::slot_resources       renderer_slot_resources;
-        ring_buffer<renderer_cmd> cmd_buffer;
-        ring_buffer<renderer_cmd> release_cmd_buffer;
-        u32*                      free_slots = nullptr;
+        pen::timer*              present_timer = nullptr;
+        f32                      present_time = 0.0f;
+        pen::timer*              dispatch_timer = nullptr;
+        pen::resolve_resources   resolve_resources;
+        pen::semaphore*          consume_semaphore = nullptr;  // posted by the user thread for each submitted frame
+        pen::semaphore*          continue_semaphore = nullptr; // posted by the render thread for each completed frame
+        a_u32                    frames_submitted = {0};
+        a_u32                    frames_completed = {0};
+        u32                      frames_in_flight = 1;
+        pen::timer*              wait_timer = nullptr; // user thread
+        pen::timer*              idle_timer = nullptr; // render thread
+        f32                      idle_ms = 0.0f;
+        pen::slot_resources      renderer_slot_resources;
+        cmd_stream               cmd_buffer;
+        spsc_queue<release_cmd>  release_cmd_buffer; // only drained once releases are old enough, so it must grow
+        spsc_queue<u32>          free_slots; // released by the render thread, returned to the allocator on the user thread
+        frame_arena              arenas[k_frame_arena_count];
+        s32                      arena_index = 0; // -1 if no arena was available this frame
+        renderer_arena_stats     arena_stats = {}; // last completed frame
+        renderer_arena_stats     arena_frame = {}; // in progress
+        renderer_cmd_stats       cmd_stats = {};
+        renderer_cmd_stats       cmd_frame = {};
+        cmd_list**               cmd_lists = nullptr; // handle indices index into here, nullptr for free handles
+        pen::slot_resources      cmd_list_slots;
+        u32                      init_slots = 0;      // slots allocated by renderer_init, a replay allocates the same
+        state_cache              state;
     };
     static fe_render_ctx* _ctx;
     static render_ctx     _main_ctx;
 
+    // commands issued on a thread while it has a list bound are recorded into the list instead of the cmd_stream
+    thread_local cmd_list* t_cmd_list = nullptr;
+
+    pen_inline state_cache& state_cache_current()
+    {
+        return t_cmd_list ? t_cmd_list->state : _ctx->state;
+    }
+
+    pen_inline void state_cache_invalidate()
+    {
+        state_cache_invalidate(state_cache_current());
+    }
+
+    void* cmd_alloc(size_t size)
+    {
+        if (size == 0)
+            return nullptr;
+
+        PEN_MEMORY_TAG(e_mem_tag::renderer);
+
+        // the arena belongs to the user thread, payloads recorded in command lists come from the heap
+        if (t_cmd_list)
+            return memory_alloc(size);
+
+        renderer_arena_stats& stats = _ctx->arena_frame;
+        stats.frame_allocs++;
+
+        if (size <= k_frame_arena_max_payload && _ctx->arena_index >= 0)
+        {
+            frame_arena& arena = _ctx->arenas[_ctx->arena_index];
+
+            size_t aligned = (size + k_frame_arena_align - 1) & ~(k_frame_arena_align - 1);
+            arena.requested += aligned;
+
+            if (arena.pos + aligned <= arena.size)
+            {
+                void* mem = arena.data + arena.pos;
+                arena.pos += aligned;
+                stats.frame_bytes += aligned;
+                return mem;
+            }
+        }
+
+        stats.heap_allocs++;
+        stats.heap_bytes += size;
+        return memory_alloc(size);
+    }
+
+    void cmd_free(void* mem)
+    {
+        // only heap payloads need freeing, arena memory is recycled per frame
+        if (!mem)
+            return;
+
+        for (u32 i = 0; i < k_frame_arena_count; ++i)
+        {
+            const frame_arena& arena = _ctx->arenas[i];
+            if (mem >= arena.data && mem < arena.data + arena.size)
+                return;
+        }
+
+        memory_free(mem);
+    }
+
+    void cmd_write(u32 command_index, u32 resource_slot, const void* payload, u32 payload_size,
+                   const void* inline_data = nullptr, u32 inline_size = 0)
+    {
+        u32 inline_offset = sizeof(cmd_header) + cmd_align(payload_size);
+        u32 size = cmd_align(inline_offset + inline_size);
+        PEN_ASSERT(size <= 0xffff);
+
+        u8* mem = nullptr;
+        if (t_cmd_list)
+        {
+            cmd_list* list = t_cmd_list;
+            if (list->size + size > list->capacity)
+            {
+                list->capacity = max<u32>(list->capacity * 2, max<u32>(list->size + size, 64 * 1024));
+                list->data = (u8*)memory_realloc(list->data, list->capacity);
+            }
+
+            mem = list->data + list->size;
+        }
+        else
+        {
+            // wait for the render thread if the stream is full
+            mem = _ctx->cmd_buffer.reserve(size);
+            while (!mem)
+            {
+                _ctx->cmd_frame.stalls++;
+                thread_yield();
+                mem = _ctx->cmd_buffer.reserve(size);
+            }
+        }
+
+        cmd_header* h = (cmd_header*)mem;
+        h->command_index = (u16)command_index;
+        h->size = (u16)size;
+        h->resource_slot = resource_slot;
+
+        if (payload_size)
+            memcpy(mem + sizeof(cmd_header), payload, payload_size);
+
+        if (inline_size)
+            memcpy(mem + inline_offset, inline_data, inline_size);
+
+        if (t_cmd_list)
+        {
+            t_cmd_list->size += size;
+            t_cmd_list->num_cmds++;
+            return;
+        }
+
+        _ctx->cmd_buffer.commit(size);
+
+        _ctx->cmd_frame.frame_bytes += size;
+        _ctx->cmd_frame.frame_cmds++;
+    }
+
+    // copies an already packed command into the stream
+    void cmd_copy(const cmd_header* h)
+    {
+        u8* mem = _ctx->cmd_buffer.reserve(h->size);
+        while (!mem)
+        {
+            _ctx->cmd_frame.stalls++;
+            thread_yield();
+            mem = _ctx->cmd_buffer.reserve(h->size);
+        }
+
+        memcpy(mem, h, h->size);
+        _ctx->cmd_buffer.commit(h->size);
+    }
+
+    template <typename T>
+    pen_inline void cmd_put(u32 command_index, const T& payload, u32 resource_slot = 0)
+    {
+        cmd_write(command_index, resource_slot, &payload, sizeof(T));
+    }
+
+    pen_inline void cmd_put(u32 command_index)
+    {
+        cmd_write(command_index, 0, nullptr, 0);
+    }
+
+    pen_inline void cmd_put_index(u32 command_index, u32 index)
+    {
+        index_cmd cmd = {index};
+        cmd_write(command_index, 0, &cmd, sizeof(cmd));
+    }
+
+    // handles returned by renderer_create_* carry the slot generation, commands carry the bare index for the backends
+    u32 resource_index(u32 handle)
+    {
+        if (handle == 0 || handle == PEN_INVALID_HANDLE)
+            return handle;
+
+        u32 index = slot_handle_index(handle);
+        if (index == handle)
+        {
+            // bare indices are only for the slots reserved by renderer_init, like PEN_BACK_BUFFER_COLOUR
+            PEN_ASSERT(_ctx->init_slots == 0 || index < _ctx->init_slots);
+            return index;
+        }
+
+        if (!slot_resources_valid(&_ctx->renderer_slot_resources, handle))
+        {
+            PEN_LOG("renderer: stale handle %08x, slot %u has been released or reused\n", handle, index);
+            PEN_ERROR;
+        }
+
+        return index;
+    }
+
+    void release_put(u32 command_index, u32 resource_slot, u32 shader_type = 0)
+    {
+        release_cmd cmd;
+        cmd.command_index = command_index;
+        cmd.resource_slot = resource_index(resource_slot);
+        cmd.shader_type = shader_type;
+        cmd.frame_index = pen::_renderer_frame_index();
+
+        _ctx->release_cmd_buffer.push(cmd);
+    }
+
+    void frame_arena_next(fe_render_ctx* ctx)
+    {
+        // user thread, end of frame. hand the current arena to the render thread and pick up the next one
+        renderer_arena_stats& stats = ctx->arena_stats;
+        renderer_arena_stats& frame = ctx->arena_frame;
+
+        if (ctx->arena_index >= 0)
+        {
+            frame_arena& arena = ctx->arenas[ctx->arena_index];
+
+            recycle_arena_cmd cmd;
+            cmd.arena_index = ctx->arena_index;
+            cmd.requested = arena.requested;
+
+            stats.high_water_bytes = max<size_t>(stats.high_water_bytes, arena.requested);
+
+            arena.in_flight = 1;
+            cmd_put(CMD_RECYCLE_FRAME_ARENA, cmd);
+        }
+
+        stats.frame_bytes = frame.frame_bytes;
+        stats.frame_allocs = frame.frame_allocs;
+        stats.heap_bytes = frame.heap_bytes;
+        stats.heap_allocs = frame.heap_allocs;
+        frame = {};
+
+        // find an arena the render thread has finished with, if the render thread is too far behind use the heap
+        u32 start = ctx->arena_index >= 0 ? ctx->arena_index + 1 : 0;
+        ctx->arena_index = -1;
+        for (u32 i = 0; i < k_frame_arena_count; ++i)
+        {
+            u32 ai = (start + i) % k_frame_arena_count;
+            if (ctx->arenas[ai].in_flight.load() == 0)
+            {
+                ctx->arena_index = ai;
+                break;
+            }
+        }
+
+        if (ctx->arena_index < 0)
+        {
+            stats.stalled_frames++;
+            return;
+        }
+
+        frame_arena& arena = ctx->arenas[ctx->arena_index];
+        arena.pos = 0;
+        arena.requested = 0;
+        stats.arena_size = arena.size;
+    }
+
+    void frame_arena_recycle(fe_render_ctx* ctx, u32 index, size_t requested)
+    {
+        // render thread, all commands which reference this arena have now been executed.
+        frame_arena& arena = ctx->arenas[index];
+
+        // grow to fit the previous frame so we stop spilling to the heap
+        if (requested > arena.size && arena.size < k_frame_arena_max_size)
+        {
+            size_t new_size = arena.size;
+            while (new_size < requested && new_size < k_frame_arena_max_size)
+                new_size *= 2;
+
+            memory_free(arena.data);
+            arena.data = (u8*)memory_alloc(new_size);
+            arena.size = new_size;
+        }
+
+        arena.in_flight = 0;
+    }
+
+    //
+    // command capture and replay
+    //
+
+    // a trace is a header followed by frames, each frame is its size in bytes followed by the commands consumed that frame.
+    // commands are stored as they were packed in the stream, data they own follows as size prefixed blobs.
+    static const u32 k_trace_magic = 0x54524d50; // PMRT
+    static const u32 k_trace_version = 1;
+
+    struct trace_header
+    {
+        u32 magic;
+        u32 version;
+        u32 num_frames;
+        u32 init_slots;
+        u32 width;
+        u32 height;
+    };
+
+    struct capture_state
+    {
+        Str   filename;
+        u32   num_frames = 0;
+        u32   frame = 0;
+        u32   frame_start = 0;
+        u8*   data = nullptr;
+        a_u32 pending = {0};
+        a_u32 active = {0};
+    };
+    static capture_state s_capture;
+
+    struct replay_state
+    {
+        u8*          data = nullptr;
+        trace_header header;
+        u32*         frame_offsets = nullptr;
+        release_cmd* resident = nullptr; // resources which are still alive at the end of the trace
+    };
+    static replay_state s_replay;
+    alignas(16) static u8 s_replay_scratch[0xffff];
+
+    struct cmd_timings
+    {
+        pen::timer* timer = nullptr;
+        u32         count[CMD_WRAP];
+        f64         total_us[CMD_WRAP];
+        a_u32       enabled = {0};
+    };
+    static cmd_timings s_cmd_timings;
+
+    void capture_write(const void* data, u32 size)
+    {
+        u8* dst = sb_add(s_capture.data, size);
+        memcpy(dst, data, size);
+    }
+
+    void capture_blob(const void* data, u32 size)
+    {
+        if (!data)
+            size = 0;
+
+        capture_write(&size, sizeof(u32));
+        if (size)
+            capture_write(data, size);
+    }
+
+    void capture_string(const c8* str)
+    {
+        capture_blob(str, str ? string_length(str) + 1 : 0);
+    }
+
+    void capture_cmd(const cmd_header* h)
+    {
+        // internal to the capturing process
+        if (h->command_index == CMD_RECYCLE_FRAME_ARENA || h->command_index == CMD_UPDATE_QUERIES)
+            return;
+
+        capture_write(h, h->size);
+
+        switch (h->command_index)
+        {
+            case CMD_LOAD_SHADER:
+            {
+                const shader_load_params& cmd = cmd_payload<shader_load_params>(h);
+                capture_blob(cmd.byte_code, cmd.byte_code_size);
+                capture_blob(cmd.so_decl_entries, sizeof(stream_out_decl_entry) * cmd.so_num_entries);
+                if (cmd.so_decl_entries)
+                    for (u32 i = 0; i < cmd.so_num_entries; ++i)
+                        capture_string(cmd.so_decl_entries[i].semantic_name);
+            }
+            break;
+
+            case CMD_LINK_SHADER:
+            {
+                const shader_link_params& cmd = cmd_payload<shader_link_params>(h);
+                capture_blob(cmd.constants, sizeof(constant_layout_desc) * cmd.num_constants);
+                for (u32 i = 0; i < cmd.num_constants; ++i)
+                    capture_string(cmd.constants[i].name);
+
+                capture_blob(cmd.stream_out_names, sizeof(c8*) * cmd.num_stream_out_names);
+                if (cmd.stream_out_names)
+                    for (u32 i = 0; i < cmd.num_stream_out_names; ++i)
+                        capture_string(cmd.stream_out_names[i]);
+            }
+            break;
+
+            case CMD_CREATE_INPUT_LAYOUT:
+            {
+                const input_layout_creation_params& cmd = cmd_payload<input_layout_creation_params>(h);
+                capture_blob(cmd.vs_byte_code, cmd.vs_byte_code_size);
+                capture_blob(cmd.input_layout, sizeof(input_layout_desc) * cmd.num_elements);
+                for (u32 i = 0; i < cmd.num_elements; ++i)
+                    capture_string(cmd.input_layout[i].semantic_name);
+            }
+            break;
+
+            case CMD_CREATE_BUFFER:
+            {
+                const buffer_creation_params& cmd = cmd_payload<buffer_creation_params>(h);
+                capture_blob(cmd.data, cmd.buffer_size);
+            }
+            break;
+
+            case CMD_CREATE_TEXTURE:
+            {
+                const texture_creation_params& cmd = cmd_payload<texture_creation_params>(h);
+                capture_blob(cmd.data, cmd.data_size);
+            }
+            break;
+
+            case CMD_CREATE_BLEND_STATE:
+            {
+                const blend_creation_params& cmd = cmd_payload<blend_creation_params>(h);
+                capture_blob(cmd.render_targets, sizeof(render_target_blend) * cmd.num_render_targets);
+            }
+            break;
+
+            case CMD_UPDATE_BUFFER:
+            {
+                const update_buffer_cmd& cmd = cmd_payload<update_buffer_cmd>(h);
+                if (!cmd.inline_data)
+                    capture_blob(cmd.data, cmd.data_size);
+            }
+            break;
+        }
+    }
+
+    // deferred releases are stored as commands so a replay executes them at the same point in the frame
+    void capture_release(const release_cmd& rc)
+    {
+        u8 buf[sizeof(cmd_header) + sizeof(release_cmd)];
+        memset(buf, 0x0, sizeof(buf));
+
+        cmd_header* h = (cmd_header*)buf;
+        h->command_index = CMD_EXEC_RELEASE;
+        h->size = sizeof(buf);
+        h->resource_slot = rc.resource_slot;
+        memcpy(h + 1, &rc, sizeof(release_cmd));
+
+        capture_write(buf, sizeof(buf));
+    }
+
+    void capture_begin_frame()
+    {
+        if (s_capture.pending.load())
+        {
+            trace_header th;
+            th.magic = k_trace_magic;
+            th.version = k_trace_version;
+            th.num_frames = s_capture.num_frames;
+            th.init_slots = _ctx->init_slots;
+            th.width = pen_window.width;
+            th.height = pen_window.height;
+
+            s_capture.frame = 0;
+            capture_write(&th, sizeof(th));
+
+            s_capture.active = 1;
+            s_capture.pending = 0;
+        }
+
+        if (!s_capture.active.load())
+            return;
+
+        // size is patched at the end of the frame
+        u32 size = 0;
+        s_capture.frame_start = sb_count(s_capture.data);
+        capture_write(&size, sizeof(u32));
+    }
+
+    void capture_end_frame()
+    {
+        if (!s_capture.active.load())
+            return;
+
+        u32 size = sb_count(s_capture.data) - s_capture.frame_start - sizeof(u32);
+        memcpy(s_capture.data + s_capture.frame_start, &size, sizeof(u32));
+
+        if (++s_capture.frame < s_capture.num_frames)
+            return;
+
+        // written in one go so file io does not show up in the captured frames
+        u32           total = sb_count(s_capture.data);
+        std::ofstream ofs(s_capture.filename.c_str(), std::ofstream::binary);
+        ofs.write((const c8*)s_capture.data, total);
+        ofs.close();
+
+        PEN_LOG("[renderer] captured %i frames (%i bytes) to %s", s_capture.frame, total, s_capture.filename.c_str());
+
+        sb_free(s_capture.data);
+        s_capture.data = nullptr;
+        s_capture.active = 0;
+    }
+
+    void replay_read(const u8*& p, void* dst, u32 size)
+    {
+        memcpy(dst, p, size);
+        p += size;
+    }
+
+    // data owned by the command is copied into a command allocation so exec_cmd can free it as usual,
+    // otherwise the blob is referenced in place in the trace
+    void* replay_blob(const u8*& p, bool own)
+    {
+        u32 size;
+        replay_read(p, &size, sizeof(u32));
+        if (size == 0)
+            return nullptr;
+
+        const u8* blob = p;
+        p += size;
+
+        if (!own)
+            return (void*)blob;
+
+        void* mem = cmd_alloc(size);
+        memcpy(mem, blob, size);
+        return mem;
+    }
+
+    void replay_read_back_complete(void* data, u32 row_pitch, u32 depth_pitch, u32 block_size)
+    {
+        // the capturing process owned the callback, data is discarded
+    }
+
+    // returns the release command type for resources created by this command
+    u32 replay_release_type(const cmd_header* h)
+    {
+        switch (h->command_index)
+        {
+            case CMD_LOAD_SHADER:
+                return CMD_RELEASE_SHADER;
+            case CMD_CREATE_INPUT_LAYOUT:
+                return CMD_RELEASE_INPUT_LAYOUT;
+            case CMD_CREATE_BUFFER:
+                return CMD_RELEASE_BUFFER;
+            case CMD_CREATE_TEXTURE:
+                return CMD_RELEASE_TEXTURE_2D;
+            case CMD_CREATE_SAMPLER:
+                return CMD_RELEASE_SAMPLER;
+            case CMD_CREATE_RASTER_STATE:
+                return CMD_RELEASE_RASTER_STATE;
+            case CMD_CREATE_BLEND_STATE:
+                return CMD_RELEASE_BLEND_STATE;
+            case CMD_CREATE_DEPTH_STENCIL_STATE:
+                return CMD_RELEASE_DEPTH_STENCIL_STATE;
+            case CMD_CREATE_RENDER_TARGET:
+                return CMD_RELEASE_RENDER_TARGET;
+            case CMD_CREATE_CLEAR_STATE:
+                return CMD_RELEASE_CLEAR_STATE;
+        }
+
+        return CMD_NONE;
+    }
+
+    // resources created by renderer_init exist in the replaying process already
+    bool replay_is_init_resource(const cmd_header* h)
+    {
+        if (h->command_index == CMD_LINK_SHADER || replay_release_type(h) != CMD_NONE)
+            return h->resource_slot < s_replay.header.init_slots;
+
+        return false;
+    }
+
+    // reads the next command into scratch memory and points any data it owns at the blobs which follow it
+    cmd_header* replay_parse(const u8*& p, bool own)
+    {
+        cmd_header* h = (cmd_header*)&s_replay_scratch[0];
+        replay_read(p, h, sizeof(cmd_header));
+        replay_read(p, h + 1, h->size - sizeof(cmd_header));
+
+        own &= !replay_is_init_resource(h);
+
+        switch (h->command_index)
+        {
+            case CMD_LOAD_SHADER:
+            {
+                shader_load_params& cmd = *(shader_load_params*)(h + 1);
+                cmd.byte_code = replay_blob(p, own);
+                cmd.so_decl_entries = (stream_out_decl_entry*)replay_blob(p, own);
+                if (cmd.so_decl_entries)
+                {
+                    for (u32 i = 0; i < cmd.so_num_entries; ++i)
+                    {
+                        const c8* name = (const c8*)replay_blob(p, false);
+                        if (own)
+                            cmd.so_decl_entries[i].semantic_name = name;
+                    }
+                }
+            }
+            break;
+
+            case CMD_LINK_SHADER:
+            {
+                shader_link_params& cmd = *(shader_link_params*)(h + 1);
+                cmd.constants = (constant_layout_desc*)replay_blob(p, own);
+                for (u32 i = 0; i < cmd.num_constants; ++i)
+                {
+                    c8* name = (c8*)replay_blob(p, own);
+                    if (own)
+                        cmd.constants[i].name = name;
+                }
+
+                cmd.stream_out_names = (c8**)replay_blob(p, own);
+                if (cmd.stream_out_names)
+                {
+                    for (u32 i = 0; i < cmd.num_stream_out_names; ++i)
+                    {
+                        c8* name = (c8*)replay_blob(p, own);
+                        if (own)
+                            cmd.stream_out_names[i] = name;
+                    }
+                }
+            }
+            break;
+
+            case CMD_CREATE_INPUT_LAYOUT:
+            {
+                input_layout_creation_params& cmd = *(input_layout_creation_params*)(h + 1);
+                cmd.vs_byte_code = replay_blob(p, own);
+                cmd.input_layout = (input_layout_desc*)replay_blob(p, own);
+                for (u32 i = 0; i < cmd.num_elements; ++i)
+                {
+                    const c8* name = (const c8*)replay_blob(p, false);
+                    if (own)
+                        cmd.input_layout[i].semantic_name = name;
+                }
+            }
+            break;
+
+            case CMD_CREATE_BUFFER:
+            {
+                buffer_creation_params& cmd = *(buffer_creation_params*)(h + 1);
+                cmd.data = replay_blob(p, own);
+            }
+            break;
+
+            case CMD_CREATE_TEXTURE:
+            {
+                texture_creation_params& cmd = *(texture_creation_params*)(h + 1);
+                cmd.data = replay_blob(p, own);
+            }
+            break;
+
+            case CMD_CREATE_BLEND_STATE:
+            {
+                blend_creation_params& cmd = *(blend_creation_params*)(h + 1);
+                cmd.render_targets = (render_target_blend*)replay_blob(p, own);
+            }
+            break;
+
+            case CMD_UPDATE_BUFFER:
+            {
+                update_buffer_cmd& cmd = *(update_buffer_cmd*)(h + 1);
+                if (!cmd.inline_data)
+                    cmd.data = replay_blob(p, own);
+            }
+            break;
+
+            case CMD_MAP_RESOURCE:
+            {
+                resource_read_back_params& cmd = *(resource_read_back_params*)(h + 1);
+                cmd.call_back_function = &replay_read_back_complete;
+            }
+            break;
+        }
+
+        return h;
+    }
+
+    void replay_track_resident(const cmd_header* h)
+    {
+        if (replay_is_init_resource(h))
+            return;
+
+        if (h->command_index == CMD_EXEC_RELEASE)
+        {
+            u32 n = sb_count(s_replay.resident);
+            for (u32 i = 0; i < n; ++i)
+            {
+                if (s_replay.resident[i].resource_slot == h->resource_slot)
+                {
+                    s_replay.resident[i] = s_replay.resident[n - 1];
+                    stb__sbn(s_replay.resident)--;
+                    break;
+                }
+            }
+            return;
+        }
+
+        u32 release_type = replay_release_type(h);
+        if (release_type == CMD_NONE)
+            return;
+
+        release_cmd rc;
+        rc.command_index = release_type;
+        rc.resource_slot = h->resource_slot;
+        rc.shader_type = 0;
+        rc.frame_index = 0;
+
+        if (h->command_index == CMD_LOAD_SHADER)
+            rc.shader_type = cmd_payload<shader_load_params>(h).type;
+
+        sb_push(s_replay.resident, rc);
+    }
 } // namespace
 
 namespace pen
@@ -265,13 +1292,20 @@ namespace pen
         gpu_ms = (f64)g_gpu_total / 1000.0 / 1000.0;
     }
 
-    void exec_cmd(const renderer_cmd& cmd)
+    void exec_release_cmd(const release_cmd& cmd);
+
+    void exec_cmd(const cmd_header* h)
     {
-        switch (cmd.command_index)
+        u32 slot = h->resource_slot;
+
+        switch (h->command_index)
         {
             case CMD_CLEAR:
-                direct::renderer_clear(cmd.clear.clear_state, cmd.clear.array_index, cmd.clear.array_index);
-                break;
+            {
+                const clear_cmd& cmd = cmd_payload<clear_cmd>(h);
+                direct::renderer_clear(cmd.clear_state, cmd.array_index, cmd.array_index);
+            }
+            break;
 
             case CMD_PRESENT:
                 direct::renderer_present();
@@ -280,157 +1314,186 @@ namespace pen
                 break;
 
             case CMD_LOAD_SHADER:
-                direct::renderer_load_shader(cmd.shader_load, cmd.resource_slot);
-                memory_free(cmd.shader_load.byte_code);
-                memory_free(cmd.shader_load.so_decl_entries);
-                break;
+            {
+                const shader_load_params& cmd = cmd_payload<shader_load_params>(h);
+                direct::renderer_load_shader(cmd, slot);
+                cmd_free(cmd.byte_code);
+                cmd_free(cmd.so_decl_entries);
+            }
+            break;
 
             case CMD_SET_SHADER:
-                direct::renderer_set_shader(cmd.set_shader.shader_index, cmd.set_shader.shader_type);
-                break;
+            {
+                const set_shader_cmd& cmd = cmd_payload<set_shader_cmd>(h);
+                direct::renderer_set_shader(cmd.shader_index, cmd.shader_type);
+            }
+            break;
 
             case CMD_LINK_SHADER:
-                direct::renderer_link_shader_program(cmd.link_params, cmd.resource_slot);
-                for (u32 i = 0; i < cmd.link_params.num_constants; ++i)
-                    memory_free(cmd.link_params.constants[i].name);
-                memory_free(cmd.link_params.constants);
-                if (cmd.link_params.stream_out_names)
-                    for (u32 i = 0; i < cmd.link_params.num_stream_out_names; ++i)
-                        memory_free(cmd.link_params.stream_out_names[i]);
-                memory_free(cmd.link_params.stream_out_names);
-                break;
+            {
+                const shader_link_params& cmd = cmd_payload<shader_link_params>(h);
+                direct::renderer_link_shader_program(cmd, slot);
+                for (u32 i = 0; i < cmd.num_constants; ++i)
+                    cmd_free(cmd.constants[i].name);
+                cmd_free(cmd.constants);
+                if (cmd.stream_out_names)
+                    for (u32 i = 0; i < cmd.num_stream_out_names; ++i)
+                        cmd_free(cmd.stream_out_names[i]);
+                cmd_free(cmd.stream_out_names);
+            }
+            break;
 
             case CMD_CREATE_INPUT_LAYOUT:
-                direct::renderer_create_input_layout(cmd.create_input_layout, cmd.resource_slot);
-                memory_free(cmd.create_input_layout.vs_byte_code);
-                memory_free(cmd.create_input_layout.input_layout);
-                break;
+            {
+                const input_layout_creation_params& cmd = cmd_payload<input_layout_creation_params>(h);
+                direct::renderer_create_input_layout(cmd, slot);
+                cmd_free(cmd.vs_byte_code);
+                cmd_free(cmd.input_layout);
+            }
+            break;
 
             case CMD_SET_INPUT_LAYOUT:
-                direct::renderer_set_input_layout(cmd.command_data_index);
+                direct::renderer_set_input_layout(cmd_payload<index_cmd>(h).index);
                 break;
 
             case CMD_CREATE_BUFFER:
-                direct::renderer_create_buffer(cmd.create_buffer, cmd.resource_slot);
-                memory_free(cmd.create_buffer.data);
-                break;
+            {
+                const buffer_creation_params& cmd = cmd_payload<buffer_creation_params>(h);
+                direct::renderer_create_buffer(cmd, slot);
+                cmd_free(cmd.data);
+            }
+            break;
 
             case CMD_SET_VERTEX_BUFFER:
-                direct::renderer_set_vertex_buffers(cmd.set_vertex_buffer.buffer_indices, cmd.set_vertex_buffer.num_buffers,
-                                                    cmd.set_vertex_buffer.start_slot, cmd.set_vertex_buffer.strides,
-                                                    cmd.set_vertex_buffer.offsets);
-                memory_free(cmd.set_vertex_buffer.buffer_indices);
-                memory_free(cmd.set_vertex_buffer.strides);
-                memory_free(cmd.set_vertex_buffer.offsets);
-                break;
+            {
+                const set_vertex_buffer_cmd& cmd = cmd_payload<set_vertex_buffer_cmd>(h);
+                u32*                         indices = (u32*)cmd_inline_data<set_vertex_buffer_cmd>(h);
+                u32*                         strides = indices + cmd.num_buffers;
+                u32*                         offsets = strides + cmd.num_buffers;
+                direct::renderer_set_vertex_buffers(indices, cmd.num_buffers, cmd.start_slot, strides, offsets);
+            }
+            break;
 
             case CMD_SET_INDEX_BUFFER:
-                direct::renderer_set_index_buffer(cmd.set_index_buffer.buffer_index, cmd.set_index_buffer.format,
-                                                  cmd.set_index_buffer.offset);
-                break;
+            {
+                const set_index_buffer_cmd& cmd = cmd_payload<set_index_buffer_cmd>(h);
+                direct::renderer_set_index_buffer(cmd.buffer_index, cmd.format, cmd.offset);
+            }
+            break;
 
             case CMD_DRAW:
-                direct::renderer_draw(cmd.draw.vertex_count, cmd.draw.start_vertex, cmd.draw.primitive_topology);
-                break;
+            {
+                const draw_cmd& cmd = cmd_payload<draw_cmd>(h);
+                direct::renderer_draw(cmd.vertex_count, cmd.start_vertex, cmd.primitive_topology);
+            }
+            break;
 
             case CMD_DRAW_INDEXED:
-                direct::renderer_draw_indexed(cmd.draw_indexed.index_count, cmd.draw_indexed.start_index,
-                                              cmd.draw_indexed.base_vertex, cmd.draw_indexed.primitive_topology);
-                break;
+            {
+                const draw_indexed_cmd& cmd = cmd_payload<draw_indexed_cmd>(h);
+                direct::renderer_draw_indexed(cmd.index_count, cmd.start_index, cmd.base_vertex, cmd.primitive_topology);
+            }
+            break;
 
             case CMD_DRAW_INDEXED_INSTANCED:
-                direct::renderer_draw_indexed_instanced(
-                    cmd.draw_indexed_instanced.instance_count, cmd.draw_indexed_instanced.start_instance,
-                    cmd.draw_indexed_instanced.index_count, cmd.draw_indexed_instanced.start_index,
-                    cmd.draw_indexed_instanced.base_vertex, cmd.draw_indexed_instanced.primitive_topology);
-                break;
+            {
+                const draw_indexed_instanced_cmd& cmd = cmd_payload<draw_indexed_instanced_cmd>(h);
+                direct::renderer_draw_indexed_instanced(cmd.instance_count, cmd.start_instance, cmd.index_count,
+                                                        cmd.start_index, cmd.base_vertex, cmd.primitive_topology);
+            }
+            break;
 
             case CMD_CREATE_TEXTURE:
-                direct::renderer_create_texture(cmd.create_texture, cmd.resource_slot);
-                memory_free(cmd.create_texture.data);
-                break;
+            {
+                const texture_creation_params& cmd = cmd_payload<texture_creation_params>(h);
+                direct::renderer_create_texture(cmd, slot);
+                cmd_free(cmd.data);
+            }
+            break;
 
             case CMD_CREATE_SAMPLER:
-                direct::renderer_create_sampler(cmd.create_sampler, cmd.resource_slot);
+                direct::renderer_create_sampler(cmd_payload<sampler_creation_params>(h), slot);
                 break;
 
             case CMD_SET_TEXTURE:
-                direct::renderer_set_texture(cmd.set_texture.texture_index, cmd.set_texture.sampler_index,
-                                             cmd.set_texture.resource_slot, cmd.set_texture.bind_flags);
-                break;
+            {
+                const set_texture_cmd& cmd = cmd_payload<set_texture_cmd>(h);
+                direct::renderer_set_texture(cmd.texture_index, cmd.sampler_index, cmd.resource_slot, cmd.bind_flags);
+            }
+            break;
 
             case CMD_CREATE_RASTER_STATE:
-                direct::renderer_create_rasterizer_state(cmd.create_raster_state, cmd.resource_slot);
+                direct::renderer_create_rasterizer_state(cmd_payload<rasteriser_state_creation_params>(h), slot);
                 break;
 
             case CMD_SET_RASTER_STATE:
-                direct::renderer_set_rasterizer_state(cmd.command_data_index);
+                direct::renderer_set_rasterizer_state(cmd_payload<index_cmd>(h).index);
                 break;
 
             case CMD_SET_VIEWPORT:
-                direct::renderer_set_viewport(cmd.set_viewport);
+                direct::renderer_set_viewport(cmd_payload<viewport>(h));
                 break;
 
             case CMD_SET_SCISSOR_RECT:
-                direct::renderer_set_scissor_rect(cmd.set_rect);
+                direct::renderer_set_scissor_rect(cmd_payload<rect>(h));
                 break;
 
             case CMD_SET_VIEWPORT_RATIO:
-                _renderer_set_viewport_ratio(cmd.set_viewport);
+                _renderer_set_viewport_ratio(cmd_payload<viewport>(h));
                 break;
 
             case CMD_SET_SCISSOR_RECT_RATIO:
-                _renderer_set_scissor_ratio(cmd.set_rect);
-                break;
-
-            case CMD_RELEASE_SHADER:
-                direct::renderer_release_shader(cmd.set_shader.shader_index, cmd.set_shader.shader_type);
-                break;
-
-            case CMD_RELEASE_BUFFER:
-                direct::renderer_release_buffer(cmd.command_data_index);
-                break;
-
-            case CMD_RELEASE_TEXTURE_2D:
-                direct::renderer_release_texture(cmd.command_data_index);
-                break;
-
-            case CMD_RELEASE_RASTER_STATE:
-                direct::renderer_release_raster_state(cmd.command_data_index);
+                _renderer_set_scissor_ratio(cmd_payload<rect>(h));
                 break;
 
             case CMD_CREATE_BLEND_STATE:
-                direct::renderer_create_blend_state(cmd.create_blend_state, cmd.resource_slot);
-                memory_free(cmd.create_blend_state.render_targets);
-                break;
+            {
+                const blend_creation_params& cmd = cmd_payload<blend_creation_params>(h);
+                direct::renderer_create_blend_state(cmd, slot);
+                cmd_free(cmd.render_targets);
+            }
+            break;
 
             case CMD_SET_BLEND_STATE:
-                direct::renderer_set_blend_state(cmd.command_data_index);
+                direct::renderer_set_blend_state(cmd_payload<index_cmd>(h).index);
                 break;
 
             case CMD_SET_CONSTANT_BUFFER:
-                direct::renderer_set_constant_buffer(cmd.set_buffer.buffer_index, cmd.set_buffer.resource_slot,
-                                                     cmd.set_buffer.flags);
-                break;
+            {
+                const set_buffer_cmd& cmd = cmd_payload<set_buffer_cmd>(h);
+                direct::renderer_set_constant_buffer(cmd.buffer_index, cmd.resource_slot, cmd.flags);
+            }
+            break;
 
             case CMD_SET_STRUCTURED_BUFFER:
-                direct::renderer_set_structured_buffer(cmd.set_buffer.buffer_index, cmd.set_buffer.resource_slot,
-                                                       cmd.set_buffer.flags);
-                break;
+            {
+                const set_buffer_cmd& cmd = cmd_payload<set_buffer_cmd>(h);
+                direct::renderer_set_structured_buffer(cmd.buffer_index, cmd.resource_slot, cmd.flags);
+            }
+            break;
 
             case CMD_UPDATE_BUFFER:
-                direct::renderer_update_buffer(cmd.update_buffer.buffer_index, cmd.update_buffer.data,
-                                               cmd.update_buffer.data_size, cmd.update_buffer.offset);
-                memory_free(cmd.update_buffer.data);
-                break;
+            {
+                const update_buffer_cmd& cmd = cmd_payload<update_buffer_cmd>(h);
+                if (cmd.inline_data)
+                {
+                    void* data = cmd_inline_data<update_buffer_cmd>(h);
+                    direct::renderer_update_buffer(cmd.buffer_index, data, cmd.data_size, cmd.offset);
+                }
+                else
+                {
+                    direct::renderer_update_buffer(cmd.buffer_index, cmd.data, cmd.data_size, cmd.offset);
+                    cmd_free(cmd.data);
+                }
+            }
+            break;
 
             case CMD_CREATE_DEPTH_STENCIL_STATE:
-                direct::renderer_create_depth_stencil_state(*cmd.p_create_depth_stencil_state, cmd.resource_slot);
-                memory_free(cmd.p_create_depth_stencil_state);
+                direct::renderer_create_depth_stencil_state(cmd_payload<depth_stencil_creation_params>(h), slot);
                 break;
 
             case CMD_SET_DEPTH_STENCIL_STATE:
-                direct::renderer_set_depth_stencil_state(cmd.command_data_index);
+                direct::renderer_set_depth_stencil_state(cmd_payload<index_cmd>(h).index);
                 break;
 
             case CMD_UPDATE_QUERIES:
@@ -438,78 +1501,123 @@ namespace pen
                 break;
 
             case CMD_CREATE_RENDER_TARGET:
-                direct::renderer_create_render_target(cmd.create_render_target, cmd.resource_slot);
+                direct::renderer_create_render_target(cmd_payload<texture_creation_params>(h), slot);
                 break;
 
             case CMD_SET_TARGETS:
-                direct::renderer_set_targets(cmd.set_targets.colour, cmd.set_targets.num_colour, cmd.set_targets.depth,
-                                             cmd.set_targets.array_index, cmd.set_targets.array_index);
+            {
+                const set_target_cmd& cmd = cmd_payload<set_target_cmd>(h);
+                u32*                  colour = (u32*)cmd_inline_data<set_target_cmd>(h);
+                direct::renderer_set_targets(colour, cmd.num_colour, cmd.depth, cmd.array_index, cmd.array_index);
+            }
+            break;
+
+            case CMD_SET_SO_TARGET:
+                direct::renderer_set_stream_out_target(cmd_payload<index_cmd>(h).index);
                 break;
 
-            case CMD_RELEASE_BLEND_STATE:
-                direct::renderer_release_blend_state(cmd.command_data_index);
+            case CMD_RESOLVE_TARGET:
+            {
+                const msaa_resolve_params& cmd = cmd_payload<msaa_resolve_params>(h);
+                direct::renderer_resolve_target(cmd.render_target, cmd.resolve_type, _ctx->resolve_resources);
+            }
+            break;
+
+            case CMD_DRAW_AUTO:
+                direct::renderer_draw_auto();
                 break;
 
-            case CMD_RELEASE_CLEAR_STATE:
-                direct::renderer_release_clear_state(cmd.command_data_index);
+            case CMD_MAP_RESOURCE:
+                direct::renderer_read_back_resource(cmd_payload<resource_read_back_params>(h));
                 break;
 
-            case CMD_RELEASE_RENDER_TARGET:
-                direct::renderer_release_render_target(cmd.command_data_index);
+            case CMD_REPLACE_RESOURCE:
+            {
+                const replace_resource& cmd = cmd_payload<replace_resource>(h);
+                direct::renderer_replace_resource(cmd.dest_handle, cmd.src_handle, cmd.type);
+            }
+            break;
+
+            case CMD_CREATE_CLEAR_STATE:
+                direct::renderer_create_clear_state(cmd_payload<clear_state>(h), slot);
                 break;
 
-            case CMD_RELEASE_INPUT_LAYOUT:
-                direct::renderer_release_input_layout(cmd.command_data_index);
+            case CMD_PUSH_PERF_MARKER:
+                profiler_begin_dynamic((const c8*)(h + 1));
+                direct::renderer_push_perf_marker((const c8*)(h + 1));
                 break;
 
-            case CMD_RELEASE_SAMPLER:
-                direct::renderer_release_sampler(cmd.command_data_index);
+            case CMD_POP_PERF_MARKER:
+                direct::renderer_pop_perf_marker();
+                profiler_end();
                 break;
 
-            case CMD_RELEASE_DEPTH_STENCIL_STATE:
-                direct::renderer_release_depth_stencil_state(cmd.command_data_index);
+            case CMD_DISPATCH_COMPUTE:
+            {
+                const compute_dispatch_params& cmd = cmd_payload<compute_dispatch_params>(h);
+                direct::renderer_dispatch_compute(cmd.grid, cmd.num_threads);
+            }
+            break;
+
+            case CMD_SET_STENCIL_REF:
+                direct::renderer_set_stencil_ref((u8)cmd_payload<index_cmd>(h).index);
                 break;
 
-            case CMD_SET_SO_TARGET:
-                direct::renderer_set_stream_out_target(cmd.command_data_index);
+            case CMD_RECYCLE_FRAME_ARENA:
+            {
+                const recycle_arena_cmd& cmd = cmd_payload<recycle_arena_cmd>(h);
+                frame_arena_recycle(_ctx, cmd.arena_index, cmd.requested);
+            }
+            break;
+
+            case CMD_EXEC_RELEASE:
+                exec_release_cmd(cmd_payload<release_cmd>(h));
                 break;
+        }
+    }
 
-            case CMD_RESOLVE_TARGET:
-                direct::renderer_resolve_target(cmd.resolve_params.render_target, cmd.resolve_params.resolve_type,
-                                                _ctx->resolve_resources);
+    void exec_release_cmd(const release_cmd& cmd)
+    {
+        switch (cmd.command_index)
+        {
+            case CMD_RELEASE_SHADER:
+                direct::renderer_release_shader(cmd.resource_slot, cmd.shader_type);
                 break;
 
-            case CMD_DRAW_AUTO:
-                direct::renderer_draw_auto();
+            case CMD_RELEASE_BUFFER:
+                direct::renderer_release_buffer(cmd.resource_slot);
                 break;
 
-            case CMD_MAP_RESOURCE:
-                direct::renderer_read_back_resource(cmd.rrb_params);
+            case CMD_RELEASE_TEXTURE_2D:
+                direct::renderer_release_texture(cmd.resource_slot);
                 break;
 
-            case CMD_REPLACE_RESOURCE:
-                direct::renderer_replace_resource(cmd.replace_resource_params.dest_handle,
-                                                  cmd.replace_resource_params.src_handle, cmd.replace_resource_params.type);
+            case CMD_RELEASE_RASTER_STATE:
+                direct::renderer_release_raster_state(cmd.resource_slot);
                 break;
 
-            case CMD_CREATE_CLEAR_STATE:
-                direct::renderer_create_clear_state(cmd.clear_state_params, cmd.resource_slot);
+            case CMD_RELEASE_BLEND_STATE:
+                direct::renderer_release_blend_state(cmd.resource_slot);
                 break;
 
-            case CMD_PUSH_PERF_MARKER:
-                direct::renderer_push_perf_marker(cmd.name);
+            case CMD_RELEASE_CLEAR_STATE:
+                direct::renderer_release_clear_state(cmd.resource_slot);
                 break;
 
-            case CMD_POP_PERF_MARKER:
-                direct::renderer_pop_perf_marker();
+            case CMD_RELEASE_RENDER_TARGET:
+                direct::renderer_release_render_target(cmd.resource_slot);
                 break;
 
-            case CMD_DISPATCH_COMPUTE:
-                direct::renderer_dispatch_compute(cmd.cs_dispatch.grid, cmd.cs_dispatch.num_threads);
+            case CMD_RELEASE_INPUT_LAYOUT:
+                direct::renderer_release_input_layout(cmd.resource_slot);
                 break;
 
-            case CMD_SET_STENCIL_REF:
-                direct::renderer_set_stencil_ref(cmd.stencil_ref);
+            case CMD_RELEASE_SAMPLER:
+                direct::renderer_release_sampler(cmd.resource_slot);
+                break;
+
+            case CMD_RELEASE_DEPTH_STENCIL_STATE:
+                direct::renderer_release_depth_stencil_state(cmd.resource_slot);
                 break;
         }
     }
@@ -525,77 +1633,164 @@ namespace pen
 
     void renderer_consume_cmd_buffer()
     {
+        // free slots the render thread has now deleted the resources for
+        u32 slot;
+        while (_ctx->free_slots.try_pop(slot))
+            slot_resources_free(&_ctx->renderer_slot_resources, slot);
+
+        frame_arena_next(_ctx);
+
+        // the render thread executes commands up to here for this frame, later commands belong to the next one
+        cmd_put(CMD_END_FRAME);
+
+        renderer_cmd_stats& stats = _ctx->cmd_stats;
+        renderer_cmd_stats& frame = _ctx->cmd_frame;
+        stats.frame_bytes = frame.frame_bytes;
+        stats.frame_cmds = frame.frame_cmds;
+        stats.stalls += frame.stalls;
+        stats.state_cmds = _ctx->state.issued;
+        stats.state_filtered = _ctx->state.filtered;
+        frame = {};
+
+        _ctx->state.issued = 0;
+        _ctx->state.filtered = 0;
+
+        // the user thread consumes once per frame, so per frame memory and profiler stats roll over here too
+        memory_tracking_new_frame();
+        profiler_new_frame();
+
         if (_ctx->consume_semaphore)
         {
+            u32 submitted = ++_ctx->frames_submitted;
             semaphore_post(_ctx->consume_semaphore, 1);
-            semaphore_wait(_ctx->continue_semaphore);
+
+            // continue is posted each time a frame completes, so it can be signalled for frames we didnt wait on
+            timer_start(_ctx->wait_timer);
+            while (submitted - _ctx->frames_completed.load() > _ctx->frames_in_flight)
+                semaphore_wait(_ctx->continue_semaphore);
+
+            stats.user_wait_ms = timer_elapsed_ms(_ctx->wait_timer);
+            stats.frames_in_flight = submitted - _ctx->frames_completed.load();
         }
 
         // sync on window surface
         direct::renderer_sync();
     }
 
-    bool renderer_dispatch()
+    void dispatch_frame()
     {
-        if (semaphore_try_wait(_ctx->consume_semaphore))
+        // some api's need to set the current context on the caller thread.
+        direct::renderer_new_frame();
+
+        PEN_PROFILE_SCOPE("renderer_dispatch");
+        timer_start(_ctx->dispatch_timer);
+
+        capture_begin_frame();
+        bool capture = s_capture.active.load();
+        bool timed = s_cmd_timings.enabled.load();
+
+        // consume and execute commands, the stream entry is released after exec so payloads can be used in place.
+        // the frame and its end marker are committed before the frame is submitted, so the stream is never empty here
+        cmd_category category = e_cmd_category::none;
+        cmd_header*  cmd = _ctx->cmd_buffer.get();
+        while (cmd->command_index != CMD_END_FRAME)
         {
-            // free slots we have now deleted the resources for
-            u32 ns = sb_count(_ctx->free_slots);
-            for(u32 i = 0; i < ns; ++i)
+            if (capture)
+                capture_cmd(cmd);
+
+            if (profiler_enabled())
             {
-                slot_resources_free(&_ctx->renderer_slot_resources, _ctx->free_slots[i]);
-            }
-            sb_free(_ctx->free_slots);
-            _ctx->free_slots = nullptr;
-            
-            // some api's need to set the current context on the caller thread.
-            direct::renderer_new_frame();
+                cmd_category c = get_cmd_category(cmd->command_index);
+                if (c != category)
+                {
+                    if (category != e_cmd_category::none)
+                        profiler_end();
 
-            semaphore_post(_ctx->continue_semaphore, 1);
+                    if (c != e_cmd_category::none)
+                        profiler_begin(k_cmd_category_names[c]);
 
-            renderer_cmd* cmd = _ctx->cmd_buffer.get();
+                    category = c;
+                }
+            }
 
-            // consume and execute commands
-            while (cmd)
+            if (timed)
             {
-                exec_cmd(*cmd);
-                cmd = _ctx->cmd_buffer.get();
+                timer_start(s_cmd_timings.timer);
+                exec_cmd(cmd);
+                s_cmd_timings.total_us[cmd->command_index] += timer_elapsed_us(s_cmd_timings.timer);
+                s_cmd_timings.count[cmd->command_index]++;
             }
-            
-            // check the release cmd_buffer.. we need to wait a few frames before releasing resources
-            // so they arent in flight on the gpu
-            static const u32 k_waitFrames = 6;
-            for(;;)
+            else
             {
-                renderer_cmd* cmd = _ctx->release_cmd_buffer.check();
-                u64 cf = pen::_renderer_frame_index();
-                if(!cmd || cf - cmd->frame_index < k_waitFrames)
-                    break;
-                    
-                cmd = _ctx->release_cmd_buffer.get();
-                if(cmd)
-                    exec_cmd(*cmd);
-                    
-                sb_push(_ctx->free_slots, cmd->resource_slot);
+                exec_cmd(cmd);
             }
 
-            direct::renderer_end_frame();
+            _ctx->cmd_buffer.pop(cmd);
+            cmd = _ctx->cmd_buffer.get();
+        }
+        _ctx->cmd_buffer.pop(cmd);
+
+        if (category != e_cmd_category::none)
+            profiler_end();
 
-            return true;
+        _ctx->cmd_stats.dispatch_ms = timer_elapsed_ms(_ctx->dispatch_timer);
+        _ctx->cmd_stats.render_idle_ms = _ctx->idle_ms;
+        _ctx->idle_ms = 0.0f;
+        
+        // check the release cmd_buffer.. we need to wait a few frames before releasing resources
+        // so they arent in flight on the gpu
+        static const u32 k_waitFrames = 6;
+        for(;;)
+        {
+            release_cmd* cmd = _ctx->release_cmd_buffer.peek();
+            u64 cf = pen::_renderer_frame_index();
+            if(!cmd || cf - cmd->frame_index < k_waitFrames)
+                break;
+
+            if (capture)
+                capture_release(*cmd);
+
+            exec_release_cmd(*cmd);
+
+            // renderer_create_* allocates on the user thread, so the slot is handed back to be freed there
+            _ctx->free_slots.push(cmd->resource_slot);
+
+            _ctx->release_cmd_buffer.pop();
         }
 
-        return false;
+        capture_end_frame();
+
+        direct::renderer_end_frame();
+
+        // fence for the user thread
+        _ctx->frames_completed++;
+        semaphore_post(_ctx->continue_semaphore, 1);
+    }
+
+    bool renderer_dispatch()
+    {
+        if (!semaphore_try_wait(_ctx->consume_semaphore))
+            return false;
+
+        dispatch_frame();
+        return true;
     }
 
     void renderer_wait_for_jobs()
     {
         // this is a dedicated thread which stays for the duration of the program
         semaphore_post(_ctx->continue_semaphore, 1);
+        PEN_PROFILE_THREAD("render");
 
         for (;;)
         {
-            if (!renderer_dispatch())
-                pen::thread_sleep_ms(1);
+            // block until a frame is submitted, the os still needs updating periodically if the user thread is idle
+            timer_start(_ctx->idle_timer);
+            bool frame = semaphore_wait_ms(_ctx->consume_semaphore, k_render_idle_wait_ms);
+            _ctx->idle_ms += timer_elapsed_ms(_ctx->idle_timer);
+
+            if (frame)
+                dispatch_frame();
 
             if (!pen::os_update())
                 break;
@@ -639,7 +1834,7 @@ namespace pen
         bcp.buffer_size = sizeof(textured_vertex) * 4;
         bcp.data = (void*)&quad_vertices[0];
 
-        ctx->resolve_resources.vertex_buffer = renderer_create_buffer(bcp);
+        ctx->resolve_resources.vertex_buffer = slot_handle_index(renderer_create_buffer(bcp));
 
         // create index buffer
         u16 indices[] = {0, 1, 2, 2, 3, 0};
@@ -650,7 +1845,7 @@ namespace pen
         bcp.buffer_size = sizeof(u16) * 6;
         bcp.data = (void*)&indices[0];
 
-        ctx->resolve_resources.index_buffer = renderer_create_buffer(bcp);
+        ctx->resolve_resources.index_buffer = slot_handle_index(renderer_create_buffer(bcp));
 
         // create cbuffer
         bcp.usage_flags = PEN_USAGE_DYNAMIC;
@@ -659,12 +1854,16 @@ namespace pen
         bcp.buffer_size = sizeof(resolve_cbuffer);
         bcp.data = nullptr;
 
-        ctx->resolve_resources.constant_buffer = renderer_create_buffer(bcp);
+        ctx->resolve_resources.constant_buffer = slot_handle_index(renderer_create_buffer(bcp));
+
+        // the backends bind these directly so they keep the bare index
         g_resolve_resources = ctx->resolve_resources;
     }
 
     void renderer_init(void* user_data, bool wait_for_jobs)
     {
+        PEN_MEMORY_TAG(e_mem_tag::renderer);
+
         // create main render context and bind it
         _main_ctx = renderer_create_context();
         _ctx = (fe_render_ctx*)_main_ctx;
@@ -681,21 +1880,19 @@ namespace pen
         
         init_resolve_resources(_ctx);
 
+        // slots are handed out in order at startup, so a replay process will have allocated the same ones
+        _ctx->init_slots = _ctx->resolve_resources.constant_buffer + 1;
+
         if (wait_for_jobs)
             renderer_wait_for_jobs();
     }
 
     void* renderer_thread_function(void* params)
     {
-        static pen::job* p_job_thread_info;
-        
-        job_thread_params* job_params = (job_thread_params*)params;
-
-        p_job_thread_info = job_params->job_info;
-
-        _ctx->consume_semaphore = p_job_thread_info->p_sem_consume;
-        _ctx->continue_semaphore = p_job_thread_info->p_sem_continue;
+        // everything allocated on the render thread, including backend allocations
+        memory_push_tag(e_mem_tag::renderer);
 
+        job_thread_params* job_params = (job_thread_params*)params;
         renderer_init(job_params->user_data, true);
 
         return PEN_THREAD_OK;
@@ -739,96 +1936,347 @@ namespace pen
             output_file.appendf("../../test_results/%s.png", pen_window.window_title);
             stbi_write_png(output_file.c_str(), pen_window.width, pen_window.height, 4, ref_image, row_pitch);
 
-            free(file_data);
+            pen::memory_free(file_data);
+        }
+        else
+        {
+            // save reference image
+            Str output_file = "";
+            output_file.appendf("../../test_reference/%s.png", pen_window.window_title);
+            stbi_write_png(output_file.c_str(), pen_window.width, pen_window.height, 4, data, row_pitch);
+        }
+
+        f32 percentage = 100.0f / ((f32)depth_pitch / (f32)diffs);
+        PEN_LOG("test complete %i diffs: out of %i (%2.3f%%)\n", diffs, depth_pitch, percentage);
+
+        Str output_results_file = "";
+        output_results_file.appendf("../../test_results/%s.txt", pen_window.window_title);
+
+        std::ofstream ofs(output_results_file.c_str());
+        ofs << diffs << "/" << depth_pitch << ", " << percentage;
+        ofs.close();
+
+        pen::os_terminate(0);
+    }
+
+    void renderer_test_enable()
+    {
+        PEN_LOG("renderer test enabled.\n");
+        s_run_test = true;
+    }
+
+    void renderer_test_run()
+    {
+        if (!s_run_test)
+            return;
+
+        // wait for the first swap.
+        static u32 count = 0;
+        if (count++ < 1)
+            return;
+
+        // run once, wait for result
+        static bool ran = false;
+        if (ran)
+            return;
+
+        PEN_LOG("running test %s.\n", pen_window.window_title);
+
+        pen::resource_read_back_params rrbp;
+        rrbp.block_size = 4; // RGBA8
+        rrbp.format = PEN_TEX_FORMAT_RGBA8_UNORM;
+        rrbp.resource_index = PEN_BACK_BUFFER_COLOUR;
+        rrbp.row_pitch = pen_window.width * rrbp.block_size;
+        rrbp.depth_pitch = pen_window.width * pen_window.height * rrbp.block_size;
+        rrbp.data_size = pen_window.width * pen_window.height * rrbp.block_size;
+        rrbp.call_back_function = &renderer_test_read_complete;
+
+        pen::renderer_read_back_resource(rrbp);
+
+        ran = true;
+    }
+    
+    render_ctx renderer_create_context()
+    {
+        fe_render_ctx* new_ctx = new fe_render_ctx();
+        new_ctx->cmd_buffer.create(k_cmd_stream_size);
+        new_ctx->release_cmd_buffer.create(1024);
+        new_ctx->free_slots.create(1024);
+        new_ctx->present_timer = timer_create();
+        timer_start(new_ctx->present_timer);
+        new_ctx->present_time = 0.0f;
+        new_ctx->dispatch_timer = timer_create();
+        new_ctx->cmd_stats.stream_size = k_cmd_stream_size;
+        new_ctx->wait_timer = timer_create();
+        new_ctx->idle_timer = timer_create();
+        new_ctx->consume_semaphore = semaphore_create(0, k_max_frames_in_flight);
+        new_ctx->continue_semaphore = semaphore_create(0, k_max_frames_in_flight);
+        slot_resources_init(&new_ctx->renderer_slot_resources, 2048);
+        slot_resources_init(&new_ctx->cmd_list_slots, 16);
+        state_cache_invalidate(new_ctx->state);
+
+        for (u32 i = 0; i < k_frame_arena_count; ++i)
+        {
+            new_ctx->arenas[i].data = (u8*)memory_alloc(k_frame_arena_initial_size);
+            new_ctx->arenas[i].size = k_frame_arena_initial_size;
+        }
+        new_ctx->arena_stats.arena_size = k_frame_arena_initial_size;
+
+        return (render_ctx*)new_ctx;
+    }
+} // namespace pen
+
+namespace pen
+{
+    //
+    // allow shared context for hot loaded dll
+    //
+    
+    void renderer_set_current_ctx(render_ctx ctx)
+    {
+        _ctx = (fe_render_ctx*)ctx;
+    }
+    
+    render_ctx renderer_get_main_context()
+    {
+        return _main_ctx;
+    }
+
+    void renderer_get_arena_stats(renderer_arena_stats& stats)
+    {
+        stats = _ctx->arena_stats;
+    }
+
+    void renderer_get_cmd_stats(renderer_cmd_stats& stats)
+    {
+        stats = _ctx->cmd_stats;
+    }
+
+    void renderer_set_frames_in_flight(u32 num_frames)
+    {
+        _ctx->frames_in_flight = max<u32>(min<u32>(num_frames, k_max_frames_in_flight), 1);
+    }
+
+    u32 renderer_get_frames_in_flight()
+    {
+        return _ctx->frames_in_flight;
+    }
+
+    //
+    // capture and replay
+    //
+
+    void renderer_capture_enable(const c8* filename, u32 num_frames)
+    {
+        if (renderer_capture_active())
+            return;
+
+        s_capture.filename = filename;
+        s_capture.num_frames = max<u32>(num_frames, 1);
+        s_capture.pending = 1;
+    }
+
+    bool renderer_capture_active()
+    {
+        return s_capture.pending.load() || s_capture.active.load();
+    }
+
+    bool renderer_replay_load(const c8* filename)
+    {
+        renderer_replay_release();
+
+        void* data = nullptr;
+        u32   size = 0;
+        if (filesystem_read_file_to_buffer(filename, &data, size) != PEN_ERR_OK)
+        {
+            PEN_LOG("[renderer] failed to open trace %s", filename);
+            return false;
         }
-        else
+
+        s_replay.data = (u8*)data;
+        if (size >= sizeof(trace_header))
+            memcpy(&s_replay.header, data, sizeof(trace_header));
+
+        if (size < sizeof(trace_header) || s_replay.header.magic != k_trace_magic ||
+            s_replay.header.version != k_trace_version)
         {
-            // save reference image
-            Str output_file = "";
-            output_file.appendf("../../test_reference/%s.png", pen_window.window_title);
-            stbi_write_png(output_file.c_str(), pen_window.width, pen_window.height, 4, data, row_pitch);
+            PEN_LOG("[renderer] %s is not a valid version %i trace", filename, k_trace_version);
+            renderer_replay_release();
+            return false;
         }
 
-        f32 percentage = 100.0f / ((f32)depth_pitch / (f32)diffs);
-        PEN_LOG("test complete %i diffs: out of %i (%2.3f%%)\n", diffs, depth_pitch, percentage);
+        // index frames and find which resources are still alive at the end
+        const u8* p = s_replay.data + sizeof(trace_header);
+        const u8* end = s_replay.data + size;
+        while (p < end)
+        {
+            sb_push(s_replay.frame_offsets, (u32)(p - s_replay.data));
 
-        Str output_results_file = "";
-        output_results_file.appendf("../../test_results/%s.txt", pen_window.window_title);
+            u32 frame_size;
+            replay_read(p, &frame_size, sizeof(u32));
 
-        std::ofstream ofs(output_results_file.c_str());
-        ofs << diffs << "/" << depth_pitch << ", " << percentage;
-        ofs.close();
+            const u8* frame_end = p + frame_size;
+            while (p < frame_end)
+                replay_track_resident(replay_parse(p, false));
+        }
 
-        pen::os_terminate(0);
+        if (s_replay.header.width != pen_window.width || s_replay.header.height != pen_window.height)
+            PEN_LOG("[renderer] trace was captured at %ix%i, replaying at %ix%i", s_replay.header.width,
+                    s_replay.header.height, pen_window.width, pen_window.height);
+
+        return true;
     }
 
-    void renderer_test_enable()
+    u32 renderer_replay_num_frames()
     {
-        PEN_LOG("renderer test enabled.\n");
-        s_run_test = true;
+        return sb_count(s_replay.frame_offsets);
     }
 
-    void renderer_test_run()
+    void renderer_replay_frame(u32 frame)
     {
-        if (!s_run_test)
-            return;
+        PEN_ASSERT(frame < renderer_replay_num_frames());
 
-        // wait for the first swap.
-        static u32 count = 0;
-        if (count++ < 1)
-            return;
+        const u8* p = s_replay.data + s_replay.frame_offsets[frame];
 
-        // run once, wait for result
-        static bool ran = false;
-        if (ran)
-            return;
+        u32 frame_size;
+        replay_read(p, &frame_size, sizeof(u32));
 
-        PEN_LOG("running test %s.\n", pen_window.window_title);
+        const u8* end = p + frame_size;
+        while (p < end)
+        {
+            cmd_header* h = replay_parse(p, true);
+            if (replay_is_init_resource(h))
+                continue;
 
-        pen::resource_read_back_params rrbp;
-        rrbp.block_size = 4; // RGBA8
-        rrbp.format = PEN_TEX_FORMAT_RGBA8_UNORM;
-        rrbp.resource_index = PEN_BACK_BUFFER_COLOUR;
-        rrbp.row_pitch = pen_window.width * rrbp.block_size;
-        rrbp.depth_pitch = pen_window.width * pen_window.height * rrbp.block_size;
-        rrbp.data_size = pen_window.width * pen_window.height * rrbp.block_size;
-        rrbp.call_back_function = &renderer_test_read_complete;
+            cmd_copy(h);
 
-        pen::renderer_read_back_resource(rrbp);
+            _ctx->cmd_frame.frame_bytes += h->size;
+            _ctx->cmd_frame.frame_cmds++;
+        }
+    }
 
-        ran = true;
+    void renderer_replay_reset()
+    {
+        // release resources the trace leaves alive, so replaying it again creates them from scratch
+        u32 n = sb_count(s_replay.resident);
+        for (u32 i = 0; i < n; ++i)
+            cmd_write(CMD_EXEC_RELEASE, s_replay.resident[i].resource_slot, &s_replay.resident[i], sizeof(release_cmd));
     }
-    
-    render_ctx renderer_create_context()
+
+    void renderer_replay_release()
     {
-        fe_render_ctx* new_ctx = new fe_render_ctx();
-        new_ctx->cmd_buffer.create(MAX_COMMANDS);
-        new_ctx->release_cmd_buffer.create(1024);
-        new_ctx->present_timer = timer_create();
-        timer_start(new_ctx->present_timer);
-        new_ctx->present_time = 0.0f;
-        new_ctx->consume_semaphore = semaphore_create(0, 1);
-        new_ctx->continue_semaphore = semaphore_create(0, 1);
-        slot_resources_init(&new_ctx->renderer_slot_resources, 2048);
+        memory_free(s_replay.data);
+        sb_free(s_replay.frame_offsets);
+        sb_free(s_replay.resident);
+        s_replay = replay_state();
+    }
 
-        return (render_ctx*)new_ctx;
+    void renderer_cmd_timings_enable(bool enable)
+    {
+        if (!s_cmd_timings.timer)
+            s_cmd_timings.timer = timer_create();
+
+        memset(s_cmd_timings.count, 0x0, sizeof(s_cmd_timings.count));
+        memset(s_cmd_timings.total_us, 0x0, sizeof(s_cmd_timings.total_us));
+        s_cmd_timings.enabled = enable ? 1 : 0;
+    }
+
+    u32 renderer_get_cmd_timings(renderer_cmd_timing* timings, u32 max_timings)
+    {
+        u32 n = 0;
+        for (u32 i = 0; i < CMD_WRAP && n < max_timings; ++i)
+        {
+            if (s_cmd_timings.count[i] == 0)
+                continue;
+
+            timings[n].name = k_cmd_names[i];
+            timings[n].count = s_cmd_timings.count[i];
+            timings[n].total_us = s_cmd_timings.total_us[i];
+            ++n;
+        }
+
+        return n;
     }
-} // namespace pen
 
-namespace pen
-{
     //
-    // allow shared context for hot loaded dll
+    // deferred command lists
     //
-    
-    void renderer_set_current_ctx(render_ctx ctx)
+
+    cmd_list* cmd_list_get(u32 list)
     {
-        _ctx = (fe_render_ctx*)ctx;
+        // list handles never reach the backends, so they are generation counted to catch use after release
+        PEN_ASSERT(slot_resources_valid(&_ctx->cmd_list_slots, list));
+        return _ctx->cmd_lists[slot_handle_index(list)];
     }
-    
-    render_ctx renderer_get_main_context()
+
+    u32 renderer_create_cmd_list()
     {
-        return _main_ctx;
+        slot_handle h = slot_resources_get_next_handle(&_ctx->cmd_list_slots);
+        u32         i = slot_handle_index(h);
+
+        while ((u32)sb_count(_ctx->cmd_lists) <= i)
+            sb_push(_ctx->cmd_lists, nullptr);
+
+        _ctx->cmd_lists[i] = new cmd_list();
+        return h;
+    }
+
+    void renderer_release_cmd_list(u32 list)
+    {
+        cmd_list* cl = cmd_list_get(list);
+        PEN_ASSERT(cl->size == 0); // unsubmitted commands would leak their heap payloads
+
+        memory_free(cl->data);
+        delete cl;
+        _ctx->cmd_lists[slot_handle_index(list)] = nullptr;
+        slot_resources_free_handle(&_ctx->cmd_list_slots, list);
+    }
+
+    void renderer_begin_cmd_list(u32 list)
+    {
+        PEN_ASSERT(!t_cmd_list);
+        t_cmd_list = cmd_list_get(list);
+
+        // commands in the list will follow whatever state the stream has when it is submitted
+        state_cache_invalidate(t_cmd_list->state);
+    }
+
+    void renderer_end_cmd_list()
+    {
+        t_cmd_list = nullptr;
+    }
+
+    bool renderer_recording_cmd_list()
+    {
+        return t_cmd_list != nullptr;
+    }
+
+    void renderer_submit_cmd_list(u32 list)
+    {
+        PEN_ASSERT(!t_cmd_list);
+
+        // commands are copied one at a time because they cannot straddle the end of the stream
+        cmd_list* cl = cmd_list_get(list);
+        u32       pos = 0;
+        while (pos < cl->size)
+        {
+            cmd_header* h = (cmd_header*)(cl->data + pos);
+            cmd_copy(h);
+            pos += h->size;
+        }
+
+        _ctx->cmd_frame.frame_bytes += cl->size;
+        _ctx->cmd_frame.frame_cmds += cl->num_cmds;
+
+        cl->size = 0;
+        cl->num_cmds = 0;
+
+        // the list leaves the stream in the state it last set
+        _ctx->state.issued += cl->state.issued;
+        _ctx->state.filtered += cl->state.filtered;
+        cl->state.issued = 0;
+        cl->state.filtered = 0;
+        state_cache_invalidate(_ctx->state);
     }
     
     //
@@ -837,186 +2285,185 @@ namespace pen
 
     void renderer_update_queries()
     {
-        renderer_cmd cmd;
-
-        cmd.command_index = CMD_UPDATE_QUERIES;
-        _ctx->cmd_buffer.put(cmd);
+        cmd_put(CMD_UPDATE_QUERIES);
     }
 
     void renderer_clear(u32 clear_state_index, u32 array_index)
     {
-        renderer_cmd cmd;
+        // some backends change depth and stencil state to clear
+        state_cache_invalidate();
 
-        cmd.command_index = CMD_CLEAR;
-        cmd.clear.clear_state = clear_state_index;
-        cmd.clear.array_index = array_index;
+        clear_cmd cmd;
+        cmd.clear_state = resource_index(clear_state_index);
+        cmd.array_index = array_index;
 
-        _ctx->cmd_buffer.put(cmd);
+        cmd_put(CMD_CLEAR, cmd);
     }
 
     void renderer_present()
     {
-        renderer_cmd cmd;
-
-        cmd.command_index = CMD_PRESENT;
+        // handles are not reused until their release has been deferred for several frames, so a cache which is
+        // reset every frame never sees a new resource with an old handle
+        state_cache_invalidate();
 
-        _ctx->cmd_buffer.put(cmd);
+        cmd_put(CMD_PRESENT);
     }
 
     u32 renderer_load_shader(const shader_load_params& params)
     {
-        renderer_cmd cmd;
-
-        cmd.command_index = CMD_LOAD_SHADER;
-
-        cmd.shader_load.byte_code_size = params.byte_code_size;
-        cmd.shader_load.type = params.type;
+        shader_load_params cmd = params;
+        cmd.byte_code = nullptr;
+        cmd.so_decl_entries = nullptr;
 
         if (params.byte_code)
         {
-            cmd.shader_load.byte_code = memory_alloc(params.byte_code_size);
-            memcpy(cmd.shader_load.byte_code, params.byte_code, params.byte_code_size);
+            cmd.byte_code = cmd_alloc(params.byte_code_size);
+            memcpy(cmd.byte_code, params.byte_code, params.byte_code_size);
         }
 
-        cmd.shader_load.so_decl_entries = nullptr;
         if (params.so_decl_entries)
         {
-            cmd.shader_load.so_num_entries = params.so_num_entries;
+            cmd.so_num_entries = params.so_num_entries;
 
             u32 entries_size = sizeof(stream_out_decl_entry) * params.so_num_entries;
-            cmd.shader_load.so_decl_entries = (stream_out_decl_entry*)memory_alloc(entries_size);
+            cmd.so_decl_entries = (stream_out_decl_entry*)cmd_alloc(entries_size);
 
-            memcpy(cmd.shader_load.so_decl_entries, params.so_decl_entries, entries_size);
+            memcpy(cmd.so_decl_entries, params.so_decl_entries, entries_size);
         }
 
-        u32 resource_slot = slot_resources_get_next(&_ctx->renderer_slot_resources);
-        cmd.resource_slot = resource_slot;
-
-        _ctx->cmd_buffer.put(cmd);
+        slot_handle h = slot_resources_get_next_handle(&_ctx->renderer_slot_resources);
+        cmd_put(CMD_LOAD_SHADER, cmd, slot_handle_index(h));
 
-        return resource_slot;
+        return h;
     }
 
     u32 renderer_link_shader_program(const shader_link_params& params)
     {
-        renderer_cmd cmd;
-
-        cmd.command_index = CMD_LINK_SHADER;
-
-        cmd.link_params = params;
+        shader_link_params cmd = params;
+        cmd.vertex_shader = resource_index(params.vertex_shader);
+        cmd.pixel_shader = resource_index(params.pixel_shader);
+        cmd.stream_out_shader = resource_index(params.stream_out_shader);
+        cmd.input_layout = resource_index(params.input_layout);
 
         u32 num = params.num_constants;
         u32 layout_size = sizeof(constant_layout_desc) * num;
-        cmd.link_params.constants = (constant_layout_desc*)memory_alloc(layout_size);
+        cmd.constants = (constant_layout_desc*)cmd_alloc(layout_size);
 
-        constant_layout_desc* c = cmd.link_params.constants;
+        constant_layout_desc* c = cmd.constants;
         for (u32 i = 0; i < num; ++i)
         {
             c[i].location = params.constants[i].location;
             c[i].type = params.constants[i].type;
 
             u32 len = string_length(params.constants[i].name);
-            c[i].name = (c8*)memory_alloc(len + 1);
+            c[i].name = (c8*)cmd_alloc(len + 1);
 
             memcpy(c[i].name, params.constants[i].name, len);
             c[i].name[len] = '\0';
         }
 
-        cmd.link_params.stream_out_names = nullptr;
+        cmd.stream_out_names = nullptr;
         if (params.stream_out_shader != 0)
         {
             u32 num_so = params.num_stream_out_names;
-            cmd.link_params.stream_out_names = (c8**)memory_alloc(sizeof(c8*) * num_so);
+            cmd.stream_out_names = (c8**)cmd_alloc(sizeof(c8*) * num_so);
 
-            c8** so = cmd.link_params.stream_out_names;
+            c8** so = cmd.stream_out_names;
             for (u32 i = 0; i < num_so; ++i)
             {
                 u32 len = string_length(params.stream_out_names[i]);
-                so[i] = (c8*)memory_alloc(len + 1);
+                so[i] = (c8*)cmd_alloc(len + 1);
 
                 memcpy(so[i], params.stream_out_names[i], len);
                 so[i][len] = '\0';
             }
         }
 
-        u32 resource_slot = slot_resources_get_next(&_ctx->renderer_slot_resources);
-        cmd.resource_slot = resource_slot;
-
-        _ctx->cmd_buffer.put(cmd);
+        slot_handle h = slot_resources_get_next_handle(&_ctx->renderer_slot_resources);
+        cmd_put(CMD_LINK_SHADER, cmd, slot_handle_index(h));
 
-        return resource_slot;
+        return h;
     }
 
     void renderer_set_shader(u32 shader_index, u32 shader_type)
     {
-        renderer_cmd cmd;
+        shader_index = resource_index(shader_index);
+
+        PEN_ASSERT(shader_type <= PEN_SHADER_TYPE_CS);
+
+        state_cache& sc = state_cache_current();
+        if (state_redundant(sc, sc.shader[shader_type], shader_index))
+            return;
+
+        // vertex and pixel shaders are bound together, stream out and compute replace them on some backends
+        for (u32 i = 0; i < PEN_ARRAY_SIZE(sc.shader); ++i)
+        {
+            if (i == shader_type)
+                continue;
+
+            if (shader_type <= PEN_SHADER_TYPE_PS && i <= PEN_SHADER_TYPE_PS)
+                continue;
 
-        cmd.command_index = CMD_SET_SHADER;
+            sc.shader[i] = (u32)-1;
+        }
 
-        cmd.set_shader.shader_index = shader_index;
-        cmd.set_shader.shader_type = shader_type;
+        set_shader_cmd cmd;
+        cmd.shader_index = shader_index;
+        cmd.shader_type = shader_type;
 
-        _ctx->cmd_buffer.put(cmd);
+        cmd_put(CMD_SET_SHADER, cmd);
     }
 
     u32 renderer_create_input_layout(const input_layout_creation_params& params)
     {
-        renderer_cmd cmd;
-
-        cmd.command_index = CMD_CREATE_INPUT_LAYOUT;
+        input_layout_creation_params cmd;
 
         // simple data
-        cmd.create_input_layout.num_elements = params.num_elements;
-        cmd.create_input_layout.vs_byte_code_size = params.vs_byte_code_size;
+        cmd.num_elements = params.num_elements;
+        cmd.vs_byte_code_size = params.vs_byte_code_size;
 
         // copy buffer
-        cmd.create_input_layout.vs_byte_code = memory_alloc(params.vs_byte_code_size);
-        memcpy(cmd.create_input_layout.vs_byte_code, params.vs_byte_code, params.vs_byte_code_size);
+        cmd.vs_byte_code = cmd_alloc(params.vs_byte_code_size);
+        memcpy(cmd.vs_byte_code, params.vs_byte_code, params.vs_byte_code_size);
 
         // copy array
         u32 input_layouts_size = sizeof(input_layout_desc) * params.num_elements;
-        cmd.create_input_layout.input_layout = (input_layout_desc*)memory_alloc(input_layouts_size);
+        cmd.input_layout = (input_layout_desc*)cmd_alloc(input_layouts_size);
 
-        memcpy(cmd.create_input_layout.input_layout, params.input_layout, input_layouts_size);
+        memcpy(cmd.input_layout, params.input_layout, input_layouts_size);
 
-        u32 resource_slot = slot_resources_get_next(&_ctx->renderer_slot_resources);
-        cmd.resource_slot = resource_slot;
-
-        _ctx->cmd_buffer.put(cmd);
+        slot_handle h = slot_resources_get_next_handle(&_ctx->renderer_slot_resources);
+        cmd_put(CMD_CREATE_INPUT_LAYOUT, cmd, slot_handle_index(h));
 
-        return resource_slot;
+        return h;
     }
 
     void renderer_set_input_layout(u32 layout_index)
     {
-        renderer_cmd cmd;
-        cmd.command_index = CMD_SET_INPUT_LAYOUT;
-        cmd.command_data_index = layout_index;
+        layout_index = resource_index(layout_index);
+
+        state_cache& sc = state_cache_current();
+        if (state_redundant(sc, sc.input_layout, layout_index))
+            return;
 
-        _ctx->cmd_buffer.put(cmd);
+        cmd_put_index(CMD_SET_INPUT_LAYOUT, layout_index);
     }
 
     u32 renderer_create_buffer(const buffer_creation_params& params)
     {
-        renderer_cmd cmd;
-
-        cmd.command_index = CMD_CREATE_BUFFER;
-
-        memcpy(&cmd.create_buffer, (void*)&params, sizeof(buffer_creation_params));
+        buffer_creation_params cmd = params;
 
         if (params.data)
         {
             // make a copy of the buffers data
-            cmd.create_buffer.data = memory_alloc(params.buffer_size);
-            memcpy(cmd.create_buffer.data, params.data, params.buffer_size);
+            cmd.data = cmd_alloc(params.buffer_size);
+            memcpy(cmd.data, params.data, params.buffer_size);
         }
 
-        u32 resource_slot = slot_resources_get_next(&_ctx->renderer_slot_resources);
-        cmd.resource_slot = resource_slot;
-
-        _ctx->cmd_buffer.put(cmd);
+        slot_handle h = slot_resources_get_next_handle(&_ctx->renderer_slot_resources);
+        cmd_put(CMD_CREATE_BUFFER, cmd, slot_handle_index(h));
 
-        return resource_slot;
+        return h;
     }
 
     void renderer_set_vertex_buffer(u32 buffer_index, u32 start_slot, u32 stride, u32 offset)
@@ -1027,106 +2474,105 @@ namespace pen
     void renderer_set_vertex_buffers(u32* buffer_indices, u32 num_buffers, u32 start_slot, const u32* strides,
                                      const u32* offsets)
     {
-        renderer_cmd cmd;
-
-        cmd.command_index = CMD_SET_VERTEX_BUFFER;
-
-        cmd.set_vertex_buffer.start_slot = start_slot;
-        cmd.set_vertex_buffer.num_buffers = num_buffers;
-
-        cmd.set_vertex_buffer.buffer_indices = (u32*)memory_alloc(sizeof(u32) * num_buffers);
-        cmd.set_vertex_buffer.strides = (u32*)memory_alloc(sizeof(u32) * num_buffers);
-        cmd.set_vertex_buffer.offsets = (u32*)memory_alloc(sizeof(u32) * num_buffers);
+        PEN_ASSERT(num_buffers <= k_max_vertex_buffers);
 
+        // start slot and count followed by indices, strides and offsets which are packed inline after the command
+        u32  packed[2 + k_max_vertex_buffers * 3];
+        u32* data = &packed[2];
+        packed[0] = start_slot;
+        packed[1] = num_buffers;
         for (u32 i = 0; i < num_buffers; ++i)
         {
-            cmd.set_vertex_buffer.buffer_indices[i] = buffer_indices[i];
-            cmd.set_vertex_buffer.strides[i] = strides[i];
-            cmd.set_vertex_buffer.offsets[i] = offsets[i];
+            data[i] = resource_index(buffer_indices[i]);
+            data[num_buffers + i] = strides[i];
+            data[num_buffers * 2 + i] = offsets[i];
+        }
+
+        state_cache& sc = state_cache_current();
+        u32          packed_size = sizeof(u32) * (2 + num_buffers * 3);
+        if (memcmp(sc.vertex_buffers, packed, packed_size) == 0)
+        {
+            sc.filtered++;
+            return;
         }
 
-        _ctx->cmd_buffer.put(cmd);
+        memcpy(sc.vertex_buffers, packed, packed_size);
+        sc.issued++;
+
+        set_vertex_buffer_cmd cmd;
+        cmd.start_slot = start_slot;
+        cmd.num_buffers = num_buffers;
+
+        cmd_write(CMD_SET_VERTEX_BUFFER, 0, &cmd, sizeof(cmd), data, sizeof(u32) * num_buffers * 3);
     }
 
     void renderer_set_index_buffer(u32 buffer_index, u32 format, u32 offset)
     {
-        renderer_cmd cmd;
+        buffer_index = resource_index(buffer_index);
+
+        set_index_buffer_cmd cmd;
+        cmd.buffer_index = buffer_index;
+        cmd.format = format;
+        cmd.offset = offset;
 
-        cmd.command_index = CMD_SET_INDEX_BUFFER;
-        cmd.set_index_buffer.buffer_index = buffer_index;
-        cmd.set_index_buffer.format = format;
-        cmd.set_index_buffer.offset = offset;
+        state_cache& sc = state_cache_current();
+        if (state_redundant(sc, sc.index_buffer, cmd))
+            return;
 
-        _ctx->cmd_buffer.put(cmd);
+        cmd_put(CMD_SET_INDEX_BUFFER, cmd);
     }
 
     void renderer_draw(u32 vertex_count, u32 start_vertex, u32 primitive_topology)
     {
-        renderer_cmd cmd;
-
-        cmd.command_index = CMD_DRAW;
-        cmd.draw.vertex_count = vertex_count;
-        cmd.draw.start_vertex = start_vertex;
-        cmd.draw.primitive_topology = primitive_topology;
+        draw_cmd cmd;
+        cmd.vertex_count = vertex_count;
+        cmd.start_vertex = start_vertex;
+        cmd.primitive_topology = primitive_topology;
 
-        _ctx->cmd_buffer.put(cmd);
+        cmd_put(CMD_DRAW, cmd);
     }
 
     void renderer_draw_indexed(u32 index_count, u32 start_index, u32 base_vertex, u32 primitive_topology)
     {
-        renderer_cmd cmd;
+        draw_indexed_cmd cmd;
+        cmd.index_count = index_count;
+        cmd.start_index = start_index;
+        cmd.base_vertex = base_vertex;
+        cmd.primitive_topology = primitive_topology;
 
-        cmd.command_index = CMD_DRAW_INDEXED;
-        cmd.draw_indexed.index_count = index_count;
-        cmd.draw_indexed.start_index = start_index;
-        cmd.draw_indexed.base_vertex = base_vertex;
-        cmd.draw_indexed.primitive_topology = primitive_topology;
-
-        _ctx->cmd_buffer.put(cmd);
+        cmd_put(CMD_DRAW_INDEXED, cmd);
     }
 
     void renderer_draw_indexed_instanced(u32 instance_count, u32 start_instance, u32 index_count, u32 start_index,
                                          u32 base_vertex, u32 primitive_topology)
     {
-        renderer_cmd cmd;
-
-        cmd.command_index = CMD_DRAW_INDEXED_INSTANCED;
-        cmd.draw_indexed_instanced.instance_count = instance_count;
-        cmd.draw_indexed_instanced.start_instance = start_instance;
-        cmd.draw_indexed_instanced.index_count = index_count;
-        cmd.draw_indexed_instanced.start_index = start_index;
-        cmd.draw_indexed_instanced.base_vertex = base_vertex;
-        cmd.draw_indexed_instanced.primitive_topology = primitive_topology;
+        draw_indexed_instanced_cmd cmd;
+        cmd.instance_count = instance_count;
+        cmd.start_instance = start_instance;
+        cmd.index_count = index_count;
+        cmd.start_index = start_index;
+        cmd.base_vertex = base_vertex;
+        cmd.primitive_topology = primitive_topology;
 
-        _ctx->cmd_buffer.put(cmd);
+        cmd_put(CMD_DRAW_INDEXED_INSTANCED, cmd);
     }
 
     u32 renderer_create_render_target(const texture_creation_params& tcp)
     {
-        renderer_cmd cmd;
-
         PEN_ASSERT(tcp.width != 0 && tcp.height != 0);
         if(tcp.collection_type == pen::TEXTURE_COLLECTION_ARRAY)
         {
             PEN_ASSERT(tcp.num_arrays > 0);
         }
 
-        cmd.command_index = CMD_CREATE_RENDER_TARGET;
-
-        memcpy(&cmd.create_render_target, (void*)&tcp, sizeof(texture_creation_params));
+        slot_handle h = slot_resources_get_next_handle(&_ctx->renderer_slot_resources);
+        cmd_put(CMD_CREATE_RENDER_TARGET, tcp, slot_handle_index(h));
 
-        u32 resource_slot = slot_resources_get_next(&_ctx->renderer_slot_resources);
-        cmd.resource_slot = resource_slot;
-
-        _ctx->cmd_buffer.put(cmd);
-
-        return resource_slot;
+        return h;
     }
 
     u32 renderer_create_texture(const texture_creation_params& tcp)
     {
-        renderer_cmd cmd;
-
         switch ((pen::texture_collection_type)tcp.collection_type)
         {
             case TEXTURE_COLLECTION_NONE:
@@ -1139,482 +2585,378 @@ namespace pen
                 break;
         }
 
-        cmd.command_index = CMD_CREATE_TEXTURE;
-
-        memcpy(&cmd.create_texture, (void*)&tcp, sizeof(texture_creation_params));
-
-        cmd.create_texture.data = memory_alloc(tcp.data_size);
+        texture_creation_params cmd = tcp;
+        cmd.data = nullptr;
 
         if (tcp.data)
         {
-            memcpy(cmd.create_texture.data, tcp.data, tcp.data_size);
-        }
-        else
-        {
-            cmd.create_texture.data = nullptr;
+            cmd.data = cmd_alloc(tcp.data_size);
+            memcpy(cmd.data, tcp.data, tcp.data_size);
         }
 
-        u32 resource_slot = slot_resources_get_next(&_ctx->renderer_slot_resources);
-        cmd.resource_slot = resource_slot;
-
-        _ctx->cmd_buffer.put(cmd);
+        slot_handle h = slot_resources_get_next_handle(&_ctx->renderer_slot_resources);
+        cmd_put(CMD_CREATE_TEXTURE, cmd, slot_handle_index(h));
 
-        return resource_slot;
+        return h;
     }
 
     u32 renderer_create_sampler(const sampler_creation_params& scp)
     {
-        renderer_cmd cmd;
-
-        cmd.command_index = CMD_CREATE_SAMPLER;
+        slot_handle h = slot_resources_get_next_handle(&_ctx->renderer_slot_resources);
+        cmd_put(CMD_CREATE_SAMPLER, scp, slot_handle_index(h));
 
-        memcpy(&cmd.create_sampler, (void*)&scp, sizeof(sampler_creation_params));
-
-        u32 resource_slot = slot_resources_get_next(&_ctx->renderer_slot_resources);
-        cmd.resource_slot = resource_slot;
-
-        _ctx->cmd_buffer.put(cmd);
-
-        return resource_slot;
+        return h;
     }
 
     void renderer_set_texture(u32 texture_index, u32 sampler_index, u32 resource_slot, u32 bind_flags)
     {
-        renderer_cmd cmd;
-        
-        cmd.command_index = CMD_SET_TEXTURE;
+        texture_index = resource_index(texture_index);
+        sampler_index = resource_index(sampler_index);
+
+        if (resource_slot < k_state_cache_slots)
+        {
+            state_cache&  sc = state_cache_current();
+            texture_state ts = {texture_index, sampler_index, bind_flags};
+            if (state_redundant(sc, sc.textures[resource_slot], ts))
+                return;
+
+            // textures and structured buffers can share slots
+            sc.sbuffers[resource_slot].buffer = (u32)-1;
+        }
 
-        cmd.set_texture.texture_index = texture_index;
-        cmd.set_texture.sampler_index = sampler_index;
-        cmd.set_texture.resource_slot = resource_slot;
-        cmd.set_texture.bind_flags = bind_flags;
+        set_texture_cmd cmd;
+        cmd.texture_index = texture_index;
+        cmd.sampler_index = sampler_index;
+        cmd.resource_slot = resource_slot;
+        cmd.bind_flags = bind_flags;
 
-        _ctx->cmd_buffer.put(cmd);
+        cmd_put(CMD_SET_TEXTURE, cmd);
     }
 
     u32 renderer_create_rasterizer_state(const rasteriser_state_creation_params& rscp)
     {
-        renderer_cmd cmd;
-
-        cmd.command_index = CMD_CREATE_RASTER_STATE;
-
-        memcpy(&cmd.create_raster_state, (void*)&rscp, sizeof(rasteriser_state_creation_params));
+        slot_handle h = slot_resources_get_next_handle(&_ctx->renderer_slot_resources);
+        cmd_put(CMD_CREATE_RASTER_STATE, rscp, slot_handle_index(h));
 
-        u32 resource_slot = slot_resources_get_next(&_ctx->renderer_slot_resources);
-        cmd.resource_slot = resource_slot;
-
-        _ctx->cmd_buffer.put(cmd);
-
-        return resource_slot;
+        return h;
     }
 
     void renderer_set_rasterizer_state(u32 rasterizer_state_index)
     {
-        renderer_cmd cmd;
-
-        cmd.command_index = CMD_SET_RASTER_STATE;
+        rasterizer_state_index = resource_index(rasterizer_state_index);
 
-        cmd.command_data_index = rasterizer_state_index;
+        state_cache& sc = state_cache_current();
+        if (state_redundant(sc, sc.raster_state, rasterizer_state_index))
+            return;
 
-        _ctx->cmd_buffer.put(cmd);
+        cmd_put_index(CMD_SET_RASTER_STATE, rasterizer_state_index);
     }
 
     void renderer_set_viewport(const viewport& vp)
     {
-        renderer_cmd cmd;
-        cmd.command_index = CMD_SET_VIEWPORT;
-        memcpy(&cmd.set_viewport, (void*)&vp, sizeof(viewport));
-        _ctx->cmd_buffer.put(cmd);
+        cmd_put(CMD_SET_VIEWPORT, vp);
     }
 
     void renderer_set_scissor_rect(const rect& r)
     {
-        renderer_cmd cmd;
-        cmd.command_index = CMD_SET_SCISSOR_RECT;
-        memcpy(&cmd.set_rect, (void*)&r, sizeof(rect));
-        _ctx->cmd_buffer.put(cmd);
+        cmd_put(CMD_SET_SCISSOR_RECT, r);
     }
 
     void renderer_set_viewport_ratio(const viewport& vp)
     {
-        renderer_cmd cmd;
-        cmd.command_index = CMD_SET_VIEWPORT_RATIO;
-        memcpy(&cmd.set_viewport, (void*)&vp, sizeof(viewport));
-        _ctx->cmd_buffer.put(cmd);
+        cmd_put(CMD_SET_VIEWPORT_RATIO, vp);
     }
 
     void renderer_set_scissor_rect_ratio(const rect& r)
     {
-        renderer_cmd cmd;
-        cmd.command_index = CMD_SET_SCISSOR_RECT_RATIO;
-        memcpy(&cmd.set_rect, (void*)&r, sizeof(rect));
-        _ctx->cmd_buffer.put(cmd);
+        cmd_put(CMD_SET_SCISSOR_RECT_RATIO, r);
     }
 
     u32 renderer_create_blend_state(const blend_creation_params& bcp)
     {
-        renderer_cmd cmd;
-
-        cmd.command_index = CMD_CREATE_BLEND_STATE;
-
-        memcpy(&cmd.create_blend_state, (void*)&bcp, sizeof(blend_creation_params));
+        blend_creation_params cmd = bcp;
 
         // alloc and copy the render targets blend modes. to save space in the cmd buffer
         u32   render_target_modes_size = sizeof(render_target_blend) * bcp.num_render_targets;
-        void* mem = memory_alloc(render_target_modes_size);
-        cmd.create_blend_state.render_targets = (render_target_blend*)mem;
-
-        memcpy(cmd.create_blend_state.render_targets, (void*)bcp.render_targets, render_target_modes_size);
+        void* mem = cmd_alloc(render_target_modes_size);
+        cmd.render_targets = (render_target_blend*)mem;
 
-        u32 resource_slot = slot_resources_get_next(&_ctx->renderer_slot_resources);
-        cmd.resource_slot = resource_slot;
+        memcpy(cmd.render_targets, (void*)bcp.render_targets, render_target_modes_size);
 
-        _ctx->cmd_buffer.put(cmd);
+        slot_handle h = slot_resources_get_next_handle(&_ctx->renderer_slot_resources);
+        cmd_put(CMD_CREATE_BLEND_STATE, cmd, slot_handle_index(h));
 
-        return resource_slot;
+        return h;
     }
 
     void renderer_set_blend_state(u32 blend_state_index)
     {
-        renderer_cmd cmd;
-
-        cmd.command_index = CMD_SET_BLEND_STATE;
+        blend_state_index = resource_index(blend_state_index);
 
-        cmd.command_data_index = blend_state_index;
+        state_cache& sc = state_cache_current();
+        if (state_redundant(sc, sc.blend_state, blend_state_index))
+            return;
 
-        _ctx->cmd_buffer.put(cmd);
+        cmd_put_index(CMD_SET_BLEND_STATE, blend_state_index);
     }
 
     void renderer_set_constant_buffer(u32 buffer_index, u32 resource_slot, u32 flags)
     {
-        renderer_cmd cmd;
-        
-        cmd.command_index = CMD_SET_CONSTANT_BUFFER;
+        buffer_index = resource_index(buffer_index);
 
-        cmd.set_buffer.buffer_index = buffer_index;
-        cmd.set_buffer.resource_slot = resource_slot;
-        cmd.set_buffer.flags = flags;
+        if (resource_slot < k_state_cache_slots)
+        {
+            state_cache& sc = state_cache_current();
+            buffer_state bs = {buffer_index, flags};
+            if (state_redundant(sc, sc.cbuffers[resource_slot], bs))
+                return;
+        }
+
+        set_buffer_cmd cmd;
+        cmd.buffer_index = buffer_index;
+        cmd.resource_slot = resource_slot;
+        cmd.flags = flags;
 
-        _ctx->cmd_buffer.put(cmd);
+        cmd_put(CMD_SET_CONSTANT_BUFFER, cmd);
     }
 
     void renderer_set_structured_buffer(u32 buffer_index, u32 resource_slot, u32 flags)
     {
-        renderer_cmd cmd;
+        buffer_index = resource_index(buffer_index);
 
-        cmd.command_index = CMD_SET_STRUCTURED_BUFFER;
+        if (resource_slot < k_state_cache_slots)
+        {
+            state_cache& sc = state_cache_current();
+            buffer_state bs = {buffer_index, flags};
+            if (state_redundant(sc, sc.sbuffers[resource_slot], bs))
+                return;
+
+            sc.textures[resource_slot].texture = (u32)-1;
+        }
 
-        cmd.set_buffer.buffer_index = buffer_index;
-        cmd.set_buffer.resource_slot = resource_slot;
-        cmd.set_buffer.flags = flags;
+        set_buffer_cmd cmd;
+        cmd.buffer_index = buffer_index;
+        cmd.resource_slot = resource_slot;
+        cmd.flags = flags;
 
-        _ctx->cmd_buffer.put(cmd);
+        cmd_put(CMD_SET_STRUCTURED_BUFFER, cmd);
     }
 
     void renderer_update_buffer(u32 buffer_index, const void* data, u32 data_size, u32 offset)
     {
-        renderer_cmd cmd;
-
         if (buffer_index == 0)
             return;
 
-        cmd.command_index = CMD_UPDATE_BUFFER;
+        buffer_index = resource_index(buffer_index);
+
+        update_buffer_cmd cmd;
+        cmd.buffer_index = buffer_index;
+        cmd.data_size = data_size;
+        cmd.offset = offset;
+
+        // small updates (cbuffers) are copied straight into the command stream
+        if (data_size <= k_max_inline_data)
+        {
+            cmd.inline_data = 1;
+            cmd.data = nullptr;
+            cmd_write(CMD_UPDATE_BUFFER, 0, &cmd, sizeof(cmd), data, data_size);
+            return;
+        }
 
-        cmd.update_buffer.buffer_index = buffer_index;
-        cmd.update_buffer.data_size = data_size;
-        cmd.update_buffer.offset = offset;
-        cmd.update_buffer.data = memory_alloc(data_size);
-        memcpy(cmd.update_buffer.data, data, data_size);
+        cmd.inline_data = 0;
+        cmd.data = cmd_alloc(data_size);
+        memcpy(cmd.data, data, data_size);
 
-        _ctx->cmd_buffer.put(cmd);
+        cmd_put(CMD_UPDATE_BUFFER, cmd);
     }
 
     u32 renderer_create_depth_stencil_state(const depth_stencil_creation_params& dscp)
     {
-        renderer_cmd cmd;
-
-        cmd.command_index = CMD_CREATE_DEPTH_STENCIL_STATE;
-
-        cmd.p_create_depth_stencil_state =
-            (depth_stencil_creation_params*)memory_alloc(sizeof(depth_stencil_creation_params));
+        slot_handle h = slot_resources_get_next_handle(&_ctx->renderer_slot_resources);
+        cmd_put(CMD_CREATE_DEPTH_STENCIL_STATE, dscp, slot_handle_index(h));
 
-        memcpy(cmd.p_create_depth_stencil_state, &dscp, sizeof(depth_stencil_creation_params));
-
-        u32 resource_slot = slot_resources_get_next(&_ctx->renderer_slot_resources);
-        cmd.resource_slot = resource_slot;
-
-        _ctx->cmd_buffer.put(cmd);
-
-        return resource_slot;
+        return h;
     }
 
     void renderer_set_depth_stencil_state(u32 depth_stencil_state)
     {
-        renderer_cmd cmd;
+        depth_stencil_state = resource_index(depth_stencil_state);
 
-        cmd.command_index = CMD_SET_DEPTH_STENCIL_STATE;
-
-        cmd.command_data_index = depth_stencil_state;
+        state_cache& sc = state_cache_current();
+        if (state_redundant(sc, sc.depth_stencil_state, depth_stencil_state))
+            return;
 
-        _ctx->cmd_buffer.put(cmd);
+        cmd_put_index(CMD_SET_DEPTH_STENCIL_STATE, depth_stencil_state);
     }
 
     void renderer_set_targets(u32* colour_targets, u32 num_colour_targets, u32 depth_target, u32 array_index)
     {
-        renderer_cmd cmd;
+        PEN_ASSERT(num_colour_targets <= MAX_MRT);
+
+        // binding targets can unbind textures and start a new pass with default state on some backends
+        state_cache_invalidate();
+
+        u32 colour[MAX_MRT];
+        for (u32 i = 0; i < num_colour_targets; ++i)
+            colour[i] = resource_index(colour_targets[i]);
 
-        cmd.command_index = CMD_SET_TARGETS;
-        cmd.set_targets.num_colour = num_colour_targets;
-        memcpy(&cmd.set_targets.colour, colour_targets, num_colour_targets * sizeof(u32));
-        cmd.set_targets.depth = depth_target;
-        cmd.set_targets.array_index = array_index;
+        set_target_cmd cmd;
+        cmd.num_colour = num_colour_targets;
+        cmd.depth = resource_index(depth_target);
+        cmd.array_index = array_index;
 
-        _ctx->cmd_buffer.put(cmd);
+        cmd_write(CMD_SET_TARGETS, 0, &cmd, sizeof(cmd), colour, num_colour_targets * sizeof(u32));
     }
 
     void renderer_set_targets(u32 colour_target, u32 depth_target)
     {
-        renderer_cmd cmd;
+        state_cache_invalidate();
 
-        cmd.command_index = CMD_SET_TARGETS;
-        cmd.set_targets.num_colour = is_valid(colour_target) ? 1 : 0;
-        cmd.set_targets.colour[0] = colour_target;
-        cmd.set_targets.depth = depth_target;
-        cmd.set_targets.array_index = 0;
+        colour_target = resource_index(colour_target);
 
-        _ctx->cmd_buffer.put(cmd);
+        set_target_cmd cmd;
+        cmd.num_colour = is_valid(colour_target) ? 1 : 0;
+        cmd.depth = resource_index(depth_target);
+        cmd.array_index = 0;
+
+        cmd_write(CMD_SET_TARGETS, 0, &cmd, sizeof(cmd), &colour_target, sizeof(u32));
     }
     
     void renderer_release_shader(u32 shader_index, u32 shader_type)
     {
-        renderer_cmd cmd;
-
-        cmd.command_index = CMD_RELEASE_SHADER;
-        cmd.frame_index = pen::_renderer_frame_index();
-        cmd.resource_slot = shader_index;
-        cmd.set_shader.shader_index = shader_index;
-        cmd.set_shader.shader_type = shader_type;
-
-        _ctx->release_cmd_buffer.put(cmd);
+        release_put(CMD_RELEASE_SHADER, shader_index, shader_type);
     }
 
     void renderer_release_buffer(u32 buffer_index)
     {
-        renderer_cmd cmd;
-
-        cmd.command_index = CMD_RELEASE_BUFFER;
-        cmd.frame_index = pen::_renderer_frame_index();
-        cmd.resource_slot = buffer_index;
-        cmd.command_data_index = buffer_index;
-
-        _ctx->release_cmd_buffer.put(cmd);
+        release_put(CMD_RELEASE_BUFFER, buffer_index);
     }
 
     void renderer_release_texture(u32 texture_index)
     {
-        renderer_cmd cmd;
-
-        cmd.command_index = CMD_RELEASE_TEXTURE_2D;
-        cmd.resource_slot = texture_index;
-        cmd.command_data_index = texture_index;
-        cmd.frame_index = pen::_renderer_frame_index();
-
-        _ctx->release_cmd_buffer.put(cmd);
+        release_put(CMD_RELEASE_TEXTURE_2D, texture_index);
     }
 
     void renderer_release_blend_state(u32 blend_state)
     {
-        renderer_cmd cmd;
-
-        cmd.command_index = CMD_RELEASE_BLEND_STATE;
-        cmd.frame_index = pen::_renderer_frame_index();
-        cmd.resource_slot = blend_state;
-        cmd.command_data_index = blend_state;
-
-        _ctx->release_cmd_buffer.put(cmd);
+        release_put(CMD_RELEASE_BLEND_STATE, blend_state);
     }
 
     void renderer_release_render_target(u32 render_target)
     {
-        renderer_cmd cmd;
-
-        cmd.command_index = CMD_RELEASE_RENDER_TARGET;
-        cmd.frame_index = pen::_renderer_frame_index();
-        cmd.resource_slot = render_target;
-        cmd.command_data_index = render_target;
-
-        _ctx->release_cmd_buffer.put(cmd);
+        release_put(CMD_RELEASE_RENDER_TARGET, render_target);
     }
 
     void renderer_release_clear_state(u32 clear_state)
     {
-        renderer_cmd cmd;
-
-        cmd.command_index = CMD_RELEASE_CLEAR_STATE;
-        cmd.frame_index = pen::_renderer_frame_index();
-        cmd.resource_slot = clear_state;
-        cmd.command_data_index = clear_state;
-
-        _ctx->release_cmd_buffer.put(cmd);
+        release_put(CMD_RELEASE_CLEAR_STATE, clear_state);
     }
 
     void renderer_release_input_layout(u32 input_layout)
     {
-        renderer_cmd cmd;
-
-        cmd.command_index = CMD_RELEASE_INPUT_LAYOUT;
-        cmd.frame_index = pen::_renderer_frame_index();
-        cmd.resource_slot = input_layout;
-        cmd.command_data_index = input_layout;
-
-        _ctx->release_cmd_buffer.put(cmd);
+        release_put(CMD_RELEASE_INPUT_LAYOUT, input_layout);
     }
 
     void renderer_release_sampler(u32 sampler)
     {
-        renderer_cmd cmd;
-
-        cmd.command_index = CMD_RELEASE_SAMPLER;
-        cmd.frame_index = pen::_renderer_frame_index();
-        cmd.resource_slot = sampler;
-        cmd.command_data_index = sampler;
-
-        _ctx->release_cmd_buffer.put(cmd);
+        release_put(CMD_RELEASE_SAMPLER, sampler);
     }
 
     void renderer_release_depth_stencil_state(u32 depth_stencil_state)
     {
-        renderer_cmd cmd;
-
-        cmd.command_index = CMD_RELEASE_DEPTH_STENCIL_STATE;
-        cmd.frame_index = pen::_renderer_frame_index();
-        cmd.resource_slot = depth_stencil_state;
-        cmd.command_data_index = depth_stencil_state;
-
-        _ctx->release_cmd_buffer.put(cmd);
+        release_put(CMD_RELEASE_DEPTH_STENCIL_STATE, depth_stencil_state);
     }
     
     void renderer_release_raster_state(u32 raster_state_index)
     {
-        renderer_cmd cmd;
-
-        cmd.command_index = CMD_RELEASE_RASTER_STATE;
-        cmd.resource_slot = raster_state_index;
-        cmd.command_data_index = raster_state_index;
-
-        _ctx->release_cmd_buffer.put(cmd);
+        release_put(CMD_RELEASE_RASTER_STATE, raster_state_index);
     }
 
     void renderer_set_stream_out_target(u32 buffer_index)
     {
-        renderer_cmd cmd;
+        buffer_index = resource_index(buffer_index);
 
-        cmd.command_index = CMD_SET_SO_TARGET;
-        cmd.command_data_index = buffer_index;
-        
-        _ctx->cmd_buffer.put(cmd);
+        state_cache_invalidate();
+
+        cmd_put_index(CMD_SET_SO_TARGET, buffer_index);
     }
 
     void renderer_resolve_target(u32 target, e_msaa_resolve_type type)
     {
-        renderer_cmd cmd;
+        // resolves are drawn with the backends own shaders and states
+        state_cache_invalidate();
 
-        cmd.command_index = CMD_RESOLVE_TARGET;
+        msaa_resolve_params cmd;
+        cmd.render_target = resource_index(target);
+        cmd.resolve_type = type;
 
-        cmd.resolve_params.render_target = target;
-        cmd.resolve_params.resolve_type = type;
-
-        _ctx->cmd_buffer.put(cmd);
+        cmd_put(CMD_RESOLVE_TARGET, cmd);
     }
 
     void renderer_draw_auto()
     {
-        renderer_cmd cmd;
-
-        cmd.command_index = CMD_DRAW_AUTO;
-
-        _ctx->cmd_buffer.put(cmd);
+        cmd_put(CMD_DRAW_AUTO);
     }
 
     void renderer_dispatch_compute(uint3 grid, uint3 num_threads)
     {
-        renderer_cmd cmd;
+        state_cache_invalidate();
 
-        cmd.command_index = CMD_DISPATCH_COMPUTE;
-        cmd.cs_dispatch.grid = grid;
-        cmd.cs_dispatch.num_threads = num_threads;
+        compute_dispatch_params cmd;
+        cmd.grid = grid;
+        cmd.num_threads = num_threads;
 
-        _ctx->cmd_buffer.put(cmd);
+        cmd_put(CMD_DISPATCH_COMPUTE, cmd);
     }
 
     void renderer_read_back_resource(const resource_read_back_params& rrbp)
     {
-        renderer_cmd cmd;
-
-        cmd.command_index = CMD_MAP_RESOURCE;
+        resource_read_back_params cmd = rrbp;
+        cmd.resource_index = resource_index(rrbp.resource_index);
 
-        cmd.rrb_params = rrbp;
-
-        _ctx->cmd_buffer.put(cmd);
+        cmd_put(CMD_MAP_RESOURCE, cmd);
     }
 
     void renderer_replace_resource(u32 dest, u32 src, e_renderer_resource type)
     {
-        renderer_cmd cmd;
-
-        cmd.command_index = CMD_REPLACE_RESOURCE;
+        // dest keeps its handle but is now a different resource
+        state_cache_invalidate();
 
-        cmd.replace_resource_params = {dest, src, type};
-
-        _ctx->cmd_buffer.put(cmd);
+        replace_resource cmd = {resource_index(dest), resource_index(src), type};
+        cmd_put(CMD_REPLACE_RESOURCE, cmd);
     }
 
     u32 renderer_create_clear_state(const clear_state& cs)
     {
-        renderer_cmd cmd;
-
-        u32 resource_slot = slot_resources_get_next(&_ctx->renderer_slot_resources);
+        slot_handle h = slot_resources_get_next_handle(&_ctx->renderer_slot_resources);
+        cmd_put(CMD_CREATE_CLEAR_STATE, cs, slot_handle_index(h));
 
-        cmd.command_index = CMD_CREATE_CLEAR_STATE;
-        cmd.clear_state_params = cs;
-        cmd.resource_slot = resource_slot;
-
-        _ctx->cmd_buffer.put(cmd);
-
-        return resource_slot;
+        return h;
     }
 
     void renderer_set_stencil_ref(u8 ref)
     {
-        renderer_cmd cmd;
-
-        cmd.command_index = CMD_SET_STENCIL_REF;
-        cmd.stencil_ref = ref;
+        state_cache& sc = state_cache_current();
+        if (state_redundant(sc, sc.stencil_ref, (u32)ref))
+            return;
 
-        _ctx->cmd_buffer.put(cmd);
+        cmd_put_index(CMD_SET_STENCIL_REF, ref);
     }
 
     void renderer_push_perf_marker(const c8* name)
     {
-        renderer_cmd cmd;
-
-        cmd.command_index = CMD_PUSH_PERF_MARKER;
+        // copy of string inline to be able to use temporaries
+        u32 len = min<u32>(string_length(name), k_max_inline_data - 1);
 
-        // make copy of string to be able to use temporaries
-        u32 len = string_length(name);
-        cmd.name = (c8*)memory_alloc(len);
-        memcpy(cmd.name, name, len);
-        cmd.name[len] = '\0';
+        c8 buf[k_max_inline_data];
+        memcpy(buf, name, len);
+        buf[len] = '\0';
 
-        _ctx->cmd_buffer.put(cmd);
+        cmd_write(CMD_PUSH_PERF_MARKER, 0, buf, len + 1);
     }
 
     void renderer_pop_perf_marker()
     {
-        renderer_cmd cmd;
-
-        cmd.command_index = CMD_POP_PERF_MARKER;
-
-        _ctx->cmd_buffer.put(cmd);
+        cmd_put(CMD_POP_PERF_MARKER);
     }
 }
@@ -0,0 +1,643 @@
+// tasks.cpp
+// Copyright 2014 - 2019 Alex Dixon.
+// License: https://github.com/polymonster/pmtech/blob/master/license.md
+
+#include "tasks.h"
+#include "console.h"
+#include "data_struct.h"
+#include "memory.h"
+#include "pen_string.h"
+#include "profiler.h"
+#include "threads.h"
+
+using namespace pen;
+
+namespace
+{
+    struct task_pool;
+}
+
+namespace pen
+{
+    struct task
+    {
+        task_function       func;
+        task_range_function range_func;
+        void*               user_data;
+        u32                 start;
+        u32                 end;
+        task_counter*       counter;
+        task*               next; // next continuation waiting on the same counter, or next free task
+        task_pool*          pool; // returned here when finished
+    };
+} // namespace pen
+
+namespace
+{
+    static const u32 k_deque_size = 4096;
+    static const u32 k_shared_queue_size = 8192;
+    static const u32 k_spin_count = 64;
+
+    // chase-lev deque, the owning worker pushes and pops at the bottom, any thread can steal from the top.
+    struct task_deque
+    {
+        a_u64              top;
+        a_u64              bottom;
+        std::atomic<task*> tasks[k_deque_size];
+
+        bool push(task* t)
+        {
+            u64 b = bottom.load(std::memory_order_relaxed);
+            u64 tp = top.load(std::memory_order_acquire);
+
+            if (b - tp >= k_deque_size)
+                return false;
+
+            tasks[b & (k_deque_size - 1)].store(t, std::memory_order_relaxed);
+            bottom.store(b + 1, std::memory_order_release);
+            return true;
+        }
+
+        task* pop()
+        {
+            u64 b = bottom.load(std::memory_order_relaxed);
+            if (b == 0)
+                return nullptr;
+
+            b = b - 1;
+            bottom.store(b, std::memory_order_seq_cst);
+            u64 tp = top.load(std::memory_order_seq_cst);
+
+            if (tp > b)
+            {
+                // empty
+                bottom.store(b + 1, std::memory_order_relaxed);
+                return nullptr;
+            }
+
+            task* t = tasks[b & (k_deque_size - 1)].load(std::memory_order_relaxed);
+            if (tp == b)
+            {
+                // last item, race against thieves
+                if (!top.compare_exchange_strong(tp, tp + 1, std::memory_order_seq_cst))
+                    t = nullptr;
+
+                bottom.store(b + 1, std::memory_order_relaxed);
+            }
+
+            return t;
+        }
+
+        task* steal()
+        {
+            u64 tp = top.load(std::memory_order_seq_cst);
+            u64 b = bottom.load(std::memory_order_seq_cst);
+
+            if (tp >= b)
+                return nullptr;
+
+            task* t = tasks[tp & (k_deque_size - 1)].load(std::memory_order_relaxed);
+            if (!top.compare_exchange_strong(tp, tp + 1, std::memory_order_seq_cst))
+                return nullptr;
+
+            return t;
+        }
+    };
+
+    // tasks submitted from non worker threads
+    struct shared_queue
+    {
+        pen::mutex* mutex = nullptr;
+        task*       tasks[k_shared_queue_size];
+        u32         get_pos = 0;
+        u32         put_pos = 0;
+        a_u32       size = {0};
+
+        bool push(task* t)
+        {
+            bool pushed = false;
+            mutex_lock(mutex);
+            if (size.load() < k_shared_queue_size)
+            {
+                tasks[put_pos] = t;
+                put_pos = (put_pos + 1) % k_shared_queue_size;
+                size++;
+                pushed = true;
+            }
+            mutex_unlock(mutex);
+            return pushed;
+        }
+
+        task* pop()
+        {
+            if (size.load() == 0)
+                return nullptr;
+
+            task* t = nullptr;
+            mutex_lock(mutex);
+            if (size.load() > 0)
+            {
+                t = tasks[get_pos];
+                get_pos = (get_pos + 1) % k_shared_queue_size;
+                size--;
+            }
+            mutex_unlock(mutex);
+            return t;
+        }
+    };
+
+    struct task_worker
+    {
+        task_deque  deque;
+        pen::thread* thread = nullptr;
+        u32         index = 0;
+    };
+
+    struct task_scheduler
+    {
+        task_worker*    workers = nullptr;
+        u32             num_workers = 0;
+        shared_queue    shared;
+        pen::semaphore* wake_semaphore = nullptr;
+        pen::semaphore* exit_semaphore = nullptr;
+        a_u32           num_sleeping = {0};
+        a_u32           num_running = {0};
+        a_u32           exit = {0};
+        a_u64           tasks_executed = {0};
+        a_u64           tasks_stolen = {0};
+        pen::mutex*     pools_mutex = nullptr;
+        task_pool**     pools = nullptr; // per thread pools and their blocks are freed at shutdown
+        task**          blocks = nullptr;
+        u32             id = 0;
+    };
+    task_scheduler* s_ts = nullptr;
+    u32             s_scheduler_id = 0; // pools from a previous scheduler are not reused after a restart
+
+    // tasks are allocated by the submitting thread, and returned by whichever thread finishes them
+    struct task_pool
+    {
+        task*              free = nullptr; // owning thread only
+        std::atomic<task*> returned = {nullptr};
+    };
+
+    thread_local s32        t_worker_index = -1;
+    thread_local u32        t_steal_seed = 0;
+    thread_local task_pool* t_task_pool = nullptr;
+    thread_local u32        t_task_pool_id = 0;
+
+    task* alloc_task()
+    {
+        // lazy alloc so threads which never submit tasks dont pay for the pool
+        if (!t_task_pool || t_task_pool_id != s_ts->id)
+        {
+            t_task_pool = new task_pool();
+            t_task_pool_id = s_ts->id;
+
+            mutex_lock(s_ts->pools_mutex);
+            sb_push(s_ts->pools, t_task_pool);
+            mutex_unlock(s_ts->pools_mutex);
+        }
+
+        task_pool* pool = t_task_pool;
+        if (!pool->free)
+            pool->free = pool->returned.exchange(nullptr, std::memory_order_acquire);
+
+        if (!pool->free)
+        {
+            // every task is still queued, waiting or running, so grow rather than reuse a live one
+            task* block = (task*)memory_alloc(sizeof(task) * k_task_block_size);
+            for (u32 i = 0; i < k_task_block_size; ++i)
+                block[i].next = i + 1 < k_task_block_size ? &block[i + 1] : nullptr;
+
+            mutex_lock(s_ts->pools_mutex);
+            sb_push(s_ts->blocks, block);
+            mutex_unlock(s_ts->pools_mutex);
+
+            pool->free = block;
+        }
+
+        task* t = pool->free;
+        pool->free = t->next;
+        t->pool = pool;
+        return t;
+    }
+
+    void free_task(task* t)
+    {
+        task_pool* pool = t->pool;
+        task*      head = pool->returned.load(std::memory_order_relaxed);
+        do
+        {
+            t->next = head;
+        } while (!pool->returned.compare_exchange_weak(head, t, std::memory_order_release, std::memory_order_relaxed));
+    }
+
+    void execute(task* t);
+
+    void wake_workers(u32 count)
+    {
+        u32 sleeping = s_ts->num_sleeping.load();
+        count = min<u32>(count, sleeping);
+        for (u32 i = 0; i < count; ++i)
+            semaphore_post(s_ts->wake_semaphore, 1);
+    }
+
+    void submit(task* t)
+    {
+        bool queued = false;
+        if (t_worker_index >= 0)
+            queued = s_ts->workers[t_worker_index].deque.push(t);
+
+        if (!queued)
+            queued = s_ts->shared.push(t);
+
+        if (!queued)
+        {
+            // queues are saturated, doing the work in place is better than dropping it
+            execute(t);
+            return;
+        }
+
+        wake_workers(1);
+    }
+
+    void kick_continuations(task_counter* counter)
+    {
+        task* c = counter->continuations.exchange(nullptr);
+        while (c)
+        {
+            task* next = c->next;
+            c->next = nullptr;
+            submit(c);
+            c = next;
+        }
+    }
+
+    void execute(task* t)
+    {
+        PEN_PROFILE_SCOPE("task");
+
+        if (t->range_func)
+            t->range_func(t->user_data, t->start, t->end);
+        else
+            t->func(t->user_data);
+
+        s_ts->tasks_executed++;
+
+        // finishing guards the counter against waiters returning while we are still kicking continuations
+        task_counter* counter = t->counter;
+        if (counter)
+        {
+            counter->finishing++;
+            if (counter->value.fetch_sub(1) == 1)
+                kick_continuations(counter);
+            counter->finishing--;
+        }
+
+        free_task(t);
+    }
+
+    task* find_task()
+    {
+        task* t = nullptr;
+
+        // own deque first
+        if (t_worker_index >= 0)
+        {
+            t = s_ts->workers[t_worker_index].deque.pop();
+            if (t)
+                return t;
+        }
+
+        // shared submissions from non workers
+        t = s_ts->shared.pop();
+        if (t)
+            return t;
+
+        // steal, starting from a different worker each time to spread contention
+        u32 nw = s_ts->num_workers;
+        u32 start = t_steal_seed++;
+        for (u32 i = 0; i < nw; ++i)
+        {
+            u32 victim = (start + i) % nw;
+            if ((s32)victim == t_worker_index)
+                continue;
+
+            t = s_ts->workers[victim].deque.steal();
+            if (t)
+            {
+                s_ts->tasks_stolen++;
+                return t;
+            }
+        }
+
+        return nullptr;
+    }
+
+    bool has_work()
+    {
+        if (s_ts->shared.size.load() > 0)
+            return true;
+
+        for (u32 i = 0; i < s_ts->num_workers; ++i)
+        {
+            task_deque& d = s_ts->workers[i].deque;
+            if (d.bottom.load() > d.top.load())
+                return true;
+        }
+
+        return false;
+    }
+
+    void* task_worker_thread(void* params)
+    {
+        task_worker* worker = (task_worker*)params;
+        t_worker_index = worker->index;
+        t_steal_seed = worker->index + 1;
+
+        c8 name[32];
+        string_format(name, 32, "task_worker %i", worker->index);
+        PEN_PROFILE_THREAD(name);
+
+        s_ts->num_running++;
+
+        u32 spin = 0;
+        while (!s_ts->exit.load())
+        {
+            task* t = find_task();
+            if (t)
+            {
+                execute(t);
+                spin = 0;
+                continue;
+            }
+
+            if (spin++ < k_spin_count)
+            {
+                thread_yield();
+                continue;
+            }
+
+            // sleep until more work is submitted, check again after announcing to avoid a lost wakeup
+            s_ts->num_sleeping++;
+            if (!has_work() && !s_ts->exit.load())
+                semaphore_wait(s_ts->wake_semaphore);
+            s_ts->num_sleeping--;
+
+            spin = 0;
+        }
+
+        s_ts->num_running--;
+        semaphore_post(s_ts->exit_semaphore, 1);
+
+        return PEN_THREAD_OK;
+    }
+
+    task* make_task(task_function func, task_range_function range_func, void* user_data, u32 start, u32 end,
+                    task_counter* counter)
+    {
+        task* t = alloc_task();
+        t->func = func;
+        t->range_func = range_func;
+        t->user_data = user_data;
+        t->start = start;
+        t->end = end;
+        t->counter = counter;
+        t->next = nullptr;
+
+        if (counter)
+            counter->value++;
+
+        return t;
+    }
+} // namespace
+
+namespace pen
+{
+    void task_scheduler_init(u32 num_workers)
+    {
+        if (s_ts)
+            return;
+
+        if (num_workers == 0)
+        {
+            u32 cores = thread_get_num_cores();
+            num_workers = cores > 1 ? cores - 1 : 1;
+        }
+
+        num_workers = min<u32>(num_workers, k_max_task_workers);
+
+        s_ts = new task_scheduler();
+        s_ts->id = ++s_scheduler_id;
+        s_ts->pools_mutex = mutex_create();
+        s_ts->shared.mutex = mutex_create();
+        s_ts->wake_semaphore = semaphore_create(0, k_max_task_workers);
+        s_ts->exit_semaphore = semaphore_create(0, k_max_task_workers);
+        s_ts->num_workers = num_workers;
+        s_ts->workers = new task_worker[num_workers];
+
+        for (u32 i = 0; i < num_workers; ++i)
+        {
+            task_worker& w = s_ts->workers[i];
+            w.index = i;
+            w.deque.top = 0;
+            w.deque.bottom = 0;
+        }
+
+        for (u32 i = 0; i < num_workers; ++i)
+            s_ts->workers[i].thread =
+                thread_create(task_worker_thread, 1024 * 1024, &s_ts->workers[i], e_thread_start_flags::detached);
+    }
+
+    void task_scheduler_shutdown()
+    {
+        if (!s_ts)
+            return;
+
+        s_ts->exit = 1;
+
+        u32 nw = s_ts->num_workers;
+        for (u32 i = 0; i < nw; ++i)
+            semaphore_post(s_ts->wake_semaphore, 1);
+
+        for (u32 i = 0; i < nw; ++i)
+            semaphore_wait(s_ts->exit_semaphore);
+
+        for (u32 i = 0; i < nw; ++i)
+            memory_free(s_ts->workers[i].thread);
+
+        // workers have exited, so no task can still be running
+        u32 num_pools = sb_count(s_ts->pools);
+        for (u32 i = 0; i < num_pools; ++i)
+            delete s_ts->pools[i];
+
+        u32 num_blocks = sb_count(s_ts->blocks);
+        for (u32 i = 0; i < num_blocks; ++i)
+            memory_free(s_ts->blocks[i]);
+
+        sb_free(s_ts->pools);
+        sb_free(s_ts->blocks);
+        t_task_pool = nullptr;
+
+        mutex_destroy(s_ts->pools_mutex);
+        mutex_destroy(s_ts->shared.mutex);
+        semaphore_destroy(s_ts->wake_semaphore);
+        semaphore_destroy(s_ts->exit_semaphore);
+
+        delete[] s_ts->workers;
+        delete s_ts;
+        s_ts = nullptr;
+    }
+
+    u32 task_scheduler_num_workers()
+    {
+        if (!s_ts)
+            return 0;
+
+        return s_ts->num_workers;
+    }
+
+    s32 task_scheduler_worker_index()
+    {
+        return t_worker_index;
+    }
+
+    void task_scheduler_get_stats(task_scheduler_stats& stats)
+    {
+        stats = {};
+        if (!s_ts)
+            return;
+
+        stats.num_workers = s_ts->num_workers;
+        stats.tasks_executed = s_ts->tasks_executed.load();
+        stats.tasks_stolen = s_ts->tasks_stolen.load();
+    }
+
+    void task_run(task_function func, void* user_data, task_counter* counter)
+    {
+        // no scheduler, run in place
+        if (!s_ts)
+        {
+            func(user_data);
+            return;
+        }
+
+        submit(make_task(func, nullptr, user_data, 0, 0, counter));
+    }
+
+    void task_parallel_for(u32 start, u32 end, u32 grain_size, task_range_function func, void* user_data,
+                           task_counter* counter)
+    {
+        if (end <= start)
+            return;
+
+        u32 count = end - start;
+
+        if (grain_size == 0)
+        {
+            // aim for a few chunks per worker so stealing can balance uneven work
+            u32 chunks = max<u32>(task_scheduler_num_workers() * 4, 1);
+            grain_size = max<u32>((count + chunks - 1) / chunks, 1);
+        }
+
+        // no scheduler, run in place keeping the same ranges
+        if (!s_ts)
+        {
+            for (u32 i = start; i < end; i += grain_size)
+            {
+                u32 e = min<u32>(i + grain_size, end);
+                func(user_data, i, e);
+
+                if (e == end)
+                    break;
+            }
+
+            return;
+        }
+
+        u32 num_tasks = 0;
+        for (u32 i = start; i < end; i += grain_size)
+        {
+            u32 e = min<u32>(i + grain_size, end);
+            task* t = make_task(nullptr, func, user_data, i, e, counter);
+
+            bool queued = false;
+            if (t_worker_index >= 0)
+                queued = s_ts->workers[t_worker_index].deque.push(t);
+
+            if (!queued)
+                queued = s_ts->shared.push(t);
+
+            if (!queued)
+                execute(t);
+
+            ++num_tasks;
+
+            // guard against wrap around for ranges near the end of u32
+            if (e == end)
+                break;
+        }
+
+        wake_workers(num_tasks);
+    }
+
+    void task_run_after(task_counter* dependency, task_function func, void* user_data, task_counter* counter)
+    {
+        // without a scheduler everything runs in place, so the dependency is already complete
+        if (!s_ts)
+        {
+            PEN_ASSERT(!dependency || task_complete(dependency));
+            func(user_data);
+            return;
+        }
+
+        task* t = make_task(func, nullptr, user_data, 0, 0, counter);
+
+        if (!dependency)
+        {
+            submit(t);
+            return;
+        }
+
+        // push onto the dependencies continuation list
+        task* head = dependency->continuations.load();
+        do
+        {
+            t->next = head;
+        } while (!dependency->continuations.compare_exchange_weak(head, t));
+
+        // dependency may have already completed, so anyone who sees zero kicks the list
+        if (dependency->value.load() == 0)
+            kick_continuations(dependency);
+    }
+
+    void task_wait(task_counter* counter)
+    {
+        if (!counter)
+            return;
+
+        while (counter->value.load() > 0 || counter->finishing.load() > 0)
+        {
+            task* t = s_ts ? find_task() : nullptr;
+            if (t)
+            {
+                execute(t);
+                continue;
+            }
+
+            thread_yield();
+        }
+    }
+
+    bool task_complete(const task_counter* counter)
+    {
+        return counter->value.load() == 0 && counter->finishing.load() == 0;
+    }
+
+    void task_parallel_for_wait(u32 start, u32 end, u32 grain_size, task_range_function func, void* user_data)
+    {
+        task_counter counter;
+        task_parallel_for(start, end, grain_size, func, user_data, &counter);
+        task_wait(&counter);
+    }
+} // namespace pen
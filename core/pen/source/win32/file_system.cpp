@@ -117,6 +117,64 @@ namespace pen
         return PEN_ERR_FILE_NOT_FOUND;
     }
 
+    pen_error filesystem_map_file(const c8* filename, mapped_file& file, file_access access)
+    {
+        file = mapped_file();
+
+        static const DWORD flags[] = {FILE_ATTRIBUTE_NORMAL, FILE_FLAG_SEQUENTIAL_SCAN, FILE_FLAG_RANDOM_ACCESS};
+
+        c8*    windir_filename = swap_slashes(filename);
+        HANDLE f = CreateFileA(windir_filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, flags[access], NULL);
+
+        pen::memory_free(windir_filename);
+
+        if (f == INVALID_HANDLE_VALUE)
+            return PEN_ERR_FILE_NOT_FOUND;
+
+        LARGE_INTEGER size;
+        if (GetFileSizeEx(f, &size) && size.QuadPart > 0)
+        {
+            HANDLE mapping = CreateFileMappingA(f, NULL, PAGE_READONLY, 0, 0, NULL);
+            if (mapping)
+            {
+                void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+                if (view)
+                {
+                    file.data = view;
+                    file.size = (u32)size.QuadPart;
+                    file._mapped = true;
+                }
+
+                // the view keeps the mapping and file referenced
+                CloseHandle(mapping);
+            }
+        }
+
+        CloseHandle(f);
+
+        if (file._mapped)
+            return PEN_ERR_OK;
+
+        // empty files and file systems which do not support mapping
+        void*     buffer = nullptr;
+        u32       buffer_size = 0;
+        pen_error err = filesystem_read_file_to_buffer(filename, &buffer, buffer_size);
+
+        file.data = buffer;
+        file.size = buffer_size;
+        return err;
+    }
+
+    void filesystem_unmap_file(mapped_file& file)
+    {
+        if (file._mapped)
+            UnmapViewOfFile(file.data);
+        else
+            pen::memory_free((void*)file.data);
+
+        file = mapped_file();
+    }
+
     pen_error filesystem_enum_volumes(fs_tree_node& tree)
     {
         DWORD drive_bit_mask = GetLogicalDrives();
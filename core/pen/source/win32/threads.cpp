@@ -100,6 +100,18 @@ namespace pen
         return FALSE;
     }
 
+    bool semaphore_wait_ms(semaphore* p_semaphore, u32 timeout_ms)
+    {
+        DWORD res = WaitForSingleObject(p_semaphore->handle, timeout_ms);
+
+        if (!res)
+        {
+            return TRUE;
+        }
+
+        return FALSE;
+    }
+
     bool semaphore_try_wait(semaphore* p_semaphore)
     {
         DWORD res = WaitForSingleObject(p_semaphore->handle, 0);
@@ -127,4 +139,16 @@ namespace pen
         // windows cannot sleep micros
         PEN_ASSERT(0);
     }
+
+    void thread_yield()
+    {
+        SwitchToThread();
+    }
+
+    u32 thread_get_num_cores()
+    {
+        SYSTEM_INFO info;
+        GetSystemInfo(&info);
+        return (u32)info.dwNumberOfProcessors;
+    }
 } // namespace pen
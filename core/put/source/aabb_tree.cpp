@@ -0,0 +1,557 @@
+// aabb_tree.cpp
+// Copyright 2014 - 2019 Alex Dixon.
+// License: https://github.com/polymonster/pmtech/blob/master/license.md
+
+#include "aabb_tree.h"
+#include "console.h"
+#include "data_struct.h"
+
+using namespace put;
+
+namespace
+{
+    const u32 k_max_stack = 256; // traversal depth, balanced trees stay well below this
+    const u32 k_min_grow = 16;
+    const f32 k_ray_epsilon = 1e-8f; // rays parallel to a slab within this are tested by origin only
+
+    struct node_stack
+    {
+        s32 items[k_max_stack];
+        u32 count = 0;
+
+        void push(s32 node)
+        {
+            PEN_ASSERT(count < k_max_stack);
+            items[count++] = node;
+        }
+
+        s32 pop()
+        {
+            return items[--count];
+        }
+    };
+
+    f32 surface_area(const vec3f& min, const vec3f& max)
+    {
+        vec3f d = max - min;
+        return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+    }
+
+    bool overlaps(const aabb_tree_node& n, const vec3f& min, const vec3f& max)
+    {
+        for (u32 i = 0; i < 3; ++i)
+            if (n.max[i] < min[i] || n.min[i] > max[i])
+                return false;
+
+        return true;
+    }
+
+    bool contains(const vec3f& outer_min, const vec3f& outer_max, const vec3f& min, const vec3f& max)
+    {
+        for (u32 i = 0; i < 3; ++i)
+            if (min[i] < outer_min[i] || max[i] > outer_max[i])
+                return false;
+
+        return true;
+    }
+
+    bool is_leaf(const aabb_tree_node& n)
+    {
+        return n.child1 == -1;
+    }
+
+    void fit_node(aabb_tree& tree, s32 index)
+    {
+        aabb_tree_node& n = tree.nodes[index];
+        aabb_tree_node& c1 = tree.nodes[n.child1];
+        aabb_tree_node& c2 = tree.nodes[n.child2];
+
+        n.min = min_union(c1.min, c2.min);
+        n.max = max_union(c1.max, c2.max);
+        n.height = 1 + max(c1.height, c2.height);
+    }
+
+    s32 allocate_node(aabb_tree& tree)
+    {
+        if (tree.free_list == -1)
+        {
+            u32             count = sb_count(tree.nodes);
+            u32             grow = max<u32>(count, k_min_grow);
+            aabb_tree_node* added = sb_add(tree.nodes, grow);
+
+            for (u32 i = 0; i < grow; ++i)
+            {
+                added[i].parent = i + 1 < grow ? (s32)(count + i + 1) : -1;
+                added[i].height = -1;
+            }
+
+            tree.free_list = (s32)count;
+        }
+
+        s32             index = tree.free_list;
+        aabb_tree_node& n = tree.nodes[index];
+        tree.free_list = n.parent;
+
+        n.parent = -1;
+        n.child1 = -1;
+        n.child2 = -1;
+        n.height = 0;
+        n.user_data = 0;
+
+        return index;
+    }
+
+    void free_node(aabb_tree& tree, s32 index)
+    {
+        tree.nodes[index].parent = tree.free_list;
+        tree.nodes[index].height = -1;
+        tree.free_list = index;
+    }
+
+    void replace_child(aabb_tree& tree, s32 parent, s32 old_child, s32 new_child)
+    {
+        if (parent == -1)
+        {
+            tree.root = new_child;
+            return;
+        }
+
+        if (tree.nodes[parent].child1 == old_child)
+            tree.nodes[parent].child1 = new_child;
+        else
+            tree.nodes[parent].child2 = new_child;
+    }
+
+    // rotates the taller grandchild of a up if a is unbalanced, returns the index of the new subtree root
+    s32 balance(aabb_tree& tree, s32 ia)
+    {
+        aabb_tree_node* nodes = tree.nodes;
+        aabb_tree_node& a = nodes[ia];
+        if (is_leaf(a) || a.height < 2)
+            return ia;
+
+        s32 ib = a.child1;
+        s32 ic = a.child2;
+
+        s32 diff = nodes[ic].height - nodes[ib].height;
+        if (diff > 1)
+        {
+            // c becomes the parent of a
+            aabb_tree_node& c = nodes[ic];
+            s32             i_f = c.child1;
+            s32             i_g = c.child2;
+
+            c.child1 = ia;
+            c.parent = a.parent;
+            a.parent = ic;
+            replace_child(tree, c.parent, ia, ic);
+
+            // the taller of c's children stays with c
+            s32 keep = nodes[i_f].height > nodes[i_g].height ? i_f : i_g;
+            s32 move = keep == i_f ? i_g : i_f;
+
+            c.child2 = keep;
+            a.child2 = move;
+            nodes[move].parent = ia;
+
+            fit_node(tree, ia);
+            fit_node(tree, ic);
+            return ic;
+        }
+
+        if (diff < -1)
+        {
+            // b becomes the parent of a
+            aabb_tree_node& b = nodes[ib];
+            s32             i_d = b.child1;
+            s32             i_e = b.child2;
+
+            b.child1 = ia;
+            b.parent = a.parent;
+            a.parent = ib;
+            replace_child(tree, b.parent, ia, ib);
+
+            s32 keep = nodes[i_d].height > nodes[i_e].height ? i_d : i_e;
+            s32 move = keep == i_d ? i_e : i_d;
+
+            b.child2 = keep;
+            a.child1 = move;
+            nodes[move].parent = ia;
+
+            fit_node(tree, ia);
+            fit_node(tree, ib);
+            return ib;
+        }
+
+        return ia;
+    }
+
+    void refit_ancestors(aabb_tree& tree, s32 index)
+    {
+        while (index != -1)
+        {
+            index = balance(tree, index);
+            fit_node(tree, index);
+            index = tree.nodes[index].parent;
+        }
+    }
+
+    void insert_leaf(aabb_tree& tree, s32 leaf)
+    {
+        if (tree.root == -1)
+        {
+            tree.root = leaf;
+            tree.nodes[leaf].parent = -1;
+            return;
+        }
+
+        // descend to the sibling which adds the least surface area to the tree
+        vec3f lmin = tree.nodes[leaf].min;
+        vec3f lmax = tree.nodes[leaf].max;
+
+        s32 index = tree.root;
+        while (!is_leaf(tree.nodes[index]))
+        {
+            const aabb_tree_node& n = tree.nodes[index];
+
+            f32 area = surface_area(n.min, n.max);
+            f32 combined = surface_area(min_union(n.min, lmin), max_union(n.max, lmax));
+
+            // cost of making a new parent for this node and the leaf, and the cost pushed down to the children
+            f32 cost = 2.0f * combined;
+            f32 inheritance = 2.0f * (combined - area);
+
+            f32 child_cost[2];
+            s32 children[2] = {n.child1, n.child2};
+            for (u32 c = 0; c < 2; ++c)
+            {
+                const aabb_tree_node& child = tree.nodes[children[c]];
+
+                f32 a = surface_area(min_union(child.min, lmin), max_union(child.max, lmax));
+                if (!is_leaf(child))
+                    a -= surface_area(child.min, child.max);
+
+                child_cost[c] = a + inheritance;
+            }
+
+            if (cost < child_cost[0] && cost < child_cost[1])
+                break;
+
+            index = child_cost[0] < child_cost[1] ? children[0] : children[1];
+        }
+
+        s32 sibling = index;
+
+        // nodes may move when allocating
+        s32 new_parent = allocate_node(tree);
+        s32 old_parent = tree.nodes[sibling].parent;
+
+        aabb_tree_node& np = tree.nodes[new_parent];
+        np.parent = old_parent;
+        np.child1 = sibling;
+        np.child2 = leaf;
+        replace_child(tree, old_parent, sibling, new_parent);
+
+        tree.nodes[sibling].parent = new_parent;
+        tree.nodes[leaf].parent = new_parent;
+
+        refit_ancestors(tree, new_parent);
+    }
+
+    void remove_leaf(aabb_tree& tree, s32 leaf)
+    {
+        if (leaf == tree.root)
+        {
+            tree.root = -1;
+            return;
+        }
+
+        s32 parent = tree.nodes[leaf].parent;
+        s32 grand_parent = tree.nodes[parent].parent;
+        s32 sibling = tree.nodes[parent].child1 == leaf ? tree.nodes[parent].child2 : tree.nodes[parent].child1;
+
+        // sibling takes the place of the parent
+        replace_child(tree, grand_parent, parent, sibling);
+        tree.nodes[sibling].parent = grand_parent;
+        free_node(tree, parent);
+
+        refit_ancestors(tree, grand_parent);
+    }
+
+    void set_fat_aabb(aabb_tree& tree, s32 proxy, const vec3f& min, const vec3f& max)
+    {
+        vec3f margin = vec3f(tree.margin);
+        tree.nodes[proxy].min = min - margin;
+        tree.nodes[proxy].max = max + margin;
+    }
+
+    // collects all leaves below index without testing them
+    u32 add_subtree(const aabb_tree& tree, s32 index, u32* results, u32 max_results, u32 count)
+    {
+        node_stack stack;
+        stack.push(index);
+
+        while (stack.count)
+        {
+            const aabb_tree_node& n = tree.nodes[stack.pop()];
+            if (is_leaf(n))
+            {
+                if (count < max_results)
+                    results[count] = n.user_data;
+                ++count;
+                continue;
+            }
+
+            stack.push(n.child1);
+            stack.push(n.child2);
+        }
+
+        return count;
+    }
+
+    template <typename T>
+    u32 query(const aabb_tree& tree, const T& test, u32* results, u32 max_results)
+    {
+        if (tree.root == -1)
+            return 0;
+
+        u32        count = 0;
+        node_stack stack;
+        stack.push(tree.root);
+
+        while (stack.count)
+        {
+            const aabb_tree_node& n = tree.nodes[stack.pop()];
+            if (!test(n))
+                continue;
+
+            if (is_leaf(n))
+            {
+                if (count < max_results)
+                    results[count] = n.user_data;
+                ++count;
+                continue;
+            }
+
+            stack.push(n.child1);
+            stack.push(n.child2);
+        }
+
+        return count;
+    }
+} // namespace
+
+namespace put
+{
+    s32 aabb_tree_create_proxy(aabb_tree& tree, const vec3f& min, const vec3f& max, u32 user_data)
+    {
+        s32 proxy = allocate_node(tree);
+        set_fat_aabb(tree, proxy, min, max);
+        tree.nodes[proxy].user_data = user_data;
+
+        insert_leaf(tree, proxy);
+        tree.num_leaves++;
+
+        return proxy;
+    }
+
+    void aabb_tree_destroy_proxy(aabb_tree& tree, s32 proxy)
+    {
+        PEN_ASSERT(is_leaf(tree.nodes[proxy]));
+
+        remove_leaf(tree, proxy);
+        free_node(tree, proxy);
+        tree.num_leaves--;
+    }
+
+    bool aabb_tree_move_proxy(aabb_tree& tree, s32 proxy, const vec3f& min, const vec3f& max)
+    {
+        PEN_ASSERT(is_leaf(tree.nodes[proxy]));
+
+        // small moves stay inside the fat aabb, but shrink it again if the object got much smaller
+        const aabb_tree_node& n = tree.nodes[proxy];
+        if (contains(n.min, n.max, min, max))
+        {
+            vec3f big_margin = vec3f(tree.margin * 4.0f);
+            if (contains(min - big_margin, max + big_margin, n.min, n.max))
+                return false;
+        }
+
+        remove_leaf(tree, proxy);
+        set_fat_aabb(tree, proxy, min, max);
+        insert_leaf(tree, proxy);
+
+        return true;
+    }
+
+    void aabb_tree_clear(aabb_tree& tree)
+    {
+        sb_free(tree.nodes);
+        tree.nodes = nullptr;
+        tree.root = -1;
+        tree.free_list = -1;
+        tree.num_leaves = 0;
+    }
+
+    u32 aabb_tree_query_aabb(const aabb_tree& tree, const vec3f& min, const vec3f& max, u32* results, u32 max_results)
+    {
+        return query(tree, [&](const aabb_tree_node& n) { return overlaps(n, min, max); }, results, max_results);
+    }
+
+    u32 aabb_tree_query_sphere(const aabb_tree& tree, const vec3f& pos, f32 radius, u32* results, u32 max_results)
+    {
+        f32 r2 = radius * radius;
+        return query(tree,
+                     [&](const aabb_tree_node& n) {
+                         vec3f cp = min_union(max_union(pos, n.min), n.max);
+                         vec3f d = cp - pos;
+                         return dot(d, d) <= r2;
+                     },
+                     results, max_results);
+    }
+
+    u32 aabb_tree_query_frustum(const aabb_tree& tree, const frustum& f, u32* results, u32 max_results)
+    {
+        if (tree.root == -1)
+            return 0;
+
+        u32        count = 0;
+        node_stack stack;
+        stack.push(tree.root);
+
+        while (stack.count)
+        {
+            s32                   index = stack.pop();
+            const aabb_tree_node& n = tree.nodes[index];
+
+            // normals point out of the frustum
+            vec3f c = (n.min + n.max) * 0.5f;
+            vec3f e = (n.max - n.min) * 0.5f;
+
+            bool outside = false;
+            bool inside = true;
+            for (u32 p = 0; p < 6; ++p)
+            {
+                f32 d = dot(f.n[p], c) - dot(f.n[p], f.p[p]);
+                f32 r = fabs(f.n[p].x) * e.x + fabs(f.n[p].y) * e.y + fabs(f.n[p].z) * e.z;
+
+                if (d > r)
+                {
+                    outside = true;
+                    break;
+                }
+
+                if (d > -r)
+                    inside = false;
+            }
+
+            if (outside)
+                continue;
+
+            // everything below a node which is inside every plane is visible
+            if (inside || is_leaf(n))
+            {
+                count = add_subtree(tree, index, results, max_results, count);
+                continue;
+            }
+
+            stack.push(n.child1);
+            stack.push(n.child2);
+        }
+
+        return count;
+    }
+
+    u32 aabb_tree_query_ray(const aabb_tree& tree, const vec3f& origin, const vec3f& dir, f32 max_t, u32* results,
+                            u32 max_results)
+    {
+        return query(tree,
+                     [&](const aabb_tree_node& n) {
+                         // slab test over the segment
+                         f32 t0 = 0.0f;
+                         f32 t1 = max_t;
+                         for (u32 i = 0; i < 3; ++i)
+                         {
+                             if (fabs(dir[i]) < k_ray_epsilon)
+                             {
+                                 if (origin[i] < n.min[i] || origin[i] > n.max[i])
+                                     return false;
+
+                                 continue;
+                             }
+
+                             f32 inv = 1.0f / dir[i];
+                             f32 ta = (n.min[i] - origin[i]) * inv;
+                             f32 tb = (n.max[i] - origin[i]) * inv;
+
+                             t0 = max(t0, min(ta, tb));
+                             t1 = min(t1, max(ta, tb));
+
+                             if (t0 > t1)
+                                 return false;
+                         }
+
+                         return true;
+                     },
+                     results, max_results);
+    }
+
+    u32 aabb_tree_height(const aabb_tree& tree)
+    {
+        if (tree.root == -1)
+            return 0;
+
+        return (u32)tree.nodes[tree.root].height;
+    }
+
+    bool aabb_tree_validate(const aabb_tree& tree)
+    {
+        if (tree.root == -1)
+            return tree.num_leaves == 0;
+
+        if (tree.nodes[tree.root].parent != -1)
+            return false;
+
+        u32        leaves = 0;
+        node_stack stack;
+        stack.push(tree.root);
+
+        while (stack.count)
+        {
+            s32                   index = stack.pop();
+            const aabb_tree_node& n = tree.nodes[index];
+
+            if (is_leaf(n))
+            {
+                if (n.height != 0 || n.child2 != -1)
+                    return false;
+
+                ++leaves;
+                continue;
+            }
+
+            const aabb_tree_node& c1 = tree.nodes[n.child1];
+            const aabb_tree_node& c2 = tree.nodes[n.child2];
+
+            if (c1.parent != index || c2.parent != index)
+                return false;
+
+            if (n.height != 1 + max(c1.height, c2.height))
+                return false;
+
+            if (!contains(n.min, n.max, c1.min, c1.max) || !contains(n.min, n.max, c2.min, c2.max))
+                return false;
+
+            stack.push(n.child1);
+            stack.push(n.child2);
+        }
+
+        if (leaves != tree.num_leaves)
+        {
+            PEN_LOG("[aabb tree] leaf count mismatch %i != %i", leaves, tree.num_leaves);
+            return false;
+        }
+
+        return true;
+    }
+} // namespace put
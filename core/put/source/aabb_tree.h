@@ -0,0 +1,56 @@
+// aabb_tree.h
+// Copyright 2014 - 2019 Alex Dixon.
+// License: https://github.com/polymonster/pmtech/blob/master/license.md
+
+#pragma once
+
+// Incrementally updated bounding volume hierarchy of aabbs, for spatial queries over many mostly static objects.
+// Each object is a leaf proxy storing a fat aabb (the aabb grown by margin), moving an object which stays inside its
+// fat aabb does nothing, otherwise the leaf is removed and reinserted. Inserts pick the sibling which adds the least
+// surface area and the tree is kept balanced with rotations, so queries are O(results log n).
+// Queries write the user data of leaves whose fat aabb passes the test, results are conservative and callers should
+// do their own exact test when needed.
+
+#include "camera.h"
+#include "maths/maths.h"
+#include "pen.h"
+
+namespace put
+{
+    struct aabb_tree_node
+    {
+        vec3f min;
+        vec3f max;
+        u32   user_data;
+        s32   parent; // next in the free list for free nodes
+        s32   child1;
+        s32   child2;
+        s32   height; // 0 for leaves, -1 for free nodes
+    };
+
+    struct aabb_tree
+    {
+        aabb_tree_node* nodes = nullptr; // stretchy buffer
+        s32             root = -1;
+        s32             free_list = -1;
+        u32             num_leaves = 0;
+        f32             margin = 0.1f; // added to each side of leaf aabbs
+    };
+
+    // Proxies
+    s32  aabb_tree_create_proxy(aabb_tree& tree, const vec3f& min, const vec3f& max, u32 user_data);
+    void aabb_tree_destroy_proxy(aabb_tree& tree, s32 proxy);
+    bool aabb_tree_move_proxy(aabb_tree& tree, s32 proxy, const vec3f& min, const vec3f& max); // true if reinserted
+    void aabb_tree_clear(aabb_tree& tree);
+
+    // Queries return the number of results, results past max_results are not written
+    u32 aabb_tree_query_aabb(const aabb_tree& tree, const vec3f& min, const vec3f& max, u32* results, u32 max_results);
+    u32 aabb_tree_query_sphere(const aabb_tree& tree, const vec3f& pos, f32 radius, u32* results, u32 max_results);
+    u32 aabb_tree_query_frustum(const aabb_tree& tree, const frustum& f, u32* results, u32 max_results);
+    u32 aabb_tree_query_ray(const aabb_tree& tree, const vec3f& origin, const vec3f& dir, f32 max_t, u32* results,
+                            u32 max_results); // dir does not need to be normalised, hits are within origin + dir * max_t
+
+    // Debug
+    u32  aabb_tree_height(const aabb_tree& tree);
+    bool aabb_tree_validate(const aabb_tree& tree);
+} // namespace put
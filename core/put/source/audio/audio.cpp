@@ -7,6 +7,7 @@
 #include "data_struct.h"
 #include "memory.h"
 #include "pen_string.h"
+#include "profiler.h"
 #include "slot_resource.h"
 #include "threads.h"
 
@@ -76,7 +77,7 @@ namespace
 
     pen::job*                   _audio_job_thread_info;
     pen::slot_resources         _audio_slot_resources;
-    pen::ring_buffer<audio_cmd> _cmd_buffer;
+    pen::spsc_queue<audio_cmd>  _cmd_buffer; // drained once per frame, so it grows to fit a frame
 } // namespace
 
 namespace put
@@ -148,6 +149,9 @@ namespace put
 
     void* audio_thread_function(void* params)
     {
+        pen::memory_push_tag(pen::e_mem_tag::audio);
+        PEN_PROFILE_THREAD("audio");
+
         job_thread_params* job_params = (job_thread_params*)params;
         _audio_job_thread_info = job_params->job_info;
 
@@ -166,11 +170,13 @@ namespace put
             {
                 pen::semaphore_post(_audio_job_thread_info->p_sem_continue, 1);
 
-                audio_cmd* cmd = _cmd_buffer.get();
+                PEN_PROFILE_SCOPE("audio_update");
+                audio_cmd* cmd = _cmd_buffer.peek();
                 while (cmd)
                 {
                     audio_exec_command(*cmd);
-                    cmd = _cmd_buffer.get();
+                    _cmd_buffer.pop();
+                    cmd = _cmd_buffer.peek();
                 }
 
                 direct::audio_system_update();
@@ -207,7 +213,7 @@ namespace put
         // set command (create stream or sound)
         ac.command_index = command;
 
-        _cmd_buffer.put(ac);
+        _cmd_buffer.push(ac);
     }
 
     u32 audio_create_stream(const c8* filename)
@@ -237,7 +243,7 @@ namespace put
         ac.command_index = e_cmd::create_group;
         ac.resource_slot = res;
 
-        _cmd_buffer.put(ac);
+        _cmd_buffer.push(ac);
 
         return res;
     }
@@ -257,7 +263,7 @@ namespace put
         ac.resource_index = sound_index;
         ac.resource_slot = res;
 
-        _cmd_buffer.put(ac);
+        _cmd_buffer.push(ac);
 
         return res;
     }
@@ -270,7 +276,7 @@ namespace put
         ac.set_valuei.resource_index = channel_index;
         ac.set_valuei.value = position_ms;
 
-        _cmd_buffer.put(ac);
+        _cmd_buffer.push(ac);
     }
 
     void audio_channel_set_frequency(const u32 channel_index, const f32 frequency)
@@ -281,7 +287,7 @@ namespace put
         ac.set_valuef.resource_index = channel_index;
         ac.set_valuef.value = frequency;
 
-        _cmd_buffer.put(ac);
+        _cmd_buffer.push(ac);
     }
 
     void audio_group_set_pause(const u32 group_index, const bool val)
@@ -292,7 +298,7 @@ namespace put
         ac.set_valuei.resource_index = group_index;
         ac.set_valuei.value = (s32)val;
 
-        _cmd_buffer.put(ac);
+        _cmd_buffer.push(ac);
     }
 
     void audio_group_set_mute(const u32 group_index, const bool val)
@@ -303,7 +309,7 @@ namespace put
         ac.set_valuei.resource_index = group_index;
         ac.set_valuei.value = (s32)val;
 
-        _cmd_buffer.put(ac);
+        _cmd_buffer.push(ac);
     }
 
     void audio_group_set_pitch(const u32 group_index, const f32 pitch)
@@ -314,7 +320,7 @@ namespace put
         ac.set_valuef.resource_index = group_index;
         ac.set_valuef.value = pitch;
 
-        _cmd_buffer.put(ac);
+        _cmd_buffer.push(ac);
     }
 
     void audio_group_set_volume(const u32 group_index, const f32 volume)
@@ -325,7 +331,7 @@ namespace put
         ac.set_valuef.resource_index = group_index;
         ac.set_valuef.value = volume;
 
-        _cmd_buffer.put(ac);
+        _cmd_buffer.push(ac);
     }
 
     void audio_add_channel_to_group(const u32 channel_index, const u32 group_index)
@@ -341,7 +347,7 @@ namespace put
         ac.set_valuei.resource_index = channel_index;
         ac.set_valuei.value = group_index;
 
-        _cmd_buffer.put(ac);
+        _cmd_buffer.push(ac);
     }
 
     void audio_release_resource(u32 index)
@@ -354,7 +360,7 @@ namespace put
         ac.command_index = e_cmd::release_resource;
         ac.resource_index = index;
 
-        _cmd_buffer.put(ac);
+        _cmd_buffer.push(ac);
     }
 
     u32 audio_add_dsp_to_group(const u32 group_index, dsp_type type)
@@ -368,7 +374,7 @@ namespace put
         ac.set_valuei.value = type;
         ac.resource_slot = res;
 
-        _cmd_buffer.put(ac);
+        _cmd_buffer.push(ac);
 
         return res;
     }
@@ -383,7 +389,7 @@ namespace put
         ac.set_value3f.value[1] = med;
         ac.set_value3f.value[2] = high;
 
-        _cmd_buffer.put(ac);
+        _cmd_buffer.push(ac);
     }
 
     void audio_dsp_set_gain(const u32 dsp_index, const f32 gain)
@@ -394,7 +400,7 @@ namespace put
         ac.set_valuef.resource_index = dsp_index;
         ac.set_valuef.value = gain;
 
-        _cmd_buffer.put(ac);
+        _cmd_buffer.push(ac);
     }
 
     void audio_channel_stop(const u32 channel_index)
@@ -404,6 +410,6 @@ namespace put
         ac.command_index = e_cmd::channel_stop;
         ac.resource_index = channel_index;
 
-        _cmd_buffer.put(ac);
+        _cmd_buffer.push(ac);
     }
 } // namespace put
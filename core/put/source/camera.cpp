@@ -255,20 +255,25 @@ namespace put
         camera_create_perspective(p_camera, p_camera->fov, p_camera->aspect, p_camera->near_plane, p_camera->far_plane);
     }
 
+    void camera_create_cbuffer(camera* p_camera)
+    {
+        if (p_camera->cbuffer != PEN_INVALID_HANDLE)
+            return;
+
+        pen::buffer_creation_params bcp;
+        bcp.usage_flags = PEN_USAGE_DYNAMIC;
+        bcp.bind_flags = PEN_BIND_CONSTANT_BUFFER;
+        bcp.cpu_access_flags = PEN_CPU_ACCESS_WRITE;
+        bcp.buffer_size = sizeof(camera_cbuffer);
+        bcp.data = nullptr;
+
+        p_camera->cbuffer = pen::renderer_create_buffer(bcp);
+    }
+
     void camera_update_shader_constants(camera* p_camera)
     {
         // create cbuffer if needed
-        if (p_camera->cbuffer == PEN_INVALID_HANDLE)
-        {
-            pen::buffer_creation_params bcp;
-            bcp.usage_flags = PEN_USAGE_DYNAMIC;
-            bcp.bind_flags = PEN_BIND_CONSTANT_BUFFER;
-            bcp.cpu_access_flags = PEN_CPU_ACCESS_WRITE;
-            bcp.buffer_size = sizeof(camera_cbuffer);
-            bcp.data = nullptr;
-
-            p_camera->cbuffer = pen::renderer_create_buffer(bcp);
-        }
+        camera_create_cbuffer(p_camera);
 
         // auto detect window aspect
         if (p_camera->flags & e_camera_flags::window_aspect)
@@ -77,6 +77,7 @@ namespace put
     void camera_update_frustum(camera* p_camera);
     void camera_update_modelling(camera* p_camera, bool has_focus = true, camera_settings settings = {});
     void camera_update_fly(camera* p_camera, bool has_focus = true, camera_settings settings = {});
+    void camera_create_cbuffer(camera* p_camera); // update_shader_constants creates it on demand otherwise
     void camera_update_shader_constants(camera* p_camera);
     void camera_update_shadow_frustum(put::camera* p_camera, vec3f light_dir, vec3f min, vec3f max);
 } // namespace put
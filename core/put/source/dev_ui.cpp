@@ -17,6 +17,7 @@
 #include "pen_json.h"
 #include "pen_string.h"
 #include "pmfx.h"
+#include "profiler.h"
 #include "renderer.h"
 #include "str_utilities.h"
 #include "timer.h"
@@ -287,6 +288,18 @@ namespace
         io.KeyAlt = pen::input_key(PK_MENU);
         io.KeySuper = false;
     }
+
+    // route imgui through pen so it shows up under the ui tag
+    void* imgui_alloc(size_t size)
+    {
+        PEN_MEMORY_TAG(pen::e_mem_tag::ui);
+        return pen::memory_alloc(size);
+    }
+
+    void imgui_free(void* mem)
+    {
+        pen::memory_free(mem);
+    }
 } // namespace
 
 namespace put
@@ -303,6 +316,9 @@ namespace put
             pen::memory_zero(&s_imgui_rs, sizeof(s_imgui_rs));
 
             ImGuiIO& io = ImGui::GetIO();
+            io.MemAllocFn = imgui_alloc;
+            io.MemFreeFn = imgui_free;
+
             io.KeyMap[ImGuiKey_Tab] = PK_TAB;
             io.KeyMap[ImGuiKey_LeftArrow] = PK_LEFT;
             io.KeyMap[ImGuiKey_RightArrow] = PK_RIGHT;
@@ -498,8 +514,9 @@ namespace put
             custom_draw_call cd = *(custom_draw_call*)cmd->UserCallbackData;
             delete (custom_draw_call*)cmd->UserCallbackData;
 
-            static hash_id ids[] = {PEN_HASH("tex_2d"), PEN_HASH("tex_cube"), PEN_HASH("tex_volume"),
-                                    PEN_HASH("tex_2d_array"), PEN_HASH("tex_cube_array")};
+            static constexpr hash_id ids[] = {PEN_CONST_HASH("tex_2d"), PEN_CONST_HASH("tex_cube"),
+                                              PEN_CONST_HASH("tex_volume"), PEN_CONST_HASH("tex_2d_array"),
+                                              PEN_CONST_HASH("tex_cube_array")};
 
             if (cd.shader == e_ui_shader::imgui)
             {
@@ -1517,6 +1534,148 @@ namespace put
             }
         }
 
+        void show_renderer_stats()
+        {
+            pen::renderer_cmd_stats cs;
+            pen::renderer_get_cmd_stats(cs);
+
+            ImGui::Text("Commands: %i (%i bytes)", cs.frame_cmds, cs.frame_bytes);
+            ImGui::Text("Dispatch: %2.3f ms", cs.dispatch_ms);
+            ImGui::Text("Stream Stalls: %i", cs.stalls);
+
+            s32 fif = pen::renderer_get_frames_in_flight();
+            if (ImGui::SliderInt("Frames In Flight", &fif, 1, 3))
+                pen::renderer_set_frames_in_flight(fif);
+
+            ImGui::Text("Queued Frames: %i", cs.frames_in_flight);
+            ImGui::Text("User Thread Wait: %2.3f ms", cs.user_wait_ms);
+            ImGui::Text("Render Thread Idle: %2.3f ms", cs.render_idle_ms);
+
+            u32 state_total = cs.state_cmds + cs.state_filtered;
+            f32 filtered_pc = state_total ? (f32)cs.state_filtered / (f32)state_total * 100.0f : 0.0f;
+            ImGui::Text("State Commands Issued: %i", cs.state_cmds);
+            ImGui::Text("State Commands Filtered: %i (%2.1f%%)", cs.state_filtered, filtered_pc);
+
+            pen::renderer_arena_stats as;
+            pen::renderer_get_arena_stats(as);
+
+            ImGui::Separator();
+            ImGui::Text("Frame Arena: %i / %i bytes", (u32)as.frame_bytes, (u32)as.arena_size);
+            ImGui::Text("Heap Allocs: %i (%i bytes)", as.heap_allocs, (u32)as.heap_bytes);
+        }
+
+        void show_memory_stats()
+        {
+            pen::memory_tag_stats ms[pen::e_mem_tag::COUNT];
+            if (!pen::memory_get_tag_stats(ms))
+            {
+                ImGui::Text("Memory tracking is disabled, build with --memory_tracking");
+                return;
+            }
+
+            ImGui::Columns(6);
+            ImGui::Text("Tag");
+            ImGui::NextColumn();
+            ImGui::Text("Live (kb)");
+            ImGui::NextColumn();
+            ImGui::Text("High Water (kb)");
+            ImGui::NextColumn();
+            ImGui::Text("Live Allocs");
+            ImGui::NextColumn();
+            ImGui::Text("Frame Allocs");
+            ImGui::NextColumn();
+            ImGui::Text("Total Allocs");
+            ImGui::NextColumn();
+            ImGui::Separator();
+
+            size_t live_bytes = 0;
+            for (u32 i = 0; i < pen::e_mem_tag::COUNT; ++i)
+            {
+                live_bytes += ms[i].live_bytes;
+
+                ImGui::Text("%s", ms[i].name);
+                ImGui::NextColumn();
+                ImGui::Text("%.1f", (f32)ms[i].live_bytes / 1024.0f);
+                ImGui::NextColumn();
+                ImGui::Text("%.1f", (f32)ms[i].high_water_bytes / 1024.0f);
+                ImGui::NextColumn();
+                ImGui::Text("%u", ms[i].live_allocs);
+                ImGui::NextColumn();
+                ImGui::Text("%u", ms[i].frame_allocs);
+                ImGui::NextColumn();
+                ImGui::Text("%llu", (unsigned long long)ms[i].total_allocs);
+                ImGui::NextColumn();
+            }
+
+            ImGui::Columns(1);
+            ImGui::Separator();
+            ImGui::Text("Total Live: %.2f mb", (f32)live_bytes / (1024.0f * 1024.0f));
+        }
+
+        void show_profiler()
+        {
+            if (!pen::profiler_enabled())
+            {
+                ImGui::Text("Profiler is disabled, build with --profiler");
+                return;
+            }
+
+            static const u32         k_max_nodes = 1024;
+            static pen::profile_node s_nodes[k_max_nodes];
+            static u32               s_num_nodes = 0;
+            static bool              s_paused = false;
+
+            ImGui::Checkbox("Pause", &s_paused);
+            ImGui::SameLine();
+            if (ImGui::Button("Export Chrome Trace"))
+            {
+                if (pen::profiler_export_chrome_trace("profile_trace.json"))
+                    dev_console_log("[profiler] exported profile_trace.json");
+                else
+                    dev_console_log_level(console_level::error, "[profiler] failed to write profile_trace.json");
+            }
+
+            if (!s_paused)
+                s_num_nodes = pen::profiler_get_frame(s_nodes, k_max_nodes);
+
+            ImGui::Columns(4);
+            ImGui::Text("Marker");
+            ImGui::NextColumn();
+            ImGui::Text("Calls");
+            ImGui::NextColumn();
+            ImGui::Text("Total (ms)");
+            ImGui::NextColumn();
+            ImGui::Text("Self (ms)");
+            ImGui::NextColumn();
+            ImGui::Separator();
+
+            const c8* thread_name = nullptr;
+            for (u32 i = 0; i < s_num_nodes; ++i)
+            {
+                const pen::profile_node& n = s_nodes[i];
+                if (n.thread_name != thread_name)
+                {
+                    thread_name = n.thread_name;
+                    ImGui::TextColored(ImVec4(0.6f, 0.8f, 1.0f, 1.0f), "%s", thread_name);
+                    ImGui::NextColumn();
+                    ImGui::NextColumn();
+                    ImGui::NextColumn();
+                    ImGui::NextColumn();
+                }
+
+                ImGui::Text("%*s%s", (n.depth + 1) * 2, "", n.name);
+                ImGui::NextColumn();
+                ImGui::Text("%u", n.calls);
+                ImGui::NextColumn();
+                ImGui::Text("%.3f", n.total_ms);
+                ImGui::NextColumn();
+                ImGui::Text("%.3f", n.self_ms);
+                ImGui::NextColumn();
+            }
+
+            ImGui::Columns(1);
+        }
+
         struct image_cbuffer
         {
             vec4f colour_mask = vec4f(1.0f, 1.0f, 1.0f, 1.0f); // mask for rgba channels
@@ -87,6 +87,9 @@ namespace put
         void      set_tooltip(const c8* fmt, ...);
         const c8* file_browser(bool& dialog_open, file_browser_flags flags, s32 num_filetypes = 0, ...);
         void      show_platform_info();
+        void      show_renderer_stats();
+        void      show_memory_stats();
+        void      show_profiler();
         void      image_ex(u32 handle, vec2f size, ui_shader shader);
 
         // generic program preferences
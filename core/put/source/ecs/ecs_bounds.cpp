@@ -0,0 +1,441 @@
+// ecs_bounds.cpp
+// Copyright 2014 - 2019 Alex Dixon.
+// License: https://github.com/polymonster/pmtech/blob/master/license.md
+
+#include "ecs/ecs_bounds.h"
+#include "memory.h"
+
+#include <math.h>
+
+#if defined(__AVX__)
+#define PEN_BOUNDS_AVX 1
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define PEN_BOUNDS_SSE 1
+#include <emmintrin.h>
+#endif
+
+using namespace put;
+
+namespace
+{
+    enum bounds_batch_layout
+    {
+        k_num_streams = 3 + 3 + 12 + 3 + 3 + 1,
+        k_num_sphere_streams = 4,
+        k_stream_align = 32,
+        k_stream_pad = 8
+    };
+
+    // plane equations with the distance to a point as dot(n, pos) + w
+    void frustum_planes(const frustum& f, f32 (&planes)[6][4])
+    {
+        for (u32 i = 0; i < 6; ++i)
+        {
+            planes[i][0] = f.n[i].x;
+            planes[i][1] = f.n[i].y;
+            planes[i][2] = f.n[i].z;
+            planes[i][3] = -dot(f.n[i], f.p[i]);
+        }
+    }
+
+    u32 cull_spheres_range(const ecs::sphere_batch& b, const f32 (&planes)[6][4], u32 start, u32 end, u32* visible)
+    {
+        u32 count = 0;
+        for (u32 i = start; i < end; ++i)
+        {
+            bool inside = true;
+            for (u32 p = 0; p < 6; ++p)
+            {
+                f32 d = planes[p][0] * b.pos[0][i] + planes[p][1] * b.pos[1][i] + planes[p][2] * b.pos[2][i] + planes[p][3];
+                inside &= !(d > b.radius[i]);
+            }
+
+            visible[count] = i;
+            count += inside ? 1 : 0;
+        }
+
+        return count;
+    }
+
+#if PEN_BOUNDS_AVX
+    const u32 k_simd_width = 8;
+
+    void transform_bounds_simd(ecs::bounds_batch& b, u32 start, u32 end)
+    {
+        const __m256 sign = _mm256_set1_ps(-0.0f);
+
+        for (u32 i = start; i < end; i += k_simd_width)
+        {
+            __m256 c[3], e[3];
+            for (u32 j = 0; j < 3; ++j)
+            {
+                c[j] = _mm256_load_ps(b.centre[j] + i);
+                e[j] = _mm256_load_ps(b.extent[j] + i);
+            }
+
+            __m256 r2 = _mm256_setzero_ps();
+            for (u32 r = 0; r < 3; ++r)
+            {
+                __m256 m0 = _mm256_load_ps(b.matrix[r * 4 + 0] + i);
+                __m256 m1 = _mm256_load_ps(b.matrix[r * 4 + 1] + i);
+                __m256 m2 = _mm256_load_ps(b.matrix[r * 4 + 2] + i);
+                __m256 m3 = _mm256_load_ps(b.matrix[r * 4 + 3] + i);
+
+                __m256 tc = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m0, c[0]), _mm256_mul_ps(m1, c[1])),
+                                          _mm256_add_ps(_mm256_mul_ps(m2, c[2]), m3));
+
+                __m256 te = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_andnot_ps(sign, m0), e[0]),
+                                                        _mm256_mul_ps(_mm256_andnot_ps(sign, m1), e[1])),
+                                          _mm256_mul_ps(_mm256_andnot_ps(sign, m2), e[2]));
+
+                _mm256_store_ps(b.min[r] + i, _mm256_sub_ps(tc, te));
+                _mm256_store_ps(b.max[r] + i, _mm256_add_ps(tc, te));
+
+                r2 = _mm256_add_ps(r2, _mm256_mul_ps(te, te));
+            }
+
+            _mm256_store_ps(b.radius + i, _mm256_sqrt_ps(r2));
+        }
+    }
+    u32 cull_spheres_simd(const ecs::sphere_batch& b, const f32 (&planes)[6][4], u32 start, u32 end, u32* visible)
+    {
+        u32 count = 0;
+        for (u32 i = start; i < end; i += k_simd_width)
+        {
+            __m256 x = _mm256_load_ps(b.pos[0] + i);
+            __m256 y = _mm256_load_ps(b.pos[1] + i);
+            __m256 z = _mm256_load_ps(b.pos[2] + i);
+            __m256 r = _mm256_load_ps(b.radius + i);
+
+            __m256 outside = _mm256_setzero_ps();
+            for (u32 p = 0; p < 6; ++p)
+            {
+                __m256 d = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(planes[p][0]), x),
+                                                       _mm256_mul_ps(_mm256_set1_ps(planes[p][1]), y)),
+                                         _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(planes[p][2]), z),
+                                                       _mm256_set1_ps(planes[p][3])));
+
+                outside = _mm256_or_ps(outside, _mm256_cmp_ps(d, r, _CMP_GT_OQ));
+            }
+
+            u32 inside = ~(u32)_mm256_movemask_ps(outside);
+            for (u32 j = 0; j < k_simd_width; ++j)
+            {
+                visible[count] = i + j;
+                count += (inside >> j) & 1;
+            }
+        }
+
+        return count;
+    }
+#elif PEN_BOUNDS_SSE
+    const u32 k_simd_width = 4;
+
+    void transform_bounds_simd(ecs::bounds_batch& b, u32 start, u32 end)
+    {
+        const __m128 sign = _mm_set1_ps(-0.0f);
+
+        for (u32 i = start; i < end; i += k_simd_width)
+        {
+            __m128 c[3], e[3];
+            for (u32 j = 0; j < 3; ++j)
+            {
+                c[j] = _mm_load_ps(b.centre[j] + i);
+                e[j] = _mm_load_ps(b.extent[j] + i);
+            }
+
+            __m128 r2 = _mm_setzero_ps();
+            for (u32 r = 0; r < 3; ++r)
+            {
+                __m128 m0 = _mm_load_ps(b.matrix[r * 4 + 0] + i);
+                __m128 m1 = _mm_load_ps(b.matrix[r * 4 + 1] + i);
+                __m128 m2 = _mm_load_ps(b.matrix[r * 4 + 2] + i);
+                __m128 m3 = _mm_load_ps(b.matrix[r * 4 + 3] + i);
+
+                __m128 tc = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m0, c[0]), _mm_mul_ps(m1, c[1])),
+                                       _mm_add_ps(_mm_mul_ps(m2, c[2]), m3));
+
+                __m128 te = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_andnot_ps(sign, m0), e[0]),
+                                                  _mm_mul_ps(_mm_andnot_ps(sign, m1), e[1])),
+                                       _mm_mul_ps(_mm_andnot_ps(sign, m2), e[2]));
+
+                _mm_store_ps(b.min[r] + i, _mm_sub_ps(tc, te));
+                _mm_store_ps(b.max[r] + i, _mm_add_ps(tc, te));
+
+                r2 = _mm_add_ps(r2, _mm_mul_ps(te, te));
+            }
+
+            _mm_store_ps(b.radius + i, _mm_sqrt_ps(r2));
+        }
+    }
+    u32 cull_spheres_simd(const ecs::sphere_batch& b, const f32 (&planes)[6][4], u32 start, u32 end, u32* visible)
+    {
+        u32 count = 0;
+        for (u32 i = start; i < end; i += k_simd_width)
+        {
+            __m128 x = _mm_load_ps(b.pos[0] + i);
+            __m128 y = _mm_load_ps(b.pos[1] + i);
+            __m128 z = _mm_load_ps(b.pos[2] + i);
+            __m128 r = _mm_load_ps(b.radius + i);
+
+            __m128 outside = _mm_setzero_ps();
+            for (u32 p = 0; p < 6; ++p)
+            {
+                __m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(planes[p][0]), x),
+                                                 _mm_mul_ps(_mm_set1_ps(planes[p][1]), y)),
+                                      _mm_add_ps(_mm_mul_ps(_mm_set1_ps(planes[p][2]), z), _mm_set1_ps(planes[p][3])));
+
+                outside = _mm_or_ps(outside, _mm_cmpgt_ps(d, r));
+            }
+
+            u32 inside = ~(u32)_mm_movemask_ps(outside);
+            for (u32 j = 0; j < k_simd_width; ++j)
+            {
+                visible[count] = i + j;
+                count += (inside >> j) & 1;
+            }
+        }
+
+        return count;
+    }
+#else
+    const u32 k_simd_width = 1;
+
+    void transform_bounds_simd(ecs::bounds_batch& b, u32 start, u32 end)
+    {
+        ecs::transform_bounds_scalar(b, start, end);
+    }
+
+    u32 cull_spheres_simd(const ecs::sphere_batch& b, const f32 (&planes)[6][4], u32 start, u32 end, u32* visible)
+    {
+        return cull_spheres_range(b, planes, start, end, visible);
+    }
+#endif
+
+    // whole aligned blocks are simd, the ends of the range are scalar so ranges can be split across threads
+    void aligned_range(u32 start, u32 end, u32& aligned_start, u32& aligned_end)
+    {
+        aligned_start = min<u32>((start + k_simd_width - 1) & ~(k_simd_width - 1), end);
+        aligned_end = max<u32>(end & ~(k_simd_width - 1), aligned_start);
+    }
+} // namespace
+
+namespace put
+{
+    namespace ecs
+    {
+        void bounds_batch_reserve(bounds_batch& batch, u32 count)
+        {
+            batch.count = count;
+            if (count <= batch.capacity)
+                return;
+
+            bounds_batch_free(batch);
+
+            u32 capacity = (count + k_stream_pad - 1) & ~(k_stream_pad - 1);
+            batch.mem = (u8*)pen::memory_alloc_align(capacity * sizeof(f32) * k_num_streams, k_stream_align);
+            batch.capacity = capacity;
+            batch.count = count;
+
+            f32*  stream = (f32*)batch.mem;
+            f32** streams[] = {&batch.centre[0], &batch.centre[1], &batch.centre[2], &batch.extent[0], &batch.extent[1],
+                               &batch.extent[2], &batch.min[0],    &batch.min[1],    &batch.min[2],    &batch.max[0],
+                               &batch.max[1],    &batch.max[2],    &batch.radius};
+
+            for (u32 i = 0; i < PEN_ARRAY_SIZE(streams); ++i, stream += capacity)
+                *streams[i] = stream;
+
+            for (u32 i = 0; i < 12; ++i, stream += capacity)
+                batch.matrix[i] = stream;
+        }
+
+        void bounds_batch_free(bounds_batch& batch)
+        {
+            if (batch.mem)
+                pen::memory_free_align(batch.mem);
+
+            batch.mem = nullptr;
+            batch.capacity = 0;
+            batch.count = 0;
+        }
+
+        void bounds_batch_set(bounds_batch& batch, u32 i, const vec3f& min, const vec3f& max, const mat4& world)
+        {
+            vec3f centre = (min + max) * 0.5f;
+            vec3f extent = (max - min) * 0.5f;
+
+            batch.centre[0][i] = centre.x;
+            batch.centre[1][i] = centre.y;
+            batch.centre[2][i] = centre.z;
+
+            batch.extent[0][i] = extent.x;
+            batch.extent[1][i] = extent.y;
+            batch.extent[2][i] = extent.z;
+
+            for (u32 j = 0; j < 12; ++j)
+                batch.matrix[j][i] = world.m[j];
+        }
+
+        void bounds_batch_get(const bounds_batch& batch, u32 i, vec3f& min, vec3f& max, f32& radius)
+        {
+            min = vec3f(batch.min[0][i], batch.min[1][i], batch.min[2][i]);
+            max = vec3f(batch.max[0][i], batch.max[1][i], batch.max[2][i]);
+            radius = batch.radius[i];
+        }
+
+        void transform_bounds_scalar(bounds_batch& b, u32 start, u32 end)
+        {
+            for (u32 i = start; i < end; ++i)
+            {
+                f32 r2 = 0.0f;
+                for (u32 r = 0; r < 3; ++r)
+                {
+                    const f32 m0 = b.matrix[r * 4 + 0][i];
+                    const f32 m1 = b.matrix[r * 4 + 1][i];
+                    const f32 m2 = b.matrix[r * 4 + 2][i];
+                    const f32 m3 = b.matrix[r * 4 + 3][i];
+
+                    f32 tc = m0 * b.centre[0][i] + m1 * b.centre[1][i] + m2 * b.centre[2][i] + m3;
+                    f32 te = fabsf(m0) * b.extent[0][i] + fabsf(m1) * b.extent[1][i] + fabsf(m2) * b.extent[2][i];
+
+                    b.min[r][i] = tc - te;
+                    b.max[r][i] = tc + te;
+
+                    r2 += te * te;
+                }
+
+                b.radius[i] = sqrtf(r2);
+            }
+        }
+
+        void transform_bounds(bounds_batch& b, u32 start, u32 end)
+        {
+            u32 aligned_start, aligned_end;
+            aligned_range(start, end, aligned_start, aligned_end);
+
+            transform_bounds_scalar(b, start, aligned_start);
+            transform_bounds_simd(b, aligned_start, aligned_end);
+            transform_bounds_scalar(b, aligned_end, end);
+        }
+
+        void transform_bounds_task(void* user_data, u32 start, u32 end)
+        {
+            transform_bounds(*(bounds_batch*)user_data, start, end);
+        }
+
+        void sphere_batch_reserve(sphere_batch& batch, u32 count)
+        {
+            if (count <= batch.capacity)
+            {
+                batch.count = count;
+                return;
+            }
+
+            u32 capacity = (count + k_stream_pad - 1) & ~(k_stream_pad - 1);
+            u8* mem = (u8*)pen::memory_alloc_align(capacity * sizeof(f32) * k_num_sphere_streams, k_stream_align);
+
+            f32* stream = (f32*)mem;
+            f32* streams[k_num_sphere_streams];
+            for (u32 i = 0; i < k_num_sphere_streams; ++i, stream += capacity)
+                streams[i] = stream;
+
+            if (batch.mem)
+            {
+                memcpy(streams[0], batch.pos[0], batch.capacity * sizeof(f32));
+                memcpy(streams[1], batch.pos[1], batch.capacity * sizeof(f32));
+                memcpy(streams[2], batch.pos[2], batch.capacity * sizeof(f32));
+                memcpy(streams[3], batch.radius, batch.capacity * sizeof(f32));
+                pen::memory_free_align(batch.mem);
+            }
+
+            batch.pos[0] = streams[0];
+            batch.pos[1] = streams[1];
+            batch.pos[2] = streams[2];
+            batch.radius = streams[3];
+
+            batch.mem = mem;
+            batch.capacity = capacity;
+            batch.count = count;
+        }
+
+        void sphere_batch_free(sphere_batch& batch)
+        {
+            if (batch.mem)
+                pen::memory_free_align(batch.mem);
+
+            batch.mem = nullptr;
+            batch.capacity = 0;
+            batch.count = 0;
+        }
+
+        void sphere_batch_set(sphere_batch& batch, u32 i, const vec3f& pos, f32 radius)
+        {
+            batch.pos[0][i] = pos.x;
+            batch.pos[1][i] = pos.y;
+            batch.pos[2][i] = pos.z;
+            batch.radius[i] = radius;
+        }
+
+        u32 cull_spheres_scalar(const sphere_batch& batch, const frustum& f, u32 start, u32 end, u32* visible)
+        {
+            f32 planes[6][4];
+            frustum_planes(f, planes);
+
+            return cull_spheres_range(batch, planes, start, end, visible);
+        }
+
+        u32 cull_spheres(const sphere_batch& batch, const frustum& f, u32 start, u32 end, u32* visible)
+        {
+            f32 planes[6][4];
+            frustum_planes(f, planes);
+
+            u32 aligned_start, aligned_end;
+            aligned_range(start, end, aligned_start, aligned_end);
+
+            u32 count = cull_spheres_range(batch, planes, start, aligned_start, visible);
+            count += cull_spheres_simd(batch, planes, aligned_start, aligned_end, visible + count);
+            count += cull_spheres_range(batch, planes, aligned_end, end, visible + count);
+
+            return count;
+        }
+
+        u32 cull_spheres_indexed(const sphere_batch& batch, const frustum& f, u32* indices, u32 count)
+        {
+            f32 planes[6][4];
+            frustum_planes(f, planes);
+
+            u32 num_inside = 0;
+            for (u32 j = 0; j < count; ++j)
+            {
+                u32 i = indices[j];
+                if (i >= batch.count)
+                    continue;
+
+                bool inside = true;
+                for (u32 p = 0; p < 6; ++p)
+                {
+                    f32 d = planes[p][0] * batch.pos[0][i] + planes[p][1] * batch.pos[1][i] +
+                            planes[p][2] * batch.pos[2][i] + planes[p][3];
+                    inside &= !(d > batch.radius[i]);
+                }
+
+                indices[num_inside] = i;
+                num_inside += inside ? 1 : 0;
+            }
+
+            return num_inside;
+        }
+
+        const c8* transform_bounds_isa()
+        {
+#if PEN_BOUNDS_AVX
+            return "avx";
+#elif PEN_BOUNDS_SSE
+            return "sse";
+#else
+            return "scalar";
+#endif
+        }
+    } // namespace ecs
+} // namespace put
@@ -0,0 +1,78 @@
+// ecs_bounds.h
+// Copyright 2014 - 2019 Alex Dixon.
+// License: https://github.com/polymonster/pmtech/blob/master/license.md
+
+// Batch bounding volume kernels used by update_scene and scene view culling.
+// Local aabbs are transformed with the centre / extent method, which gives the same box as transforming all 8 corners
+// for affine matrices:
+//      centre' = M * centre
+//      extent' = abs(M) * extent
+// Bounding spheres are tested against the 6 frustum planes and the indices of visible spheres are written out.
+// Data is laid out as structure of arrays so 8 (avx) or 4 (sse) entities are processed at once, other platforms and
+// the tail of a batch use the scalar path.
+
+#pragma once
+
+#include "camera.h"
+#include "pen.h"
+
+#include "maths/maths.h"
+
+namespace put
+{
+    namespace ecs
+    {
+        struct bounds_batch
+        {
+            // inputs
+            f32* centre[3];  // local aabb centre
+            f32* extent[3];  // local aabb half size
+            f32* matrix[12]; // first 3 rows of the world matrix
+
+            // outputs
+            f32* min[3];
+            f32* max[3];
+            f32* radius;
+
+            u32 count = 0;
+            u32 capacity = 0;
+            u8* mem = nullptr;
+        };
+
+        // streams are 32 byte aligned, existing contents are not kept when growing
+        void bounds_batch_reserve(bounds_batch& batch, u32 count);
+        void bounds_batch_free(bounds_batch& batch);
+
+        void bounds_batch_set(bounds_batch& batch, u32 i, const vec3f& min, const vec3f& max, const mat4& world);
+        void bounds_batch_get(const bounds_batch& batch, u32 i, vec3f& min, vec3f& max, f32& radius);
+
+        // transform [start, end), ranges can be split across threads
+        void transform_bounds(bounds_batch& batch, u32 start, u32 end);
+        void transform_bounds_scalar(bounds_batch& batch, u32 start, u32 end);
+        void transform_bounds_task(void* user_data, u32 start, u32 end); // user_data is a bounds_batch*
+
+        struct sphere_batch
+        {
+            f32* pos[3];
+            f32* radius;
+
+            u32 count = 0;
+            u32 capacity = 0;
+            u8* mem = nullptr;
+        };
+
+        // existing contents up to the previous capacity are kept when growing
+        void sphere_batch_reserve(sphere_batch& batch, u32 count);
+        void sphere_batch_free(sphere_batch& batch);
+        void sphere_batch_set(sphere_batch& batch, u32 i, const vec3f& pos, f32 radius);
+
+        // writes indices of spheres in [start, end) which are not outside any plane to visible, returns the count
+        u32 cull_spheres(const sphere_batch& batch, const frustum& f, u32 start, u32 end, u32* visible);
+        u32 cull_spheres_scalar(const sphere_batch& batch, const frustum& f, u32 start, u32 end, u32* visible);
+
+        // keeps indices whose spheres are not outside any plane, in place, returns the count. for refining coarse results
+        u32 cull_spheres_indexed(const sphere_batch& batch, const frustum& f, u32* indices, u32 count);
+
+        const c8* transform_bounds_isa();
+    } // namespace ecs
+} // namespace put
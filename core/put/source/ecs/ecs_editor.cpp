@@ -559,8 +559,24 @@ namespace put
                         pm = e_select_mode::add;
                     }
 
-                    for (s32 node = 0; node < scene->num_entities; ++node)
+                    // the spatial tree narrows the candidates, its fat aabbs still need the exact test below
+                    u32  num_candidates = (u32)scene->num_entities;
+                    u32* candidates = nullptr;
+                    if (scene->spatial_tree.num_leaves > 0)
+                    {
+                        frustum f;
+                        memcpy(f.n, n, sizeof(f.n));
+                        memcpy(f.p, p, sizeof(f.p));
+
+                        candidates = (u32*)pen::memory_alloc(sizeof(u32) * num_candidates);
+                        num_candidates = aabb_tree_query_frustum(scene->spatial_tree, f, candidates, num_candidates);
+                        num_candidates = min<u32>(num_candidates, (u32)scene->num_entities);
+                    }
+
+                    for (u32 c = 0; c < num_candidates; ++c)
                     {
+                        u32 node = candidates ? candidates[c] : c;
+
                         if (!(scene->entities[node] & e_cmp::allocated))
                             continue;
 
@@ -587,6 +603,8 @@ namespace put
                         }
                     }
 
+                    pen::memory_free(candidates);
+
                     sb_clear(scene->selection_list);
                     stb__sbgrow(scene->selection_list, scene->num_entities);
 
@@ -1427,6 +1445,21 @@ namespace put
                         debug_show_icons();
                     }
 
+                    if (ImGui::CollapsingHeader("Renderer"))
+                    {
+                        dev_ui::show_renderer_stats();
+                    }
+
+                    if (ImGui::CollapsingHeader("Memory"))
+                    {
+                        dev_ui::show_memory_stats();
+                    }
+
+                    if (ImGui::CollapsingHeader("Profiler"))
+                    {
+                        dev_ui::show_profiler();
+                    }
+
                     ImGui::End();
                 }
             }
@@ -2275,6 +2308,7 @@ namespace put
                     {
                         s32 s = selected_index;
                         scene->world_matrices[s] = mat4::create_identity();
+                        scene->entities[s] |= e_cmp::transform;
                     }
                 }
                 else
@@ -2441,6 +2475,14 @@ namespace put
                     ImGui::Text("Total Entities: %lu", scene->num_entities);
                     ImGui::Text("Selected: %i", (s32)sb_count(scene->selection_list));
 
+                    const scene_update_stats& us = scene->update_stats;
+                    ImGui::Text("Updated Transforms: %i / %i", us.transforms, us.entities);
+                    ImGui::Text("Updated Bounds: %i / %i", us.bounds, us.entities);
+                    ImGui::Text("Updated Cbuffers: %i", us.cbuffers);
+                    ImGui::Text("Culled Views: %i, Visible: %i / %i", us.cull_views, us.cull_visible, us.cull_tested);
+                    ImGui::Text("Spatial Tree: %i leaves, height %i", scene->spatial_tree.num_leaves,
+                                aabb_tree_height(scene->spatial_tree));
+
                     for (s32 i = 0; i < PEN_ARRAY_SIZE(dumps); ++i)
                         dumps[i].count = 0;
 
@@ -3403,8 +3445,8 @@ namespace put
             put::dbg::render_3d(view.cb_view);
 
             // no depth test and default raster state
-            static hash_id id_disabled = PEN_HASH("disabled");
-            static hash_id id_default = PEN_HASH("default");
+            static constexpr hash_id id_disabled = PEN_CONST_HASH("disabled");
+            static constexpr hash_id id_default = PEN_CONST_HASH("default");
 
             u32 depth_disabled = pmfx::get_render_state(id_disabled, pmfx::e_render_state::depth_stencil);
             u32 fill = pmfx::get_render_state(id_default, pmfx::e_render_state::rasterizer);
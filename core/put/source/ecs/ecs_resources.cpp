@@ -60,7 +60,8 @@ namespace
         u32              num_geometry = 0;
         u32              num_materials = 0;
         u8*              data_start = nullptr;
-        void*            file_data = nullptr;
+        pen::mapped_file file;
+        const void*      file_data = nullptr;
         u32              file_size = 0;
         std::vector<u32> scene_offsets;
         std::vector<u32> material_offsets;
@@ -118,10 +119,37 @@ namespace
     std::vector<material_resource*> s_material_resources;
     std::vector<animation_resource> s_animation_resources;
 
+    // hashed lookups into the resource lists, first registered wins as with the linear searches
+    pen::hash_map<geometry_resource*> s_geometry_lookup;  // sub mesh hash
+    pen::hash_set                     s_geometry_files;   // file + geometry name hash
+    pen::hash_map<material_resource*> s_material_lookup;  // file + material name hash
+    pen::hash_map<anim_handle>        s_animation_lookup; // stripped filename hash
+
+    void register_geometry_resource(geometry_resource* gr)
+    {
+        s_geometry_resources.push_back(gr);
+
+        if (gr->hash)
+            s_geometry_lookup.try_insert(gr->hash, gr);
+
+        if (gr->geom_hash)
+            s_geometry_files.insert(gr->geom_hash);
+    }
+
+    void register_material_resource(material_resource* mr)
+    {
+        s_material_resources.push_back(mr);
+
+        if (mr->hash)
+            s_material_lookup.try_insert(mr->hash, mr);
+    }
+
     bool parse_pmm_contents(const c8* filename, pmm_contents& contents)
     {
-        // read in file from disk
-        pen_error err = pen::filesystem_read_file_to_buffer(filename, &contents.file_data, contents.file_size);
+        // map file from disk, sub resources are copied out of the view
+        pen_error err = pen::filesystem_map_file(filename, contents.file, pen::e_file_access::sequential);
+        contents.file_data = contents.file.data;
+        contents.file_size = contents.file.size;
         if (err != PEN_ERR_OK || contents.file_size == 0)
         {
             dev_ui::log_level(dev_ui::console_level::error, "[error] load pmm - failed to find file: %s", filename);
@@ -266,9 +294,8 @@ namespace
             hash_id geom_hash = hm.end();
 
             // check for existing
-            for (s32 g = 0; g < s_geometry_resources.size(); ++g)
-                if (geom_hash == s_geometry_resources[g]->geom_hash)
-                    return;
+            if (s_geometry_files.contains(geom_hash))
+                return;
 
             for (u32 submesh = 0; submesh < geom[g].submeshes.size(); ++submesh)
             {
@@ -299,7 +326,15 @@ namespace
                 if (sm.skinned)
                 {
                     p_geometry->p_skin = (cmp_skin*)pen::memory_alloc(sizeof(cmp_skin));
-                    p_geometry->p_skin->bone_cbuffer = PEN_INVALID_HANDLE;
+                    // bone cbuffer is created up front, the render path must not create resources
+                    pen::buffer_creation_params bcp;
+                    bcp.usage_flags = PEN_USAGE_DYNAMIC;
+                    bcp.bind_flags = PEN_BIND_CONSTANT_BUFFER;
+                    bcp.cpu_access_flags = PEN_CPU_ACCESS_WRITE;
+                    bcp.buffer_size = sizeof(mat4) * 85;
+                    bcp.data = nullptr;
+
+                    p_geometry->p_skin->bone_cbuffer = pen::renderer_create_buffer(bcp);
                     p_geometry->p_skin->bind_shape_matrix = sm.bind_shape_matrix;
                     p_geometry->p_skin->num_joints = sm.num_joint_floats / k_matrix_floats;
                     memset(p_geometry->p_skin->joint_bind_matrices, 0x0, sizeof(p_geometry->p_skin->joint_bind_matrices));
@@ -345,7 +380,7 @@ namespace
                     r.index_buffer = pen::renderer_create_buffer(bcp);
                 }
 
-                s_geometry_resources.push_back(p_geometry);
+                register_geometry_resource(p_geometry);
             }
         }
     }
@@ -358,9 +393,8 @@ namespace
         hm.add(material_name, pen::string_length(material_name));
         hash_id hash = hm.end();
 
-        for (s32 m = 0; m < s_material_resources.size(); ++m)
-            if (s_material_resources[m]->hash == hash)
-                return;
+        if (s_material_lookup.find(hash))
+            return;
 
         const u32* p_reader = (u32*)data;
 
@@ -419,7 +453,7 @@ namespace
             p_mat->texture_handles[map_type] = put::load_texture(texture_name.c_str());
         }
 
-        s_material_resources.push_back(p_mat);
+        register_material_resource(p_mat);
 
         return;
     }
@@ -699,7 +733,7 @@ namespace
                         }
                         else
                         {
-                            static hash_id id_default = PEN_HASH("default_material");
+                            static constexpr hash_id id_default = PEN_CONST_HASH("default_material");
 
                             mr = get_material_resource(id_default);
 
@@ -766,19 +800,19 @@ namespace put
     {
         void add_material_resource(material_resource* mr)
         {
-            s_material_resources.push_back(mr);
+            register_material_resource(mr);
         }
 
         void add_geometry_resource(geometry_resource* gr)
         {
-            s_geometry_resources.push_back(gr);
+            register_geometry_resource(gr);
         }
 
         geometry_resource* get_geometry_resource(hash_id hash)
         {
-            for (auto* g : s_geometry_resources)
-                if (hash == g->hash)
-                    return g;
+            geometry_resource** g = hash ? s_geometry_lookup.find(hash) : nullptr;
+            if (g)
+                return *g;
 
             return nullptr;
         }
@@ -803,9 +837,9 @@ namespace put
 
         material_resource* get_material_resource(hash_id hash)
         {
-            for (auto* m : s_material_resources)
-                if (m->hash == hash)
-                    return m;
+            material_resource** m = hash ? s_material_lookup.find(hash) : nullptr;
+            if (m)
+                return *m;
 
             return nullptr;
         }
@@ -1128,8 +1162,8 @@ namespace put
 
             hash_id id_type = pmv["volume_type"].as_hash_id();
 
-            static hash_id id_sdf = PEN_HASH("signed_distance_field");
-            static hash_id id_cl = PEN_HASH("clamp_linear");
+            static constexpr hash_id id_sdf = PEN_CONST_HASH("signed_distance_field");
+            static constexpr hash_id id_cl = PEN_CONST_HASH("clamp_linear");
             if (id_type != id_sdf)
             {
                 dev_console_log_level(dev_ui::console_level::error, "[shadow] %s is not a signed distance field texture",
@@ -1242,15 +1276,15 @@ namespace put
             // set defaults
             if (mr->id_shader == 0)
             {
-                static hash_id id_default_shader = PEN_HASH("forward_render");
-                static hash_id id_default_technique = PEN_HASH("forward_lit");
+                static constexpr hash_id id_default_shader = PEN_CONST_HASH("forward_render");
+                static constexpr hash_id id_default_technique = PEN_CONST_HASH("forward_lit");
 
                 mr->shader_name = "forward_render";
                 mr->id_shader = id_default_shader;
                 mr->id_technique = id_default_technique;
             }
 
-            static hash_id id_default_sampler_state = PEN_HASH("wrap_linear");
+            static constexpr hash_id id_default_sampler_state = PEN_CONST_HASH("wrap_linear");
 
             for (u32 i = 0; i < e_texture::COUNT; ++i)
             {
@@ -1361,6 +1395,8 @@ namespace put
 
         anim_handle load_pma(const c8* filename)
         {
+            PEN_MEMORY_TAG(pen::e_mem_tag::loader);
+
             Str pd = put::dev_ui::get_program_preference_filename("project_dir");
 
             Str stipped_filename = pen::str_replace_string(filename, pd.c_str(), "");
@@ -1368,38 +1404,33 @@ namespace put
             hash_id filename_hash = PEN_HASH(stipped_filename.c_str());
 
             // search for existing
-            s32 num_anims = s_animation_resources.size();
-            for (s32 i = 0; i < num_anims; ++i)
-            {
-                if (s_animation_resources[i].id_name == filename_hash)
-                {
-                    return (anim_handle)i;
-                }
-            }
-
-            void* anim_file;
-            u32   anim_file_size;
+            anim_handle* existing = s_animation_lookup.find(filename_hash);
+            if (existing)
+                return *existing;
 
-            pen_error err = pen::filesystem_read_file_to_buffer(filename, &anim_file, anim_file_size);
+            pen::mapped_file anim_file;
+            pen_error        err = pen::filesystem_map_file(filename, anim_file, pen::e_file_access::sequential);
 
-            if (err != PEN_ERR_OK || anim_file_size == 0)
+            if (err != PEN_ERR_OK || anim_file.size == 0)
             {
                 // TODO error dialog
+                pen::filesystem_unmap_file(anim_file);
                 return PEN_INVALID_HANDLE;
             }
 
-            const u32* p_u32reader = (u32*)anim_file;
+            const u32* p_u32reader = (const u32*)anim_file.data;
 
             u32 version = *p_u32reader++;
 
             if (version < 1)
             {
-                pen::memory_free(anim_file);
+                pen::filesystem_unmap_file(anim_file);
                 return PEN_INVALID_HANDLE;
             }
 
             s_animation_resources.push_back(animation_resource());
             animation_resource& new_animation = s_animation_resources.back();
+            s_animation_lookup.try_insert(filename_hash, (anim_handle)s_animation_resources.size() - 1);
 
             new_animation.name = stipped_filename;
             new_animation.id_name = filename_hash;
@@ -1584,8 +1615,8 @@ namespace put
                 max_frames = std::max<u32>(new_animation.channels[i].num_frames, max_frames);
             }
 
-            // free file mem
-            pen::memory_free(anim_file);
+            // release the file view
+            pen::filesystem_unmap_file(anim_file);
 
             // bake animations into soa.
 
@@ -1952,7 +1983,7 @@ namespace put
                     pen::memory_free(sm.joint_data);
                 }
             }
-            pen::memory_free(contents.file_data);
+            pen::filesystem_unmap_file(contents.file);
         }
 
         void optimise_pma(const c8* input_filename, const c8* output_filename)
@@ -1963,6 +1994,8 @@ namespace put
 
         s32 load_pmm(const c8* filename, ecs_scene* scene, u32 load_flags)
         {
+            PEN_MEMORY_TAG(pen::e_mem_tag::loader);
+
             // pmm contains scene node, material, and geometry resources
             pmm_contents contents;
             parse_pmm_contents(filename, contents);
@@ -1999,12 +2032,14 @@ namespace put
                         scene->flags |= e_scene_flags::invalidate_scene_tree;
             }
 
-            pen::memory_free(contents.file_data);
+            pen::filesystem_unmap_file(contents.file);
             return root;
         }
 
         s32 load_pmv(const c8* filename, ecs_scene* scene)
         {
+            PEN_MEMORY_TAG(pen::e_mem_tag::loader);
+
             pen::json pmv = pen::json::load_from_file(filename);
 
             Str volume_texture_filename = pmv["filename"].as_str();
@@ -2,6 +2,7 @@
 // Copyright 2014 - 2019 Alex Dixon.
 // License: https://github.com/polymonster/pmtech/blob/master/license.md
 
+#include <cmath>
 #include <fstream>
 #include <functional>
 
@@ -13,10 +14,13 @@
 #include "hash.h"
 #include "os.h"
 #include "pmfx.h"
+#include "profiler.h"
 #include "str/Str.h"
 #include "str_utilities.h"
+#include "tasks.h"
 #include "timer.h"
 
+#include "ecs/ecs_bounds.h"
 #include "ecs/ecs_resources.h"
 #include "ecs/ecs_scene.h"
 #include "ecs/ecs_utilities.h"
@@ -29,6 +33,19 @@ namespace put
     {
         static std::vector<ecs_scene_instance> s_scenes;
 
+        // shared by the scene view renderers, created by their setup functions because views can be recorded on task threads
+        struct view_renderer_resources
+        {
+            u32 cb_shadow_view = PEN_INVALID_HANDLE;
+            u32 cb_shadow_light = PEN_INVALID_HANDLE;
+            u32 cb_omni_camera = PEN_INVALID_HANDLE;
+            u32 cb_omni_light = PEN_INVALID_HANDLE;
+            u32 deferred_shader = PEN_INVALID_HANDLE;
+            u32 ltc_mat = 0;
+            u32 ltc_mag = 0;
+        };
+        static view_renderer_resources s_svr;
+
         void register_ecs_extentsions(ecs_scene* scene, const ecs_extension& ext)
         {
             sb_push(scene->extensions, ext);
@@ -78,6 +95,8 @@ namespace put
 
         void resize_scene_buffers(ecs_scene* scene, s32 size)
         {
+            PEN_MEMORY_TAG(pen::e_mem_tag::ecs);
+
             u32 new_size = scene->soa_size + size;
 
             for (u32 i = 0; i < scene->num_components; ++i)
@@ -128,6 +147,14 @@ namespace put
                 cmp.data = nullptr;
             }
 
+            sb_clear(scene->hierarchy_parents);
+            sb_clear(scene->hierarchy_order);
+            sb_clear(scene->hierarchy_levels);
+            sb_clear(scene->update_cache);
+            sphere_batch_free(scene->bounding_spheres);
+            aabb_tree_clear(scene->spatial_tree);
+            sb_clear(scene->tree_proxies);
+
             scene->soa_size = 0;
             scene->num_entities = 0;
         }
@@ -296,6 +323,52 @@ namespace put
             return dst;
         }
         
+        u32 create_dynamic_cbuffer(u32 size)
+        {
+            pen::buffer_creation_params bcp;
+            bcp.usage_flags = PEN_USAGE_DYNAMIC;
+            bcp.bind_flags = PEN_BIND_CONSTANT_BUFFER;
+            bcp.cpu_access_flags = PEN_CPU_ACCESS_WRITE;
+            bcp.buffer_size = size;
+            bcp.data = nullptr;
+
+            return pen::renderer_create_buffer(bcp);
+        }
+
+        void setup_scene_view()
+        {
+            // ltc lookups for area lights in forward lit views
+            if (s_svr.ltc_mat == 0)
+            {
+                s_svr.ltc_mat = put::load_texture("data/textures/ltc/ltc_mat.dds");
+                s_svr.ltc_mag = put::load_texture("data/textures/ltc/ltc_amp.dds");
+            }
+        }
+
+        void setup_light_volumes()
+        {
+            if (!is_valid(s_svr.deferred_shader))
+                s_svr.deferred_shader = pmfx::load_shader("deferred_render");
+        }
+
+        void setup_shadow_views()
+        {
+            if (!is_valid(s_svr.cb_shadow_view))
+            {
+                s_svr.cb_shadow_view = create_dynamic_cbuffer(sizeof(camera_cbuffer));
+                s_svr.cb_shadow_light = create_dynamic_cbuffer(sizeof(light_data));
+            }
+        }
+
+        void setup_omni_shadow_views()
+        {
+            if (!is_valid(s_svr.cb_omni_camera))
+            {
+                s_svr.cb_omni_camera = create_dynamic_cbuffer(sizeof(camera_cbuffer));
+                s_svr.cb_omni_light = create_dynamic_cbuffer(sizeof(light_data));
+            }
+        }
+
         void init()
         {
             // create view renderers
@@ -303,26 +376,35 @@ namespace put
             svr_main.name = "ecs_render_scene";
             svr_main.id_name = PEN_HASH(svr_main.name.c_str());
             svr_main.render_function = &ecs::render_scene_view;
+            svr_main.setup_function = &setup_scene_view;
+            svr_main.parallel_record = true;
 
             put::scene_view_renderer svr_light_volumes;
             svr_light_volumes.name = "ecs_render_light_volumes";
             svr_light_volumes.id_name = PEN_HASH(svr_light_volumes.name.c_str());
             svr_light_volumes.render_function = &ecs::render_light_volumes;
+            svr_light_volumes.setup_function = &setup_light_volumes;
+            svr_light_volumes.parallel_record = true;
 
             put::scene_view_renderer svr_shadow_maps;
             svr_shadow_maps.name = "ecs_render_shadow_maps";
             svr_shadow_maps.id_name = PEN_HASH(svr_shadow_maps.name.c_str());
             svr_shadow_maps.render_function = &ecs::render_shadow_views;
+            svr_shadow_maps.setup_function = &setup_shadow_views;
+            svr_shadow_maps.parallel_record = true;
 
             put::scene_view_renderer svr_area_light_textures;
             svr_area_light_textures.name = "ecs_render_area_light_textures";
             svr_area_light_textures.id_name = PEN_HASH(svr_area_light_textures.name.c_str());
             svr_area_light_textures.render_function = &ecs::render_area_light_textures;
+            svr_area_light_textures.parallel_record = true;
 
             put::scene_view_renderer svr_omni_shadow_maps;
             svr_omni_shadow_maps.name = "ecs_render_omni_shadow_maps";
             svr_omni_shadow_maps.id_name = PEN_HASH(svr_omni_shadow_maps.name.c_str());
             svr_omni_shadow_maps.render_function = &ecs::render_omni_shadow_views;
+            svr_omni_shadow_maps.setup_function = &setup_omni_shadow_views;
+            svr_omni_shadow_maps.parallel_record = true;
             
             put::scene_view_renderer svr_volume_gi;
             svr_volume_gi.name = "ecs_compute_volume_gi";
@@ -339,6 +421,8 @@ namespace put
 
         ecs_scene* create_scene(const c8* name)
         {
+            PEN_MEMORY_TAG(pen::e_mem_tag::ecs);
+
             ecs_scene_instance new_instance;
             new_instance.name = name;
             new_instance.scene = new ecs_scene();
@@ -512,22 +596,11 @@ namespace put
         void render_shadow_views(const scene_view& view)
         {
             ecs_scene* scene = view.scene;
+            u32        cb_view = s_svr.cb_shadow_view;
 
-            static u32 cb_view = PEN_INVALID_HANDLE;
-            if (!is_valid(cb_view))
-            {
-                pen::buffer_creation_params bcp;
-                bcp.usage_flags = PEN_USAGE_DYNAMIC;
-                bcp.bind_flags = PEN_BIND_CONSTANT_BUFFER;
-                bcp.cpu_access_flags = PEN_CPU_ACCESS_WRITE;
-                bcp.buffer_size = sizeof(camera_cbuffer);
-                bcp.data = nullptr;
-
-                cb_view = pen::renderer_create_buffer(bcp);
-            }
-
-            static mat4 shadow_matrices[e_scene_limits::max_shadow_maps];
-            u32         shadow_index = 0;
+            // shadow views can be recorded in parallel, so each view builds the full set of matrices locally
+            mat4 shadow_matrices[e_scene_limits::max_shadow_maps];
+            u32  shadow_index = 0;
             for (u32 n = 0; n < scene->num_entities; ++n)
             {
                 if (!(scene->entities[n] & e_cmp::light))
@@ -536,38 +609,29 @@ namespace put
                 if (!(scene->lights[n].flags & (e_light_flags::shadow_map | e_light_flags::global_illumination)))
                     continue;
 
-                if (shadow_index++ != view.array_index)
-                    continue;
+                if (shadow_index >= e_scene_limits::max_shadow_maps)
+                    break;
 
                 // create a shadow camera
                 camera cam;
                 shadow_camera_from_entity(cam, scene, n);
+                mat4 shadow_vp = cam.proj * cam.view;
+                shadow_matrices[shadow_index] = shadow_vp;
+
+                if (shadow_index++ != view.array_index)
+                    continue;
 
                 // update view and camera
                 scene_view vv = view;
                 vv.camera = &cam;
-                mat4 shadow_vp = cam.proj * cam.view;
                 pen::renderer_update_buffer(cb_view, &shadow_vp, sizeof(mat4));
-                shadow_matrices[shadow_index - 1] = shadow_vp;
                 vv.cb_view = cb_view;
                 
                 // colour shadow maps
                 if(vv.render_flags & pmfx::e_scene_render_flags::forward_lit)
                 {
                     // bind single light cbuffer
-                    static u32    cb_light = -1;
-                    if (!is_valid(cb_light))
-                    {
-                        pen::buffer_creation_params bcp;
-                        bcp.usage_flags = PEN_USAGE_DYNAMIC;
-                        bcp.bind_flags = PEN_BIND_CONSTANT_BUFFER;
-                        bcp.cpu_access_flags = PEN_CPU_ACCESS_WRITE;
-                        bcp.buffer_size = sizeof(light_data);
-                        bcp.data = nullptr;
-
-                        cb_light = pen::renderer_create_buffer(bcp);
-                    }
-                    
+                    u32        cb_light = s_svr.cb_shadow_light;
                     light_data ld;
                     single_light_from_entity(ld, scene, n);
                     pen::renderer_update_buffer(cb_light, &ld, sizeof(light_data));
@@ -580,6 +644,9 @@ namespace put
             // update cbuffer
             if (is_valid(scene->shadow_map_buffer))
             {
+                for (u32 i = shadow_index; i < e_scene_limits::max_shadow_maps; ++i)
+                    shadow_matrices[i] = mat4::create_identity();
+
                 pen::renderer_update_buffer(scene->shadow_map_buffer, &shadow_matrices[0],
                                             sizeof(mat4) * e_scene_limits::max_shadow_maps);
             }
@@ -588,22 +655,8 @@ namespace put
         void render_omni_shadow_views(const scene_view& view)
         {
             ecs_scene* scene = view.scene;
-
-            static camera cam_omni_shadow;
-            static u32    cb_light = -1;
-            if (!is_valid(cb_light))
-            {
-                cam_omni_shadow.pos = vec3f(0.0f, 0.0f, 0.0f);
-
-                pen::buffer_creation_params bcp;
-                bcp.usage_flags = PEN_USAGE_DYNAMIC;
-                bcp.bind_flags = PEN_BIND_CONSTANT_BUFFER;
-                bcp.cpu_access_flags = PEN_CPU_ACCESS_WRITE;
-                bcp.buffer_size = sizeof(light_data);
-                bcp.data = nullptr;
-
-                cb_light = pen::renderer_create_buffer(bcp);
-            }
+            u32        cb_omni_camera = s_svr.cb_omni_camera;
+            u32        cb_light = s_svr.cb_omni_light;
 
             u32 target_omni_light_index = view.array_index / 6;
             u32 array_face = view.array_index % 6;
@@ -619,6 +672,9 @@ namespace put
                 if (omni_light_index++ != target_omni_light_index)
                     continue;
 
+                // local camera sharing one cbuffer, updates are ordered with the draws in the command stream
+                camera cam_omni_shadow;
+                cam_omni_shadow.cbuffer = cb_omni_camera;
                 cam_omni_shadow.pos = scene->transforms[n].translation;
                 put::camera_create_cubemap(&cam_omni_shadow, 0.1f, scene->lights[n].radius * 2.0f);
                 put::camera_set_cubemap_face(&cam_omni_shadow, array_face);
@@ -646,20 +702,22 @@ namespace put
 
             pen::renderer_set_constant_buffer(view.cb_view, 0, pen::CBUFFER_BIND_PS | pen::CBUFFER_BIND_VS);
 
-            static hash_id id_volume[] = {PEN_HASH("full_screen_quad"), PEN_HASH("sphere"), PEN_HASH("cone")};
+            static constexpr hash_id id_volume[] = {PEN_CONST_HASH("full_screen_quad"), PEN_CONST_HASH("sphere"),
+                                                    PEN_CONST_HASH("cone")};
 
-            static hash_id id_technique[] = {PEN_HASH("directional_light"), PEN_HASH("point_light"), PEN_HASH("spot_light")};
+            static constexpr hash_id id_technique[] = {PEN_CONST_HASH("directional_light"), PEN_CONST_HASH("point_light"),
+                                                       PEN_CONST_HASH("spot_light")};
 
-            static u32 shader = pmfx::load_shader("deferred_render");
+            u32 shader = s_svr.deferred_shader;
 
             geometry_resource* volume[PEN_ARRAY_SIZE(id_volume)];
             for (u32 i = 0; i < PEN_ARRAY_SIZE(id_volume); ++i)
                 volume[i] = get_geometry_resource(id_volume[i]);
 
-            static hash_id id_cull_front = PEN_HASH("front_face_cull");
+            static constexpr hash_id id_cull_front = PEN_CONST_HASH("front_face_cull");
             u32            cull_front = pmfx::get_render_state(id_cull_front, pmfx::e_render_state::sampler);
 
-            static hash_id id_disable_depth = PEN_HASH("disabled");
+            static constexpr hash_id id_disable_depth = PEN_CONST_HASH("disabled");
             u32            depth_disabled = pmfx::get_render_state(id_disable_depth, pmfx::e_render_state::depth_stencil);
 
             for (u32 n = 0; n < scene->num_entities; ++n)
@@ -824,18 +882,163 @@ namespace put
             pen::renderer_set_texture(0, 0, 2, pen::TEXTURE_BIND_CS);
         }
 
-        void render_scene_view(const scene_view& view)
+        // scratch for sorting draws, views may be recorded from task threads
+        struct draw_sort_buffer
+        {
+            pen::sort_item* items = nullptr;
+            pen::sort_item* tmp = nullptr;
+            u32             capacity = 0;
+
+            ~draw_sort_buffer()
+            {
+                pen::memory_free(items);
+                pen::memory_free(tmp);
+            }
+
+            void reserve(u32 count)
+            {
+                if (count <= capacity)
+                    return;
+
+                capacity = count;
+                items = (pen::sort_item*)pen::memory_realloc(items, sizeof(pen::sort_item) * capacity);
+                tmp = (pen::sort_item*)pen::memory_realloc(tmp, sizeof(pen::sort_item) * capacity);
+            }
+        };
+        static thread_local draw_sort_buffer t_draw_sort;
+
+        // float to unsigned with the same ordering, negative depths sort before positive
+        static pen_inline u32 depth_sort_bits(f32 d)
+        {
+            u32 u;
+            memcpy(&u, &d, sizeof(u32));
+            return (u & 0x80000000) ? ~u : (u | 0x80000000);
+        }
+
+        // draw sort key, msb first:
+        // opaque: technique 16 | material 16 | geometry 16 | depth 16 front to back
+        // alpha:  depth 24 back to front | technique 16 | material 16 | geometry 8
+        static u64 draw_sort_key(const scene_view& view, u32 n, const cmp_geometry* p_geom, f32 depth)
         {
             ecs_scene* scene = view.scene;
 
-            if (scene->view_flags & e_scene_view_flags::hide)
-                return;
+            u64 technique;
+            if (is_valid(view.pmfx_shader))
+                technique = scene->material_permutation[n] & 0xffff;
+            else
+                technique = ((scene->materials[n].shader & 0xff) << 8) | (scene->materials[n].technique_index & 0xff);
 
-            s32 draw_count = 0;
-            s32 cull_count = 0;
+            // material cbuffers are per entity, so group by texture bindings
+            u32                 material = 0;
+            const cmp_samplers& samplers = scene->samplers[n];
+            for (u32 s = 0; s < e_pmfx_constants::max_technique_sampler_bindings; ++s)
+                material = material * 31 + samplers.sb[s].handle;
 
-            for (u32 n = 0; n < scene->num_entities; ++n)
+            material = (material ^ (material >> 16)) & 0xffff;
+
+            u64 geometry = p_geom->vertex_buffer & 0xffff;
+            u64 depth_bits = depth_sort_bits(depth);
+
+            if (view.render_flags & pmfx::e_scene_render_flags::alpha_blended)
+                return ((~depth_bits >> 8) << 40) | (technique << 24) | ((u64)material << 8) | (geometry & 0xff);
+
+            return (technique << 48) | ((u64)material << 32) | (geometry << 16) | (depth_bits >> 16);
+        }
+
+        static const u32 k_parallel_cull_threshold = 16384; // views of smaller scenes are culled by the calling thread
+        static const u32 k_cull_grain_size = 4096;
+
+        // visible indices for the view being recorded, views may be recorded from task threads
+        struct cull_buffer
+        {
+            u32* visible = nullptr;
+            u32  capacity = 0;
+
+            ~cull_buffer()
+            {
+                pen::memory_free(visible);
+            }
+
+            void reserve(u32 count)
+            {
+                if (count <= capacity)
+                    return;
+
+                capacity = count;
+                visible = (u32*)pen::memory_realloc(visible, sizeof(u32) * capacity);
+            }
+        };
+        static thread_local cull_buffer t_cull;
+
+        struct cull_job
+        {
+            const sphere_batch* spheres;
+            const frustum*      camera_frustum;
+            u32*                visible;
+            u32*                range_counts;
+        };
+
+        void cull_range_task(void* user_data, u32 start, u32 end)
+        {
+            // each range writes into its own part of visible, they are compacted after
+            cull_job* job = (cull_job*)user_data;
+            job->range_counts[start / k_cull_grain_size] =
+                cull_spheres(*job->spheres, *job->camera_frustum, start, end, job->visible + start);
+        }
+
+        u32 cull_scene_view(const scene_view& view, u32* visible)
+        {
+            PEN_PROFILE_FUNCTION;
+
+            ecs_scene* scene = view.scene;
+
+            // spheres are updated with the bounds, entities added since the last update are not tested
+            const sphere_batch& spheres = scene->bounding_spheres;
+            u32                 num = min<u32>((u32)scene->num_entities, spheres.count);
+
+            // views recorded into command lists are already spread across task threads, and waiting here could
+            // start recording another view on this thread
+            bool parallel = num >= k_parallel_cull_threshold && pen::task_scheduler_num_workers() > 0 &&
+                            !pen::renderer_recording_cmd_list();
+
+            // views not recorded into command lists leave the workers idle, so large scenes are split across them.
+            // otherwise the tree visits only the nodes which touch the frustum
+            u32 num_inside = 0;
+            if (parallel)
+            {
+                u32  num_ranges = (num + k_cull_grain_size - 1) / k_cull_grain_size;
+                u32* range_counts = (u32*)pen::memory_alloc(sizeof(u32) * num_ranges);
+
+                cull_job job = {&spheres, &view.camera->camera_frustum, visible, range_counts};
+                pen::task_parallel_for_wait(0, num, k_cull_grain_size, cull_range_task, &job);
+
+                for (u32 r = 0; r < num_ranges; ++r)
+                {
+                    memmove(visible + num_inside, visible + r * k_cull_grain_size, range_counts[r] * sizeof(u32));
+                    num_inside += range_counts[r];
+                }
+
+                pen::memory_free(range_counts);
+            }
+            else if (scene->spatial_tree.num_leaves > 0)
             {
+                // tree nodes are fattened to avoid refits, so leaves are only candidates and get the exact sphere test
+                num_inside = aabb_tree_query_frustum(scene->spatial_tree, view.camera->camera_frustum, visible,
+                                                     (u32)scene->num_entities);
+                num_inside = min<u32>(num_inside, (u32)scene->num_entities);
+                num_inside = cull_spheres_indexed(spheres, view.camera->camera_frustum, visible, num_inside);
+            }
+            else
+            {
+                num_inside = cull_spheres(spheres, view.camera->camera_frustum, 0, num, visible);
+            }
+
+            // keep drawable entities
+            u32 num_visible = 0;
+            for (u32 i = 0; i < num_inside; ++i)
+            {
+                u32 n = visible[i];
+
                 if (!(scene->entities[n] & e_cmp::geometry && scene->entities[n] & e_cmp::material))
                     continue;
 
@@ -844,8 +1047,42 @@ namespace put
 
                 if (scene->state_flags[n] & e_state::hidden)
                     continue;
-                
-                
+
+                visible[num_visible++] = n;
+            }
+
+            scene->cull_counters.views++;
+            scene->cull_counters.tested += num;
+            scene->cull_counters.visible += num_visible;
+
+            return num_visible;
+        }
+
+        void render_scene_view(const scene_view& view)
+        {
+            ecs_scene* scene = view.scene;
+
+            if (scene->view_flags & e_scene_view_flags::hide)
+                return;
+
+            s32 draw_count = 0;
+
+            draw_sort_buffer& ds = t_draw_sort;
+            ds.reserve(scene->num_entities);
+
+            cull_buffer& cb = t_cull;
+            cb.reserve(scene->num_entities);
+
+            u32* visible = cb.visible;
+            u32  num_visible = cull_scene_view(view, visible);
+
+            vec4f view_z = view.camera->view.get_row(2);
+
+            // gather visible draws
+            for (u32 i = 0; i < num_visible; ++i)
+            {
+                u32 n = visible[i];
+
                 // alpha
                 if(view.render_flags & pmfx::e_scene_render_flags::alpha_blended)
                 {
@@ -858,34 +1095,40 @@ namespace put
                         continue;
                 }
 
-                // frustum cull
-                bool inside = true;
-                for (s32 i = 0; i < 6; ++i)
-                {
-                    frustum& camera_frustum = view.camera->camera_frustum;
+                vec3f& min = scene->bounding_volumes[n].transformed_min_extents;
+                vec3f& max = scene->bounding_volumes[n].transformed_max_extents;
+                vec3f  pos = min + (max - min) * 0.5f;
 
-                    vec3f& min = scene->bounding_volumes[n].transformed_min_extents;
-                    vec3f& max = scene->bounding_volumes[n].transformed_max_extents;
+                cmp_geometry* p_geom = &scene->geometries[n];
+                if (!(scene->entities[n] & e_cmp::skinned))
+                    if(view.render_flags & pmfx::e_scene_render_flags::shadow_map)
+                        p_geom = &scene->position_geometries[n];
 
-                    vec3f pos = min + (max - min) * 0.5f;
-                    f32   radius = scene->bounding_volumes[n].radius;
+                // view space z points away from the view direction
+                f32 depth = -(dot((vec3f)view_z.xyz, pos) + view_z.w);
 
-                    f32 d = maths::point_plane_distance(pos, camera_frustum.p[i], camera_frustum.n[i]);
+                ds.items[draw_count].key = draw_sort_key(view, n, p_geom, depth);
+                ds.items[draw_count].value = n;
+                draw_count++;
+            }
 
-                    if (d > radius)
-                    {
-                        inside = false;
-                        break;
-                    }
-                }
+            pen::radix_sort(ds.items, ds.tmp, draw_count);
 
-                if (!inside)
-                {
-                    cull_count++;
+            // sdf shadow is the same for every draw
+            cmp_shadow* sdf_shadow = nullptr;
+            for (u32 n = 0; n < scene->num_entities; ++n)
+            {
+                if (!(scene->entities[n] & e_cmp::sdf_shadow))
                     continue;
-                }
 
-                draw_count++;
+                if (is_valid(scene->shadows[n].texture_handle))
+                    sdf_shadow = &scene->shadows[n];
+            }
+
+            // submit in key order
+            for (s32 d = 0; d < draw_count; ++d)
+            {
+                u32 n = ds.items[d].value;
 
                 cmp_geometry* p_geom = &scene->geometries[n];
                 if (!(scene->entities[n] & e_cmp::skinned))
@@ -906,11 +1149,6 @@ namespace put
                     bool set = pmfx::set_technique_perm(view.pmfx_shader, view.technique, permutation);
                     if (!set)
                     {
-                        if (scene->entities[n] & e_cmp::master_instance)
-                        {
-                            u32 num_instances = scene->master_instances[n].num_instances;
-                            n += num_instances;
-                        }
                         PEN_ASSERT(0);
                         continue;
                     }
@@ -919,20 +1157,9 @@ namespace put
                 // update skin
                 if (scene->entities[n] & e_cmp::skinned && !(scene->entities[n] & e_cmp::sub_geometry))
                 {
-                    static mat4 bb[85];
-                    if (p_geom->p_skin->bone_cbuffer == PEN_INVALID_HANDLE)
-                    {
-                        pen::buffer_creation_params bcp;
-                        bcp.usage_flags = PEN_USAGE_DYNAMIC;
-                        bcp.bind_flags = PEN_BIND_CONSTANT_BUFFER;
-                        bcp.cpu_access_flags = PEN_CPU_ACCESS_WRITE;
-                        bcp.buffer_size = sizeof(mat4) * 85;
-                        bcp.data = nullptr;
-
-                        p_geom->p_skin->bone_cbuffer = pen::renderer_create_buffer(bcp);
-                    }
-
-                    s32 joints_offset = scene->anim_controller_v2[n].joints_offset;
+                    // bone cbuffer is created on load, views may be recorded from task threads
+                    mat4 bb[85];
+                    s32  joints_offset = scene->anim_controller_v2[n].joints_offset;
                     for (s32 i = 0; i < p_geom->p_skin->num_joints; ++i)
                         bb[i] = scene->world_matrices[joints_offset + i] * p_geom->p_skin->joint_bind_matrices[i];
 
@@ -990,10 +1217,10 @@ namespace put
                     pen::renderer_set_constant_buffer(scene->area_light_buffer, 6, pen::CBUFFER_BIND_PS);
 
                     // ltc lookups
-                    static u32 ltc_mat = put::load_texture("data/textures/ltc/ltc_mat.dds");
-                    static u32 ltc_mag = put::load_texture("data/textures/ltc/ltc_amp.dds");
+                    u32 ltc_mat = s_svr.ltc_mat;
+                    u32 ltc_mag = s_svr.ltc_mag;
 
-                    static hash_id id_clamp_linear = PEN_HASH("clamp_linear");
+                    static constexpr hash_id id_clamp_linear = PEN_CONST_HASH("clamp_linear");
                     u32            clamp_linear = pmfx::get_render_state(id_clamp_linear, pmfx::e_render_state::sampler);
 
                     pen::renderer_set_texture(ltc_mat, clamp_linear, 13, pen::TEXTURE_BIND_PS);
@@ -1002,20 +1229,9 @@ namespace put
 
                 // sdf shadows
                 pen::renderer_set_constant_buffer(scene->sdf_shadow_buffer, 5, pen::CBUFFER_BIND_PS);
-                for (u32 n = 0; n < scene->num_entities; ++n)
-                {
-                    if (!(scene->entities[n] & e_cmp::sdf_shadow))
-                        continue;
-
-                    cmp_shadow& shadow = scene->shadows[n];
-
-                    if (is_valid(shadow.texture_handle))
-                        pen::renderer_set_texture(shadow.texture_handle, shadow.sampler_state, e_global_textures::sdf_shadow,
-                                                  pen::TEXTURE_BIND_PS);
-
-                    // info for sdf
-                    pen::renderer_set_constant_buffer(scene->sdf_shadow_buffer, 5, pen::CBUFFER_BIND_PS);
-                }
+                if (sdf_shadow)
+                    pen::renderer_set_texture(sdf_shadow->texture_handle, sdf_shadow->sampler_state,
+                                              e_global_textures::sdf_shadow, pen::TEXTURE_BIND_PS);
                 
                 // gi volume
                 pen::renderer_set_constant_buffer(scene->gi_volume_buffer, 11, pen::CBUFFER_BIND_PS);
@@ -1029,7 +1245,6 @@ namespace put
                     u32 num_instances = scene->master_instances[n].num_instances;
                     pen::renderer_draw_indexed_instanced(num_instances, 0, p_geom->num_indices, 0, 0,
                                                          PEN_PT_TRIANGLELIST);
-                    n += num_instances;
                     continue;
                 }
 
@@ -1040,9 +1255,7 @@ namespace put
 
         void update_animations(ecs_scene* scene, f32 dt)
         {
-            //dt = 16.66;
-            //pen::timer* timer = pen::timer_create("anim_v2");
-            //pen::timer_start(timer);
+            PEN_PROFILE_FUNCTION;
 
             for (u32 n = 0; n < scene->num_entities; ++n)
             {
@@ -1243,9 +1456,6 @@ namespace put
                     }
                 }
             }
-
-            //f32 ms = pen::timer_elapsed_ms(timer);
-            //PEN_LOG("anim_v2 : %f", ms);
         }
 
         void update(f32 dt)
@@ -1270,40 +1480,113 @@ namespace put
             return &s_scenes;
         }
 
-        void update_scene(ecs_scene* scene, f32 dt)
-        {
-            // static anim time to pass into draw calls etc..
-            f32 anim_time = pen::get_time_ms() / 1000.0f;
+        static const u32 k_parallel_transform_threshold = 4096; // scenes with fewer entities update serially
+        static const u32 k_transform_grain_size = 256;
+        static const u32 k_cbuffer_upload_frames = 3; // backends may keep a copy of dynamic buffers per frame in flight
 
-            u32 num_controllers = sb_count(scene->controllers);
-            u32 num_extensions = sb_count(scene->extensions);
+        namespace e_transform_update
+        {
+            enum transform_update_t
+            {
+                skip_world = 1 << 0,   // physics entity has no output yet, the world matrix is left as it was
+                sync_physics = 1 << 1, // controlled transform is pushed to the physics thread after the parallel pass
+                dirty = 1 << 2,        // local matrix or parent changed, or the parent moved
+                bounds_dirty = 1 << 3, // moved, extents or components changed, or a child's bounds changed
+                reparented = 1 << 4    // parent changed, the previous parent is in transform_cache::prev_parent
+            };
+        }
 
-            // pre update controllers
-            for (u32 c = 0; c < num_controllers; ++c)
-                if (scene->controllers[c].update_func)
-                    scene->controllers[c].update_func(scene->controllers[c], scene, dt);
+        static u8*          s_transform_flags = nullptr;
+        static u32*         s_bounds_entities = nullptr; // entities in s_bounds_batch
+        static bounds_batch s_bounds_batch;
 
-            if (scene->flags & e_scene_flags::pause_update)
+        // entities with inverted or non finite extents are left out of the spatial tree
+        static bool valid_extents(const cmp_bounding_volume& bv)
+        {
+            for (u32 i = 0; i < 3; ++i)
             {
-                physics::set_paused(1);
+                f32 emin = bv.transformed_min_extents[i];
+                f32 emax = bv.transformed_max_extents[i];
+                if (!(emin <= emax) || !std::isfinite(emin) || !std::isfinite(emax))
+                    return false;
             }
-            else
+
+            return true;
+        }
+
+        // entities are grouped by depth so each level of world matrices can be updated in parallel, the levels are
+        // cached and rebuilt when any parent changes. returns false if a child appears before its parent, the
+        // serial update reads the parents world matrix from last frame in that case so it must run in entity order.
+        bool update_hierarchy_levels(ecs_scene* scene)
+        {
+            u32 num = (u32)scene->num_entities;
+            if (sb_count(scene->hierarchy_parents) == num &&
+                memcmp(scene->hierarchy_parents, scene->parents.data, num * sizeof(u32)) == 0)
+                return sb_count(scene->hierarchy_levels) > 0;
+
+            sb_clear(scene->hierarchy_parents);
+            sb_clear(scene->hierarchy_order);
+            sb_clear(scene->hierarchy_levels);
+
+            if (num == 0)
+                return false;
+
+            u32* parents = sb_add(scene->hierarchy_parents, num);
+            memcpy(parents, scene->parents.data, num * sizeof(u32));
+
+            u32* depth = nullptr;
+            sb_add(depth, num);
+
+            u32 max_depth = 0;
+            for (u32 n = 0; n < num; ++n)
             {
-                physics::set_paused(0);
-                update_animations(scene, dt);
+                u32 p = parents[n];
+                if (p == n)
+                {
+                    depth[n] = 0;
+                }
+                else if (p < n)
+                {
+                    depth[n] = depth[p] + 1;
+                    max_depth = max<u32>(max_depth, depth[n]);
+                }
+                else
+                {
+                    sb_free(depth);
+                    return false;
+                }
             }
 
-            // extension component update
-            for (u32 e = 0; e < num_extensions; ++e)
-                if (scene->extensions[e].update_func)
-                    scene->extensions[e].update_func(scene->extensions[e], scene, dt);
+            // counting sort by depth, entities stay in index order within a level
+            u32* levels = sb_add(scene->hierarchy_levels, max_depth + 2);
+            memset(levels, 0x0, (max_depth + 2) * sizeof(u32));
 
-            static pen::timer* timer = pen::timer_create();
-            pen::timer_start(timer);
+            for (u32 n = 0; n < num; ++n)
+                levels[depth[n] + 1]++;
 
-            // scene node transform
-            for (size_t n = 0; n < scene->num_entities; ++n)
+            for (u32 l = 0; l <= max_depth; ++l)
+                levels[l + 1] += levels[l];
+
+            u32* cursor = nullptr;
+            sb_add(cursor, max_depth + 1);
+            memcpy(cursor, levels, (max_depth + 1) * sizeof(u32));
+
+            u32* order = sb_add(scene->hierarchy_order, num);
+            for (u32 n = 0; n < num; ++n)
+                order[cursor[depth[n]]++] = n;
+
+            sb_free(cursor);
+            sb_free(depth);
+            return true;
+        }
+
+        void update_local_matrices(ecs_scene* scene, u32 start, u32 end)
+        {
+            for (u32 n = start; n < end; ++n)
             {
+                u8& tf = s_transform_flags[n];
+                tf = 0;
+
                 // force physics entity to sync and ignore controlled transform
                 if (scene->state_flags[n] & e_state::sync_physics_transform)
                 {
@@ -1329,21 +1612,20 @@ namespace put
                     if (scene->entities[n] & e_cmp::physics)
                     {
                         if (scene->physics_data[n].type == e_physics_type::rigid_body)
-                        {
-                            cmp_transform& pt = scene->physics_offset[n];
-                            physics::set_transform(scene->physics_handles[n], t.translation + pt.translation, t.rotation);
-                            physics::set_v3(scene->physics_handles[n], vec3f::zero(), physics::e_cmd::set_angular_velocity);
-                            physics::set_v3(scene->physics_handles[n], vec3f::zero(), physics::e_cmd::set_linear_velocity);
-                        }
+                            tf |= e_transform_update::sync_physics;
                     }
 
                     // local matrix will be baked
                     scene->entities[n] &= ~e_cmp::transform;
+                    tf |= e_transform_update::dirty;
                 }
                 else if (scene->entities[n] & e_cmp::physics)
                 {
                     if (!physics::has_rb_matrix(n))
+                    {
+                        tf |= e_transform_update::skip_world;
                         continue;
+                    }
 
                     cmp_transform& t = scene->transforms[n];
                     cmp_transform& pt = scene->physics_offset[n];
@@ -1362,61 +1644,263 @@ namespace put
                     scene->local_matrices[n] = translation_mat * rot_mat * scale_mat;
                 }
 
-                // heirarchical scene transform
-                u32 parent = scene->parents[n];
-                if (parent == n)
-                    scene->world_matrices[n] = scene->local_matrices[n];
-                else
-                    scene->world_matrices[n] = scene->world_matrices[parent] * scene->local_matrices[n];
+                // physics moves and anything outside of update_scene which changes the local matrix or parent
+                transform_cache& tc = scene->update_cache[n];
+                if (memcmp(&tc.local_matrix, &scene->local_matrices[n], sizeof(mat4)) != 0)
+                    tf |= e_transform_update::dirty;
+
+                if (tc.parent != scene->parents[n])
+                {
+                    tf |= e_transform_update::dirty | e_transform_update::reparented;
+                    tc.prev_parent = tc.parent;
+                }
+
+                if (tf & e_transform_update::dirty)
+                {
+                    tc.local_matrix = scene->local_matrices[n];
+                    tc.parent = scene->parents[n];
+                }
+            }
+        }
+
+        pen_inline void update_world_matrix(ecs_scene* scene, u32 n)
+        {
+            u8& tf = s_transform_flags[n];
+            if (tf & e_transform_update::skip_world)
+                return;
+
+            // children inherit a change from their parent, a parent which comes after its child has not been updated
+            // yet and the world matrix is taken from the last frame, so those children always update
+            u32 parent = scene->parents[n];
+            if (parent != n && (parent > n || (s_transform_flags[parent] & e_transform_update::dirty)))
+                tf |= e_transform_update::dirty;
+
+            if (!(tf & e_transform_update::dirty))
+                return;
+
+            // heirarchical scene transform
+            if (parent == n)
+                scene->world_matrices[n] = scene->local_matrices[n];
+            else
+                scene->world_matrices[n] = scene->world_matrices[parent] * scene->local_matrices[n];
+        }
+
+        void update_local_matrices_task(void* user_data, u32 start, u32 end)
+        {
+            update_local_matrices((ecs_scene*)user_data, start, end);
+        }
+
+        void update_world_matrices_task(void* user_data, u32 start, u32 end)
+        {
+            ecs_scene* scene = (ecs_scene*)user_data;
+            for (u32 i = start; i < end; ++i)
+                update_world_matrix(scene, scene->hierarchy_order[i]);
+        }
+
+        void update_transforms(ecs_scene* scene)
+        {
+            PEN_PROFILE_FUNCTION;
+
+            u32 num = (u32)scene->num_entities;
+            if (sb_count(s_transform_flags) < num)
+                sb_add(s_transform_flags, num - sb_count(s_transform_flags));
+
+            // new entries never match so new entities are always updated once
+            u32 num_cached = sb_count(scene->update_cache);
+            if (num_cached < num)
+            {
+                transform_cache* tc = sb_add(scene->update_cache, num - num_cached);
+                memset(tc, 0xff, (num - num_cached) * sizeof(transform_cache));
+            }
+
+            bool parallel = num >= k_parallel_transform_threshold && pen::task_scheduler_num_workers() > 0;
+
+            // local matrices are independent of each other
+            if (parallel)
+                pen::task_parallel_for_wait(0, num, k_transform_grain_size, update_local_matrices_task, scene);
+            else
+                update_local_matrices(scene, 0, num);
+
+            // physics commands are not thread safe, they are issued in entity order after the local matrices
+            for (u32 n = 0; n < num; ++n)
+            {
+                if (!(s_transform_flags[n] & e_transform_update::sync_physics))
+                    continue;
+
+                cmp_transform& t = scene->transforms[n];
+                cmp_transform& pt = scene->physics_offset[n];
+                physics::set_transform(scene->physics_handles[n], t.translation + pt.translation, t.rotation);
+                physics::set_v3(scene->physics_handles[n], vec3f::zero(), physics::e_cmd::set_angular_velocity);
+                physics::set_v3(scene->physics_handles[n], vec3f::zero(), physics::e_cmd::set_linear_velocity);
+            }
+
+            // world matrices are propagated one level at a time, parents are always complete before their children
+            if (parallel && update_hierarchy_levels(scene))
+            {
+                u32 num_levels = sb_count(scene->hierarchy_levels) - 1;
+                for (u32 l = 0; l < num_levels; ++l)
+                {
+                    u32 start = scene->hierarchy_levels[l];
+                    u32 end = scene->hierarchy_levels[l + 1];
+                    pen::task_parallel_for_wait(start, end, k_transform_grain_size, update_world_matrices_task, scene);
+                }
+            }
+            else
+            {
+                for (u32 n = 0; n < num; ++n)
+                    update_world_matrix(scene, n);
+            }
+        }
+
+        void update_scene(ecs_scene* scene, f32 dt)
+        {
+            PEN_PROFILE_FUNCTION;
+
+            // static anim time to pass into draw calls etc..
+            f32 anim_time = pen::get_time_ms() / 1000.0f;
+
+            u32 num_controllers = sb_count(scene->controllers);
+            u32 num_extensions = sb_count(scene->extensions);
+
+            // pre update controllers
+            for (u32 c = 0; c < num_controllers; ++c)
+                if (scene->controllers[c].update_func)
+                    scene->controllers[c].update_func(scene->controllers[c], scene, dt);
+
+            if (scene->flags & e_scene_flags::pause_update)
+            {
+                physics::set_paused(1);
+            }
+            else
+            {
+                physics::set_paused(0);
+                update_animations(scene, dt);
             }
 
+            // extension component update
+            for (u32 e = 0; e < num_extensions; ++e)
+                if (scene->extensions[e].update_func)
+                    scene->extensions[e].update_func(scene->extensions[e], scene, dt);
+
+            // scene node transform
+            update_transforms(scene);
+
             // bounding volume transform
-            static vec3f corners[] = {vec3f(0.0f, 0.0f, 0.0f),
+            u32                 num_entities = (u32)scene->num_entities;
+            scene_update_stats& stats = scene->update_stats;
+            stats = {};
+            stats.entities = num_entities;
+            stats.cull_views = scene->cull_counters.views.exchange(0);
+            stats.cull_tested = scene->cull_counters.tested.exchange(0);
+            stats.cull_visible = scene->cull_counters.visible.exchange(0);
+
+            // bounds need recalculating if the entity moved or its extents or components changed
+            bool ordered = true;
+            for (u32 n = 0; n < num_entities; ++n)
+            {
+                u8&                  tf = s_transform_flags[n];
+                transform_cache&     tc = scene->update_cache[n];
+                cmp_bounding_volume& bv = scene->bounding_volumes[n];
+
+                if (tf & e_transform_update::dirty)
+                    stats.transforms++;
+
+                if (memcmp(&tc.min_extents, &bv.min_extents, sizeof(vec3f)) != 0 ||
+                    memcmp(&tc.max_extents, &bv.max_extents, sizeof(vec3f)) != 0 || tc.entities != scene->entities[n])
+                {
+                    tf |= e_transform_update::bounds_dirty;
+                    tc.min_extents = bv.min_extents;
+                    tc.max_extents = bv.max_extents;
+                    tc.entities = scene->entities[n];
+                }
 
-                                      vec3f(1.0f, 0.0f, 0.0f), vec3f(0.0f, 1.0f, 0.0f), vec3f(0.0f, 0.0f, 1.0f),
+                if (tf & e_transform_update::dirty)
+                    tf |= e_transform_update::bounds_dirty;
 
-                                      vec3f(1.0f, 1.0f, 0.0f), vec3f(0.0f, 1.0f, 1.0f), vec3f(1.0f, 0.0f, 1.0f),
+                // the old parent was expanded by this entity last update
+                u32 pp = tc.prev_parent;
+                if ((tf & e_transform_update::reparented) && pp < num_entities && pp != n)
+                    s_transform_flags[pp] |= e_transform_update::bounds_dirty;
 
-                                      vec3f(1.0f, 1.0f, 1.0f)};
+                ordered &= scene->parents[n] <= n;
+            }
 
-            scene->renderable_extents.min = vec3f::flt_max();
-            scene->renderable_extents.max = -vec3f::flt_max();
+            // parents are expanded by their children, so they need recalculating if any child bounds changed
+            if (ordered)
+            {
+                for (s32 n = (s32)num_entities - 1; n > 0; --n)
+                {
+                    u32 p = scene->parents[n];
+                    if (p != (u32)n && (s_transform_flags[n] & e_transform_update::bounds_dirty))
+                        s_transform_flags[p] |= e_transform_update::bounds_dirty;
+                }
+            }
+            else
+            {
+                // expansion relies on children coming after parents, update everything as before
+                for (u32 n = 0; n < num_entities; ++n)
+                    s_transform_flags[n] |= e_transform_update::bounds_dirty;
+            }
 
-            // transform extents by transform
-            for (size_t n = 0; n < scene->num_entities; ++n)
+            // gather extents and world matrices of changed entities and transform them in a batch
+            u32 num_bounds = 0;
+            if (sb_count(s_bounds_entities) < num_entities)
+                sb_add(s_bounds_entities, num_entities - sb_count(s_bounds_entities));
+
+            for (u32 n = 0; n < num_entities; ++n)
             {
-                vec3f min = scene->bounding_volumes[n].min_extents;
-                vec3f max = scene->bounding_volumes[n].max_extents - min;
+                if (!(s_transform_flags[n] & e_transform_update::bounds_dirty))
+                    continue;
 
-                vec3f& tmin = scene->bounding_volumes[n].transformed_min_extents;
-                vec3f& tmax = scene->bounding_volumes[n].transformed_max_extents;
+                stats.bounds++;
 
                 if (scene->entities[n] & e_cmp::bone)
                 {
-                    tmin = tmax = scene->world_matrices[n].get_translation();
+                    vec3f t = scene->world_matrices[n].get_translation();
+                    scene->bounding_volumes[n].transformed_min_extents = t;
+                    scene->bounding_volumes[n].transformed_max_extents = t;
                     continue;
                 }
 
-                tmax = -vec3f::flt_max();
-                tmin = vec3f::flt_max();
+                s_bounds_entities[num_bounds++] = n;
+            }
 
-                for (s32 c = 0; c < 8; ++c)
-                {
-                    vec3f p = scene->world_matrices[n].transform_vector(min + max * corners[c]);
+            bounds_batch_reserve(s_bounds_batch, num_bounds);
+            for (u32 i = 0; i < num_bounds; ++i)
+            {
+                u32                  n = s_bounds_entities[i];
+                cmp_bounding_volume& bv = scene->bounding_volumes[n];
+                bounds_batch_set(s_bounds_batch, i, bv.min_extents, bv.max_extents, scene->world_matrices[n]);
+            }
 
-                    tmax = max_union(tmax, p);
-                    tmin = min_union(tmin, p);
-                }
+            if (num_bounds >= k_parallel_transform_threshold && pen::task_scheduler_num_workers() > 0)
+                pen::task_parallel_for_wait(0, num_bounds, k_transform_grain_size, transform_bounds_task, &s_bounds_batch);
+            else
+                transform_bounds(s_bounds_batch, 0, num_bounds);
 
-                f32& trad = scene->bounding_volumes[n].radius;
-                trad = mag(tmax - tmin) * 0.5f;
+            for (u32 i = 0; i < num_bounds; ++i)
+            {
+                u32                  n = s_bounds_entities[i];
+                cmp_bounding_volume& bv = scene->bounding_volumes[n];
+                bounds_batch_get(s_bounds_batch, i, bv.transformed_min_extents, bv.transformed_max_extents, bv.radius);
 
-                if (!(scene->entities[n] & e_cmp::geometry))
+                transform_cache& tc = scene->update_cache[n];
+                tc.own_min_extents = bv.transformed_min_extents;
+                tc.own_max_extents = bv.transformed_max_extents;
+            }
+
+            // scene extents are made from the geometry bounds before expansion
+            scene->renderable_extents.min = vec3f::flt_max();
+            scene->renderable_extents.max = -vec3f::flt_max();
+
+            for (u32 n = 0; n < num_entities; ++n)
+            {
+                if (!(scene->entities[n] & e_cmp::geometry) || (scene->entities[n] & e_cmp::bone))
                     continue;
 
-                // also set scene extents
-                scene->renderable_extents.min = min_union(tmin, scene->renderable_extents.min);
-                scene->renderable_extents.max = max_union(tmax, scene->renderable_extents.max);
+                const transform_cache& tc = scene->update_cache[n];
+                scene->renderable_extents.min = min_union(tc.own_min_extents, scene->renderable_extents.min);
+                scene->renderable_extents.max = max_union(tc.own_max_extents, scene->renderable_extents.max);
             }
 
             // reverse iterate over scene and expand parents extents by children
@@ -1429,6 +1913,9 @@ namespace put
                 if (p == n)
                     continue;
 
+                if (!(s_transform_flags[p] & e_transform_update::bounds_dirty))
+                    continue;
+
                 vec3f& parent_tmin = scene->bounding_volumes[p].transformed_min_extents;
                 vec3f& parent_tmax = scene->bounding_volumes[p].transformed_max_extents;
 
@@ -1449,6 +1936,54 @@ namespace put
                 }
             }
 
+            // spheres for culling are taken from the expanded extents
+            sphere_batch_reserve(scene->bounding_spheres, num_entities);
+            for (u32 n = 0; n < num_entities; ++n)
+            {
+                if (!(s_transform_flags[n] & e_transform_update::bounds_dirty))
+                    continue;
+
+                const cmp_bounding_volume& bv = scene->bounding_volumes[n];
+                vec3f pos = bv.transformed_min_extents + (bv.transformed_max_extents - bv.transformed_min_extents) * 0.5f;
+                sphere_batch_set(scene->bounding_spheres, n, pos, bv.radius);
+            }
+
+            // spatial tree, changes to the allocated flag also dirty the bounds
+            u32 num_proxies = sb_count(scene->tree_proxies);
+            for (u32 n = num_entities; n < num_proxies; ++n)
+            {
+                if (scene->tree_proxies[n] != -1)
+                    aabb_tree_destroy_proxy(scene->spatial_tree, scene->tree_proxies[n]);
+
+                scene->tree_proxies[n] = -1;
+            }
+
+            for (u32 n = num_proxies; n < num_entities; ++n)
+                sb_push(scene->tree_proxies, -1);
+
+            for (u32 n = 0; n < num_entities; ++n)
+            {
+                s32& proxy = scene->tree_proxies[n];
+                if (!(s_transform_flags[n] & e_transform_update::bounds_dirty) && proxy != -1)
+                    continue;
+
+                const cmp_bounding_volume& bv = scene->bounding_volumes[n];
+                if (!(scene->entities[n] & e_cmp::allocated) || !valid_extents(bv))
+                {
+                    if (proxy != -1)
+                        aabb_tree_destroy_proxy(scene->spatial_tree, proxy);
+
+                    proxy = -1;
+                    continue;
+                }
+
+                if (proxy == -1)
+                    proxy = aabb_tree_create_proxy(scene->spatial_tree, bv.transformed_min_extents,
+                                                   bv.transformed_max_extents, n);
+                else
+                    aabb_tree_move_proxy(scene->spatial_tree, proxy, bv.transformed_min_extents, bv.transformed_max_extents);
+            }
+
             // Forward light buffer
             static forward_light_buffer light_buffer;
             s32                         pos = 0;
@@ -1728,7 +2263,7 @@ namespace put
             }
             
             // Update pre skinned vertex buffers
-            static hash_id id_pre_skin_technique = PEN_HASH("pre_skin");
+            static constexpr hash_id id_pre_skin_technique = PEN_CONST_HASH("pre_skin");
             static u32     shader = pmfx::load_shader("forward_render");
             if (pmfx::set_technique_perm(shader, id_pre_skin_technique))
             {
@@ -1739,20 +2274,8 @@ namespace put
 
                     // update bone cbuffer
                     cmp_geometry& geom = scene->geometries[n];
-                    if (geom.p_skin->bone_cbuffer == PEN_INVALID_HANDLE)
-                    {
-                        pen::buffer_creation_params bcp;
-                        bcp.usage_flags = PEN_USAGE_DYNAMIC;
-                        bcp.bind_flags = PEN_BIND_CONSTANT_BUFFER;
-                        bcp.cpu_access_flags = PEN_CPU_ACCESS_WRITE;
-                        bcp.buffer_size = sizeof(mat4) * 85;
-                        bcp.data = nullptr;
-
-                        geom.p_skin->bone_cbuffer = pen::renderer_create_buffer(bcp);
-                    }
-
-                    static mat4 bb[85];
-                    s32         joints_offset = scene->anim_controller_v2[n].joints_offset;
+                    mat4 bb[85];
+                    s32  joints_offset = scene->anim_controller_v2[n].joints_offset;
                     for (s32 i = 0; i < geom.p_skin->num_joints; ++i)
                         bb[i] = scene->world_matrices[joints_offset + i] * geom.p_skin->joint_bind_matrices[i];
 
@@ -1796,15 +2319,35 @@ namespace put
                 if (scene->entities[n] & e_cmp::skinned || scene->entities[n] & e_cmp::pre_skinned)
                     scene->draw_call_data[n].world_matrix = mat4::create_identity();
 
-                mat4 invt = scene->world_matrices[n];
+                bool dirty = s_transform_flags[n] & e_transform_update::dirty;
+                if (dirty)
+                {
+                    mat4 invt = scene->world_matrices[n];
+
+                    invt = invt.transposed();
+                    invt = mat::inverse4x4(invt);
+
+                    scene->draw_call_data[n].world_matrix_inv_transpose = invt;
+                }
+
+                // static entities stop uploading, v1 and v2 can be written by user code. backends can keep a copy of
+                // the buffer per frame in flight, so a change is uploaded for enough frames to reach all of them
+                transform_cache& tc = scene->update_cache[n];
+                cmp_draw_call&   dc = scene->draw_call_data[n];
+                if (dirty || tc.cbuffer != scene->cbuffer[n] || memcmp(&tc.v1, &dc.v1, sizeof(vec4f)) != 0 ||
+                    memcmp(&tc.v2, &dc.v2, sizeof(vec4f)) != 0)
+                    tc.upload_frames = k_cbuffer_upload_frames;
 
-                invt = invt.transposed();
-                invt = mat::inverse4x4(invt);
+                if (tc.upload_frames == 0)
+                    continue;
 
-                scene->draw_call_data[n].world_matrix_inv_transpose = invt;
+                tc.upload_frames--;
+                tc.cbuffer = scene->cbuffer[n];
+                tc.v1 = dc.v1;
+                tc.v2 = dc.v2;
+                stats.cbuffers++;
 
-                // todo mark dirty?
-                pen::renderer_update_buffer(scene->cbuffer[n], &scene->draw_call_data[n], sizeof(cmp_draw_call));
+                pen::renderer_update_buffer(scene->cbuffer[n], &dc, sizeof(cmp_draw_call));
             }
 
             // update instance buffers
@@ -1830,10 +2373,6 @@ namespace put
             for (u32 c = 0; c < num_controllers; ++c)
                 if (scene->controllers[c].post_update_func)
                     scene->controllers[c].post_update_func(scene->controllers[c], scene, dt);
-
-            f32 elapsed = pen::timer_elapsed_ms(timer);
-            PEN_UNUSED(elapsed);
-            // PEN_LOG("scene update: %f(ms)", elapsed);
         }
 
         struct scene_header
@@ -1891,10 +2430,10 @@ namespace put
             sb_push(s_lookup_strings, ls);
         }
 
-        Str read_lookup_string(std::ifstream& ifs)
+        Str read_lookup_string(file_view_reader& reader)
         {
-            hash_id id;
-            ifs.read((c8*)&id, sizeof(hash_id));
+            hash_id id = 0;
+            reader.read((c8*)&id, sizeof(hash_id));
 
             u32 num_strings = sb_count(s_lookup_strings);
             for (u32 i = 0; i < num_strings; ++i)
@@ -2157,16 +2696,21 @@ namespace put
 
         void load_scene(const c8* filename, ecs_scene* scene, bool merge)
         {
+            PEN_MEMORY_TAG(pen::e_mem_tag::ecs);
+
             scene->flags |= e_scene_flags::invalidate_scene_tree;
             bool      error = false;
             const c8* wd = pen::os_get_user_info().working_directory;
             Str       project_dir = dev_ui::get_program_preference_filename("project_dir", wd);
 
-            std::ifstream ifs(pen::os_path_for_resource(filename), std::ofstream::binary);
+            // whole component arrays are copied straight out of the mapped view
+            pen::mapped_file file;
+            pen::filesystem_map_file(filename, file, pen::e_file_access::sequential);
+            file_view_reader reader = {(const c8*)file.data, file.size, 0};
 
             // header
             scene_header sh;
-            ifs.read((c8*)&sh, sizeof(scene_header));
+            reader.read((c8*)&sh, sizeof(scene_header));
 
             if (!merge)
             {
@@ -2207,7 +2751,7 @@ namespace put
             for (u32 i = 0; i < sh.num_components; ++i)
             {
                 u32 size;
-                ifs.read((c8*)&size, sizeof(u32));
+                reader.read((c8*)&size, sizeof(u32));
                 sb_push(component_sizes, size);
             }
 
@@ -2223,9 +2767,9 @@ namespace put
             for (u32 i = 0; i < sh.num_extensions; ++i)
             {
                 ext_components ext;
-                ifs.read((c8*)&ext.id, sizeof(hash_id));
-                ifs.read((c8*)&ext.start_cmp, sizeof(u32));
-                ifs.read((c8*)&ext.num_cmp, sizeof(u32));
+                reader.read((c8*)&ext.id, sizeof(hash_id));
+                reader.read((c8*)&ext.start_cmp, sizeof(u32));
+                reader.read((c8*)&ext.num_cmp, sizeof(u32));
 
                 sb_push(exts, ext);
             }
@@ -2237,8 +2781,8 @@ namespace put
             for (u32 n = 0; n < sh.num_lookup_strings; ++n)
             {
                 lookup_string ls;
-                ls.name = read_parsable_string(ifs);
-                ifs.read((c8*)&ls.id, sizeof(hash_id));
+                ls.name = read_parsable_string(reader);
+                reader.read((c8*)&ls.id, sizeof(hash_id));
 
                 sb_push(s_lookup_strings, ls);
             }
@@ -2251,22 +2795,22 @@ namespace put
 
             // read cameras
             u32 num_cams;
-            ifs.read((c8*)&num_cams, sizeof(u32));
+            reader.read((c8*)&num_cams, sizeof(u32));
 
             for (u32 i = 0; i < num_cams; ++i)
             {
                 camera  cam;
                 hash_id id_cam;
 
-                ifs.read((c8*)&id_cam, sizeof(hash_id));
-                ifs.read((c8*)&cam.pos, sizeof(vec3f));
-                ifs.read((c8*)&cam.focus, sizeof(vec3f));
-                ifs.read((c8*)&cam.rot, sizeof(vec2f));
-                ifs.read((c8*)&cam.fov, sizeof(f32));
-                ifs.read((c8*)&cam.aspect, sizeof(f32));
-                ifs.read((c8*)&cam.near_plane, sizeof(f32));
-                ifs.read((c8*)&cam.far_plane, sizeof(f32));
-                ifs.read((c8*)&cam.zoom, sizeof(f32));
+                reader.read((c8*)&id_cam, sizeof(hash_id));
+                reader.read((c8*)&cam.pos, sizeof(vec3f));
+                reader.read((c8*)&cam.focus, sizeof(vec3f));
+                reader.read((c8*)&cam.rot, sizeof(vec2f));
+                reader.read((c8*)&cam.fov, sizeof(f32));
+                reader.read((c8*)&cam.aspect, sizeof(f32));
+                reader.read((c8*)&cam.near_plane, sizeof(f32));
+                reader.read((c8*)&cam.far_plane, sizeof(f32));
+                reader.read((c8*)&cam.zoom, sizeof(f32));
 
                 // find camera and set
                 camera* _cam = pmfx::get_camera(id_cam);
@@ -2315,21 +2859,16 @@ namespace put
                     {
                         // read whole array
                         c8* data_offset = (c8*)cmp.data + zero_offset * cmp.size;
-                        ifs.read(data_offset, cmp.size * num_nodes);
+                        reader.read(data_offset, cmp.size * num_nodes);
                         read = true;
                     }
                 }
 
                 if (!read)
                 {
-                    // read the old size
+                    // skip the old size, here any fixup can be applied from the view into cmp.data
                     u32 array_size = component_sizes[i] * num_nodes;
-                    c8* old = (c8*)pen::memory_alloc(array_size);
-                    ifs.read(old, array_size);
-
-                    // here any fuxup can be applied old into cmp.data
-
-                    pen::memory_free(old);
+                    reader.skip(array_size);
                 }
             }
 
@@ -2344,9 +2883,9 @@ namespace put
                 memset(&scene->geometry_names[n], 0x0, sizeof(Str));
                 memset(&scene->material_names[n], 0x0, sizeof(Str));
 
-                scene->names[n] = read_lookup_string(ifs);
-                scene->geometry_names[n] = read_lookup_string(ifs);
-                scene->material_names[n] = read_lookup_string(ifs);
+                scene->names[n] = read_lookup_string(reader);
+                scene->geometry_names[n] = read_lookup_string(reader);
+                scene->material_names[n] = read_lookup_string(reader);
             }
 
             // geometry
@@ -2355,14 +2894,14 @@ namespace put
                 if (scene->entities[n] & e_cmp::geometry)
                 {
                     u32 submesh;
-                    ifs.read((c8*)&submesh, sizeof(u32));
+                    reader.read((c8*)&submesh, sizeof(u32));
 
                     Str filename = project_dir;
-                    Str name = read_lookup_string(ifs).c_str();
-                    Str geometry_name = read_lookup_string(ifs);
+                    Str name = read_lookup_string(reader).c_str();
+                    Str geometry_name = read_lookup_string(reader);
 
                     hash_id        name_hash = PEN_HASH(name.c_str());
-                    static hash_id primitive_id = PEN_HASH("primitive");
+                    static constexpr hash_id primitive_id = PEN_CONST_HASH("primitive");
 
                     filename.append(name.c_str());
 
@@ -2422,12 +2961,12 @@ namespace put
             for (s32 n = zero_offset; n < zero_offset + num_nodes; ++n)
             {
                 s32 size;
-                ifs.read((c8*)&size, sizeof(s32));
+                reader.read((c8*)&size, sizeof(s32));
 
                 for (s32 i = 0; i < size; ++i)
                 {
                     Str anim_name = project_dir;
-                    anim_name.append(read_lookup_string(ifs).c_str());
+                    anim_name.append(read_lookup_string(reader).c_str());
 
                     anim_handle h = load_pma(anim_name.c_str());
 
@@ -2456,9 +2995,9 @@ namespace put
                 memset(&mat_res.shader_name, 0x0, sizeof(Str));
                 mat.material_cbuffer = PEN_INVALID_HANDLE;
 
-                Str material_name = read_lookup_string(ifs);
-                Str shader = read_lookup_string(ifs);
-                Str technique = read_lookup_string(ifs);
+                Str material_name = read_lookup_string(reader);
+                Str shader = read_lookup_string(reader);
+                Str technique = read_lookup_string(reader);
 
                 mat_res.material_name = material_name;
                 mat_res.id_shader = PEN_HASH(shader.c_str());
@@ -2472,7 +3011,7 @@ namespace put
                 if (!(scene->entities[n] & e_cmp::sdf_shadow))
                     continue;
 
-                Str sdf_shadow_volume_file = read_lookup_string(ifs);
+                Str sdf_shadow_volume_file = read_lookup_string(reader);
                 sdf_shadow_volume_file = pen::str_replace_string(sdf_shadow_volume_file, ".dds", ".pmv");
 
                 dev_console_log("[scene load] %s", sdf_shadow_volume_file.c_str());
@@ -2489,7 +3028,7 @@ namespace put
 
                 for (u32 i = 0; i < e_pmfx_constants::max_technique_sampler_bindings; ++i)
                 {
-                    Str texture_name = read_lookup_string(ifs);
+                    Str texture_name = read_lookup_string(reader);
 
                     if (!texture_name.empty())
                     {
@@ -2498,7 +3037,7 @@ namespace put
                             pmfx::get_render_state(PEN_HASH("wrap_linear"), pmfx::e_render_state::sampler);
                     }
 
-                    Str sampler_state_name = read_lookup_string(ifs);
+                    Str sampler_state_name = read_lookup_string(reader);
 
                     if (!sampler_state_name.empty())
                     {
@@ -2510,7 +3049,7 @@ namespace put
 
             // read cams strings
             for (u32 i = 0; i < num_cams; ++i)
-                read_lookup_string(ifs);
+                read_lookup_string(reader);
 
             // read extensions
             for (u32 i = 0; i < sh.num_extensions; ++i)
@@ -2541,7 +3080,7 @@ namespace put
                     scene->view_flags |= (e_scene_view_flags::matrix | e_scene_view_flags::bones);
             }
 
-            ifs.close();
+            pen::filesystem_unmap_file(file);
 
             initialise_free_list(scene);
 
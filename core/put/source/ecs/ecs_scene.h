@@ -4,7 +4,9 @@
 
 #pragma once
 
+#include "aabb_tree.h"
 #include "camera.h"
+#include "ecs/ecs_bounds.h"
 #include "loader.h"
 #include "physics/physics.h"
 #include "pmfx.h"
@@ -434,6 +436,44 @@ namespace put
             void (*post_update_func)(ecs_controller&, ecs_scene* scene, f32 dt) = nullptr;
         };
 
+        // per entity state from the last update, entities which have not changed skip transform, bounds and cbuffer work
+        struct transform_cache
+        {
+            mat4  local_matrix;
+            vec3f min_extents;
+            vec3f max_extents;
+            vec3f own_min_extents; // transformed extents before they were expanded by children
+            vec3f own_max_extents;
+            vec4f v1; // draw call data last uploaded to the cbuffer
+            vec4f v2;
+            u64   entities;
+            u32   parent;
+            u32   prev_parent; // parent before the last reparent, its bounds no longer include this entity
+            u32   cbuffer;
+            u32   upload_frames; // cbuffer uploads left since the last change
+        };
+
+        struct scene_update_stats
+        {
+            u32 entities;
+            u32 transforms; // world matrices recalculated last update
+            u32 bounds;
+            u32 cbuffers; // per entity cbuffers uploaded
+
+            // scene views culled during the last frame
+            u32 cull_views;
+            u32 cull_tested;
+            u32 cull_visible;
+        };
+
+        // accumulated by views which may be culled in parallel, moved into update_stats each update
+        struct scene_cull_counters
+        {
+            a_u32 views = {0};
+            a_u32 tested = {0};
+            a_u32 visible = {0};
+        };
+
         struct ecs_scene
         {
             static const u32 k_version = 9;
@@ -509,6 +549,22 @@ namespace put
             u32              version = k_version;
             Str              filename = "";
 
+            // entity indices grouped by hierarchy depth, for updating world matrices in parallel a level at a time
+            u32* hierarchy_order = nullptr;
+            u32* hierarchy_levels = nullptr;  // start of each level in hierarchy_order, followed by the end
+            u32* hierarchy_parents = nullptr; // parents when the levels were built, they are rebuilt if any change
+
+            transform_cache*    update_cache = nullptr;
+            scene_update_stats  update_stats = {};
+            scene_cull_counters cull_counters;
+
+            // centre of the transformed extents and radius of every entity, for culling
+            sphere_batch bounding_spheres;
+
+            // transformed extents of allocated entities, for view culling and spatial queries
+            aabb_tree spatial_tree;
+            s32*      tree_proxies = nullptr; // per entity proxy in spatial_tree, -1 for none
+
             generic_cmp_array& get_component_array(u32 index);
         };
 
@@ -528,6 +584,8 @@ namespace put
         void update(f32 dt);
         void update_scene(ecs_scene* scene, f32 dt);
 
+        // visible must have space for scene->num_entities, returns the number of drawable entities inside the frustum
+        u32  cull_scene_view(const scene_view& view, u32* visible);
         void render_scene_view(const scene_view& view);
         void render_light_volumes(const scene_view& view);
         void render_shadow_views(const scene_view& view);
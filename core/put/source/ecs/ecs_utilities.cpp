@@ -51,6 +51,34 @@ namespace put
             return name;
         }
 
+        Str read_parsable_string(file_view_reader& reader)
+        {
+            Str name;
+            u32 len = 0;
+
+            reader.read((c8*)&len, sizeof(u32));
+
+            u32 available = reader.size - reader.pos;
+            len = std::min<u32>(len, available);
+
+            name.append(reader.data + reader.pos, reader.data + reader.pos + len);
+            reader.skip(len);
+
+            return name;
+        }
+
+        void file_view_reader::read(c8* dst, u32 bytes)
+        {
+            bytes = std::min<u32>(bytes, size - pos);
+            memcpy(dst, data + pos, bytes);
+            pos += bytes;
+        }
+
+        void file_view_reader::skip(u32 bytes)
+        {
+            pos += std::min<u32>(bytes, size - pos);
+        }
+
         void write_parsable_string(const Str& str, std::ofstream& ofs)
         {
             if (str.c_str())
@@ -29,6 +29,17 @@ namespace put
         }
         typedef e_clone_mode::clone_mode_t clone_mode;
 
+        // sequential reads from a mapped file view, like std::ifstream::read a read past the end is short
+        struct file_view_reader
+        {
+            const c8* data;
+            u32       size;
+            u32       pos;
+
+            void read(c8* dst, u32 bytes);
+            void skip(u32 bytes);
+        };
+
         u32  get_next_entity(ecs_scene* scene); // gets next entity index
         u32  get_new_entity(ecs_scene* scene);  // allocates a new entity at the next index o(1)
         void get_new_entities_contiguous(ecs_scene* scene, s32 num, s32& start, s32& end); // finds contiguous space o(n)
@@ -51,6 +62,7 @@ namespace put
         void scene_tree_add_entity(scene_tree& tree, scene_tree& node, std::vector<s32>& heirarchy);
         Str  read_parsable_string(const u32** data);
         Str  read_parsable_string(std::ifstream& ifs);
+        Str  read_parsable_string(file_view_reader& reader);
         void write_parsable_string(const Str& str, std::ofstream& ofs);
         void write_parsable_string_u32(const Str& str, std::ofstream& ofs);
     } // namespace ecs
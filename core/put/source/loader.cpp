@@ -7,11 +7,13 @@
 #include "data_struct.h"
 #include "dev_ui.h"
 #include "file_system.h"
+#include "file_watcher.h"
 #include "hash.h"
 #include "memory.h"
 #include "pen.h"
 #include "pen_json.h"
 #include "pen_string.h"
+#include "profiler.h"
 #include "renderer.h"
 #include "str/Str.h"
 #include "str_utilities.h"
@@ -146,6 +148,7 @@ namespace
         Str                  filename;
         pen::json            dependencies;
         bool                 invalidated = false;
+        bool                 changed = false; // set by the file watcher when the dependencies or inputs change
         std::vector<hash_id> changes;
         u32                  rebuild_ts = 0;
 
@@ -156,6 +159,32 @@ namespace
     // static vars
     std::vector<file_watch*>       k_file_watches;
     std::vector<texture_reference> k_texture_references;
+    pen::hash_map<u32>             k_texture_name_lookup;   // id_name to index in k_texture_references
+    pen::hash_map<u32>             k_texture_handle_lookup; // handle to index in k_texture_references
+
+    void file_watch_changed(const c8* filename, void* user_data)
+    {
+        file_watch* fw = (file_watch*)user_data;
+        fw->changed = true;
+    }
+
+    void watch_dependencies(file_watch* fw)
+    {
+        PEN_HOTLOADING_ENABLED;
+
+        // the dependency file is rewritten by the build, the inputs by the user
+        pen::file_watcher_add(fw->filename.c_str(), file_watch_changed, fw);
+
+        pen::json files = fw->dependencies["files"];
+        s32       num_files = files.size();
+        for (s32 i = 0; i < num_files; ++i)
+        {
+            pen::json outputs = files[i];
+            s32       num_inputs = outputs.size();
+            for (s32 j = 0; j < num_inputs; ++j)
+                pen::file_watcher_add(outputs[j]["name"].as_str().c_str(), file_watch_changed, fw);
+        }
+    }
 
     u32 calc_level_size(u32 width, u32 height, bool compressed, u32 block_size)
     {
@@ -301,20 +330,19 @@ namespace
 
     u32 load_texture_internal(const c8* filename, hash_id hh, pen::texture_creation_params& tcp)
     {
-        // load a texture file from disk.
-        void* file_data = nullptr;
-        u32   file_data_size = 0;
+        // map the texture file from disk, the renderer copies the data so it is read straight from the view.
+        pen::mapped_file file;
+        u32              pen_err = pen::filesystem_map_file(filename, file, pen::e_file_access::sequential);
 
-        u32 pen_err = pen::filesystem_read_file_to_buffer(filename, &file_data, file_data_size);
-
-        if (pen_err != PEN_ERR_OK)
+        if (pen_err != PEN_ERR_OK || file.size < sizeof(dds_header))
         {
             dev_console_log_level(dev_ui::console_level::error, "[error] texture - unabled to find file: %s", filename);
-            pen::memory_free(file_data);
+            pen::filesystem_unmap_file(file);
             return 0;
         }
 
         // parse dds header
+        const u8*   file_data = (const u8*)file.data;
         dds_header* ddsh = (dds_header*)file_data;
 
         bool dx10_header_present;
@@ -323,11 +351,11 @@ namespace
 
         u32 format = dds_pixel_format_to_texture_format(ddsh, compressed, block_size, dx10_header_present);
 
-        u8* top_image_start = (u8*)file_data + sizeof(dds_header);
-        u32 array_size = 1;
+        const u8* top_image_start = file_data + sizeof(dds_header);
+        u32       array_size = 1;
         if (dx10_header_present)
         {
-            dx10_header* dxh = (dx10_header*)top_image_start;
+            const dx10_header* dxh = (const dx10_header*)top_image_start;
 
             format = dxgi_format_to_texture_format(dxh, compressed, block_size);
 
@@ -392,18 +420,20 @@ namespace
             tcp.data_size += data_size + ext_data_size;
         }
 
-        // allocate mem and copy
-        tcp.data = pen::memory_alloc(tcp.data_size);
-
-        // copy texture data into the tcp storage
-        memcpy(tcp.data, top_image_start, tcp.data_size);
+        if (top_image_start + tcp.data_size > file_data + file.size)
+        {
+            dev_console_log_level(dev_ui::console_level::error, "[error] texture - truncated file: %s", filename);
+            pen::filesystem_unmap_file(file);
+            return 0;
+        }
 
-        // free the files contents
-        pen::memory_free(file_data);
+        // create directly from the view
+        tcp.data = (void*)top_image_start;
 
         u32 texture_index = pen::renderer_create_texture(tcp);
 
-        pen::memory_free(tcp.data);
+        tcp.data = nullptr;
+        pen::filesystem_unmap_file(file);
 
         return texture_index;
     }
@@ -434,6 +464,7 @@ namespace
 
         pen::job* p_thread_info = job_params->job_info;
         pen::semaphore_post(p_thread_info->p_sem_continue, 1);
+        PEN_PROFILE_THREAD("hot_loader");
 
         s_hot_loader_cmd_buffer.create(32);
 
@@ -447,6 +478,7 @@ namespace
                 {
                     case HOT_LOADER_CMD_CALL_SYSTEM:
                     {
+                        PEN_PROFILE_SCOPE("hot_loader_build");
                         PEN_SYSTEM(cmd->cmdline);
                         pen::memory_free(cmd->cmdline);
                     }
@@ -482,14 +514,13 @@ namespace
     {
         for (auto& d : dirty)
         {
-            for (auto& tr : k_texture_references)
-            {
-                if (tr.id_name == d)
-                {
-                    u32 new_handle = load_texture_internal(tr.filename.c_str(), tr.id_name, tr.tcp);
-                    pen::renderer_replace_resource(tr.handle, new_handle, pen::RESOURCE_TEXTURE);
-                }
-            }
+            u32* index = k_texture_name_lookup.find(d);
+            if (!index)
+                continue;
+
+            texture_reference& tr = k_texture_references[*index];
+            u32                new_handle = load_texture_internal(tr.filename.c_str(), tr.id_name, tr.tcp);
+            pen::renderer_replace_resource(tr.handle, new_handle, pen::RESOURCE_TEXTURE);
         }
     }
 } // namespace
@@ -584,40 +615,46 @@ namespace put
 
     u32 load_texture(const c8* filename)
     {
+        PEN_MEMORY_TAG(pen::e_mem_tag::loader);
+
         // check for existing
         hash_id hh = PEN_HASH(filename);
-        for (auto& t : k_texture_references)
-            if (t.id_name == hh)
-                return t.handle;
+        u32*    existing = k_texture_name_lookup.find(hh);
+        if (existing)
+            return k_texture_references[*existing].handle;
 
         add_file_watcher(filename, texture_build, texture_hotload);
 
         pen::texture_creation_params tcp;
         u32                          texture_index = load_texture_internal(filename, hh, tcp);
 
+        u32 index = (u32)k_texture_references.size();
         k_texture_references.push_back({hh, filename, texture_index, tcp});
+        k_texture_name_lookup.insert(hh, index);
+
+        // failed loads return 0, which is not a valid key
+        if (texture_index)
+            k_texture_handle_lookup.insert(texture_index, index);
 
         return texture_index;
     }
 
     Str get_texture_filename(u32 handle)
     {
-        for (auto& t : k_texture_references)
-            if (t.handle == handle)
-                return t.filename;
+        u32* index = handle ? k_texture_handle_lookup.find(handle) : nullptr;
+        if (index)
+            return k_texture_references[*index].filename;
 
         return "";
     }
 
     void get_texture_info(u32 handle, texture_info& info)
     {
-        for (auto& t : k_texture_references)
+        u32* index = handle ? k_texture_handle_lookup.find(handle) : nullptr;
+        if (index)
         {
-            if (t.handle == handle)
-            {
-                info = t.tcp;
-                return;
-            }
+            info = k_texture_references[*index].tcp;
+            return;
         }
 
         // not found, not a texture handle.
@@ -665,18 +702,31 @@ namespace put
         fw->hotload_callback = hotload_callback;
         fw->build_callback = build_callback;
 
+        // inputs may have been edited since the last build, check once without waiting for an event
+        fw->changed = true;
+
         k_file_watches.push_back(fw);
+        watch_dependencies(fw);
     }
 
     void poll_hot_loader()
     {
         PEN_HOTLOADING_ENABLED;
+        PEN_PROFILE_FUNCTION;
 
         // print build cmd to console first time init
         get_build_cmd();
 
+        pen::file_watcher_update();
+
         for (auto* fw : k_file_watches)
         {
+            // only check files once the watcher has seen a change, or while waiting for a rebuild
+            if (!fw->changed && !fw->invalidated)
+                continue;
+
+            fw->changed = false;
+
             if (fw->invalidated)
             {
                 u32 dep_ts;
@@ -685,12 +735,16 @@ namespace put
                     if(dep_ts >= fw->rebuild_ts)
                     {
                         fw->dependencies = pen::json::load_from_file(fw->filename.c_str());
+                        watch_dependencies(fw);
                         
                         // rebuild has succeeded
                         dev_console_log("[file watcher] rebuild for %s complete", fw->filename.c_str());
                         fw->hotload_callback(fw->changes);
                         fw->changes.clear();
                         fw->invalidated = false;
+
+                        // events during the rebuild were dropped, so check again in case inputs changed meanwhile
+                        fw->changed = true;
                     }
                 }
             }
@@ -5,6 +5,7 @@
 #include "pen.h"
 #include "pen_string.h"
 #include "physics_bullet.h"
+#include "profiler.h"
 #include "slot_resource.h"
 #include "timer.h"
 
@@ -21,10 +22,30 @@
 
 namespace physics
 {
-    static pen::ring_buffer<physics_cmd> s_cmd_buffer;
+    static pen::spsc_queue<physics_cmd>  s_cmd_buffer; // drained once per frame, so it grows to fit a frame
     static pen::slot_resources           s_physics_slot_resources;
     static pen::slot_resources           s_p2p_slot_resources;
 
+    // handles returned to the user carry the slot generation, commands carry the bare index for the physics thread
+    u32 entity_slot(u32 handle)
+    {
+        if (handle == PEN_INVALID_HANDLE)
+            return handle;
+
+        // bare indices come back from cast and contact results
+        u32 index = pen::slot_handle_index(handle);
+        if (index == handle)
+            return index;
+
+        if (!pen::slot_resources_valid(&s_physics_slot_resources, handle))
+        {
+            PEN_LOG("physics: stale handle %08x, slot %u has been released or reused\n", handle, index);
+            PEN_ERROR;
+        }
+
+        return index;
+    }
+
     void exec_cmd(const physics_cmd& cmd)
     {
         switch (cmd.command_index)
@@ -175,6 +196,9 @@ namespace physics
     // thread sync
     pen::job* p_physics_job_thread_info;
 
+    // the physics thread sleeps until a frame is submitted, it wakes this often to check for exit
+    static const u32 k_exit_poll_ms = 100;
+
     void physics_consume_command_buffer()
     {
         pen::semaphore_post(p_physics_job_thread_info->p_sem_consume, 1);
@@ -183,31 +207,38 @@ namespace physics
 
     void* physics_thread_main(void* params)
     {
+        pen::memory_push_tag(pen::e_mem_tag::physics);
+        PEN_PROFILE_THREAD("physics");
+
         pen::job_thread_params* job_params = (pen::job_thread_params*)params;
         pen::job*               p_thread_info = job_params->job_info;
-        pen::semaphore_post(p_thread_info->p_sem_continue, 1);
-
-        p_physics_job_thread_info = p_thread_info;
 
+        // handles are allocated and commands pushed on the user thread, so both must be ready before it continues
         pen::slot_resources_init(&s_physics_slot_resources, 1024);
         pen::slot_resources_init(&s_p2p_slot_resources, 16);
 
-        physics_initialise();
-
-        // space for 8192 commands
+        // grows from 8192 commands
         s_cmd_buffer.create(8192);
 
+        pen::semaphore_post(p_thread_info->p_sem_continue, 1);
+
+        p_physics_job_thread_info = p_thread_info;
+
+        physics_initialise();
+
         for (;;)
         {
-            if (pen::semaphore_try_wait(p_physics_job_thread_info->p_sem_consume))
+            if (pen::semaphore_wait_ms(p_physics_job_thread_info->p_sem_consume, k_exit_poll_ms))
             {
                 pen::semaphore_post(p_physics_job_thread_info->p_sem_continue, 1);
 
-                physics_cmd* cmd = s_cmd_buffer.get();
+                PEN_PROFILE_SCOPE("physics_exec");
+                physics_cmd* cmd = s_cmd_buffer.peek();
                 while (cmd)
                 {
                     exec_cmd(*cmd);
-                    cmd = s_cmd_buffer.get();
+                    s_cmd_buffer.pop();
+                    cmd = s_cmd_buffer.peek();
                 }
             }
 
@@ -226,9 +257,9 @@ namespace physics
         physics_cmd pc;
         pc.command_index = cmd;
         memcpy(&pc.set_v3.data, &v3, sizeof(vec3f));
-        pc.set_v3.object_index = entity_index;
+        pc.set_v3.object_index = entity_slot(entity_index);
 
-        s_cmd_buffer.put(pc);
+        s_cmd_buffer.push(pc);
     }
 
     void set_float(const u32& entity_index, const f32& fval, u32 cmd)
@@ -236,9 +267,9 @@ namespace physics
         physics_cmd pc;
         pc.command_index = cmd;
         memcpy(&pc.set_float.data, &fval, sizeof(f32));
-        pc.set_float.object_index = entity_index;
+        pc.set_float.object_index = entity_slot(entity_index);
 
-        s_cmd_buffer.put(pc);
+        s_cmd_buffer.push(pc);
     }
 
     void set_transform(const u32& entity_index, const vec3f& position, const quat& quaternion)
@@ -247,9 +278,9 @@ namespace physics
         pc.command_index = e_cmd::set_transform;
         memcpy(&pc.set_transform.position, &position, sizeof(vec3f));
         memcpy(&pc.set_transform.rotation, &quaternion, sizeof(quat));
-        pc.set_transform.object_index = entity_index;
+        pc.set_transform.object_index = entity_slot(entity_index);
 
-        s_cmd_buffer.put(pc);
+        s_cmd_buffer.push(pc);
     }
 
     mat4 get_rb_matrix(const u32& entity_index)
@@ -258,20 +289,20 @@ namespace physics
             return mat4::create_identity();
             
         mat4* const& fb = g_readable_data.output_matrices.frontbuffer();
-        return fb[entity_index];
+        return fb[entity_slot(entity_index)];
     }
 
     maths::transform get_rb_transform(const u32& entity_index)
     {
         maths::transform* const& fb = g_readable_data.output_transforms.frontbuffer();
-        return fb[entity_index];
+        return fb[entity_slot(entity_index)];
     }
 
     bool has_rb_matrix(const u32& entity_index)
     {
         auto&        om = g_readable_data.output_matrices;
         mat4* const& fb = om._data[om._fb];
-        if (entity_index >= sb_count(fb))
+        if (entity_slot(entity_index) >= sb_count(fb))
             return false;
 
         return true;
@@ -284,12 +315,12 @@ namespace physics
         pc.command_index = e_cmd::add_rigid_body;
         pc.add_rb = rbp;
 
-        u32 resource_slot = pen::slot_resources_get_next(&s_physics_slot_resources);
-        pc.resource_slot = resource_slot;
+        pen::slot_handle h = pen::slot_resources_get_next_handle(&s_physics_slot_resources);
+        pc.resource_slot = pen::slot_handle_index(h);
 
-        s_cmd_buffer.put(pc);
+        s_cmd_buffer.push(pc);
 
-        return resource_slot;
+        return h;
     }
 
     u32 add_ghost_rb(const rigid_body_params& rbp)
@@ -299,12 +330,12 @@ namespace physics
         pc.command_index = e_cmd::add_ghost_rigid_body;
         pc.add_rb = rbp;
 
-        u32 resource_slot = pen::slot_resources_get_next(&s_physics_slot_resources);
-        pc.resource_slot = resource_slot;
+        pen::slot_handle h = pen::slot_resources_get_next_handle(&s_physics_slot_resources);
+        pc.resource_slot = pen::slot_handle_index(h);
 
-        s_cmd_buffer.put(pc);
+        s_cmd_buffer.push(pc);
 
-        return resource_slot;
+        return h;
     }
 
     u32 add_multibody(const multi_body_params& mbp)
@@ -314,12 +345,12 @@ namespace physics
         pc.command_index = e_cmd::add_multi_body;
         pc.add_multi = mbp;
 
-        u32 resource_slot = pen::slot_resources_get_next(&s_physics_slot_resources);
-        pc.resource_slot = resource_slot;
+        pen::slot_handle h = pen::slot_resources_get_next_handle(&s_physics_slot_resources);
+        pc.resource_slot = pen::slot_handle_index(h);
 
-        s_cmd_buffer.put(pc);
+        s_cmd_buffer.push(pc);
 
-        return resource_slot;
+        return h;
     }
 
     void set_paused(bool val)
@@ -334,10 +365,10 @@ namespace physics
         pc.command_index = cmd;
 
         memcpy(&pc.set_multi_v3.data, &v3_data, sizeof(vec3f));
-        pc.set_multi_v3.multi_index = object_index;
+        pc.set_multi_v3.multi_index = entity_slot(object_index);
         pc.set_multi_v3.link_index = link_index;
 
-        s_cmd_buffer.put(pc);
+        s_cmd_buffer.push(pc);
     }
 
     u32 add_compound_rb(const compound_rb_params& crbp, u32** child_handles_out)
@@ -347,21 +378,21 @@ namespace physics
         pc.command_index = e_cmd::add_compound_rb;
         pc.add_compound_rb.params = crbp;
 
-        u32 resource_slot = pen::slot_resources_get_next(&s_physics_slot_resources);
-        pc.resource_slot = resource_slot;
+        pen::slot_handle h = pen::slot_resources_get_next_handle(&s_physics_slot_resources);
+        pc.resource_slot = pen::slot_handle_index(h);
 
         pc.add_compound_rb.children_handles = nullptr;
         *child_handles_out = nullptr;
         for (u32 i = 0; i < crbp.num_shapes; ++i)
         {
-            u32 cs = pen::slot_resources_get_next(&s_physics_slot_resources);
-            sb_push(pc.add_compound_rb.children_handles, cs);
+            pen::slot_handle cs = pen::slot_resources_get_next_handle(&s_physics_slot_resources);
+            sb_push(pc.add_compound_rb.children_handles, pen::slot_handle_index(cs));
             sb_push(*child_handles_out, cs);
         }
 
-        s_cmd_buffer.put(pc);
+        s_cmd_buffer.push(pc);
 
-        return resource_slot;
+        return h;
     }
 
     void sync_compound_multi(const u32& compound_index, const u32& multi_index)
@@ -370,10 +401,10 @@ namespace physics
 
         pc.command_index = e_cmd::sync_compound_to_multi;
 
-        pc.sync_compound.compound_index = compound_index;
-        pc.sync_compound.multi_index = multi_index;
+        pc.sync_compound.compound_index = entity_slot(compound_index);
+        pc.sync_compound.multi_index = entity_slot(multi_index);
 
-        s_cmd_buffer.put(pc);
+        s_cmd_buffer.push(pc);
     }
 
     void sync_rigid_bodies(const u32& master, const u32& slave, const s32& link_index, u32 cmd)
@@ -382,11 +413,11 @@ namespace physics
 
         pc.command_index = cmd;
 
-        pc.sync_rb.master = master;
-        pc.sync_rb.slave = slave;
+        pc.sync_rb.master = entity_slot(master);
+        pc.sync_rb.slave = entity_slot(slave);
         pc.sync_rb.link_index = link_index;
 
-        s_cmd_buffer.put(pc);
+        s_cmd_buffer.push(pc);
     }
 
     u32 add_constraint(const constraint_params& crbp)
@@ -395,13 +426,15 @@ namespace physics
 
         pc.command_index = e_cmd::add_constraint;
         pc.add_constraint_params = crbp;
+        for (u32 i = 0; i < 2; ++i)
+            pc.add_constraint_params.rb_indices[i] = (s32)entity_slot((u32)crbp.rb_indices[i]);
 
-        u32 resource_slot = pen::slot_resources_get_next(&s_physics_slot_resources);
-        pc.resource_slot = resource_slot;
+        pen::slot_handle h = pen::slot_resources_get_next_handle(&s_physics_slot_resources);
+        pc.resource_slot = pen::slot_handle_index(h);
 
-        s_cmd_buffer.put(pc);
+        s_cmd_buffer.push(pc);
 
-        return resource_slot;
+        return h;
     }
 
     void set_collision_group(const u32& object_index, const u32& group, const u32& mask)
@@ -409,10 +442,11 @@ namespace physics
         physics_cmd pc;
 
         pc.command_index = e_cmd::set_group;
+        pc.set_group.object_index = entity_slot(object_index);
         pc.set_group.group = group;
         pc.set_group.mask = mask;
 
-        s_cmd_buffer.put(pc);
+        s_cmd_buffer.push(pc);
     }
 
     u32 add_compound_shape(const compound_rb_params& crbp)
@@ -422,12 +456,12 @@ namespace physics
         pc.command_index = e_cmd::add_compound_shape;
         pc.add_compound_rb.params = crbp;
 
-        u32 resource_slot = pen::slot_resources_get_next(&s_physics_slot_resources);
-        pc.resource_slot = resource_slot;
+        pen::slot_handle h = pen::slot_resources_get_next_handle(&s_physics_slot_resources);
+        pc.resource_slot = pen::slot_handle_index(h);
 
-        s_cmd_buffer.put(pc);
+        s_cmd_buffer.push(pc);
 
-        return resource_slot;
+        return h;
     }
 
     u32 attach_rb_to_compound(const attach_to_compound_params& params)
@@ -436,8 +470,10 @@ namespace physics
 
         pc.command_index = e_cmd::attach_rb_to_compound;
         pc.attach_compound = params;
+        pc.attach_compound.rb = entity_slot(params.rb);
+        pc.attach_compound.compound = entity_slot(params.compound);
 
-        s_cmd_buffer.put(pc);
+        s_cmd_buffer.push(pc);
 
         return 0;
     }
@@ -447,9 +483,9 @@ namespace physics
         physics_cmd pc;
 
         pc.command_index = e_cmd::remove_from_world;
-        pc.entity_index = entity_index;
+        pc.entity_index = entity_slot(entity_index);
 
-        s_cmd_buffer.put(pc);
+        s_cmd_buffer.push(pc);
     }
 
     void add_to_world(const u32& entity_index)
@@ -457,22 +493,23 @@ namespace physics
         physics_cmd pc;
 
         pc.command_index = e_cmd::add_to_world;
-        pc.entity_index = entity_index;
+        pc.entity_index = entity_slot(entity_index);
 
-        s_cmd_buffer.put(pc);
+        s_cmd_buffer.push(pc);
     }
 
     void release_entity(const u32& entity_index)
     {
-        if (!pen::slot_resources_free(&s_physics_slot_resources, entity_index))
+        u32 slot = entity_slot(entity_index);
+        if (!pen::slot_resources_free(&s_physics_slot_resources, slot))
             return;
 
         physics_cmd pc;
 
         pc.command_index = e_cmd::release_entity;
-        pc.entity_index = entity_index;
+        pc.entity_index = slot;
 
-        s_cmd_buffer.put(pc);
+        s_cmd_buffer.push(pc);
     }
 
     void cast_ray(const ray_cast_params& rcp)
@@ -483,7 +520,7 @@ namespace physics
         physics_cmd pc;
         pc.command_index = e_cmd::cast_ray;
         pc.ray_cast = rcp;
-        s_cmd_buffer.put(pc);
+        s_cmd_buffer.push(pc);
     }
 
     void cast_sphere(const sphere_cast_params& scp)
@@ -494,7 +531,7 @@ namespace physics
         physics_cmd pc;
         pc.command_index = e_cmd::cast_sphere;
         pc.sphere_cast = scp;
-        s_cmd_buffer.put(pc);
+        s_cmd_buffer.push(pc);
     }
 
     cast_result cast_ray_immediate(const ray_cast_params& rcp)
@@ -512,7 +549,8 @@ namespace physics
         physics_cmd pc;
         pc.command_index = e_cmd::contact_test;
         pc.contact_test = ctp;
-        s_cmd_buffer.put(pc);
+        pc.contact_test.entity = entity_slot(ctp.entity);
+        s_cmd_buffer.push(pc);
     }
 
     void step(f32 dt)
@@ -520,6 +558,6 @@ namespace physics
         physics_cmd pc;
         pc.command_index = e_cmd::step;
         pc.dt = dt;
-        s_cmd_buffer.put(pc);
+        s_cmd_buffer.push(pc);
     }
 } // namespace physics
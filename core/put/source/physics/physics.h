@@ -390,6 +390,7 @@ namespace physics
     cast_result cast_ray_immediate(const ray_cast_params& rcp);
     cast_result cast_sphere_immediate(const sphere_cast_params& scp);
 
+    // accumulates dt and steps the simulation at a fixed rate, output transforms are interpolated between steps
     void step(f32 dt);
     void set_v3(const u32& entity_index, const vec3f& v3, u32 cmd);
     void set_float(const u32& entity_index, const f32& fval, u32 cmd);
@@ -44,6 +44,12 @@ namespace physics
     static bullet_systems                s_bullet_systems;
     static pen::res_pool<physics_entity> s_entities;
 
+    // the simulation steps at a fixed rate decoupled from the frame rate, output transforms are interpolated
+    // between the last two steps by the time left in the accumulator.
+    static const f32 k_fixed_timestep = 1.0f / 60.0f;
+    static const u32 k_max_substeps = 8; // time beyond this is dropped so a long frame cant spiral
+    static f32       s_accumulator = 0.0f;
+
     btTransform get_bttransform(const vec3f& p, const quat& q)
     {
         btTransform trans;
@@ -231,6 +237,8 @@ namespace physics
         body->setContactProcessingThreshold(BT_LARGE_FLOAT);
         body->setActivationState(DISABLE_DEACTIVATION);
 
+        entity.prev_transform = from_bttransform(body->getWorldTransform());
+
         if (!ghost)
         {
             s_bullet_systems.dynamics_world->addRigidBody(body, params.group, params.mask);
@@ -259,7 +267,30 @@ namespace physics
         s_bullet_systems.dynamics_world->setGravity(btVector3(0, -10, 0));
     }
 
-    void update_output_matrices()
+    btTransform interpolate_transform(const maths::transform& prev, const btTransform& cur, f32 alpha)
+    {
+        btTransform prev_bt = get_bttransform(prev.translation, prev.rotation);
+
+        btTransform t;
+        t.setOrigin(prev_bt.getOrigin().lerp(cur.getOrigin(), alpha));
+        t.setRotation(prev_bt.getRotation().slerp(cur.getRotation(), alpha));
+        return t;
+    }
+
+    void store_prev_transforms()
+    {
+        for (u32 i = 0; i < s_entities._capacity; i++)
+        {
+            physics_entity& entity = s_entities.get(i);
+            if (entity.type != ENTITY_RIGID_BODY && entity.type != ENTITY_COMPOUND_RIGID_BODY)
+                continue;
+
+            if (entity.rb.rigid_body)
+                entity.prev_transform = from_bttransform(entity.rb.rigid_body->getWorldTransform());
+        }
+    }
+
+    void update_output_matrices(f32 alpha)
     {
         mat4*&             bb_mats = g_readable_data.output_matrices.backbuffer();
         maths::transform*& bb_transforms = g_readable_data.output_transforms.backbuffer();
@@ -285,7 +316,8 @@ namespace physics
                     if (!p_rb)
                         continue;
 
-                    btTransform rb_transform = p_rb->getWorldTransform();
+                    btTransform rb_transform =
+                        interpolate_transform(entity.prev_transform, p_rb->getWorldTransform(), alpha);
 
                     btScalar _mm[16];
 
@@ -304,7 +336,8 @@ namespace physics
                     btCompoundShape* p_compound = entity.compound_shape;
                     btRigidBody*     p_rb = entity.rb.rigid_body;
 
-                    btTransform rb_transform = p_rb->getWorldTransform();
+                    btTransform rb_transform =
+                        interpolate_transform(entity.prev_transform, p_rb->getWorldTransform(), alpha);
 
                     btScalar _mm[16];
 
@@ -322,7 +355,7 @@ namespace physics
                         {
                             if (p_rb)
                             {
-                                btTransform       base = p_rb->getWorldTransform();
+                                btTransform       base = rb_transform;
                                 btTransform       child = p_compound->getChildTransform(j);
                                 btCollisionShape* shape = p_compound->getChildShape(j);
                                 u32               ph = shape->getUserIndex();
@@ -359,14 +392,22 @@ namespace physics
     void physics_update(f32 dt)
     {
         // step
+        f32 alpha = 1.0f;
         if (!g_readable_data.b_paused)
         {
-            s_bullet_systems.dynamics_world->stepSimulation(dt);
-        }
+            s_accumulator = min(s_accumulator + dt, k_fixed_timestep * k_max_substeps);
+            while (s_accumulator >= k_fixed_timestep)
+            {
+                store_prev_transforms();
+                s_bullet_systems.dynamics_world->stepSimulation(k_fixed_timestep, 0);
+                s_accumulator -= k_fixed_timestep;
+            }
 
+            alpha = s_accumulator / k_fixed_timestep;
+        }
 
         // update mats
-        update_output_matrices();
+        update_output_matrices(alpha);
     }
 
     void add_rb_internal(const rigid_body_params& params, u32 resource_slot, bool ghost)
@@ -593,6 +634,9 @@ namespace physics
 
         if (rb)
         {
+            // teleport, dont interpolate from the old position
+            s_entities.get(cmd.object_index).prev_transform = from_bttransform(bt_trans);
+
             if (rb->getCollisionFlags() & btCollisionObject::CF_KINEMATIC_OBJECT)
             {
                 rb->getMotionState()->setWorldTransform(bt_trans);
@@ -84,6 +84,8 @@ namespace physics
         u32 group;
         u32 mask;
 
+        maths::transform prev_transform; // world transform before the last fixed step, for interpolating the output
+
         physics_entity(){};
         ~physics_entity(){};
     };
@@ -82,6 +82,8 @@ namespace put
         hash_id id_name = 0;
 
         void (*render_function)(const scene_view&) = nullptr;
+        void (*setup_function)() = nullptr; // called on the user thread when a view using this renderer is built
+        bool parallel_record = false;        // render_function only touches resources made by setup_function
     };
 
     struct technique_constant_data
@@ -157,7 +159,8 @@ namespace put
                 rasterizer,
                 sampler,
                 blend,
-                depth_stencil
+                depth_stencil,
+                COUNT
             };
         }
         typedef e_render_state::render_state_t render_state_t;
@@ -17,6 +17,7 @@
 #include "pmfx.h"
 #include "renderer_shared.h"
 #include "str_utilities.h"
+#include "tasks.h"
 #include "timer.h"
 
 #include <fstream>
@@ -57,7 +58,8 @@ namespace
             resolve = (1<<4),           // after view has completed, render targets are resolved.
             generate_mips = (1 << 5),   // generate mip maps for the render target after resolving
             compute = (1<<6),           // runs a compute job instead of render job
-            cubemap_array = (1<<7)
+            cubemap_array = (1<<7),
+            parallel_record = (1<<8)    // view can be recorded on a task thread alongside its neighbours
         };
     }
 
@@ -273,6 +275,15 @@ namespace
         bool stash_output = false;
         u32  stashed_output_rt = PEN_INVALID_HANDLE;
         f32  stashed_rt_aspect = 0.0f;
+
+        // orthographic camera for views without a camera (directional shadow maps)
+        put::camera ortho_camera;
+    };
+
+    struct view_record
+    {
+        view_params* view;
+        u32          cmd_list;
     };
 
     struct edited_post_process
@@ -342,11 +353,18 @@ namespace
     std::vector<texture_creation_params> s_render_target_tcp;
     std::vector<const c8*>               s_render_target_names;
     std::vector<render_state>            s_render_states;
+    pen::hash_map<u32>                   s_render_state_names[e_render_state::COUNT];  // id_name to s_render_states index
+    pen::hash_map<u32>                   s_render_state_hashes[e_render_state::COUNT]; // hash to s_render_states index
+    pen::hash_map<u32>                   s_render_state_handles;                       // handle to s_render_states index
     std::vector<sampler_binding>         s_sampler_bindings;
     std::vector<filter_kernel>           s_filter_kernels;
     geometry_utility                     s_geometry;
     std::vector<Str>                     s_script_files;
     bool                                 s_reload = false;
+    std::vector<u32>                     s_cmd_lists;                            // Command lists for parallel view recording
+    std::vector<view_record>             s_view_records;                         // Views waiting to be recorded in parallel
+    u32                                  s_cb_2d = PEN_INVALID_HANDLE;           // 2d view projection shared by all views
+    u32                                  s_cb_sampler_info = PEN_INVALID_HANDLE; // 1.0 / size of bound samplers
 
     // ids
 } // namespace
@@ -440,44 +458,66 @@ namespace put
             return res;
         }
 
+        void add_render_state(const render_state& rs)
+        {
+            // lookups return the first state added with a name, hash or handle, as the linear search used to
+            u32 index = (u32)s_render_states.size();
+            s_render_states.push_back(rs);
+
+            if (rs.id_name)
+                s_render_state_names[rs.type].try_insert(rs.id_name, index);
+
+            if (rs.hash)
+                s_render_state_hashes[rs.type].try_insert(rs.hash, index);
+
+            if (rs.handle)
+                s_render_state_handles.try_insert(rs.handle, index);
+        }
+
+        void clear_render_states()
+        {
+            s_render_states.clear();
+            s_render_state_handles.clear();
+
+            for (u32 i = 0; i < e_render_state::COUNT; ++i)
+            {
+                s_render_state_names[i].clear();
+                s_render_state_hashes[i].clear();
+            }
+        }
+
         render_state* get_state_by_hash(hash_id hash, u32 type)
         {
-            size_t num = s_render_states.size();
-            for (s32 i = 0; i < num; ++i)
-                if (s_render_states[i].hash == hash && s_render_states[i].type == type)
-                    return &s_render_states[i];
+            u32* index = hash ? s_render_state_hashes[type].find(hash) : nullptr;
+            if (index)
+                return &s_render_states[*index];
 
             return nullptr;
         }
 
         render_state* _get_render_state(hash_id id_name, u32 type)
         {
-            size_t num = s_render_states.size();
-            for (s32 i = 0; i < num; ++i)
-                if (s_render_states[i].type == type)
-                    if (s_render_states[i].id_name == id_name)
-                        return &s_render_states[i];
+            u32* index = id_name ? s_render_state_names[type].find(id_name) : nullptr;
+            if (index)
+                return &s_render_states[*index];
 
             return nullptr;
         }
 
         u32 get_render_state(hash_id id_name, u32 type)
         {
-            size_t num = s_render_states.size();
-            for (s32 i = 0; i < num; ++i)
-                if (s_render_states[i].type == type)
-                    if (s_render_states[i].id_name == id_name)
-                        return s_render_states[i].handle;
+            render_state* rs = _get_render_state(id_name, type);
+            if (rs)
+                return rs->handle;
 
             return 0;
         }
 
         Str get_render_state_name(u32 handle)
         {
-            size_t num = s_render_states.size();
-            for (s32 i = 0; i < num; ++i)
-                if (s_render_states[i].handle == handle)
-                    return s_render_states[i].name;
+            u32* index = handle ? s_render_state_handles.find(handle) : nullptr;
+            if (index)
+                return s_render_states[*index].name;
 
             return "";
         }
@@ -652,7 +692,7 @@ namespace put
                     rs.handle = pen::renderer_create_sampler(scp);
                 }
 
-                s_render_states.push_back(rs);
+                add_render_state(rs);
             }
         }
 
@@ -697,7 +737,7 @@ namespace put
                     rs.handle = pen::renderer_create_rasterizer_state(rcp);
                 }
 
-                s_render_states.push_back(rs);
+                add_render_state(rs);
             }
         }
 
@@ -754,7 +794,7 @@ namespace put
                 rs.handle = pen::renderer_create_blend_state(bcp);
                 rs.copy = false;
 
-                s_render_states.push_back(rs);
+                add_render_state(rs);
             }
         }
 
@@ -833,7 +873,7 @@ namespace put
                     rs.handle = pen::renderer_create_depth_stencil_state(dscp);
                 }
 
-                s_render_states.push_back(rs);
+                add_render_state(rs);
             }
         }
 
@@ -1004,7 +1044,7 @@ namespace put
                 rs.handle = pen::renderer_create_blend_state(bcp);
             }
 
-            s_render_states.push_back(rs);
+            add_render_state(rs);
 
             return rs.handle;
         }
@@ -1193,7 +1233,7 @@ namespace put
                             tcp.cpu_access_flags |= PEN_CPU_ACCESS_WRITE;
                             
 
-                        static hash_id id_write = PEN_HASH("write");
+                        static constexpr hash_id id_write = PEN_CONST_HASH("write");
                         if (r["pp"].as_hash_id() == id_write)
                         {
                             new_info.pp = e_vrt_mode::write;
@@ -1523,6 +1563,30 @@ namespace put
             new_view.clear_state = pen::renderer_create_clear_state(cs_info);
         }
 
+        void create_view_cbuffers(view_params& new_view)
+        {
+            // created with the view so recording it only updates them
+            if (!is_valid(s_cb_2d))
+            {
+                pen::buffer_creation_params bcp;
+                bcp.usage_flags = PEN_USAGE_DYNAMIC;
+                bcp.bind_flags = PEN_BIND_CONSTANT_BUFFER;
+                bcp.cpu_access_flags = PEN_CPU_ACCESS_WRITE;
+                bcp.buffer_size = sizeof(float) * 20;
+                bcp.data = (void*)nullptr;
+
+                s_cb_2d = pen::renderer_create_buffer(bcp);
+
+                bcp.buffer_size = sizeof(vec4f) * 16; // 16 samplers worth, x = 1.0 / width, y = 1.0 / height
+                s_cb_sampler_info = pen::renderer_create_buffer(bcp);
+            }
+
+            if (new_view.camera)
+                put::camera_create_cbuffer(new_view.camera);
+            else
+                put::camera_create_cbuffer(&new_view.ortho_camera);
+        }
+
         void parse_views(pen::json& j_views, const pen::json& all_views, std::vector<view_params>& view_array,
                          const char* group = nullptr)
         {
@@ -1683,6 +1747,9 @@ namespace put
                 if (view["generate_mip_maps"].as_bool())
                     new_view.view_flags |= e_view_flags::generate_mips;
 
+                if (view["parallel_record"].as_bool())
+                    new_view.view_flags |= e_view_flags::parallel_record;
+
                 // viewport
                 pen::json viewport = view["viewport"];
 
@@ -1811,6 +1878,7 @@ namespace put
                 }
 
                 // scene views
+                bool      parallel_record = true;
                 pen::json scene_views = view["scene_views"];
                 for (s32 ii = 0; ii < scene_views.size(); ++ii)
                 {
@@ -1822,6 +1890,12 @@ namespace put
                         {
                             found = true;
                             new_view.render_functions.push_back(sv.render_function);
+
+                            // resources are created here so recording the view never has to
+                            if (sv.setup_function)
+                                sv.setup_function();
+
+                            parallel_record &= sv.parallel_record;
                         }
                     }
 
@@ -1836,6 +1910,15 @@ namespace put
                 if (scene_views.size() > 0)
                     new_view.view_flags |= e_view_flags::scene_view;
 
+                if ((new_view.view_flags & e_view_flags::parallel_record) && !parallel_record)
+                {
+                    dev_console_log_level(dev_ui::console_level::warning,
+                                          "[warning] pmfx - view %s has scene views which cannot be recorded in parallel",
+                                          new_view.name.c_str());
+
+                    new_view.view_flags &= ~e_view_flags::parallel_record;
+                }
+
                 // sampler bindings
                 parse_sampler_bindings(view, new_view);
 
@@ -1917,7 +2000,10 @@ namespace put
                 }
 
                 if (valid)
+                {
+                    create_view_cbuffers(new_view);
                     view_array.push_back(new_view);
+                }
             }
         }
 
@@ -2576,9 +2662,12 @@ namespace put
             for (auto& v : s_views)
             {
                 pen::renderer_release_clear_state(v.clear_state);
+
+                if (is_valid(v.ortho_camera.cbuffer))
+                    pen::renderer_release_buffer(v.ortho_camera.cbuffer);
             }
 
-            s_render_states.clear();
+            clear_render_states();
             s_render_targets.clear();
             s_render_target_tcp.clear();
             s_render_target_names.clear();
@@ -2689,7 +2778,7 @@ namespace put
             pen::renderer_set_index_buffer(r.index_buffer, r.index_type, 0);
             pen::renderer_set_vertex_buffer(r.vertex_buffer, 0, r.vertex_size, 0);
 
-            static hash_id id_technique = PEN_HASH("blit");
+            static constexpr hash_id id_technique = PEN_CONST_HASH("blit");
             if (!pmfx::set_technique_perm(pp_shader, id_technique))
                 PEN_ASSERT(0);
 
@@ -2799,23 +2888,6 @@ namespace put
             if (v.num_colour_targets == 0 && v.depth_target == PEN_INVALID_HANDLE)
                 return;
 
-            static u32 cb_2d = PEN_INVALID_HANDLE;
-            static u32 cb_sampler_info = PEN_INVALID_HANDLE;
-            if (!is_valid(cb_2d))
-            {
-                pen::buffer_creation_params bcp;
-                bcp.usage_flags = PEN_USAGE_DYNAMIC;
-                bcp.bind_flags = PEN_BIND_CONSTANT_BUFFER;
-                bcp.cpu_access_flags = PEN_CPU_ACCESS_WRITE;
-                bcp.buffer_size = sizeof(float) * 20;
-                bcp.data = (void*)nullptr;
-
-                cb_2d = pen::renderer_create_buffer(bcp);
-
-                bcp.buffer_size = sizeof(vec4f) * 16; // 16 samplers worth, x = 1.0 / width, y = 1.0 / height
-                cb_sampler_info = pen::renderer_create_buffer(bcp);
-            }
-
             // unbind samplers to stop validation layers complaining, render targets may still be bound on output.
             for (s32 i = 0; i < e_pmfx_constants::max_sampler_bindings; ++i)
                 pen::renderer_set_texture(0, 0, i, pen::TEXTURE_BIND_PS | pen::TEXTURE_BIND_VS);
@@ -2835,7 +2907,7 @@ namespace put
             f32 W = 2.0f / vvp.width;
             f32 H = 2.0f / vvp.height;
             f32 mvp[4][4] = {{W, 0.0, 0.0, 0.0}, {0.0, H, 0.0, 0.0}, {0.0, 0.0, 1.0, 0.0}, {-1.0, -1.0, 0.0, 1.0}};
-            pen::renderer_update_buffer(cb_2d, mvp, sizeof(mvp), 0);
+            pen::renderer_update_buffer(s_cb_2d, mvp, sizeof(mvp), 0);
 
             // build scene view info
             scene_view sv;
@@ -2847,7 +2919,7 @@ namespace put
             sv.blend_state = v.blend_state;
             sv.camera = v.camera;
             sv.viewport = &vp;
-            sv.cb_2d_view = cb_2d;
+            sv.cb_2d_view = s_cb_2d;
             sv.pmfx_shader = v.pmfx_shader;
             sv.permutation = v.technique_permutation;
 
@@ -2870,7 +2942,7 @@ namespace put
                 else
                 {
                     // orthogonal projections (directional shadow maps)
-                    static put::camera c;
+                    put::camera& c = v.ortho_camera;
                     put::camera_create_orthographic(&c, vvp.x, vvp.width, vvp.y, vvp.height, 0.0f, 1.0f);
                     put::camera_update_shader_constants(&c);
                     sv.cb_view = c.cbuffer;
@@ -2903,8 +2975,8 @@ namespace put
                 u32 num_samplers = v.sampler_bindings.size();
                 if (num_samplers > 0)
                 {
-                    pen::renderer_update_buffer(cb_sampler_info, v.sampler_info, num_samplers * sizeof(vec4f));
-                    pen::renderer_set_constant_buffer(cb_sampler_info, e_cbuffer_location::sampler_info,
+                    pen::renderer_update_buffer(s_cb_sampler_info, v.sampler_info, num_samplers * sizeof(vec4f));
+                    pen::renderer_set_constant_buffer(s_cb_sampler_info, e_cbuffer_location::sampler_info,
                                                       pen::CBUFFER_BIND_PS);
                 }
 
@@ -2959,15 +3031,86 @@ namespace put
             }
         }
 
+        bool can_record_parallel(const view_params& v)
+        {
+            if (!(v.view_flags & e_view_flags::parallel_record))
+                return false;
+
+            if (v.view_flags & (e_view_flags::template_view | e_view_flags::abstract | e_view_flags::compute))
+                return false;
+
+            // post process and stash mutate shared virtual targets
+            if ((v.post_process_flags & e_pp_flags::enabled) || v.stash_output)
+                return false;
+
+            return true;
+        }
+
+        void record_view(void* user_data)
+        {
+            view_record* vr = (view_record*)user_data;
+
+            pen::renderer_begin_cmd_list(vr->cmd_list);
+            render_view(*vr->view);
+            pen::renderer_end_cmd_list();
+        }
+
+        void flush_view_records()
+        {
+            u32 num_records = s_view_records.size();
+            if (num_records == 0)
+                return;
+
+            pen::task_counter recorded;
+            for (u32 i = 0; i < num_records; ++i)
+                pen::task_run(record_view, &s_view_records[i], &recorded);
+
+            pen::task_wait(&recorded);
+
+            // submit in view order so the output matches serial recording
+            for (u32 i = 0; i < num_records; ++i)
+                pen::renderer_submit_cmd_list(s_view_records[i].cmd_list);
+
+            s_view_records.clear();
+        }
+
+        void add_view_record(view_params& v)
+        {
+            // views sharing a camera cannot be recorded at the same time
+            for (auto& vr : s_view_records)
+            {
+                if (v.camera && vr.view->camera == v.camera)
+                {
+                    flush_view_records();
+                    break;
+                }
+            }
+
+            u32 i = s_view_records.size();
+            if (i >= s_cmd_lists.size())
+                s_cmd_lists.push_back(pen::renderer_create_cmd_list());
+
+            s_view_records.push_back({&v, s_cmd_lists[i]});
+        }
+
         void render()
         {
             reload();
-            
+
             for (auto& v : s_views)
             {
                 if (v.view_flags & e_view_flags::template_view)
                     continue;
 
+                // consecutive parallel views are batched and recorded on task threads
+                if (can_record_parallel(v))
+                {
+                    add_view_record(v);
+                    continue;
+                }
+
+                flush_view_records();
+
                 if (v.view_flags & e_view_flags::abstract)
                 {
                     render_abstract_view(v);
@@ -2980,6 +3123,8 @@ namespace put
                         render_post_process(v);
                 }
             }
+
+            flush_view_records();
         }
 
         void render_target_info_ui(const render_target& rt)
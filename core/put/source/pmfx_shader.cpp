@@ -13,6 +13,7 @@
 #include "console.h"
 #include "data_struct.h"
 #include "file_system.h"
+#include "file_watcher.h"
 #include "hash.h"
 #include "memory.h"
 #include "pen.h"
@@ -52,6 +53,8 @@ namespace
         hash_id         id_filename = 0;
         Str             filename = nullptr;
         bool            invalidated = false;
+        bool            watching = false;
+        bool            changed = false; // set by the file watcher when the info file or inputs change
         pen::json       info;
         u32             info_timestamp = 0;
         shader_program* techniques = nullptr;
@@ -370,6 +373,7 @@ namespace put
                 slp.stream_out_shader = program.stream_out_shader;
                 slp.pixel_shader = 0;
                 slp.vertex_shader = 0;
+                slp.input_layout = 0;
 
                 slp.stream_out_names = new c8*[num_vertex_outputs];
                 slp.num_stream_out_names = num_vertex_outputs;
@@ -565,8 +569,8 @@ namespace put
 
                 hash_id id_widget = j_technique["permutations"][i]["type"].as_hash_id();
 
-                static hash_id id_checkbox = PEN_HASH("checkbox");
-                static hash_id id_input = PEN_HASH("input");
+                static constexpr hash_id id_checkbox = PEN_CONST_HASH("checkbox");
+                static constexpr hash_id id_input = PEN_CONST_HASH("input");
 
                 if (id_widget == id_checkbox)
                 {
@@ -607,7 +611,7 @@ namespace put
             {
                 pmfx::technique_sampler* ts = pmfx::get_technique_samplers(shader, technique_index);
 
-                static hash_id id_wrap_linear = PEN_HASH("wrap_linear");
+                static constexpr hash_id id_wrap_linear = PEN_CONST_HASH("wrap_linear");
 
                 u32 num_tt = sb_count(ts);
                 for (u32 i = 0; i < num_tt; ++i)
@@ -882,10 +886,41 @@ namespace put
             return PEN_INVALID_HANDLE;
         }
 
+        void pmfx_file_changed(const c8* filename, void* user_data)
+        {
+            u32 i = (u32)(size_t)user_data;
+            if (i < sb_count(s_pmfx_list))
+                s_pmfx_list[i].changed = true;
+        }
+
+        void watch_pmfx_files(u32 i)
+        {
+            // user data is the index in s_pmfx_list, which is stable while the pmfx is loaded
+            static c8 info_file_buf[256];
+
+            auto& pmfx_set = s_pmfx_list[i];
+            void* user_data = (void*)(size_t)i;
+
+            get_pmfx_info_filename(info_file_buf, pmfx_set.filename.c_str());
+            pen::file_watcher_add(info_file_buf, pmfx_file_changed, user_data);
+
+            pen::json files = pmfx_set.info["files"];
+            s32       num_files = files.size();
+            for (s32 f = 0; f < num_files; ++f)
+                pen::file_watcher_add(files[f]["name"].as_str().c_str(), pmfx_file_changed, user_data);
+
+            pmfx_set.watching = true;
+
+            // inputs may have been edited since the last build, check once without waiting for an event
+            pmfx_set.changed = true;
+        }
+
         void poll_for_changes()
         {
             PEN_HOTLOADING_ENABLED;
 
+            pen::file_watcher_update();
+
             static c8 info_file_buf[256];
             
             Str shader_compiler_str = put::get_build_cmd();
@@ -900,6 +935,13 @@ namespace put
             {
                 auto& pmfx_set = s_pmfx_list[i];
 
+                if (pmfx_set.filename.length() > 0 && !pmfx_set.watching)
+                    watch_pmfx_files(i);
+
+                // only check files once the watcher has seen a change, or while waiting for a rebuild
+                bool changed = pmfx_set.changed;
+                pmfx_set.changed = false;
+
                 if (pmfx_set.invalidated)
                 {
                     get_pmfx_info_filename(info_file_buf, pmfx_set.filename.c_str());
@@ -919,7 +961,7 @@ namespace put
                         }
                     }
                 }
-                else
+                else if (changed)
                 {
                     pen::json files = pmfx_set.info["files"];
 
@@ -960,6 +1002,9 @@ namespace put
                     pmfx_shader pmfx_new = load_internal(pmfx_set.filename.c_str());
                     release_shader(current_counter);
                     pmfx_set = pmfx_new;
+
+                    // the rebuilt info can list new inputs, and events during the build were dropped
+                    watch_pmfx_files(reload_list[i]);
                 }
                 
                 // fixup resources / references
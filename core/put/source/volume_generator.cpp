@@ -1085,7 +1085,7 @@ namespace put
             s_rasteriser_job.current_slice_aabb.min.z *= -1;
             s_rasteriser_job.current_slice_aabb.max.z *= -1;
 
-            static hash_id             id_volume_raster = PEN_HASH("volume_raster");
+            static constexpr hash_id   id_volume_raster = PEN_CONST_HASH("volume_raster");
             const pmfx::render_target* rt = pmfx::get_render_target(id_volume_raster);
 
             pen::resource_read_back_params rrbp;
@@ -1400,7 +1400,7 @@ namespace put
 
                     if (ImGui::CollapsingHeader("Render Target Output"))
                     {
-                        static hash_id             id_volume_raster_rt = PEN_HASH("volume_raster");
+                        static constexpr hash_id   id_volume_raster_rt = PEN_CONST_HASH("volume_raster");
                         const pmfx::render_target* volume_rt = pmfx::get_render_target(id_volume_raster_rt);
                         ImGui::Image(IMG(volume_rt->handle), ImVec2(256, 256));
                     }
@@ -1687,8 +1687,8 @@ namespace put
         void post_update()
         {
             static u32     dim = 128;
-            static hash_id id_volume_raster_rt = PEN_HASH("volume_raster");
-            static hash_id id_volume_raster_ds = PEN_HASH("volume_raster_ds");
+            static constexpr hash_id id_volume_raster_rt = PEN_CONST_HASH("volume_raster");
+            static constexpr hash_id id_volume_raster_ds = PEN_CONST_HASH("volume_raster_ds");
 
             u32 cur_dim = 1 << s_options.volume_dimension;
 
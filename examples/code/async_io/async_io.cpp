@@ -0,0 +1,236 @@
+#include "async_io.h"
+#include "console.h"
+#include "memory.h"
+#include "pen.h"
+#include "threads.h"
+
+#include <stdio.h>
+#include <string.h>
+
+void* pen::user_entry(void* params);
+namespace pen
+{
+    pen_creation_params pen_entry(int argc, char** argv)
+    {
+        pen::pen_creation_params p;
+        p.window_width = 1280;
+        p.window_height = 720;
+        p.window_title = "async_io";
+        p.window_sample_count = 4;
+        p.user_thread_function = user_entry;
+        p.flags = pen::e_pen_create_flags::console_app;
+        return p;
+    }
+} // namespace pen
+
+namespace
+{
+    const c8* k_test_file = "async_io_test.bin";
+    const u32 k_test_file_size = 4 * 1024 * 1024;
+    const u32 k_num_requests = 256;
+
+    u8*   s_file_data = nullptr;
+    a_u32 s_callbacks = {0};
+    a_u32 s_errors = {0};
+
+    u8 test_byte(u32 i)
+    {
+        return (u8)((i * 7) ^ (i >> 11));
+    }
+
+    bool write_test_file()
+    {
+        s_file_data = (u8*)pen::memory_alloc(k_test_file_size);
+        for (u32 i = 0; i < k_test_file_size; ++i)
+            s_file_data[i] = test_byte(i);
+
+        FILE* fp = fopen(k_test_file, "wb");
+        if (!fp)
+            return false;
+
+        fwrite(s_file_data, 1, k_test_file_size, fp);
+        fclose(fp);
+        return true;
+    }
+
+    pen::io_result wait_result(pen::io_handle h)
+    {
+        pen::io_result result;
+        while (!pen::io_get_result(h, result))
+            pen::thread_sleep_ms(1);
+
+        return result;
+    }
+
+    void* counted_alloc(u32 size, void* alloc_user_data)
+    {
+        (*(a_u32*)alloc_user_data)++;
+        return pen::memory_alloc(size);
+    }
+
+    void counted_free(void* data, void* alloc_user_data)
+    {
+        (*(a_u32*)alloc_user_data)--;
+        pen::memory_free(data);
+    }
+
+    void completion_callback(const pen::io_result& result)
+    {
+        u32 offset = (u32)(size_t)result.user_data;
+
+        if (result.status == pen::e_io_status::complete)
+        {
+            if (memcmp(result.data, s_file_data + offset, result.size) != 0)
+                s_errors++;
+        }
+        else if (result.status != pen::e_io_status::cancelled)
+        {
+            s_errors++;
+        }
+
+        pen::memory_free(result.data);
+        s_callbacks++;
+    }
+
+    bool test_reads()
+    {
+        bool pass = true;
+
+        // offset and size into an allocated buffer
+        pen::io_request req;
+        req.filename = k_test_file;
+        req.offset = 1000;
+        req.size = 4096;
+
+        pen::io_result r = wait_result(pen::io_read(req));
+        pass &= r.status == pen::e_io_status::complete && r.size == 4096;
+        pass &= r.data && memcmp(r.data, s_file_data + 1000, 4096) == 0;
+        pen::memory_free(r.data);
+
+        // whole file into a user buffer
+        u8* dst = (u8*)pen::memory_alloc(k_test_file_size);
+        req.offset = 0;
+        req.size = 0;
+        req.dst = dst;
+
+        r = wait_result(pen::io_read(req));
+        pass &= r.status == pen::e_io_status::complete && r.size == k_test_file_size;
+        pass &= memcmp(dst, s_file_data, k_test_file_size) == 0;
+        pen::memory_free(dst);
+
+        // missing files and reads past the end fail
+        pen::io_request bad;
+        bad.filename = "async_io_missing.bin";
+        pass &= wait_result(pen::io_read(bad)).status == pen::e_io_status::failed;
+
+        bad.filename = k_test_file;
+        bad.offset = k_test_file_size - 16;
+        bad.size = 32;
+        pass &= wait_result(pen::io_read(bad)).status == pen::e_io_status::failed;
+
+        // user allocated data from a cancelled read is handed back to free_func
+        a_u32           live_allocs = {0};
+        pen::io_request custom;
+        custom.filename = k_test_file;
+        custom.alloc_func = counted_alloc;
+        custom.free_func = counted_free;
+        custom.alloc_user_data = &live_allocs;
+
+        pen::io_handle ch = pen::io_read(custom);
+        pen::io_cancel(ch);
+
+        r = wait_result(ch);
+        if (r.data)
+            counted_free(r.data, &live_allocs);
+        pass &= live_allocs.load() == 0;
+
+        if (!pass)
+            PEN_LOG("[async_io] basic reads failed");
+
+        return pass;
+    }
+
+    bool test_callbacks()
+    {
+        pen::io_stats prev;
+        pen::io_get_stats(prev);
+
+        pen::io_handle handles[k_num_requests];
+        for (u32 i = 0; i < k_num_requests; ++i)
+        {
+            u32 offset = (i * 4099) % (k_test_file_size / 2);
+
+            pen::io_request req;
+            req.filename = k_test_file;
+            req.offset = offset;
+            req.size = i % 8 == 0 ? 0 : 4096;
+            req.priority = (pen::io_priority)(i % pen::e_io_priority::COUNT);
+            req.callback = completion_callback;
+            req.user_data = (void*)(size_t)offset;
+            req.completion = i & 1 ? pen::e_io_completion::io_thread : pen::e_io_completion::dispatch;
+
+            handles[i] = pen::io_read(req);
+        }
+
+        u32 cancelled = 0;
+        for (u32 i = 0; i < k_num_requests; i += 5)
+            cancelled += pen::io_cancel(handles[i]) ? 1 : 0;
+
+        while (s_callbacks.load() < k_num_requests)
+        {
+            pen::io_dispatch_completions();
+            pen::thread_sleep_ms(1);
+        }
+
+        pen::io_stats stats;
+        pen::io_get_stats(stats);
+
+        PEN_LOG("[async_io] %i requests, %i cancelled, %.2f mb/s, avg latency %.2f ms, max latency %.2f ms",
+                (u32)stats.requests, (u32)stats.cancelled, stats.bandwidth_mbps, stats.avg_latency_ms,
+                stats.max_latency_ms);
+
+        bool pass = s_errors.load() == 0 && stats.queued == 0 && stats.in_flight == 0;
+        pass &= stats.cancelled - prev.cancelled == cancelled;
+
+        if (!pass)
+            PEN_LOG("[async_io] callbacks failed, %i errors", s_errors.load());
+
+        return pass;
+    }
+} // namespace
+
+void* pen::user_entry(void* params)
+{
+    // unpack the params passed to the thread and signal to the engine it ok to proceed
+    pen::job_thread_params* job_params = (pen::job_thread_params*)params;
+    pen::job*               p_thread_info = job_params->job_info;
+    pen::semaphore_post(p_thread_info->p_sem_continue, 1);
+
+    bool pass = write_test_file();
+    pass = pass && test_reads();
+    pass = pass && test_callbacks();
+
+    remove(k_test_file);
+    pen::memory_free(s_file_data);
+
+    if (pass)
+        PEN_LOG("[async_io] passed");
+    else
+        PEN_LOG("[async_io] failed");
+
+    for (;;)
+    {
+        pen::thread_sleep_ms(16);
+
+        // msg from the engine we want to terminate
+        if (pen::semaphore_try_wait(p_thread_info->p_sem_exit))
+        {
+            break;
+        }
+    }
+
+    // signal to the engine the thread has finished
+    pen::semaphore_post(p_thread_info->p_sem_terminated, 1);
+
+    return PEN_THREAD_OK;
+}
@@ -0,0 +1,557 @@
+#include "console.h"
+#include "pen.h"
+#include "tasks.h"
+#include "threads.h"
+#include "timer.h"
+
+#include "aabb_tree.h"
+#include "ecs/ecs_bounds.h"
+
+#include "maths/maths.h"
+
+#include <algorithm>
+#include <vector>
+
+using namespace put;
+
+void* pen::user_entry(void* params);
+namespace pen
+{
+    pen_creation_params pen_entry(int argc, char** argv)
+    {
+        pen::pen_creation_params p;
+        p.window_width = 1280;
+        p.window_height = 720;
+        p.window_title = "bounds_benchmark";
+        p.window_sample_count = 4;
+        p.user_thread_function = user_entry;
+        p.flags = pen::e_pen_create_flags::console_app;
+        return p;
+    }
+} // namespace pen
+
+namespace
+{
+    const u32 k_counts[] = {10000, 100000, 1000000};
+    const u32 k_grain_size = 256;
+    const f32 k_epsilon = 1e-3f;
+
+    f32 random_range(f32 min, f32 max)
+    {
+        return min + ((f32)(rand() % RAND_MAX) / RAND_MAX) * (max - min);
+    }
+
+    vec3f random_vec3(f32 min, f32 max)
+    {
+        return vec3f(random_range(min, max), random_range(min, max), random_range(min, max));
+    }
+
+    struct bench_data
+    {
+        std::vector<vec3f> local_min;
+        std::vector<vec3f> local_max;
+        std::vector<mat4>  world;
+        std::vector<u32>   parents;
+
+        // 8 corner reference, as update_scene used to do it
+        std::vector<vec3f> ref_min;
+        std::vector<vec3f> ref_max;
+        std::vector<f32>   ref_radius;
+    };
+
+    void generate(bench_data& bd, u32 count)
+    {
+        bd.local_min.resize(count);
+        bd.local_max.resize(count);
+        bd.world.resize(count);
+        bd.parents.resize(count);
+
+        for (u32 i = 0; i < count; ++i)
+        {
+            vec3f c = random_vec3(-10.0f, 10.0f);
+            vec3f e = random_vec3(0.1f, 5.0f);
+            bd.local_min[i] = c - e;
+            bd.local_max[i] = c + e;
+
+            f32 x = maths::deg_to_rad(random_range(-180.0f, 180.0f));
+            f32 y = maths::deg_to_rad(random_range(-180.0f, 180.0f));
+            f32 z = maths::deg_to_rad(random_range(-180.0f, 180.0f));
+
+            quat q;
+            q.euler_angles(z, y, x);
+
+            mat4 rot;
+            q.get_matrix(rot);
+
+            mat4 translation = mat::create_translation(random_vec3(-1000.0f, 1000.0f));
+            mat4 scale = mat::create_scale(random_vec3(0.5f, 2.0f));
+            bd.world[i] = translation * rot * scale;
+
+            // shallow hierarchies, parents always come before children
+            bd.parents[i] = i == 0 || rand() % 4 == 0 ? i : i - 1 - (rand() % min<u32>(i, 8));
+        }
+    }
+
+    void transform_corners(bench_data& bd, u32 count)
+    {
+        static vec3f corners[] = {vec3f(0.0f, 0.0f, 0.0f), vec3f(1.0f, 0.0f, 0.0f), vec3f(0.0f, 1.0f, 0.0f),
+                                  vec3f(0.0f, 0.0f, 1.0f), vec3f(1.0f, 1.0f, 0.0f), vec3f(0.0f, 1.0f, 1.0f),
+                                  vec3f(1.0f, 0.0f, 1.0f), vec3f(1.0f, 1.0f, 1.0f)};
+
+        bd.ref_min.resize(count);
+        bd.ref_max.resize(count);
+        bd.ref_radius.resize(count);
+
+        for (u32 n = 0; n < count; ++n)
+        {
+            vec3f min = bd.local_min[n];
+            vec3f max = bd.local_max[n] - min;
+
+            vec3f tmax = -vec3f::flt_max();
+            vec3f tmin = vec3f::flt_max();
+
+            for (s32 c = 0; c < 8; ++c)
+            {
+                vec3f p = bd.world[n].transform_vector(min + max * corners[c]);
+
+                tmax = max_union(tmax, p);
+                tmin = min_union(tmin, p);
+            }
+
+            bd.ref_min[n] = tmin;
+            bd.ref_max[n] = tmax;
+            bd.ref_radius[n] = mag(tmax - tmin) * 0.5f;
+        }
+    }
+
+    void expand_parents(std::vector<vec3f>& tmin, std::vector<vec3f>& tmax, const std::vector<u32>& parents)
+    {
+        for (u32 n = (u32)parents.size() - 1; n > 0; --n)
+        {
+            u32 p = parents[n];
+            if (p == n)
+                continue;
+
+            tmin[p] = min_union(tmin[p], tmin[n]);
+            tmax[p] = max_union(tmax[p], tmax[n]);
+        }
+    }
+
+    f32 max_error(const ecs::bounds_batch& batch, const bench_data& bd, u32 count)
+    {
+        f32 err = 0.0f;
+        for (u32 i = 0; i < count; ++i)
+        {
+            vec3f bmin, bmax;
+            f32   radius;
+            ecs::bounds_batch_get(batch, i, bmin, bmax, radius);
+
+            // relative to the size of the world so translation does not dominate
+            f32 scale = max(mag(bd.ref_max[i]), 1.0f);
+            err = max(err, mag(bmin - bd.ref_min[i]) / scale);
+            err = max(err, mag(bmax - bd.ref_max[i]) / scale);
+            err = max(err, fabsf(radius - bd.ref_radius[i]) / scale);
+        }
+
+        return err;
+    }
+
+    // box shaped frustum around the origin with outward facing normals
+    frustum box_frustum(f32 size)
+    {
+        frustum f;
+        vec3f   axes[] = {vec3f(1.0f, 0.0f, 0.0f), vec3f(0.0f, 1.0f, 0.0f), vec3f(0.0f, 0.0f, 1.0f)};
+        for (u32 i = 0; i < 3; ++i)
+        {
+            f.n[i * 2 + 0] = axes[i];
+            f.p[i * 2 + 0] = axes[i] * size;
+            f.n[i * 2 + 1] = -axes[i];
+            f.p[i * 2 + 1] = -axes[i] * size;
+        }
+
+        return f;
+    }
+
+    bool cull_benchmark(const ecs::bounds_batch& batch, u32 count)
+    {
+        ecs::sphere_batch spheres;
+        ecs::sphere_batch_reserve(spheres, count);
+        for (u32 i = 0; i < count; ++i)
+        {
+            vec3f bmin, bmax;
+            f32   radius;
+            ecs::bounds_batch_get(batch, i, bmin, bmax, radius);
+            ecs::sphere_batch_set(spheres, i, bmin + (bmax - bmin) * 0.5f, radius);
+        }
+
+        frustum f = box_frustum(500.0f);
+
+        std::vector<u32> scalar_visible(count);
+        std::vector<u32> simd_visible(count);
+
+        pen::timer* t = pen::timer_create();
+
+        pen::timer_start(t);
+        u32 num_scalar = ecs::cull_spheres_scalar(spheres, f, 0, count, scalar_visible.data());
+        f32 scalar_ms = pen::timer_elapsed_ms(t);
+
+        pen::timer_start(t);
+        u32 num_simd = ecs::cull_spheres(spheres, f, 0, count, simd_visible.data());
+        f32 simd_ms = pen::timer_elapsed_ms(t);
+
+        // ranges split at unaligned positions must give the same list
+        u32 split = count / 3 + 1;
+        u32 num_split = ecs::cull_spheres(spheres, f, 0, split, simd_visible.data());
+        num_split += ecs::cull_spheres(spheres, f, split, count, simd_visible.data() + num_split);
+
+        bool pass = num_scalar == num_simd && num_split == num_simd;
+        for (u32 i = 0; pass && i < num_simd; ++i)
+            pass = scalar_visible[i] == simd_visible[i];
+
+        PEN_LOG("    cull scalar: %f ms, simd: %f ms (%.2fx), visible %i / %i", scalar_ms, simd_ms, scalar_ms / simd_ms,
+                num_simd, count);
+
+        if (!pass)
+            PEN_LOG("[bounds] simd cull does not match scalar (%i, %i, %i)", num_scalar, num_simd, num_split);
+
+        pen::timer_destroy(t);
+        ecs::sphere_batch_free(spheres);
+        return pass;
+    }
+
+    bool overlaps(const vec3f& amin, const vec3f& amax, const vec3f& bmin, const vec3f& bmax)
+    {
+        for (u32 i = 0; i < 3; ++i)
+            if (amax[i] < bmin[i] || amin[i] > bmax[i])
+                return false;
+
+        return true;
+    }
+
+    bool ray_hits(const vec3f& min, const vec3f& max, const vec3f& origin, const vec3f& dir, f32 max_t)
+    {
+        f32 t0 = 0.0f;
+        f32 t1 = max_t;
+        for (u32 i = 0; i < 3; ++i)
+        {
+            f32 ta = (min[i] - origin[i]) / dir[i];
+            f32 tb = (max[i] - origin[i]) / dir[i];
+            t0 = std::max(t0, std::min(ta, tb));
+            t1 = std::min(t1, std::max(ta, tb));
+        }
+
+        return t0 <= t1;
+    }
+
+    bool aabb_in_frustum(const frustum& f, const vec3f& min, const vec3f& max)
+    {
+        vec3f c = (min + max) * 0.5f;
+        vec3f e = (max - min) * 0.5f;
+        for (u32 p = 0; p < 6; ++p)
+        {
+            f32 d = dot(f.n[p], c - f.p[p]);
+            f32 r = fabsf(f.n[p].x) * e.x + fabsf(f.n[p].y) * e.y + fabsf(f.n[p].z) * e.z;
+            if (d > r)
+                return false;
+        }
+
+        return true;
+    }
+
+    // tree results must contain every exact hit and only hits of the fat aabbs
+    bool check_query(std::vector<u32>& results, u32 num_results, const std::vector<u8>& exact, const std::vector<u8>& fat)
+    {
+        if (num_results > results.size())
+            return false;
+
+        std::vector<u8> found(exact.size(), 0);
+        for (u32 i = 0; i < num_results; ++i)
+        {
+            u32 r = results[i];
+            if (found[r] || !fat[r])
+                return false;
+
+            found[r] = 1;
+        }
+
+        for (u32 i = 0; i < exact.size(); ++i)
+            if (exact[i] && !found[i])
+                return false;
+
+        return true;
+    }
+
+    bool tree_queries(const aabb_tree& tree, const std::vector<s32>& proxies, const std::vector<vec3f>& tmin,
+                      const std::vector<vec3f>& tmax)
+    {
+        u32              count = (u32)proxies.size();
+        std::vector<u32> results(count);
+        std::vector<u8>  exact(count), fat(count);
+
+        bool pass = true;
+        for (u32 q = 0; q < 8; ++q)
+        {
+            // aabb
+            vec3f qmin = random_vec3(-1000.0f, 1000.0f);
+            vec3f qmax = qmin + random_vec3(1.0f, 200.0f);
+
+            for (u32 i = 0; i < count; ++i)
+            {
+                const aabb_tree_node& n = tree.nodes[proxies[i]];
+                exact[i] = overlaps(tmin[i], tmax[i], qmin, qmax);
+                fat[i] = overlaps(n.min, n.max, qmin, qmax);
+            }
+
+            u32 num = aabb_tree_query_aabb(tree, qmin, qmax, results.data(), count);
+            pass &= check_query(results, num, exact, fat);
+
+            // sphere
+            vec3f pos = random_vec3(-1000.0f, 1000.0f);
+            f32   radius = random_range(1.0f, 200.0f);
+
+            for (u32 i = 0; i < count; ++i)
+            {
+                const aabb_tree_node& n = tree.nodes[proxies[i]];
+
+                vec3f cp = min_union(max_union(pos, tmin[i]), tmax[i]);
+                exact[i] = dot(cp - pos, cp - pos) <= radius * radius;
+
+                cp = min_union(max_union(pos, n.min), n.max);
+                fat[i] = dot(cp - pos, cp - pos) <= radius * radius;
+            }
+
+            num = aabb_tree_query_sphere(tree, pos, radius, results.data(), count);
+            pass &= check_query(results, num, exact, fat);
+
+            // ray
+            vec3f origin = random_vec3(-1000.0f, 1000.0f);
+            vec3f dir = random_vec3(-1.0f, 1.0f);
+            f32   max_t = 500.0f;
+
+            for (u32 i = 0; i < count; ++i)
+            {
+                const aabb_tree_node& n = tree.nodes[proxies[i]];
+                exact[i] = ray_hits(tmin[i], tmax[i], origin, dir, max_t);
+                fat[i] = ray_hits(n.min, n.max, origin, dir, max_t);
+            }
+
+            num = aabb_tree_query_ray(tree, origin, dir, max_t, results.data(), count);
+            pass &= check_query(results, num, exact, fat);
+        }
+
+        if (!pass)
+            PEN_LOG("[bounds] aabb tree queries do not match brute force");
+
+        return pass;
+    }
+
+    bool tree_benchmark(const ecs::bounds_batch& batch, u32 count)
+    {
+        std::vector<vec3f> tmin(count), tmax(count);
+        std::vector<f32>   radius(count);
+
+        ecs::sphere_batch spheres;
+        ecs::sphere_batch_reserve(spheres, count);
+        for (u32 i = 0; i < count; ++i)
+        {
+            ecs::bounds_batch_get(batch, i, tmin[i], tmax[i], radius[i]);
+            ecs::sphere_batch_set(spheres, i, tmin[i] + (tmax[i] - tmin[i]) * 0.5f, radius[i]);
+        }
+
+        pen::timer* t = pen::timer_create();
+
+        aabb_tree        tree;
+        std::vector<s32> proxies(count);
+
+        pen::timer_start(t);
+        for (u32 i = 0; i < count; ++i)
+            proxies[i] = aabb_tree_create_proxy(tree, tmin[i], tmax[i], i);
+        f32 build_ms = pen::timer_elapsed_ms(t);
+
+        bool pass = aabb_tree_validate(tree);
+
+        // leaves are tested as aabbs, which are tighter than the spheres used by the linear cull
+        frustum          f = box_frustum(200.0f);
+        std::vector<u32> linear_visible(count);
+        std::vector<u32> tree_visible(count);
+
+        pen::timer_start(t);
+        u32 num_linear = ecs::cull_spheres(spheres, f, 0, count, linear_visible.data());
+        f32 linear_ms = pen::timer_elapsed_ms(t);
+
+        pen::timer_start(t);
+        u32 num_tree = aabb_tree_query_frustum(tree, f, tree_visible.data(), count);
+        f32 tree_ms = pen::timer_elapsed_ms(t);
+
+        std::vector<u8> exact(count), fat(count);
+        for (u32 i = 0; i < count; ++i)
+        {
+            const aabb_tree_node& n = tree.nodes[proxies[i]];
+            exact[i] = aabb_in_frustum(f, tmin[i], tmax[i]);
+            fat[i] = aabb_in_frustum(f, n.min, n.max);
+        }
+
+        if (!check_query(tree_visible, num_tree, exact, fat))
+        {
+            PEN_LOG("[bounds] aabb tree cull does not match brute force");
+            pass = false;
+        }
+
+        pass &= tree_queries(tree, proxies, tmin, tmax);
+
+        // small moves stay inside the fat aabbs, large ones are reinserted
+        u32 reinserted = 0;
+
+        pen::timer_start(t);
+        for (u32 i = 0; i < count; ++i)
+        {
+            vec3f offset = i % 8 == 0 ? random_vec3(-100.0f, 100.0f) : random_vec3(-0.05f, 0.05f);
+            tmin[i] += offset;
+            tmax[i] += offset;
+
+            if (aabb_tree_move_proxy(tree, proxies[i], tmin[i], tmax[i]))
+                reinserted++;
+        }
+        f32 move_ms = pen::timer_elapsed_ms(t);
+
+        pass &= aabb_tree_validate(tree);
+        pass &= tree_queries(tree, proxies, tmin, tmax);
+
+        // remove half and check the rest are still found
+        for (u32 i = 0; i < count; i += 2)
+            aabb_tree_destroy_proxy(tree, proxies[i]);
+
+        pass &= aabb_tree_validate(tree) && tree.num_leaves == count / 2;
+
+        PEN_LOG("    tree build: %f ms, height %i", build_ms, aabb_tree_height(tree));
+        PEN_LOG("    tree cull: %f ms (%.2fx linear), visible %i / %i, linear spheres visible %i", tree_ms,
+                linear_ms / tree_ms, num_tree, count, num_linear);
+        PEN_LOG("    tree move: %f ms, reinserted %i / %i", move_ms, reinserted, count);
+
+        if (!pass)
+            PEN_LOG("[bounds] aabb tree failed");
+
+        aabb_tree_clear(tree);
+        ecs::sphere_batch_free(spheres);
+        pen::timer_destroy(t);
+        return pass;
+    }
+
+    bool run_benchmarks()
+    {
+        bool pass = true;
+
+        PEN_LOG("[bounds] isa: %s, workers: %i", ecs::transform_bounds_isa(), pen::task_scheduler_num_workers());
+
+        pen::timer* t = pen::timer_create();
+        for (u32 c = 0; c < PEN_ARRAY_SIZE(k_counts); ++c)
+        {
+            u32        count = k_counts[c];
+            bench_data bd;
+            generate(bd, count);
+
+            pen::timer_start(t);
+            transform_corners(bd, count);
+            f32 corners_ms = pen::timer_elapsed_ms(t);
+
+            ecs::bounds_batch batch;
+
+            pen::timer_start(t);
+            ecs::bounds_batch_reserve(batch, count);
+            for (u32 i = 0; i < count; ++i)
+                ecs::bounds_batch_set(batch, i, bd.local_min[i], bd.local_max[i], bd.world[i]);
+            f32 gather_ms = pen::timer_elapsed_ms(t);
+
+            pen::timer_start(t);
+            ecs::transform_bounds_scalar(batch, 0, count);
+            f32 scalar_ms = pen::timer_elapsed_ms(t);
+            f32 scalar_err = max_error(batch, bd, count);
+
+            pen::timer_start(t);
+            ecs::transform_bounds(batch, 0, count);
+            f32 simd_ms = pen::timer_elapsed_ms(t);
+            f32 simd_err = max_error(batch, bd, count);
+
+            pen::timer_start(t);
+            pen::task_parallel_for_wait(0, count, k_grain_size, ecs::transform_bounds_task, &batch);
+            f32 parallel_ms = pen::timer_elapsed_ms(t);
+            f32 parallel_err = max_error(batch, bd, count);
+
+            // parent expansion runs after the transform
+            std::vector<vec3f> tmin(count), tmax(count);
+            for (u32 i = 0; i < count; ++i)
+            {
+                f32 radius;
+                ecs::bounds_batch_get(batch, i, tmin[i], tmax[i], radius);
+            }
+
+            pen::timer_start(t);
+            expand_parents(tmin, tmax, bd.parents);
+            f32 expand_ms = pen::timer_elapsed_ms(t);
+
+            expand_parents(bd.ref_min, bd.ref_max, bd.parents);
+
+            f32 expand_err = 0.0f;
+            for (u32 i = 0; i < count; ++i)
+            {
+                f32 scale = max(mag(bd.ref_max[i]), 1.0f);
+                expand_err = max(expand_err, mag(tmin[i] - bd.ref_min[i]) / scale);
+                expand_err = max(expand_err, mag(tmax[i] - bd.ref_max[i]) / scale);
+            }
+
+            PEN_LOG("[bounds] %i entities", count);
+            PEN_LOG("    8 corners: %f ms", corners_ms);
+            PEN_LOG("    gather: %f ms", gather_ms);
+            PEN_LOG("    scalar: %f ms (%.2fx), error %e", scalar_ms, corners_ms / scalar_ms, scalar_err);
+            PEN_LOG("    simd: %f ms (%.2fx), error %e", simd_ms, corners_ms / simd_ms, simd_err);
+            PEN_LOG("    simd parallel: %f ms (%.2fx), error %e", parallel_ms, corners_ms / parallel_ms, parallel_err);
+            PEN_LOG("    expand parents: %f ms, error %e", expand_ms, expand_err);
+
+            if (scalar_err > k_epsilon || simd_err > k_epsilon || parallel_err > k_epsilon || expand_err > k_epsilon)
+            {
+                PEN_LOG("[bounds] results do not match the 8 corner transform");
+                pass = false;
+            }
+
+            if (!cull_benchmark(batch, count))
+                pass = false;
+
+            if (!tree_benchmark(batch, count))
+                pass = false;
+
+            ecs::bounds_batch_free(batch);
+        }
+
+        pen::timer_destroy(t);
+        return pass;
+    }
+} // namespace
+
+void* pen::user_entry(void* params)
+{
+    // unpack the params passed to the thread and signal to the engine it ok to proceed
+    pen::job_thread_params* job_params = (pen::job_thread_params*)params;
+    pen::job*               p_thread_info = job_params->job_info;
+    pen::semaphore_post(p_thread_info->p_sem_continue, 1);
+
+    if (run_benchmarks())
+        PEN_LOG("[bounds] passed");
+    else
+        PEN_LOG("[bounds] failed");
+
+    for (;;)
+    {
+        pen::thread_sleep_ms(16);
+
+        // msg from the engine we want to terminate
+        if (pen::semaphore_try_wait(p_thread_info->p_sem_exit))
+        {
+            break;
+        }
+    }
+
+    // signal to the engine the thread has finished
+    pen::semaphore_post(p_thread_info->p_sem_terminated, 1);
+
+    return PEN_THREAD_OK;
+}
@@ -0,0 +1,413 @@
+#include "console.h"
+#include "data_struct.h"
+#include "pen.h"
+#include "threads.h"
+#include "timer.h"
+
+void* pen::user_entry(void* params);
+namespace pen
+{
+    pen_creation_params pen_entry(int argc, char** argv)
+    {
+        pen::pen_creation_params p;
+        p.window_width = 1280;
+        p.window_height = 720;
+        p.window_title = "concurrent_containers";
+        p.window_sample_count = 4;
+        p.user_thread_function = user_entry;
+        p.flags = pen::e_pen_create_flags::console_app;
+        return p;
+    }
+} // namespace pen
+
+namespace
+{
+    const u32 k_num_producers = 4;
+    const u32 k_num_consumers = 4;
+    const u32 k_items_per_producer = 1 << 18;
+    const u32 k_spsc_items = 1 << 20;
+
+    // runs a function on a detached thread and posts a semaphore when done
+    struct test_thread
+    {
+        void (*func)(void* user_data, u32 index);
+        void*           user_data;
+        u32             index;
+        pen::semaphore* done;
+    };
+
+    void* test_thread_entry(void* params)
+    {
+        test_thread* tt = (test_thread*)params;
+        tt->func(tt->user_data, tt->index);
+        pen::semaphore_post(tt->done, 1);
+        return PEN_THREAD_OK;
+    }
+
+    void run_threads(void (*func)(void*, u32), void* user_data, u32 num_threads, test_thread* threads, pen::semaphore* done)
+    {
+        for (u32 i = 0; i < num_threads; ++i)
+        {
+            threads[i] = {func, user_data, i, done};
+            pen::thread_create(test_thread_entry, 64 * 1024, &threads[i], pen::e_thread_start_flags::detached);
+        }
+    }
+
+    void wait_threads(u32 num_threads, pen::semaphore* done)
+    {
+        for (u32 i = 0; i < num_threads; ++i)
+            pen::semaphore_wait(done);
+    }
+
+    //
+    // mpmc queue: items encode producer and sequence, consumers check per producer order and the total
+    //
+
+    struct mpmc_test
+    {
+        pen::mpmc_queue<u64> queue;
+        a_u64                sum = {0};
+        a_u32                consumed = {0};
+        a_u32                order_errors = {0};
+    };
+
+    void mpmc_producer(void* user_data, u32 index)
+    {
+        mpmc_test* t = (mpmc_test*)user_data;
+        for (u32 i = 0; i < k_items_per_producer; ++i)
+        {
+            u64 item = ((u64)index << 32) | (u64)i;
+
+            // mix blocking and non blocking api
+            if (i & 1)
+                t->queue.push(item);
+            else
+                while (!t->queue.try_push(item))
+                    pen::thread_yield();
+        }
+    }
+
+    void mpmc_consumer(void* user_data, u32 index)
+    {
+        mpmc_test* t = (mpmc_test*)user_data;
+
+        s64 last[k_num_producers];
+        for (u32 i = 0; i < k_num_producers; ++i)
+            last[i] = -1;
+
+        const u32 total = k_num_producers * k_items_per_producer;
+        u64       sum = 0;
+        while (t->consumed.load() < total)
+        {
+            u64 item;
+            if (!t->queue.try_pop(item))
+            {
+                pen::thread_yield();
+                continue;
+            }
+
+            t->consumed++;
+
+            u32 producer = (u32)(item >> 32);
+            s64 seq = (s64)(item & 0xffffffff);
+            if (seq <= last[producer])
+                t->order_errors++;
+
+            last[producer] = seq;
+            sum += seq;
+        }
+
+        t->sum += sum;
+    }
+
+    bool test_mpmc_queue(test_thread* threads, pen::semaphore* done)
+    {
+        // mpmc_queue is cache line aligned, keep it on the stack since new ignores over-alignment before c++17
+        mpmc_test  test;
+        mpmc_test* t = &test;
+        t->queue.create(1024);
+
+        run_threads(mpmc_consumer, t, k_num_consumers, threads, done);
+        run_threads(mpmc_producer, t, k_num_producers, threads + k_num_consumers, done);
+        wait_threads(k_num_consumers + k_num_producers, done);
+
+        u64 expected = (u64)k_num_producers * ((u64)k_items_per_producer * (k_items_per_producer - 1) / 2);
+
+        bool pass = true;
+        if (t->sum.load() != expected || t->order_errors.load() != 0)
+        {
+            PEN_LOG("[concurrent_containers] mpmc_queue failed: sum %llu != %llu, order errors %i", t->sum.load(), expected,
+                    t->order_errors.load());
+            pass = false;
+        }
+
+        // bounds
+        pen::mpmc_queue<u32> bq;
+        bq.create(5);
+        u32 pushed = 0;
+        while (bq.try_push(pushed))
+            ++pushed;
+
+        u32 v;
+        if (pushed != bq.capacity() || !bq.try_pop(v) || v != 0)
+        {
+            PEN_LOG("[concurrent_containers] mpmc_queue full / empty semantics failed");
+            pass = false;
+        }
+
+        return pass;
+    }
+
+    //
+    // spsc queue: small blocks to force lots of growth while the consumer is freeing drained blocks
+    //
+
+    struct spsc_test
+    {
+        pen::spsc_queue<u32> queue;
+        a_u32                errors = {0};
+    };
+
+    void spsc_producer(void* user_data, u32 index)
+    {
+        spsc_test* t = (spsc_test*)user_data;
+        for (u32 i = 0; i < k_spsc_items; ++i)
+            t->queue.push(i);
+    }
+
+    void spsc_consumer(void* user_data, u32 index)
+    {
+        spsc_test* t = (spsc_test*)user_data;
+        u32        expected = 0;
+        while (expected < k_spsc_items)
+        {
+            u32* item = t->queue.peek();
+            if (!item)
+            {
+                pen::thread_yield();
+                continue;
+            }
+
+            if (*item != expected)
+                t->errors++;
+
+            t->queue.pop();
+            ++expected;
+        }
+    }
+
+    bool test_spsc_queue(test_thread* threads, pen::semaphore* done)
+    {
+        spsc_test* t = new spsc_test();
+        t->queue.create(16, 4096);
+
+        run_threads(spsc_consumer, t, 1, threads, done);
+        run_threads(spsc_producer, t, 1, threads + 1, done);
+        wait_threads(2, done);
+
+        bool pass = t->errors.load() == 0;
+        if (!pass)
+            PEN_LOG("[concurrent_containers] spsc_queue failed: %i items out of order", t->errors.load());
+
+        u32 v;
+        if (t->queue.try_pop(v))
+        {
+            PEN_LOG("[concurrent_containers] spsc_queue not empty after consuming all items");
+            pass = false;
+        }
+
+        delete t;
+        return pass;
+    }
+
+    //
+    // ring buffer: small capacity so put has to wait on the consumer instead of overwriting
+    //
+
+    struct ring_test
+    {
+        pen::ring_buffer<u32> ring;
+        a_u32                 errors = {0};
+    };
+
+    void ring_producer(void* user_data, u32 index)
+    {
+        ring_test* t = (ring_test*)user_data;
+        for (u32 i = 0; i < k_spsc_items; ++i)
+            t->ring.put(i);
+    }
+
+    void ring_consumer(void* user_data, u32 index)
+    {
+        ring_test* t = (ring_test*)user_data;
+        u32        expected = 0;
+        while (expected < k_spsc_items)
+        {
+            u32* item = t->ring.get();
+            if (!item)
+            {
+                pen::thread_yield();
+                continue;
+            }
+
+            if (*item != expected)
+                t->errors++;
+
+            ++expected;
+        }
+    }
+
+    bool test_ring_buffer(test_thread* threads, pen::semaphore* done)
+    {
+        ring_test* t = new ring_test();
+        t->ring.create(64);
+
+        run_threads(ring_consumer, t, 1, threads, done);
+        run_threads(ring_producer, t, 1, threads + 1, done);
+        wait_threads(2, done);
+
+        bool pass = t->errors.load() == 0;
+        if (!pass)
+            PEN_LOG("[concurrent_containers] ring_buffer failed: %i items overwritten or out of order", t->errors.load());
+
+        // full check
+        pen::ring_buffer<u32> fr;
+        fr.create(4);
+        u32 count = 0;
+        while (fr.try_put(count))
+            ++count;
+
+        if (count != 3)
+        {
+            PEN_LOG("[concurrent_containers] ring_buffer full check failed: %i items fit in capacity 4", count);
+            pass = false;
+        }
+
+        delete t;
+        return pass;
+    }
+
+    //
+    // concurrent vector: writers push while a reader checks every element below size() is visible
+    //
+
+    struct vector_test
+    {
+        pen::concurrent_vector<u32> vec;
+        a_u32                       writers_done = {0};
+        a_u32                       errors = {0};
+    };
+
+    void vector_writer(void* user_data, u32 index)
+    {
+        vector_test* t = (vector_test*)user_data;
+        for (u32 i = 0; i < k_items_per_producer; ++i)
+            t->vec.push_back(index * k_items_per_producer + i + 1);
+
+        t->writers_done++;
+    }
+
+    void vector_reader(void* user_data, u32 index)
+    {
+        vector_test* t = (vector_test*)user_data;
+        while (t->writers_done.load() < k_num_producers)
+        {
+            u32 size = t->vec.size();
+            u32 start = size > 1024 ? size - 1024 : 0;
+            for (u32 i = start; i < size; ++i)
+                if (t->vec[i] == 0)
+                    t->errors++;
+
+            pen::thread_yield();
+        }
+    }
+
+    bool test_concurrent_vector(test_thread* threads, pen::semaphore* done)
+    {
+        vector_test* t = new vector_test();
+
+        run_threads(vector_reader, t, 1, threads, done);
+        run_threads(vector_writer, t, k_num_producers, threads + 1, done);
+        wait_threads(k_num_producers + 1, done);
+
+        bool pass = true;
+        u32  total = k_num_producers * k_items_per_producer;
+        if (t->vec.size() != total || t->errors.load() != 0)
+        {
+            PEN_LOG("[concurrent_containers] concurrent_vector failed: size %i != %i, unpublished reads %i", t->vec.size(),
+                    total, t->errors.load());
+            pass = false;
+        }
+
+        // every value pushed exactly once
+        u8* seen = new u8[total + 1];
+        memset(seen, 0x0, total + 1);
+        for (u32 i = 0; i < t->vec.size(); ++i)
+            seen[t->vec[i]]++;
+
+        for (u32 i = 1; i <= total; ++i)
+        {
+            if (seen[i] != 1)
+            {
+                PEN_LOG("[concurrent_containers] concurrent_vector failed: value %i seen %i times", i, seen[i]);
+                pass = false;
+                break;
+            }
+        }
+
+        delete[] seen;
+        delete t;
+        return pass;
+    }
+
+    bool run_tests()
+    {
+        bool            pass = true;
+        test_thread     threads[k_num_producers + k_num_consumers];
+        pen::semaphore* done = pen::semaphore_create(0, k_num_producers + k_num_consumers);
+
+        pen::timer* t = pen::timer_create();
+        pen::timer_start(t);
+
+        pass &= test_mpmc_queue(threads, done);
+        pass &= test_spsc_queue(threads, done);
+        pass &= test_ring_buffer(threads, done);
+        pass &= test_concurrent_vector(threads, done);
+
+        PEN_LOG("[concurrent_containers] stress tests completed in %f ms", pen::timer_elapsed_ms(t));
+
+        pen::timer_destroy(t);
+        pen::semaphore_destroy(done);
+
+        return pass;
+    }
+} // namespace
+
+void* pen::user_entry(void* params)
+{
+    // unpack the params passed to the thread and signal to the engine it ok to proceed
+    pen::job_thread_params* job_params = (pen::job_thread_params*)params;
+    pen::job*               p_thread_info = job_params->job_info;
+    pen::semaphore_post(p_thread_info->p_sem_continue, 1);
+
+    if (run_tests())
+        PEN_LOG("[concurrent_containers] passed");
+    else
+        PEN_LOG("[concurrent_containers] failed");
+
+    for (;;)
+    {
+        pen::thread_sleep_ms(16);
+
+        // msg from the engine we want to terminate
+        if (pen::semaphore_try_wait(p_thread_info->p_sem_exit))
+        {
+            break;
+        }
+    }
+
+    // signal to the engine the thread has finished
+    pen::semaphore_post(p_thread_info->p_sem_terminated, 1);
+
+    return PEN_THREAD_OK;
+}
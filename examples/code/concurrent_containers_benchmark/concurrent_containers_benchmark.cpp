@@ -0,0 +1,274 @@
+#include "console.h"
+#include "data_struct.h"
+#include "pen.h"
+#include "threads.h"
+#include "timer.h"
+
+#include <vector>
+
+void* pen::user_entry(void* params);
+namespace pen
+{
+    pen_creation_params pen_entry(int argc, char** argv)
+    {
+        pen::pen_creation_params p;
+        p.window_width = 1280;
+        p.window_height = 720;
+        p.window_title = "concurrent_containers_benchmark";
+        p.window_sample_count = 4;
+        p.user_thread_function = user_entry;
+        p.flags = pen::e_pen_create_flags::console_app;
+        return p;
+    }
+} // namespace pen
+
+namespace
+{
+    const u32 k_max_threads = 16;
+    const u32 k_num_items = 1 << 20;
+
+    struct bench_thread
+    {
+        void (*func)(void* user_data, u32 index, u32 num_threads);
+        void*           user_data;
+        u32             index;
+        u32             num_threads;
+        pen::semaphore* done;
+    };
+
+    struct bench_ctx
+    {
+        pen::mpmc_queue<u32>        mpmc;
+        pen::spsc_queue<u32>        spsc;
+        pen::ring_buffer<u32>       ring;
+        pen::concurrent_vector<u32> vec;
+        std::vector<u32>            locked_vec;
+        pen::mutex*                 mut;
+        a_u32                       consumed = {0};
+        a_u32                       start = {0};
+    };
+
+    bench_thread    s_threads[k_max_threads];
+    pen::semaphore* s_done;
+
+    void* bench_thread_entry(void* params)
+    {
+        bench_thread* bt = (bench_thread*)params;
+        bt->func(bt->user_data, bt->index, bt->num_threads);
+        pen::semaphore_post(bt->done, 1);
+        return PEN_THREAD_OK;
+    }
+
+    // threads spin on ctx->start so creation time is not measured
+    f32 run(void (*producer)(void*, u32, u32), u32 num_producers, void (*consumer)(void*, u32, u32), u32 num_consumers,
+            bench_ctx* ctx)
+    {
+        ctx->consumed = 0;
+        ctx->start = 0;
+
+        u32 n = 0;
+        for (u32 i = 0; i < num_producers; ++i, ++n)
+        {
+            s_threads[n] = {producer, ctx, i, num_producers, s_done};
+            pen::thread_create(bench_thread_entry, 64 * 1024, &s_threads[n], pen::e_thread_start_flags::detached);
+        }
+
+        for (u32 i = 0; i < num_consumers; ++i, ++n)
+        {
+            s_threads[n] = {consumer, ctx, i, num_consumers, s_done};
+            pen::thread_create(bench_thread_entry, 64 * 1024, &s_threads[n], pen::e_thread_start_flags::detached);
+        }
+
+        pen::timer* t = pen::timer_create();
+        pen::timer_start(t);
+        ctx->start = 1;
+
+        for (u32 i = 0; i < n; ++i)
+            pen::semaphore_wait(s_done);
+
+        f32 ms = pen::timer_elapsed_ms(t);
+        pen::timer_destroy(t);
+        return ms;
+    }
+
+    void wait_start(bench_ctx* ctx)
+    {
+        while (!ctx->start.load())
+            pen::thread_yield();
+    }
+
+    void mpmc_producer(void* user_data, u32 index, u32 num_threads)
+    {
+        bench_ctx* ctx = (bench_ctx*)user_data;
+        wait_start(ctx);
+
+        for (u32 i = index; i < k_num_items; i += num_threads)
+            ctx->mpmc.push(i);
+    }
+
+    void mpmc_consumer(void* user_data, u32 index, u32 num_threads)
+    {
+        bench_ctx* ctx = (bench_ctx*)user_data;
+        wait_start(ctx);
+
+        u32 item;
+        while (ctx->consumed.load(std::memory_order_relaxed) < k_num_items)
+        {
+            if (ctx->mpmc.try_pop(item))
+                ctx->consumed++;
+            else
+                pen::thread_yield();
+        }
+    }
+
+    void spsc_producer(void* user_data, u32 index, u32 num_threads)
+    {
+        bench_ctx* ctx = (bench_ctx*)user_data;
+        wait_start(ctx);
+
+        for (u32 i = 0; i < k_num_items; ++i)
+            ctx->spsc.push(i);
+    }
+
+    void spsc_consumer(void* user_data, u32 index, u32 num_threads)
+    {
+        bench_ctx* ctx = (bench_ctx*)user_data;
+        wait_start(ctx);
+
+        u32 item;
+        u32 count = 0;
+        while (count < k_num_items)
+        {
+            if (ctx->spsc.try_pop(item))
+                ++count;
+            else
+                pen::thread_yield();
+        }
+    }
+
+    void ring_producer(void* user_data, u32 index, u32 num_threads)
+    {
+        bench_ctx* ctx = (bench_ctx*)user_data;
+        wait_start(ctx);
+
+        for (u32 i = 0; i < k_num_items; ++i)
+            ctx->ring.put(i);
+    }
+
+    void ring_consumer(void* user_data, u32 index, u32 num_threads)
+    {
+        bench_ctx* ctx = (bench_ctx*)user_data;
+        wait_start(ctx);
+
+        u32 count = 0;
+        while (count < k_num_items)
+        {
+            if (ctx->ring.get())
+                ++count;
+            else
+                pen::thread_yield();
+        }
+    }
+
+    void vector_writer(void* user_data, u32 index, u32 num_threads)
+    {
+        bench_ctx* ctx = (bench_ctx*)user_data;
+        wait_start(ctx);
+
+        for (u32 i = index; i < k_num_items; i += num_threads)
+            ctx->vec.push_back(i);
+    }
+
+    void locked_vector_writer(void* user_data, u32 index, u32 num_threads)
+    {
+        bench_ctx* ctx = (bench_ctx*)user_data;
+        wait_start(ctx);
+
+        for (u32 i = index; i < k_num_items; i += num_threads)
+        {
+            pen::mutex_lock(ctx->mut);
+            ctx->locked_vec.push_back(i);
+            pen::mutex_unlock(ctx->mut);
+        }
+    }
+
+    void none(void* user_data, u32 index, u32 num_threads)
+    {
+    }
+
+    f32 items_per_ms(f32 ms)
+    {
+        return ms > 0.0f ? (f32)k_num_items / ms : 0.0f;
+    }
+
+    void run_benchmarks()
+    {
+        u32 max_threads = min<u32>(max<u32>(pen::thread_get_num_cores() / 2, 1), k_max_threads / 2);
+        s_done = pen::semaphore_create(0, k_max_threads);
+
+        // mpmc_queue is cache line aligned, keep it on the stack since new ignores over-alignment before c++17
+        bench_ctx  bench;
+        bench_ctx* ctx = &bench;
+        ctx->mut = pen::mutex_create();
+
+        PEN_LOG("[benchmark] %i items, %i cores", k_num_items, pen::thread_get_num_cores());
+
+        // mpmc queue with increasing contention
+        ctx->mpmc.create(4096);
+        for (u32 n = 1; n <= max_threads; n *= 2)
+        {
+            f32 ms = run(mpmc_producer, n, mpmc_consumer, n, ctx);
+            PEN_LOG("[benchmark] mpmc_queue %ip/%ic: %f ms, %f items/ms", n, n, ms, items_per_ms(ms));
+        }
+
+        // single producer single consumer, growable queue vs the fixed ring buffer
+        ctx->spsc.create(1024);
+        f32 ms = run(spsc_producer, 1, spsc_consumer, 1, ctx);
+        PEN_LOG("[benchmark] spsc_queue: %f ms, %f items/ms", ms, items_per_ms(ms));
+
+        ctx->ring.create(4096);
+        ms = run(ring_producer, 1, ring_consumer, 1, ctx);
+        PEN_LOG("[benchmark] ring_buffer: %f ms, %f items/ms", ms, items_per_ms(ms));
+
+        // concurrent push back vs mutex and std::vector
+        for (u32 n = 1; n <= max_threads * 2; n *= 2)
+        {
+            ctx->vec.clear();
+            ms = run(vector_writer, n, none, 0, ctx);
+            PEN_LOG("[benchmark] concurrent_vector push_back %i threads: %f ms, %f items/ms", n, ms, items_per_ms(ms));
+
+            ctx->locked_vec.clear();
+            ms = run(locked_vector_writer, n, none, 0, ctx);
+            PEN_LOG("[benchmark] locked std::vector push_back %i threads: %f ms, %f items/ms", n, ms, items_per_ms(ms));
+        }
+
+        pen::mutex_destroy(ctx->mut);
+        pen::semaphore_destroy(s_done);
+    }
+} // namespace
+
+void* pen::user_entry(void* params)
+{
+    // unpack the params passed to the thread and signal to the engine it ok to proceed
+    pen::job_thread_params* job_params = (pen::job_thread_params*)params;
+    pen::job*               p_thread_info = job_params->job_info;
+    pen::semaphore_post(p_thread_info->p_sem_continue, 1);
+
+    run_benchmarks();
+
+    for (;;)
+    {
+        pen::thread_sleep_ms(16);
+
+        // msg from the engine we want to terminate
+        if (pen::semaphore_try_wait(p_thread_info->p_sem_exit))
+        {
+            break;
+        }
+    }
+
+    // signal to the engine the thread has finished
+    pen::semaphore_post(p_thread_info->p_sem_terminated, 1);
+
+    return PEN_THREAD_OK;
+}
@@ -0,0 +1,200 @@
+#include "console.h"
+#include "hash.h"
+#include "pen.h"
+#include "threads.h"
+
+void* pen::user_entry(void* params);
+namespace pen
+{
+    pen_creation_params pen_entry(int argc, char** argv)
+    {
+        pen::pen_creation_params p;
+        p.window_width = 1280;
+        p.window_height = 720;
+        p.window_title = "hash_ids";
+        p.window_sample_count = 4;
+        p.user_thread_function = user_entry;
+        p.flags = pen::e_pen_create_flags::console_app;
+        return p;
+    }
+} // namespace pen
+
+// the compile time hash must be usable in constant expressions
+static_assert(PEN_CONST_HASH("") != PEN_CONST_HASH("a"), "const hash empty string");
+static_assert(PEN_CONST_HASH("wrap_linear") != PEN_CONST_HASH("wrap_point"), "const hash collision");
+
+namespace
+{
+    struct const_id
+    {
+        const c8* name;
+        hash_id   id;
+    };
+
+#define CONST_ID(V)                                                                                                          \
+    {                                                                                                                        \
+        V, PEN_CONST_HASH(V)                                                                                                 \
+    }
+
+    // ids hashed by put code and the names of states, targets and views in assets/configs
+    const const_id k_ids[] = {
+        CONST_ID(""),
+        CONST_ID("_instanced"),
+        CONST_ID("_skinned"),
+        CONST_ID("additive"),
+        CONST_ID("alpha_blend"),
+        CONST_ID("area_light_colour"),
+        CONST_ID("area_light_texture"),
+        CONST_ID("area_light_textures"),
+        CONST_ID("bgra8"),
+        CONST_ID("blit"),
+        CONST_ID("blit_colour_depth"),
+        CONST_ID("blit_depth"),
+        CONST_ID("blit_post_process"),
+        CONST_ID("bloom"),
+        CONST_ID("capsule"),
+        CONST_ID("checkbox"),
+        CONST_ID("clamp_linear"),
+        CONST_ID("clamp_point"),
+        CONST_ID("clear_volume_gi"),
+        CONST_ID("colour_shadow_map"),
+        CONST_ID("colour_shadow_map_depth"),
+        CONST_ID("cone"),
+        CONST_ID("constant_colour"),
+        CONST_ID("cube"),
+        CONST_ID("cubemap"),
+        CONST_ID("cylinder"),
+        CONST_ID("d24s8"),
+        CONST_ID("debug_2d"),
+        CONST_ID("debug_3d"),
+        CONST_ID("default"),
+        CONST_ID("default_material"),
+        CONST_ID("deferred_lights_view"),
+        CONST_ID("deferred_render"),
+        CONST_ID("depth_always"),
+        CONST_ID("depth_equal"),
+        CONST_ID("directional_light"),
+        CONST_ID("disabled"),
+        CONST_ID("forward_lit"),
+        CONST_ID("forward_render"),
+        CONST_ID("front_face_cull"),
+        CONST_ID("full_screen_quad"),
+        CONST_ID("gbuffer_albedo"),
+        CONST_ID("gbuffer_depth"),
+        CONST_ID("gbuffer_normals"),
+        CONST_ID("gbuffer_world_pos"),
+        CONST_ID("input"),
+        CONST_ID("main_colour"),
+        CONST_ID("main_depth"),
+        CONST_ID("main_view"),
+        CONST_ID("msaa_colour"),
+        CONST_ID("msaa_depth"),
+        CONST_ID("no_cull"),
+        CONST_ID("omni_shadow_map"),
+        CONST_ID("picking"),
+        CONST_ID("point_light"),
+        CONST_ID("pre_skin"),
+        CONST_ID("primitive"),
+        CONST_ID("quad"),
+        CONST_ID("r16f"),
+        CONST_ID("r32f"),
+        CONST_ID("r32u"),
+        CONST_ID("rgba16f"),
+        CONST_ID("rgba32f"),
+        CONST_ID("rgba8"),
+        CONST_ID("shadow_map"),
+        CONST_ID("signed_distance_field"),
+        CONST_ID("sphere"),
+        CONST_ID("spot_light"),
+        CONST_ID("tex_2d"),
+        CONST_ID("tex_2d_array"),
+        CONST_ID("tex_cube"),
+        CONST_ID("tex_cube_array"),
+        CONST_ID("tex_volume"),
+        CONST_ID("volume_gi"),
+        CONST_ID("volume_raster"),
+        CONST_ID("volume_raster_ds"),
+        CONST_ID("wireframe"),
+        CONST_ID("wrap_linear"),
+        CONST_ID("wrap_point"),
+        CONST_ID("write"),
+    };
+
+#undef CONST_ID
+
+    bool test_ids()
+    {
+        bool pass = true;
+        for (auto& cid : k_ids)
+        {
+            hash_id runtime = PEN_HASH(cid.name);
+            if (runtime != cid.id)
+            {
+                PEN_LOG("[hash_ids] mismatch \"%s\": runtime %u, compile time %u", cid.name, runtime, cid.id);
+                pass = false;
+            }
+        }
+
+        return pass;
+    }
+
+    // every length and alignment, to cover the block loop and each tail size
+    bool test_lengths()
+    {
+        static const u32 k_max_len = 67;
+
+        c8 buf[k_max_len + 4];
+        for (u32 i = 0; i < PEN_ARRAY_SIZE(buf); ++i)
+            buf[i] = (c8)(i * 37 + 128);
+
+        bool pass = true;
+        for (u32 offset = 0; offset < 4; ++offset)
+        {
+            for (u32 len = 0; len <= k_max_len; ++len)
+            {
+                hash_id runtime = pen::hashMurmur2A(buf + offset, len);
+                hash_id const_fn = pen::const_hash_murmur2a(buf + offset, len);
+                if (runtime != const_fn)
+                {
+                    PEN_LOG("[hash_ids] mismatch offset %i len %i: runtime %u, compile time %u", offset, len, runtime,
+                            const_fn);
+                    pass = false;
+                }
+            }
+        }
+
+        return pass;
+    }
+} // namespace
+
+void* pen::user_entry(void* params)
+{
+    // unpack the params passed to the thread and signal to the engine it ok to proceed
+    pen::job_thread_params* job_params = (pen::job_thread_params*)params;
+    pen::job*               p_thread_info = job_params->job_info;
+    pen::semaphore_post(p_thread_info->p_sem_continue, 1);
+
+    bool pass = test_ids();
+    pass &= test_lengths();
+
+    if (pass)
+        PEN_LOG("[hash_ids] passed %i ids", (u32)PEN_ARRAY_SIZE(k_ids));
+    else
+        PEN_LOG("[hash_ids] failed");
+
+    for (;;)
+    {
+        pen::thread_sleep_ms(16);
+
+        // msg from the engine we want to terminate
+        if (pen::semaphore_try_wait(p_thread_info->p_sem_exit))
+        {
+            break;
+        }
+    }
+
+    // signal to the engine the thread has finished
+    pen::semaphore_post(p_thread_info->p_sem_terminated, 1);
+
+    return PEN_THREAD_OK;
+}
@@ -0,0 +1,156 @@
+#include "console.h"
+#include "pen.h"
+#include "tasks.h"
+#include "threads.h"
+#include "timer.h"
+
+void* pen::user_entry(void* params);
+namespace pen
+{
+    pen_creation_params pen_entry(int argc, char** argv)
+    {
+        pen::pen_creation_params p;
+        p.window_width = 1280;
+        p.window_height = 720;
+        p.window_title = "tasks";
+        p.window_sample_count = 4;
+        p.user_thread_function = user_entry;
+        p.flags = pen::e_pen_create_flags::console_app;
+        return p;
+    }
+} // namespace pen
+
+namespace
+{
+    const u32 k_num_items = 1 << 20;
+
+    struct sum_data
+    {
+        u32*  input;
+        u64*  output;
+        a_u64 total = {0};
+    };
+
+    void fill(void* user_data, u32 start, u32 end)
+    {
+        sum_data* sd = (sum_data*)user_data;
+        for (u32 i = start; i < end; ++i)
+            sd->input[i] = i;
+    }
+
+    void square(void* user_data, u32 start, u32 end)
+    {
+        sum_data* sd = (sum_data*)user_data;
+        for (u32 i = start; i < end; ++i)
+            sd->output[i] = (u64)sd->input[i] * (u64)sd->input[i];
+    }
+
+    void reduce(void* user_data)
+    {
+        sum_data* sd = (sum_data*)user_data;
+        u64       total = 0;
+        for (u32 i = 0; i < k_num_items; ++i)
+            total += sd->output[i];
+        sd->total = total;
+    }
+
+    void nested(void* user_data, u32 start, u32 end)
+    {
+        // tasks spawning and waiting on tasks from inside a worker
+        a_u32* count = (a_u32*)user_data;
+        for (u32 i = start; i < end; ++i)
+        {
+            pen::task_counter inner;
+            pen::task_run([](void* ud) { (*(a_u32*)ud)++; }, count, &inner);
+            pen::task_wait(&inner);
+        }
+    }
+
+    bool run_tests()
+    {
+        bool pass = true;
+
+        // parallel for chained with continuations: fill -> square -> reduce
+        sum_data sd;
+        sd.input = new u32[k_num_items];
+        sd.output = new u64[k_num_items];
+
+        pen::timer* t = pen::timer_create();
+        pen::timer_start(t);
+
+        pen::task_counter filled, squared, reduced;
+        pen::task_parallel_for(0, k_num_items, 4096, fill, &sd, &filled);
+        pen::task_wait(&filled);
+        pen::task_parallel_for(0, k_num_items, 4096, square, &sd, &squared);
+        pen::task_run_after(&squared, reduce, &sd, &reduced);
+        pen::task_wait(&reduced);
+
+        f32 ms = pen::timer_elapsed_ms(t);
+
+        u64 expected = 0;
+        for (u64 i = 0; i < k_num_items; ++i)
+            expected += i * i;
+
+        if (sd.total.load() != expected)
+        {
+            PEN_LOG("[tasks] parallel_for / continuation failed: %llu != %llu", sd.total.load(), expected);
+            pass = false;
+        }
+
+        PEN_LOG("[tasks] parallel_for + continuation over %i items: %f ms", k_num_items, ms);
+
+        // continuation added to a counter which has already completed runs immediately
+        pen::task_counter after_done;
+        pen::task_run_after(&reduced, reduce, &sd, &after_done);
+        pen::task_wait(&after_done);
+
+        // nested waits
+        a_u32 nested_count = {0};
+        pen::task_parallel_for_wait(0, 1024, 16, nested, &nested_count);
+        if (nested_count.load() != 1024)
+        {
+            PEN_LOG("[tasks] nested wait failed: %i != 1024", nested_count.load());
+            pass = false;
+        }
+
+        pen::task_scheduler_stats stats;
+        pen::task_scheduler_get_stats(stats);
+        PEN_LOG("[tasks] workers: %i, executed: %llu, stolen: %llu", stats.num_workers, stats.tasks_executed,
+                stats.tasks_stolen);
+
+        delete[] sd.input;
+        delete[] sd.output;
+        pen::timer_destroy(t);
+
+        return pass;
+    }
+} // namespace
+
+void* pen::user_entry(void* params)
+{
+    // unpack the params passed to the thread and signal to the engine it ok to proceed
+    pen::job_thread_params* job_params = (pen::job_thread_params*)params;
+    pen::job*               p_thread_info = job_params->job_info;
+    pen::semaphore_post(p_thread_info->p_sem_continue, 1);
+
+    if (run_tests())
+        PEN_LOG("[tasks] passed");
+    else
+        PEN_LOG("[tasks] failed");
+
+    for (;;)
+    {
+        pen::thread_sleep_ms(16);
+
+        // msg from the engine we want to terminate
+        if (pen::semaphore_try_wait(p_thread_info->p_sem_exit))
+        {
+            break;
+        }
+    }
+
+    // signal to the engine the thread has finished
+    pen::semaphore_post(p_thread_info->p_sem_terminated, 1);
+
+    return PEN_THREAD_OK;
+}
@@ -70,4 +70,10 @@ create_app_example( "stencil_shadows", script_path() )
 create_app_example( "msaa_resolve", script_path() )
 create_app_example( "compute_demo", script_path() )
 create_app_example( "global_illumination", script_path() )
-
+create_app_example( "tasks", script_path() )
+create_app_example( "command_buffer_benchmark", script_path() )
+create_app_example( "concurrent_containers", script_path() )
+create_app_example( "concurrent_containers_benchmark", script_path() )
+create_app_example( "hash_ids", script_path() )
+create_app_example( "async_io", script_path() )
+create_app_example( "bounds_benchmark", script_path() )
@@ -0,0 +1,171 @@
+#include "console.h"
+#include "data_struct.h"
+#include "os.h"
+#include "pen.h"
+#include "renderer.h"
+#include "str/Str.h"
+#include "threads.h"
+#include "timer.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+using namespace pen;
+
+void* pen::user_entry(void* params);
+
+static Str* s_args = nullptr;
+
+namespace pen
+{
+    pen_creation_params pen_entry(int argc, char** argv)
+    {
+        pen::pen_creation_params p;
+        p.window_width = 1280;
+        p.window_height = 720;
+        p.window_title = "renderer_replay";
+        p.window_sample_count = 4;
+        p.user_thread_function = user_entry;
+        p.flags = pen::e_pen_create_flags::renderer;
+
+        // unpack args, the trace should be replayed at the resolution it was captured
+        u32 num_args = (u32)argc;
+        for (u32 i = 0; i < num_args; ++i)
+        {
+            sb_push(s_args, argv[i]);
+
+            if (i + 1 < num_args && strcmp(argv[i], "-w") == 0)
+                p.window_width = atoi(argv[i + 1]);
+            else if (i + 1 < num_args && strcmp(argv[i], "-h") == 0)
+                p.window_height = atoi(argv[i + 1]);
+        }
+
+        return p;
+    }
+} // namespace pen
+
+namespace
+{
+    void show_help()
+    {
+        PEN_LOG("renderer_replay help");
+        PEN_LOG("    -help <show this dialog>");
+        PEN_LOG("    -i <trace file captured with -capture>");
+        PEN_LOG("    -loops (optional) <number of times to replay the trace>");
+        PEN_LOG("    -w -h (optional) <window size, should match the size the trace was captured at>");
+    }
+
+    void replay(const c8* filename, u32 loops)
+    {
+        if (!pen::renderer_replay_load(filename))
+            return;
+
+        u32 num_frames = pen::renderer_replay_num_frames();
+        PEN_LOG("replaying: %s, %i frames x %i loops", filename, num_frames, loops);
+
+        // first pass creates resources from the trace, only subsequent loops are timed
+        for (u32 f = 0; f < num_frames; ++f)
+        {
+            pen::renderer_replay_frame(f);
+            pen::renderer_consume_cmd_buffer();
+        }
+
+        pen::renderer_replay_reset();
+        pen::renderer_consume_cmd_buffer();
+
+        pen::renderer_cmd_timings_enable(true);
+
+        pen::timer* t = pen::timer_create();
+        pen::timer_start(t);
+
+        for (u32 l = 0; l < loops; ++l)
+        {
+            for (u32 f = 0; f < num_frames; ++f)
+            {
+                pen::renderer_replay_frame(f);
+                pen::renderer_consume_cmd_buffer();
+            }
+
+            pen::renderer_replay_reset();
+            pen::renderer_consume_cmd_buffer();
+        }
+
+        // make sure the last frame has been dispatched before reading timings
+        pen::renderer_consume_cmd_buffer();
+
+        f32 total_ms = pen::timer_elapsed_ms(t);
+        pen::timer_destroy(t);
+
+        pen::renderer_cmd_timing timings[128];
+        u32                      num_timings = pen::renderer_get_cmd_timings(timings, 128);
+        pen::renderer_cmd_timings_enable(false);
+
+        f64 exec_us = 0.0;
+        for (u32 i = 0; i < num_timings; ++i)
+            exec_us += timings[i].total_us;
+
+        u32 total_frames = num_frames * loops;
+        PEN_LOG("%-28s %10s %12s %10s %8s", "command", "count", "total us", "avg ns", "%");
+        for (u32 i = 0; i < num_timings; ++i)
+        {
+            const pen::renderer_cmd_timing& ct = timings[i];
+            PEN_LOG("%-28s %10i %12.1f %10.1f %8.2f", ct.name, ct.count, ct.total_us, ct.total_us * 1000.0 / ct.count,
+                    exec_us > 0.0 ? ct.total_us / exec_us * 100.0 : 0.0);
+        }
+
+        PEN_LOG("renderer: %s", pen::renderer_get_info().renderer);
+        PEN_LOG("%i frames in %f ms, %f ms per frame, %f ms executing commands per frame", total_frames, total_ms,
+                total_ms / total_frames, exec_us / 1000.0 / total_frames);
+
+        pen::renderer_replay_release();
+    }
+} // namespace
+
+void* pen::user_entry(void* params)
+{
+    // unpack the params passed to the thread and signal to the engine it ok to proceed
+    pen::job_thread_params* job_params = (pen::job_thread_params*)params;
+    pen::job*               p_thread_info = job_params->job_info;
+    pen::semaphore_post(p_thread_info->p_sem_continue, 1);
+
+    Str input_file = "";
+    u32 loops = 10;
+
+    u32 argc = sb_count(s_args);
+    for (u32 i = 0; i < argc; ++i)
+    {
+        if (s_args[i] == "-help")
+        {
+            break;
+        }
+        else if (s_args[i] == "-i" && i + 1 < argc)
+        {
+            input_file = s_args[i + 1];
+        }
+        else if (s_args[i] == "-loops" && i + 1 < argc)
+        {
+            loops = max<u32>(atoi(s_args[i + 1].c_str()), 1);
+        }
+    }
+
+    if (input_file.empty())
+        show_help();
+    else
+        replay(input_file.c_str(), loops);
+
+    pen::os_terminate(0);
+
+    for (;;)
+    {
+        // msg from the engine we want to terminate
+        if (pen::semaphore_try_wait(p_thread_info->p_sem_exit))
+            break;
+
+        pen::thread_sleep_ms(16);
+    }
+
+    // signal to the engine the thread has finished
+    pen::semaphore_post(p_thread_info->p_sem_terminated, 1);
+
+    return PEN_THREAD_OK;
+}
@@ -26,6 +26,15 @@ end
 local function setup_linux()
 	--linux must be linked in order
 	add_pmtech_links()
+	if renderer_dir == "null" then
+		links 
+		{ 
+			"pthread",
+			"fmod",
+			"dl"
+		}
+		return
+	end
 	links 
 	{ 
 		"pthread",
@@ -144,6 +144,12 @@ function setup_platform_defines()
 		("PEN_PLATFORM_" .. string.upper(platform)),
         ("PEN_RENDERER_" .. string.upper(renderer_dir))
 	}
+	if _OPTIONS["memory_tracking"] then
+		defines { "PEN_MEMORY_TRACKING" }
+	end
+	if _OPTIONS["profiler"] then
+		defines { "PEN_PROFILER" }
+	end
 end
 
 -- entry
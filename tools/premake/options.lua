@@ -9,7 +9,8 @@ newoption
       { "opengl", "OpenGL (macOS, linux, Android)" },
       { "dx11",  "DirectX 11 (Windows only)" },
       { "metal", "Metal (macOS, iOS only)" },
-      { "vulkan", "Vulkan (Windows, linux)" }
+      { "vulkan", "Vulkan (Windows, linux)" },
+      { "null", "Null headless renderer (linux)" }
    }
 }
 
@@ -59,3 +60,15 @@ newoption
    value       = "dir",
    description = "specify location of pmtech in relation to project"
 }
+
+newoption
+{
+   trigger     = "memory_tracking",
+   description = "Track allocations per subsystem tag (pen::memory_get_tag_stats)",
+}
+
+newoption
+{
+   trigger     = "profiler",
+   description = "Compile in cpu profiler markers (PEN_PROFILE_SCOPE) and the dev ui profiler view",
+}
@@ -17,6 +17,7 @@ dofile "../core/put/project.lua"
 
 create_app_example("mesh_opt", script_path())
 create_app_example("pmtech_editor", script_path())
+create_app_example("renderer_replay", script_path())
 
 -- dll to hot reload
 create_binary("live_lib", "live_lib", script_path(), "SharedLib" )